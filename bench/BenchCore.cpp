@@ -0,0 +1,205 @@
+#include "stdinc.h"
+#include "BenchCore.h"
+#include "DataGenerator.h"
+#include "DCPlusPlus.h"
+#include "ClientManager.h"
+#include "ConnectivityManager.h"
+#include "ThrottleManager.h"
+#include "TimerManager.h"
+#include "LogManager.h"
+#include "SettingsManager.h"
+#include "ConfCore.h"
+#include "AppPaths.h"
+#include "FormatUtil.h"
+#include "FilteredFile.h"
+#include "BZUtils.h"
+#include "SimpleXML.h"
+#include "MerkleTree.h"
+#include "PathUtil.h"
+#include "Util.h"
+#include "SettingsUtil.h"
+
+#include <filesystem>
+
+const string BenchCore::TRANSFER_SHARE = "Transfers";
+
+bool BenchCore::running = false;
+string BenchCore::profilePath;
+vector<BenchCore::TransferFile> BenchCore::transferFiles;
+
+static const string attrType = "type";
+static const string attrVirtual = "Virtual";
+static const string typeString = "string";
+
+static bool verboseOutput;
+
+static void progressCallback(void*, const tstring& text)
+{
+	if (verboseOutput)
+		fprintf(stderr, "Loading: %s\n", Text::fromT(text).c_str());
+}
+
+static void dbErrorCallback(const string& message, bool forceExit)
+{
+	fprintf(stderr, "%s\n", message.c_str());
+	if (forceExit) _exit(1);
+}
+
+// Settings file with the shares of the dataset, the share directories are empty
+static void writeSettings(const string& path, const Dataset& ds, bool network)
+{
+	SimpleXML xml;
+	xml.addTag("DCPlusPlus");
+	xml.stepIn();
+	xml.addTag("Settings");
+	xml.stepIn();
+	xml.addTag("Nick", "bench");
+	xml.addChildAttrib(attrType, typeString);
+	xml.addTag("DownloadDirectory", path + "Downloads" PATH_SEPARATOR_STR);
+	xml.addChildAttrib(attrType, typeString);
+	xml.stepOut();
+	xml.addTag("Share");
+	xml.stepIn();
+	StringList shares = ds.shares;
+	if (network) shares.push_back(BenchCore::TRANSFER_SHARE);
+	for (const string& share : shares)
+	{
+		const string realPath = path + "Share" PATH_SEPARATOR_STR + share + PATH_SEPARATOR;
+		File::ensureDirectory(realPath);
+		xml.addTag("Directory", realPath);
+		xml.addChildAttrib(attrVirtual, share);
+	}
+	xml.stepOut();
+	xml.stepOut();
+
+	File f(path + "DCPlusPlus.xml", File::WRITE, File::CREATE | File::TRUNCATE);
+	f.write(SimpleXML::utf8Header);
+	f.write(xml.toXML());
+}
+
+// The share is loaded from files.xml.bz2 when there is no Share.dat
+static void writeFileList(const string& path, const Dataset& ds, const vector<BenchCore::TransferFile>& transferFiles)
+{
+	string xml = ds.fileList;
+	if (!transferFiles.empty())
+	{
+		string dir = "<Directory Name=\"" + BenchCore::TRANSFER_SHARE + "\">\r\n";
+		for (const auto& tf : transferFiles)
+			dir += "<File Name=\"" + tf.name + "\" Size=\"" + Util::toString(tf.data.length()) + "\" TTH=\"" + tf.root.toBase32() + "\"/>\r\n";
+		dir += "</Directory>\r\n";
+		xml.insert(xml.rfind("</FileListing>"), dir);
+	}
+	FilteredOutputStream<BZFilter, true> f(new File(path + "files.xml.bz2", File::WRITE, File::CREATE | File::TRUNCATE));
+	f.write(xml);
+	f.flushBuffers(true);
+}
+
+// Files with random content that can be downloaded from the core, their TTHs are put in the file list
+static void writeTransferFiles(const string& path, vector<BenchCore::TransferFile>& transferFiles)
+{
+	const string dir = path + "Share" PATH_SEPARATOR_STR + BenchCore::TRANSFER_SHARE + PATH_SEPARATOR;
+	for (size_t i = 0; i < BenchCore::TRANSFER_FILES; ++i)
+	{
+		DataGenerator gen((uint32_t) (DataGenerator::DEFAULT_SEED + i));
+		BenchCore::TransferFile tf;
+		tf.name = "transfer-" + Util::toString(i) + ".bin";
+		tf.data = gen.randomBytes(BenchCore::TRANSFER_FILE_SIZE);
+		TigerTree tree(TigerTree::getMaxBlockSize(tf.data.length()));
+		tree.update(tf.data.data(), tf.data.length());
+		tree.finalize();
+		tf.root = tree.getRoot();
+		File f(dir + tf.name, File::WRITE, File::CREATE | File::TRUNCATE);
+		f.write(tf.data);
+		transferFiles.push_back(std::move(tf));
+	}
+}
+
+// Listens on the loopback interface only, the share is never refreshed
+static void applyNetworkSettings()
+{
+	auto ss = SettingsManager::instance.getCoreSettings();
+	ss->lockWrite();
+	ss->setString(Conf::BIND_ADDRESS, "127.0.0.1");
+	ss->setInt(Conf::INCOMING_CONNECTIONS, Conf::INCOMING_DIRECT);
+	ss->setBool(Conf::AUTO_DETECT_CONNECTION, false);
+	ss->setBool(Conf::AUTO_TEST_PORTS, false);
+	ss->setBool(Conf::ENABLE_IP6, false);
+	ss->setBool(Conf::WAN_IP_MANUAL, true);
+	ss->setString(Conf::EXTERNAL_IP, "127.0.0.1");
+	ss->setBool(Conf::NO_IP_OVERRIDE, true);
+	ss->setBool(Conf::USE_TLS, false);
+	ss->setInt(Conf::SLOTS, 500);
+	ss->setInt(Conf::AUTO_REFRESH_TIME, 0);
+	ss->setBool(Conf::AUTO_REFRESH_ON_STARTUP, false);
+	ss->setBool(Conf::WATCH_SHARE_CHANGES, false);
+	ss->unlockWrite();
+}
+
+bool BenchCore::startup(bool verbose, bool network)
+{
+	verboseOutput = verbose;
+	char tempPath[] = "/tmp/blacklink-bench-XXXXXX";
+	if (!mkdtemp(tempPath))
+	{
+		fprintf(stderr, "Can't create profile directory: %s\n", Util::translateError().c_str());
+		return false;
+	}
+	profilePath = tempPath;
+	Util::appendPathSeparator(profilePath);
+
+	const Dataset& ds = Dataset::get();
+	try
+	{
+		writeSettings(profilePath, ds, network);
+		if (network) writeTransferFiles(profilePath, transferFiles);
+		writeFileList(profilePath, ds, transferFiles);
+	}
+	catch (const Exception& e)
+	{
+		fprintf(stderr, "Can't write profile: %s\n", e.getError().c_str());
+		return false;
+	}
+
+	Util::setUserConfigPath(profilePath);
+	Util::initialize();
+	Util::initFormatParams();
+
+	Conf::initCoreSettings();
+	SettingsManager::instance.loadSettings();
+	if (network) applyNetworkSettings();
+
+	LogManager::init();
+	Util::loadLanguage();
+
+	Conf::updateCoreSettingsDefaults();
+	Conf::processCoreSettings();
+
+	ThrottleManager::newInstance();
+	TimerManager::newInstance();
+	ClientManager::newInstance();
+	ThrottleManager::getInstance()->startup();
+
+	::startup(progressCallback, nullptr, nullptr, nullptr, dbErrorCallback);
+
+	if (network)
+	{
+		ConnectivityManager::getInstance()->setupConnections();
+		TimerManager::getInstance()->start(0, "TimerManager");
+	}
+	// Without networking the timer is not started: the share is never refreshed from the empty directories
+	ClientManager::stopStartup();
+	running = true;
+	return true;
+}
+
+void BenchCore::shutdown()
+{
+	if (!running) return;
+	running = false;
+	ClientManager::beforeShutdown();
+	preparingCoreToShutdown();
+	::shutdown(nullptr, nullptr);
+
+	std::error_code ec;
+	std::filesystem::remove_all(profilePath, ec);
+}
@@ -0,0 +1,35 @@
+#ifndef BENCH_CORE_H_
+#define BENCH_CORE_H_
+
+#include "typedefs.h"
+#include "HashValue.h"
+
+// Runs the client core in a temporary profile while the benchmarks run.
+// The share is loaded from the file list of the dataset. Without networking no sockets are opened;
+// with networking the core listens on the loopback interface and also shares a few real files.
+class BenchCore
+{
+	public:
+		struct TransferFile
+		{
+			string name;
+			string data;
+			TTHValue root;
+		};
+
+		static const size_t TRANSFER_FILES = 4;
+		static const size_t TRANSFER_FILE_SIZE = 16 * 1024 * 1024;
+		static const string TRANSFER_SHARE;
+
+		static bool startup(bool verbose, bool network = false);
+		static void shutdown();
+		static const string& getProfilePath() { return profilePath; }
+		static const vector<TransferFile>& getTransferFiles() { return transferFiles; }
+
+	private:
+		static bool running;
+		static string profilePath;
+		static vector<TransferFile> transferFiles;
+};
+
+#endif // BENCH_CORE_H_
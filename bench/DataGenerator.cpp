@@ -0,0 +1,376 @@
+#include "stdinc.h"
+#include "DataGenerator.h"
+#include "File.h"
+#include "PathUtil.h"
+#include "StrUtil.h"
+#include "StringTokenizer.h"
+#include "Util.h"
+
+static const size_t WORD_COUNT = 4000;
+
+static const char* const syllables[] =
+{
+	"ka", "to", "ri", "ne", "mo", "sa", "li", "da", "ve", "ru", "pa", "zo", "mi", "te", "lo", "shi",
+	"an", "er", "on", "is", "or", "el", "ux", "tra", "bel", "gor", "dan", "mer", "vin", "sol", "kra", "tem"
+};
+
+static const char* const fileExtensions[] =
+{
+	".mp3", ".flac", ".avi", ".mkv", ".mp4", ".jpg", ".png", ".pdf", ".epub", ".zip", ".rar", ".iso", ".txt", ".nfo"
+};
+
+static const char base32Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+
+template<typename T, size_t N>
+static inline size_t countOf(T (&)[N]) { return N; }
+
+static string makeNick(size_t index)
+{
+	return "user" + Util::toString(index);
+}
+
+// SIDs are made from the user index, AAAA is the hub
+static string makeSID(size_t index)
+{
+	++index;
+	string sid(4, 'A');
+	for (int i = 3; i >= 0; --i)
+	{
+		sid[i] = base32Chars[index & 31];
+		index >>= 5;
+	}
+	return sid;
+}
+
+DataGenerator::DataGenerator(uint32_t seed)
+{
+	state.setSeed(seed);
+	words.reserve(WORD_COUNT);
+	boost::unordered_set<string> known;
+	while (words.size() < WORD_COUNT)
+	{
+		string word;
+		int count = rand(2, 5);
+		for (int i = 0; i < count; ++i)
+			word += syllables[rand(countOf(syllables))];
+		if (known.insert(word).second)
+			words.push_back(word);
+	}
+}
+
+const string& DataGenerator::randomWord()
+{
+	return words[rand(rand(1, (uint32_t) words.size()))];
+}
+
+string DataGenerator::randomBytes(size_t size)
+{
+	string result;
+	result.resize(size);
+	size_t i = 0;
+	for (; i + 4 <= size; i += 4)
+	{
+		uint32_t value = rand();
+		memcpy(&result[i], &value, 4);
+	}
+	for (; i < size; ++i)
+		result[i] = (char) rand();
+	return result;
+}
+
+string DataGenerator::randomText(size_t size)
+{
+	string result;
+	result.reserve(size + 64);
+	while (result.length() < size)
+	{
+		result += randomWord();
+		result += rand(12) ? ' ' : '\n';
+	}
+	result.resize(size);
+	return result;
+}
+
+TTHValue DataGenerator::randomTTH()
+{
+	TTHValue tth;
+	for (size_t i = 0; i < TTHValue::BYTES; ++i)
+		tth.data[i] = (uint8_t) rand();
+	return tth;
+}
+
+CID DataGenerator::randomCID()
+{
+	uint8_t data[CID::SIZE];
+	for (size_t i = 0; i < CID::SIZE; ++i)
+		data[i] = (uint8_t) rand();
+	return CID(data);
+}
+
+string DataGenerator::randomFileName()
+{
+	string name = randomWord();
+	int count = rand(1, 4);
+	for (int i = 0; i < count; ++i)
+	{
+		name += ' ';
+		name += randomWord();
+	}
+	if (rand(3) == 0)
+	{
+		name += " - ";
+		name += Util::toString(rand(1, 100));
+	}
+	name += fileExtensions[rand(countOf(fileExtensions))];
+	return name;
+}
+
+string DataGenerator::makeFileList(const CID& cid, const StringList& shares, size_t fileCount, vector<TTHValue>* tths, StringList* names)
+{
+	string xml = "<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?>\r\n"
+		"<FileListing Version=\"1\" CID=\"" + cid.toBase32() + "\" Base=\"/\" Generator=\"bench\">\r\n";
+	size_t filesLeft = fileCount;
+	for (size_t i = 0; i < shares.size(); ++i)
+	{
+		size_t shareFiles = i + 1 == shares.size() ? filesLeft : fileCount / shares.size();
+		filesLeft -= shareFiles;
+		xml += "<Directory Name=\"" + shares[i] + "\">\r\n";
+		int depth = 1;
+		while (shareFiles)
+		{
+			// Directories are nested up to 4 levels, each holds up to 50 files
+			if (depth < 4 && rand(3) == 0)
+			{
+				string name = randomWord();
+				name += ' ';
+				name += randomWord();
+				xml += "<Directory Name=\"" + name + "\">\r\n";
+				++depth;
+			}
+			else if (depth > 1 && rand(3) == 0)
+			{
+				xml += "</Directory>\r\n";
+				--depth;
+			}
+			size_t count = std::min<size_t>(shareFiles, rand(1, 50));
+			for (size_t j = 0; j < count; ++j)
+			{
+				const string name = randomFileName();
+				const TTHValue tth = randomTTH();
+				int64_t size = rand(1, 1 << 30);
+				if (rand(20) == 0) size += (int64_t) rand(1, 8) << 30;
+				xml += "<File Name=\"" + name + "\" Size=\"" + Util::toString(size) + "\" TTH=\"" + tth.toBase32() + "\"/>\r\n";
+				if (tths) tths->push_back(tth);
+				if (names) names->push_back(name);
+			}
+			shareFiles -= count;
+		}
+		while (depth-- > 0)
+			xml += "</Directory>\r\n";
+	}
+	xml += "</FileListing>\r\n";
+	return xml;
+}
+
+string DataGenerator::makeSearchString()
+{
+	// Most searches look for one or two words, some look for words that are not shared
+	string result;
+	if (rand(5) == 0)
+	{
+		result = randomWord();
+		result += "xq";
+		return result;
+	}
+	result = randomWord();
+	if (rand(2))
+	{
+		result += ' ';
+		result += randomWord();
+	}
+	return result;
+}
+
+StringList DataGenerator::makeNmdcTraffic(size_t userCount, size_t lineCount, const vector<TTHValue>& tths)
+{
+	StringList lines;
+	lines.reserve(userCount + lineCount);
+	auto myInfo = [this](size_t user)
+	{
+		const uint32_t hubs = rand(1, 20);
+		const uint32_t slots = rand(1, 10);
+		const int64_t shared = (int64_t) rand() * 1024;
+		return "$MyINFO $ALL " + makeNick(user) + " <++ V:0.868,M:P,H:" + Util::toString(hubs) + "/0/0,S:" +
+			Util::toString(slots) + ">$ $100\x01$$" + Util::toString(shared) + '$';
+	};
+	for (size_t i = 0; i < userCount; ++i)
+		lines.push_back(myInfo(i));
+	for (size_t i = 0; i < lineCount; ++i)
+	{
+		const size_t user = rand((uint32_t) userCount);
+		const uint32_t kind = rand(100);
+		if (kind < 50)
+		{
+			string line = "$Search Hub:" + makeNick(user) + ' ';
+			if (kind < 10 && !tths.empty())
+				line += "F?T?0?9?TTH:" + pickTTH(tths).toBase32();
+			else
+			{
+				string s = makeSearchString();
+				std::replace(s.begin(), s.end(), ' ', '$');
+				line += "F?T?0?1?" + s;
+			}
+			lines.push_back(line);
+		}
+		else if (kind < 70)
+		{
+			string line = '<' + makeNick(user) + "> ";
+			int count = rand(1, 12);
+			for (int j = 0; j < count; ++j)
+			{
+				if (j) line += ' ';
+				line += randomWord();
+			}
+			lines.push_back(line);
+		}
+		else if (kind < 90)
+			lines.push_back(myInfo(user));
+		else
+		{
+			lines.push_back("$Quit " + makeNick(user));
+			lines.push_back(myInfo(user));
+		}
+	}
+	return lines;
+}
+
+StringList DataGenerator::makeAdcTraffic(size_t userCount, size_t lineCount, const vector<TTHValue>& tths)
+{
+	StringList lines;
+	lines.reserve(userCount + lineCount);
+	vector<string> cids;
+	cids.reserve(userCount);
+	for (size_t i = 0; i < userCount; ++i)
+		cids.push_back(randomCID().toBase32());
+	auto inf = [this, &cids](size_t user)
+	{
+		const int64_t shared = (int64_t) rand() * 1024;
+		const uint32_t files = rand(1, 100000);
+		const uint32_t hubs = rand(1, 20);
+		const uint32_t slots = rand(1, 10);
+		return "BINF " + makeSID(user) + " ID" + cids[user] + " NI" + makeNick(user) +
+			" SS" + Util::toString(shared) + " SF" + Util::toString(files) +
+			" HN" + Util::toString(hubs) + " HR0 HO0 SL" + Util::toString(slots) + " VE++\\s0.868 SUADC0";
+	};
+	for (size_t i = 0; i < userCount; ++i)
+		lines.push_back(inf(i));
+	for (size_t i = 0; i < lineCount; ++i)
+	{
+		const size_t user = rand((uint32_t) userCount);
+		const string sid = makeSID(user);
+		const uint32_t kind = rand(100);
+		if (kind < 50)
+		{
+			string line = "BSCH " + sid;
+			if (kind < 10 && !tths.empty())
+				line += " TR" + pickTTH(tths).toBase32();
+			else
+			{
+				const StringTokenizer<string> st(makeSearchString(), ' ');
+				for (const string& term : st.getTokens())
+					line += " AN" + term;
+			}
+			line += " TO" + Util::toString(rand());
+			lines.push_back(line);
+		}
+		else if (kind < 70)
+		{
+			string line = "BMSG " + sid + ' ';
+			int count = rand(1, 12);
+			for (int j = 0; j < count; ++j)
+			{
+				if (j) line += "\\s";
+				line += randomWord();
+			}
+			lines.push_back(line);
+		}
+		else if (kind < 90)
+		{
+			const int64_t shared = (int64_t) rand() * 1024;
+			const uint32_t slots = rand(1, 10);
+			lines.push_back("BINF " + sid + " SS" + Util::toString(shared) + " SL" + Util::toString(slots));
+		}
+		else
+		{
+			lines.push_back("IQUI " + sid);
+			lines.push_back(inf(user));
+		}
+	}
+	return lines;
+}
+
+StringList DataGenerator::makeSearchTerms(size_t count)
+{
+	StringList result;
+	result.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+		result.push_back(makeSearchString());
+	return result;
+}
+
+const Dataset& Dataset::get()
+{
+	static Dataset* dataset = nullptr;
+	if (!dataset)
+	{
+		dataset = new Dataset;
+		DataGenerator gen;
+		dataset->listCID = gen.randomCID();
+		dataset->shares = { "Music", "Video", "Books", "Software" };
+		dataset->fileList = gen.makeFileList(dataset->listCID, dataset->shares, SHARED_FILES, &dataset->sharedTTHs, &dataset->fileNames);
+		dataset->nmdcTraffic = gen.makeNmdcTraffic(HUB_USERS, HUB_LINES, dataset->sharedTTHs);
+		dataset->adcTraffic = gen.makeAdcTraffic(HUB_USERS, HUB_LINES, dataset->sharedTTHs);
+		dataset->searchTerms = gen.makeSearchTerms(SEARCH_TERMS);
+	}
+	return *dataset;
+}
+
+static bool writeLines(const string& path, const StringList& lines, char separator)
+{
+	try
+	{
+		File f(path, File::WRITE, File::CREATE | File::TRUNCATE);
+		string data;
+		for (const string& line : lines)
+		{
+			data += line;
+			data += separator;
+		}
+		f.write(data);
+	}
+	catch (const FileException&)
+	{
+		return false;
+	}
+	return true;
+}
+
+bool Dataset::write(const string& path)
+{
+	const Dataset& ds = get();
+	string dir = path;
+	Util::appendPathSeparator(dir);
+	File::ensureDirectory(dir);
+	try
+	{
+		File f(dir + "files.xml", File::WRITE, File::CREATE | File::TRUNCATE);
+		f.write(ds.fileList);
+	}
+	catch (const FileException&)
+	{
+		return false;
+	}
+	return writeLines(dir + "nmdc.txt", ds.nmdcTraffic, '|') &&
+		writeLines(dir + "adc.txt", ds.adcTraffic, '\n') &&
+		writeLines(dir + "search.txt", ds.searchTerms, '\n');
+}
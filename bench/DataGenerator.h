@@ -0,0 +1,73 @@
+#ifndef BENCH_DATA_GENERATOR_H_
+#define BENCH_DATA_GENERATOR_H_
+
+#include "typedefs.h"
+#include "HashValue.h"
+#include "CID.h"
+#include "Random.h"
+
+// Synthetic data for the benchmarks. The same seed always produces the same data,
+// results of different builds are comparable.
+class DataGenerator
+{
+	public:
+		static const uint32_t DEFAULT_SEED = 0x424c4b21;
+
+		explicit DataGenerator(uint32_t seed = DEFAULT_SEED);
+
+		uint32_t rand() { return state.getValue(); }
+		uint32_t rand(uint32_t high) { return rand() % high; }
+		uint32_t rand(uint32_t low, uint32_t high) { return low + rand(high - low); }
+
+		// Words are picked with a skewed distribution, a few of them are very common
+		const string& randomWord();
+		const StringList& getWords() const { return words; }
+
+		string randomBytes(size_t size);
+		string randomText(size_t size);
+		TTHValue randomTTH();
+		CID randomCID();
+		string randomFileName();
+
+		// File list XML, each share is a top level directory
+		string makeFileList(const CID& cid, const StringList& shares, size_t fileCount, vector<TTHValue>* tths, StringList* names);
+
+		// Hub traffic without separators: a login burst followed by searches, chat, MyINFO updates and reconnects.
+		// Searches are passive, results are never sent to the network. Some searches look for the given TTHs.
+		StringList makeNmdcTraffic(size_t userCount, size_t lineCount, const vector<TTHValue>& tths);
+		StringList makeAdcTraffic(size_t userCount, size_t lineCount, const vector<TTHValue>& tths);
+
+		// Search strings: words from the share and words that match nothing
+		StringList makeSearchTerms(size_t count);
+
+	private:
+		Util::MT19937 state;
+		StringList words;
+
+		string makeSearchString();
+		const TTHValue& pickTTH(const vector<TTHValue>& tths) { return tths[rand((uint32_t) tths.size())]; }
+};
+
+// Data shared by all benchmarks, generated once with the default seed
+struct Dataset
+{
+	static const size_t SHARED_FILES = 100000;
+	static const size_t HUB_USERS = 2000;
+	static const size_t HUB_LINES = 20000;
+	static const size_t SEARCH_TERMS = 1000;
+
+	CID listCID;
+	StringList shares;
+	string fileList;
+	vector<TTHValue> sharedTTHs;
+	StringList nmdcTraffic;
+	StringList adcTraffic;
+	StringList searchTerms;
+	StringList fileNames;
+
+	static const Dataset& get();
+	// Writes the dataset to a directory, the files can be used by other tools
+	static bool write(const string& path);
+};
+
+#endif // BENCH_DATA_GENERATOR_H_
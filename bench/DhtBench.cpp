@@ -0,0 +1,81 @@
+#include "stdinc.h"
+#include "DataGenerator.h"
+#include "User.h"
+#include "dht/KBucket.h"
+
+#include <benchmark/benchmark.h>
+
+// DHT routing table filled with random nodes. The table is standalone,
+// the DHT of the core is not started.
+
+static const unsigned DHT_LOOKUPS = 1000;
+
+static vector<dht::Node::Ptr> makeNodes(DataGenerator& gen, size_t count)
+{
+	vector<dht::Node::Ptr> nodes;
+	nodes.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		dht::Node::Ptr node = std::make_shared<dht::Node>(std::make_shared<User>(gen.randomCID(), Util::emptyString));
+		node->getIdentity().setIP4(0x0A000000 | (uint32_t) (i >> 8));
+		node->getIdentity().setUdp4Port((uint16_t) (1024 + (i & 0xFF)));
+		node->setIpVerified(true);
+		nodes.push_back(node);
+	}
+	return nodes;
+}
+
+static void setTableCounters(benchmark::State& state, const dht::KBucket& table)
+{
+	const size_t stored = table.getNodeCount() + table.getReplacementCount();
+	state.counters["nodes"] = (double) table.getNodeCount();
+	state.counters["replacements"] = (double) table.getReplacementCount();
+	state.counters["buckets"] = (double) table.getBucketCount();
+	state.counters["node_bytes"] = (double) (stored * (sizeof(dht::Node) + sizeof(User)));
+}
+
+static void BM_KBucketInsert(benchmark::State& state)
+{
+	const size_t count = (size_t) state.range(0);
+	std::unique_ptr<dht::KBucket> table;
+	for (auto _ : state)
+	{
+		// Nodes remember that they are in a table, each pass needs new ones
+		state.PauseTiming();
+		table.reset();
+		DataGenerator gen;
+		const vector<dht::Node::Ptr> nodes = makeNodes(gen, count);
+		table.reset(new dht::KBucket(gen.randomCID()));
+		state.ResumeTiming();
+		for (const auto& node : nodes)
+			table->insert(node);
+	}
+	state.SetItemsProcessed((int64_t) (state.iterations() * count));
+	setTableCounters(state, *table);
+}
+BENCHMARK(BM_KBucketInsert)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMillisecond);
+
+static void BM_KBucketClosestNodes(benchmark::State& state)
+{
+	DataGenerator gen;
+	const vector<dht::Node::Ptr> nodes = makeNodes(gen, (size_t) state.range(0));
+	dht::KBucket table(gen.randomCID());
+	for (const auto& node : nodes)
+		table.insert(node);
+	vector<CID> targets;
+	for (unsigned i = 0; i < DHT_LOOKUPS; ++i)
+		targets.push_back(gen.randomCID());
+
+	size_t index = 0;
+	int64_t found = 0;
+	for (auto _ : state)
+	{
+		dht::Node::Map closest;
+		table.getClosestNodes(targets[index], closest, dht::K, 3);
+		found += closest.size();
+		if (++index == targets.size()) index = 0;
+	}
+	state.counters["found"] = benchmark::Counter((double) found, benchmark::Counter::kAvgIterations);
+	setTableCounters(state, table);
+}
+BENCHMARK(BM_KBucketClosestNodes)->RangeMultiplier(10)->Range(10000, 1000000);
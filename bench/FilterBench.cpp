@@ -0,0 +1,86 @@
+#include "stdinc.h"
+#include "DataGenerator.h"
+#include "ZUtils.h"
+#include "BZUtils.h"
+
+#include <benchmark/benchmark.h>
+
+static const size_t FILTER_DATA_SIZE = 4 * 1024 * 1024;
+static const size_t FILTER_BUF_SIZE = 64 * 1024;
+
+// Runs the data through a filter in buffers of the size used by the filtered streams
+template<class Filter>
+static size_t filterData(Filter& filter, const string& in, string& out)
+{
+	size_t inPos = 0;
+	size_t outPos = 0;
+	bool more = true;
+	while (more)
+	{
+		if (out.size() < outPos + FILTER_BUF_SIZE)
+			out.resize(outPos + FILTER_BUF_SIZE);
+		size_t inSize = std::min(FILTER_BUF_SIZE, in.size() - inPos);
+		size_t outSize = FILTER_BUF_SIZE;
+		more = filter(in.data() + inPos, inSize, &out[outPos], outSize);
+		inPos += inSize;
+		outPos += outSize;
+		if (inPos < in.size()) more = true;
+	}
+	return outPos;
+}
+
+// File lists and protocol traffic are text, transferred files are mostly incompressible
+static const string& getFilterInput(bool text)
+{
+	static string textData, binaryData;
+	string& data = text ? textData : binaryData;
+	if (data.empty())
+	{
+		DataGenerator gen;
+		data = text ? gen.randomText(FILTER_DATA_SIZE) : gen.randomBytes(FILTER_DATA_SIZE);
+	}
+	return data;
+}
+
+template<class Filter>
+static string compressInput(bool text)
+{
+	Filter filter;
+	string out;
+	out.resize(filterData(filter, getFilterInput(text), out));
+	return out;
+}
+
+template<class Filter>
+static void BM_Compress(benchmark::State& state)
+{
+	const string& in = getFilterInput(state.range(0) != 0);
+	string out;
+	size_t outSize = 0;
+	for (auto _ : state)
+	{
+		Filter filter;
+		outSize = filterData(filter, in, out);
+	}
+	state.SetBytesProcessed((int64_t) state.iterations() * in.size());
+	state.counters["ratio"] = (double) outSize / in.size();
+}
+
+template<class Filter, class CompressFilter>
+static void BM_Decompress(benchmark::State& state)
+{
+	const string in = compressInput<CompressFilter>(state.range(0) != 0);
+	string out;
+	size_t outSize = 0;
+	for (auto _ : state)
+	{
+		Filter filter;
+		outSize = filterData(filter, in, out);
+	}
+	state.SetBytesProcessed((int64_t) state.iterations() * outSize);
+}
+
+BENCHMARK_TEMPLATE(BM_Compress, ZFilter)->ArgName("text")->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Decompress, UnZFilter, ZFilter)->ArgName("text")->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Compress, BZFilter)->ArgName("text")->Arg(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Decompress, UnBZFilter, BZFilter)->ArgName("text")->Arg(1)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,38 @@
+#include "stdinc.h"
+#include "DataGenerator.h"
+#include "MerkleTree.h"
+
+#include <benchmark/benchmark.h>
+
+static void BM_TigerHash(benchmark::State& state)
+{
+	DataGenerator gen;
+	const string data = gen.randomBytes((size_t) state.range(0));
+	for (auto _ : state)
+	{
+		TigerHash h;
+		h.update(data.data(), data.length());
+		benchmark::DoNotOptimize(h.finalize());
+	}
+	state.SetBytesProcessed((int64_t) state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TigerHash)->Arg(64)->Arg(1024)->Arg(64 * 1024)->Arg(1024 * 1024);
+
+// Tree of a file hashed in the buffer size used by the hash manager, the tree block size is chosen for the file size
+static void BM_TigerTree(benchmark::State& state)
+{
+	const int64_t fileSize = state.range(0);
+	const size_t bufSize = 1024 * 1024;
+	DataGenerator gen;
+	const string data = gen.randomBytes(bufSize);
+	for (auto _ : state)
+	{
+		TigerTree tree(TigerTree::getMaxBlockSize(fileSize));
+		for (int64_t pos = 0; pos < fileSize; pos += bufSize)
+			tree.update(data.data(), (size_t) std::min<int64_t>(bufSize, fileSize - pos));
+		tree.finalize();
+		benchmark::DoNotOptimize(tree.getRoot());
+	}
+	state.SetBytesProcessed((int64_t) state.iterations() * fileSize);
+}
+BENCHMARK(BM_TigerTree)->Arg(1024 * 1024)->Arg(16 * 1024 * 1024)->Unit(benchmark::kMillisecond);
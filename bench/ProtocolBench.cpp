@@ -0,0 +1,58 @@
+#include "stdinc.h"
+#include "DataGenerator.h"
+#include "AdcCommand.h"
+#include "ClientManager.h"
+#include "Client.h"
+
+#include <benchmark/benchmark.h>
+
+static void BM_AdcCommandParse(benchmark::State& state)
+{
+	const StringList& lines = Dataset::get().adcTraffic;
+	size_t bytes = 0;
+	for (const string& line : lines)
+		bytes += line.length();
+	for (auto _ : state)
+	{
+		for (const string& line : lines)
+		{
+			AdcCommand cmd(0);
+			benchmark::DoNotOptimize(cmd.parse(line.data(), line.length()));
+		}
+	}
+	state.SetItemsProcessed((int64_t) state.iterations() * lines.size());
+	state.SetBytesProcessed((int64_t) state.iterations() * bytes);
+}
+BENCHMARK(BM_AdcCommandParse)->Unit(benchmark::kMillisecond);
+
+// Recorded hub traffic is fed to a hub that is not connected: user list updates and chat are processed
+// as usual, everything the hub sends is dropped. Searches are left out, an NMDC hub ignores them
+// before login and an ADC hub runs a share search for each one; the search benchmarks measure that.
+static void replayHubTraffic(benchmark::State& state, const string& hubUrl, const StringList& traffic, const string& searchPrefix)
+{
+	StringList lines;
+	for (const string& line : traffic)
+		if (line.compare(0, searchPrefix.length(), searchPrefix) != 0)
+			lines.push_back(line);
+	ClientBasePtr cb = ClientManager::getInstance()->getClient(hubUrl);
+	BufferedSocketListener* hub = static_cast<Client*>(cb.get());
+	for (auto _ : state)
+	{
+		for (const string& line : lines)
+			hub->onDataLine(line.data(), line.length());
+	}
+	state.SetItemsProcessed((int64_t) state.iterations() * lines.size());
+	ClientManager::getInstance()->putClient(cb);
+}
+
+static void BM_NmdcHubReplay(benchmark::State& state)
+{
+	replayHubTraffic(state, "dchub://bench.invalid:411", Dataset::get().nmdcTraffic, "$Search ");
+}
+BENCHMARK(BM_NmdcHubReplay)->Unit(benchmark::kMillisecond);
+
+static void BM_AdcHubReplay(benchmark::State& state)
+{
+	replayHubTraffic(state, "adc://bench.invalid:412", Dataset::get().adcTraffic, "BSCH ");
+}
+BENCHMARK(BM_AdcHubReplay)->Unit(benchmark::kMillisecond);
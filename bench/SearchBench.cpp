@@ -0,0 +1,185 @@
+#include "stdinc.h"
+#include "DataGenerator.h"
+#include "ShareManager.h"
+#include "StringSearch.h"
+#include "BloomFilter.h"
+#include "SearchParam.h"
+#include "SearchResult.h"
+#include "StringTokenizer.h"
+#include "Text.h"
+#include "StrUtil.h"
+
+#include <benchmark/benchmark.h>
+
+static const size_t SEARCH_NAME_COUNT = 10000;
+
+static StringList getLowerNames(size_t count)
+{
+	const Dataset& ds = Dataset::get();
+	StringList names;
+	count = std::min(count, ds.fileNames.size());
+	names.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+		names.push_back(Text::toLower(ds.fileNames[i]));
+	return names;
+}
+
+static StringList splitTerm(const string& term)
+{
+	const StringTokenizer<string> st(term, ' ');
+	return st.getTokens();
+}
+
+// Name matching done for each shared file by a search
+static void BM_StringSearch(benchmark::State& state)
+{
+	const StringList names = getLowerNames(SEARCH_NAME_COUNT);
+	const StringList& terms = Dataset::get().searchTerms;
+	size_t index = 0;
+	int64_t matches = 0;
+	for (auto _ : state)
+	{
+		const StringSearch ss(terms[index]);
+		if (++index == terms.size()) index = 0;
+		for (const string& name : names)
+			if (ss.matchKeepCase(name)) ++matches;
+	}
+	state.SetItemsProcessed((int64_t) state.iterations() * names.size());
+	state.counters["matches"] = benchmark::Counter((double) matches, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_StringSearch);
+
+// Bloom filter check done by the share before any name is matched. The filter holds the names of a share
+// of the given size. Generated words have few distinct N-grams, so each name also gets a random tag,
+// this adds N-grams of its own as real names do. The filter is sized the way the share was before its size
+// followed the number of files (fixed at 2^20 bits) or with ShareManager::getBloomSize.
+// The probes are N-grams with a character no name contains, so every match is a false positive.
+
+static const size_t BLOOM_FIXED_SIZE = 1 << 20;
+static const size_t BLOOM_PROBES = 100000;
+static const char BLOOM_ABSENT_CHAR = '#';
+static const size_t BLOOM_TAG_LENGTH = 8;
+static const char tagChars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+enum
+{
+	BLOOM_SIZE_FIXED,
+	BLOOM_SIZE_SHARE
+};
+
+static void BM_BloomFilterMatch(benchmark::State& state)
+{
+	typedef BloomFilter<5> Bloom;
+	const size_t count = (size_t) state.range(0);
+	Bloom bloom(state.range(1) == BLOOM_SIZE_FIXED ? BLOOM_FIXED_SIZE : ShareManager::getBloomSize(count));
+	DataGenerator gen;
+	for (size_t i = 0; i < count; ++i)
+	{
+		string name = Text::toLower(gen.randomFileName());
+		name += ' ';
+		for (size_t j = 0; j < BLOOM_TAG_LENGTH; ++j)
+			name += tagChars[gen.rand(sizeof(tagChars) - 1)];
+		bloom.add(name);
+	}
+
+	StringList probes;
+	for (size_t i = 0; i < BLOOM_PROBES; ++i)
+	{
+		string probe;
+		for (size_t j = 0; j < 5; ++j)
+			probe += (char) ('a' + gen.rand(26));
+		probe[gen.rand(5)] = BLOOM_ABSENT_CHAR;
+		probes.push_back(probe);
+	}
+	size_t index = 0;
+	int64_t hits = 0;
+	for (auto _ : state)
+	{
+		if (bloom.match(probes[index])) ++hits;
+		if (++index == probes.size()) index = 0;
+	}
+	size_t size, used;
+	bloom.getInfo(size, used);
+	state.SetItemsProcessed(state.iterations());
+	state.counters["fp_rate"] = (double) hits / state.iterations();
+	state.counters["fill"] = (double) used / size;
+	state.counters["size_mb"] = (double) size / (8 * 1024 * 1024);
+}
+BENCHMARK(BM_BloomFilterMatch)->ArgNames({"names", "sizing"})
+	->ArgsProduct({{100000, 3000000}, {BLOOM_SIZE_FIXED, BLOOM_SIZE_SHARE}});
+
+static void BM_ShareSearchNmdc(benchmark::State& state)
+{
+	const StringList& terms = Dataset::get().searchTerms;
+	ShareManager* sm = ShareManager::getInstance();
+	NmdcSearchParam sp;
+	sp.fileType = FILE_TYPE_ANY;
+	sp.maxResults = SearchParamBase::MAX_RESULTS_ACTIVE;
+	vector<SearchResultCore> results;
+	size_t index = 0;
+	int64_t found = 0;
+	for (auto _ : state)
+	{
+		sp.filter = terms[index];
+		std::replace(sp.filter.begin(), sp.filter.end(), ' ', '$');
+		if (++index == terms.size()) index = 0;
+		results.clear();
+		sm->search(results, sp, nullptr);
+		found += results.size();
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.counters["results"] = benchmark::Counter((double) found, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_ShareSearchNmdc);
+
+static void BM_ShareSearchAdc(benchmark::State& state)
+{
+	vector<StringList> queries;
+	for (const string& term : Dataset::get().searchTerms)
+	{
+		StringList params;
+		for (const string& word : splitTerm(term))
+			params.push_back("AN" + word);
+		queries.push_back(params);
+	}
+	ShareManager* sm = ShareManager::getInstance();
+	const CID shareGroup;
+	vector<SearchResultCore> results;
+	size_t index = 0;
+	int64_t found = 0;
+	for (auto _ : state)
+	{
+		AdcSearchParam sp(queries[index], SearchParamBase::MAX_RESULTS_ACTIVE, shareGroup);
+		if (++index == queries.size()) index = 0;
+		results.clear();
+		sm->search(results, sp);
+		found += results.size();
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.counters["results"] = benchmark::Counter((double) found, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_ShareSearchAdc);
+
+static void BM_ShareSearchTTH(benchmark::State& state)
+{
+	// Every other TTH is not shared
+	DataGenerator gen;
+	const vector<TTHValue>& shared = Dataset::get().sharedTTHs;
+	vector<TTHValue> tths;
+	for (size_t i = 0; i < 1000; ++i)
+		tths.push_back((i & 1) ? gen.randomTTH() : shared[gen.rand((uint32_t) shared.size())]);
+	ShareManager* sm = ShareManager::getInstance();
+	const CID shareGroup;
+	vector<SearchResultCore> results;
+	size_t index = 0;
+	int64_t found = 0;
+	for (auto _ : state)
+	{
+		results.clear();
+		if (sm->searchTTH(tths[index], results, nullptr, shareGroup)) ++found;
+		if (++index == tths.size()) index = 0;
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.counters["hit_ratio"] = (double) found / state.iterations();
+}
+BENCHMARK(BM_ShareSearchTTH);
@@ -0,0 +1,232 @@
+#include "stdinc.h"
+#include "DataGenerator.h"
+
+#include <benchmark/benchmark.h>
+
+// Completion time of a swarm downloading one file. One seed has the whole file, every other peer
+// starts with a few ranges, mostly near the start of the file, and knows the seed and a few other peers
+// through PSR. A peer downloads one block at a time from a source, limited by the upload slots of the source
+// and the download slots of the peer, and shares the block as soon as it is done. The time is counted in
+// ticks, a source needs 1 to 4 ticks per block. The simulation runs until every peer has the whole file.
+// Block selection follows QueueItem::getNextSegmentL:
+// - forward: the first free block for a full source, a random chunk of a partial source (the old policy);
+// - rarest: the block held by the fewest partial sources among the ones the source has, ties are random.
+// As in QueueItem::updateAvailabilityL, a peer only counts the partial sources it knows.
+// Taking over slow segments in the endgame is not simulated.
+
+static const size_t SWARM_BLOCKS = 256;
+static const size_t SWARM_NEIGHBOURS = 8;
+static const int SWARM_UPLOAD_SLOTS = 4;
+static const int SWARM_DOWNLOAD_SLOTS = 4;
+static const uint64_t SWARM_MAX_TICKS = 1000000;
+
+enum
+{
+	POLICY_FORWARD,
+	POLICY_RAREST
+};
+
+namespace
+{
+	struct Peer
+	{
+		vector<bool> blocks;
+		vector<bool> running;
+		vector<size_t> sources;
+		vector<size_t> watchers; // peers having this one as a source
+		vector<unsigned> availability;
+		size_t doneCount = 0;
+		int uploads = 0;
+		int downloads = 0;
+		unsigned blockTicks = 1;
+		uint64_t finishTime = 0;
+		bool seed = false;
+	};
+
+	struct Transfer
+	{
+		uint64_t endTime;
+		size_t peer;
+		size_t source;
+		size_t block;
+	};
+
+	struct SwarmResult
+	{
+		uint64_t lastFinish = 0;
+		double meanFinish = 0;
+		double seedShare = 0;
+	};
+}
+
+static void makeBlocks(DataGenerator& gen, vector<bool>& blocks)
+{
+	blocks.assign(SWARM_BLOCKS, false);
+	int ranges = gen.rand(0, 3);
+	for (int i = 0; i < ranges; ++i)
+	{
+		size_t start = gen.rand(gen.rand(1, (uint32_t) SWARM_BLOCKS));
+		size_t end = std::min(SWARM_BLOCKS, start + gen.rand(1, (uint32_t) SWARM_BLOCKS / 4));
+		for (size_t j = start; j < end; ++j)
+			blocks[j] = true;
+	}
+}
+
+static bool canGet(const Peer& peer, const Peer& source, size_t block)
+{
+	return source.blocks[block] && !peer.blocks[block] && !peer.running[block];
+}
+
+static size_t selectBlock(int policy, const Peer& peer, const Peer& source, DataGenerator& gen)
+{
+	const vector<unsigned>& availability = peer.availability;
+	size_t result = SIZE_MAX;
+	uint32_t count = 0;
+	if (policy == POLICY_FORWARD)
+	{
+		if (source.seed)
+		{
+			for (size_t i = 0; i < SWARM_BLOCKS; ++i)
+				if (canGet(peer, source, i)) return i;
+			return SIZE_MAX;
+		}
+		// random chunk, the download starts at its first block
+		for (size_t i = 0; i < SWARM_BLOCKS; ++i)
+			if (canGet(peer, source, i) && (i == 0 || !canGet(peer, source, i - 1)) && gen.rand(++count) == 0)
+				result = i;
+		return result;
+	}
+	unsigned minCount = UINT_MAX;
+	for (size_t i = 0; i < SWARM_BLOCKS; ++i)
+	{
+		if (!canGet(peer, source, i) || availability[i] > minCount) continue;
+		if (availability[i] < minCount)
+		{
+			minCount = availability[i];
+			count = 0;
+		}
+		if (gen.rand(++count) == 0) result = i;
+	}
+	return result;
+}
+
+static void runSwarm(size_t peerCount, int policy, SwarmResult& res)
+{
+	DataGenerator gen((uint32_t) (DataGenerator::DEFAULT_SEED + peerCount));
+	vector<Peer> peers(peerCount + 1);
+	Peer& seed = peers[0];
+	seed.blocks.assign(SWARM_BLOCKS, true);
+	seed.doneCount = SWARM_BLOCKS;
+	seed.seed = true;
+	for (size_t i = 1; i < peers.size(); ++i)
+	{
+		Peer& peer = peers[i];
+		makeBlocks(gen, peer.blocks);
+		peer.running.assign(SWARM_BLOCKS, false);
+		peer.blockTicks = gen.rand(1, 5);
+		peer.sources.push_back(0);
+		while (peer.sources.size() <= SWARM_NEIGHBOURS && peer.sources.size() < peerCount)
+		{
+			size_t source = 1 + gen.rand((uint32_t) peerCount - 1);
+			if (source >= i) ++source;
+			if (std::find(peer.sources.begin(), peer.sources.end(), source) == peer.sources.end())
+				peer.sources.push_back(source);
+		}
+		for (size_t j = 0; j < SWARM_BLOCKS; ++j)
+			if (peer.blocks[j]) ++peer.doneCount;
+	}
+	for (size_t i = 1; i < peers.size(); ++i)
+	{
+		Peer& peer = peers[i];
+		peer.availability.assign(SWARM_BLOCKS, 0);
+		for (size_t j = 1; j < peer.sources.size(); ++j)
+		{
+			Peer& source = peers[peer.sources[j]];
+			source.watchers.push_back(i);
+			for (size_t k = 0; k < SWARM_BLOCKS; ++k)
+				if (source.blocks[k]) ++peer.availability[k];
+		}
+	}
+
+	vector<Transfer> transfers;
+	size_t unfinished = peerCount;
+	uint64_t seedBlocks = 0, totalBlocks = 0;
+	for (size_t i = 1; i < peers.size(); ++i)
+		if (peers[i].doneCount == SWARM_BLOCKS) --unfinished;
+	uint64_t now = 0;
+	while (unfinished && now < SWARM_MAX_TICKS)
+	{
+		for (size_t i = 0; i < transfers.size();)
+		{
+			const Transfer& t = transfers[i];
+			if (t.endTime != now)
+			{
+				++i;
+				continue;
+			}
+			Peer& peer = peers[t.peer];
+			peer.blocks[t.block] = true;
+			peer.running[t.block] = false;
+			peer.downloads--;
+			peers[t.source].uploads--;
+			for (size_t watcher : peer.watchers)
+				++peers[watcher].availability[t.block];
+			if (++peer.doneCount == SWARM_BLOCKS)
+			{
+				peer.finishTime = now;
+				--unfinished;
+			}
+			transfers[i] = transfers.back();
+			transfers.pop_back();
+		}
+
+		// peers ask their sources in a different order on each tick
+		const size_t offset = gen.rand((uint32_t) peerCount);
+		for (size_t k = 0; k < peerCount; ++k)
+		{
+			const size_t index = 1 + (offset + k) % peerCount;
+			Peer& peer = peers[index];
+			if (peer.doneCount == SWARM_BLOCKS) continue;
+			const size_t sourceOffset = gen.rand((uint32_t) peer.sources.size());
+			for (size_t j = 0; j < peer.sources.size() && peer.downloads < SWARM_DOWNLOAD_SLOTS; ++j)
+			{
+				const size_t sourceIndex = peer.sources[(sourceOffset + j) % peer.sources.size()];
+				Peer& source = peers[sourceIndex];
+				if (source.uploads >= SWARM_UPLOAD_SLOTS) continue;
+				const size_t block = selectBlock(policy, peer, source, gen);
+				if (block == SIZE_MAX) continue;
+				peer.running[block] = true;
+				peer.downloads++;
+				source.uploads++;
+				transfers.push_back(Transfer{now + source.blockTicks, index, sourceIndex, block});
+				if (source.seed) ++seedBlocks;
+				++totalBlocks;
+			}
+		}
+		++now;
+	}
+
+	res.lastFinish = 0;
+	uint64_t sum = 0;
+	for (size_t i = 1; i < peers.size(); ++i)
+	{
+		sum += peers[i].finishTime;
+		res.lastFinish = std::max(res.lastFinish, peers[i].finishTime);
+	}
+	res.meanFinish = (double) sum / peerCount;
+	res.seedShare = totalBlocks ? (double) seedBlocks / totalBlocks : 0;
+}
+
+static void BM_SwarmCompletion(benchmark::State& state)
+{
+	const size_t peerCount = (size_t) state.range(0);
+	const int policy = (int) state.range(1);
+	SwarmResult res;
+	for (auto _ : state)
+		runSwarm(peerCount, policy, res);
+	state.counters["last_finish"] = (double) res.lastFinish;
+	state.counters["mean_finish"] = res.meanFinish;
+	state.counters["seed_share"] = res.seedShare;
+}
+BENCHMARK(BM_SwarmCompletion)->ArgNames({"peers", "policy"})
+	->ArgsProduct({{16, 64, 256}, {POLICY_FORWARD, POLICY_RAREST}})->Unit(benchmark::kMillisecond);
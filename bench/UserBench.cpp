@@ -0,0 +1,178 @@
+#include "stdinc.h"
+#include "DataGenerator.h"
+#include "ClientManager.h"
+#include "OnlineUserIndex.h"
+#include "IdentityAttribs.h"
+#include "User.h"
+#include "Tag16.h"
+
+#include <benchmark/benchmark.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Online users of a hub that is not connected, every user has its own IPv4 address
+// and nick. The users are put into a standalone index, not the one of ClientManager.
+
+static const size_t USER_LOOKUP_PROBES = 4096;
+
+enum
+{
+	LOOKUP_IP,
+	LOOKUP_NICK,
+	LOOKUP_SCAN // all users are compared, this is what getNicksByIp did before the index
+};
+
+namespace
+{
+	struct BenchUsers
+	{
+		ClientBasePtr cb;
+		OnlineUserList users;
+		vector<IpAddress> probeIPs;
+		StringList probeNicks;
+
+		~BenchUsers()
+		{
+			users.clear();
+			if (cb) ClientManager::getInstance()->putClient(cb);
+		}
+	};
+}
+
+static void makeUsers(BenchUsers& us, size_t count)
+{
+	DataGenerator gen((uint32_t) (DataGenerator::DEFAULT_SEED + count));
+	us.cb = ClientManager::getInstance()->getClient("dchub://users.invalid:411");
+	us.users.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		UserPtr user = std::make_shared<User>(gen.randomCID(), Util::emptyString);
+		user->setIP4(0x0A000000 + (Ip4Address) i);
+		OnlineUserPtr ou = std::make_shared<OnlineUser>(user, us.cb, (uint32_t) i);
+		ou->getIdentity().setNick(gen.randomWord() + Util::toString(i));
+		us.users.push_back(ou);
+	}
+	for (size_t i = 0; i < USER_LOOKUP_PROBES; ++i)
+	{
+		const OnlineUserPtr& ou = us.users[gen.rand((uint32_t) count)];
+		IpAddress ip;
+		ip.type = AF_INET;
+		ip.data.v4 = ou->getUser()->getIP4();
+		us.probeIPs.push_back(ip);
+		us.probeNicks.push_back(ou->getIdentity().getNick());
+	}
+}
+
+static void BM_OnlineUserLookup(benchmark::State& state)
+{
+	BenchUsers us;
+	makeUsers(us, (size_t) state.range(0));
+	OnlineUserIndex index;
+	for (const OnlineUserPtr& ou : us.users)
+		index.addUser(ou);
+
+	const int mode = (int) state.range(1);
+	size_t probe = 0;
+	int64_t found = 0;
+	vector<UserPtr> result;
+	for (auto _ : state)
+	{
+		switch (mode)
+		{
+			case LOOKUP_IP:
+				result.clear();
+				index.getUsersByIp(us.probeIPs[probe], result);
+				found += result.size();
+				break;
+			case LOOKUP_NICK:
+				if (index.findNick(us.probeNicks[probe], Util::emptyString, nullptr)) ++found;
+				break;
+			default:
+			{
+				const Ip4Address ip = us.probeIPs[probe].data.v4;
+				for (const OnlineUserPtr& ou : us.users)
+					if (ou->getUser()->getIP4() == ip) ++found;
+			}
+		}
+		if (++probe == USER_LOOKUP_PROBES) probe = 0;
+	}
+	state.counters["found"] = benchmark::Counter((double) found, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_OnlineUserLookup)->ArgNames({"users", "mode"})
+	->ArgsProduct({{1000, 10000, 100000, 1000000}, {LOOKUP_IP, LOOKUP_NICK}})
+	->ArgsProduct({{1000, 10000, 100000}, {LOOKUP_SCAN}});
+
+// String attributes of the users of a large hub, stored the way Identity did before IdentityAttribs
+// (a map per user) and with IdentityAttribs. Client names, versions, locales and speeds repeat,
+// descriptions are mostly unique. Memory is measured as the change of the heap size.
+
+static const size_t ATTRIB_USERS = 200000;
+static const size_t ATTRIB_COUNT = 6;
+static const uint16_t attribTags[ATTRIB_COUNT] = { TAG('A', 'P'), TAG('V', 'E'), TAG('S', 'U'), TAG('U', 'S'), TAG('L', 'C'), TAG('D', 'E') };
+
+static vector<StringList> makeAttribValues(size_t count)
+{
+	static const char* apps[] = { "AirDC++", "DC++", "FlylinkDC++", "EiskaltDC++", "BlackLink" };
+	static const char* versions[] = { "4.21", "0.868", "r600", "2.4.2", "6.1.0", "4.10" };
+	static const char* supports[] = { "TCP4,UDP4,ADC0,SUDP", "TCP4,UDP4", "ADC0,NAT0,SEGA" };
+	static const char* speeds[] = { "1048576", "10485760", "104857600", "131072" };
+	static const char* locales[] = { "en-US", "ru-RU", "de-DE", "sv-SE" };
+	DataGenerator gen;
+	vector<StringList> result(count);
+	for (StringList& values : result)
+	{
+		values.push_back(apps[gen.rand(_countof(apps))]);
+		values.push_back(versions[gen.rand(_countof(versions))]);
+		values.push_back(supports[gen.rand(_countof(supports))]);
+		values.push_back(speeds[gen.rand(_countof(speeds))]);
+		values.push_back(locales[gen.rand(_countof(locales))]);
+		values.push_back(gen.randomWord() + ' ' + gen.randomWord() + ' ' + gen.randomWord());
+	}
+	return result;
+}
+
+#ifdef __GLIBC__
+static size_t getHeapUsed()
+{
+	return mallinfo2().uordblks;
+}
+#endif
+
+static void BM_IdentityAttribsMemory(benchmark::State& state)
+{
+#ifdef __GLIBC__
+	const vector<StringList> values = makeAttribValues(ATTRIB_USERS);
+	const bool pooled = state.range(0) != 0;
+	double bytesPerUser = 0;
+	for (auto _ : state)
+	{
+		const size_t heapStart = getHeapUsed();
+		if (pooled)
+		{
+			std::unique_ptr<IdentityAttribs[]> users(new IdentityAttribs[ATTRIB_USERS]);
+			for (size_t i = 0; i < ATTRIB_USERS; ++i)
+				for (size_t j = 0; j < ATTRIB_COUNT; ++j)
+					users[i].set(attribTags[j], values[i][j]);
+			// replaced arrays are freed in two steps
+			IdentityAttribs::reclaim();
+			IdentityAttribs::reclaim();
+			bytesPerUser = (double) (getHeapUsed() - heapStart) / ATTRIB_USERS;
+		}
+		else
+		{
+			typedef boost::unordered_map<uint16_t, string> AttribMap;
+			std::unique_ptr<AttribMap[]> users(new AttribMap[ATTRIB_USERS]);
+			for (size_t i = 0; i < ATTRIB_USERS; ++i)
+				for (size_t j = 0; j < ATTRIB_COUNT; ++j)
+					users[i][attribTags[j]] = values[i][j];
+			bytesPerUser = (double) (getHeapUsed() - heapStart) / ATTRIB_USERS;
+		}
+	}
+	state.counters["bytes_per_user"] = bytesPerUser;
+	state.counters["total_mb"] = bytesPerUser * ATTRIB_USERS / (1024 * 1024);
+#else
+	state.SkipWithError("Heap size is only available with glibc");
+#endif
+}
+BENCHMARK(BM_IdentityAttribsMemory)->ArgName("pooled")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,50 @@
+#include "stdinc.h"
+#include "DataGenerator.h"
+#include "SimpleXMLReader.h"
+#include "DirectoryListing.h"
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+	class CountingCallback : public SimpleXMLReader::CallBack
+	{
+		public:
+			size_t tags = 0;
+
+			void startTag(const string&, StringPairList&, bool) override { ++tags; }
+			void endTag(const string&, const string&) override {}
+	};
+}
+
+static void BM_SimpleXMLReader(benchmark::State& state)
+{
+	const string& xml = Dataset::get().fileList;
+	size_t tags = 0;
+	for (auto _ : state)
+	{
+		CountingCallback cb;
+		SimpleXMLReader reader(&cb);
+		reader.parse(xml.data(), xml.length(), false);
+		tags = cb.tags;
+	}
+	state.SetBytesProcessed((int64_t) state.iterations() * xml.length());
+	state.counters["tags"] = (double) tags;
+}
+BENCHMARK(BM_SimpleXMLReader)->Unit(benchmark::kMillisecond);
+
+// Loading a downloaded list also checks every file against the share and the queue
+static void BM_DirectoryListingLoad(benchmark::State& state)
+{
+	const string& xml = Dataset::get().fileList;
+	for (auto _ : state)
+	{
+		std::atomic_bool abortFlag(false);
+		DirectoryListing dl(abortFlag);
+		dl.loadXML(xml, nullptr, false);
+		benchmark::DoNotOptimize(dl.getRoot());
+	}
+	state.SetBytesProcessed((int64_t) state.iterations() * xml.length());
+	state.SetItemsProcessed((int64_t) state.iterations() * Dataset::SHARED_FILES);
+}
+BENCHMARK(BM_DirectoryListingLoad)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,86 @@
+#include "stdinc.h"
+#include "LoadStats.h"
+
+#include <chrono>
+
+uint64_t getMicroTick()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void LatencySamples::add(uint64_t value)
+{
+	LOCK(cs);
+	samples.push_back(value);
+	sorted = false;
+}
+
+void LatencySamples::clear()
+{
+	LOCK(cs);
+	samples.clear();
+	sorted = true;
+}
+
+size_t LatencySamples::count() const
+{
+	LOCK(cs);
+	return samples.size();
+}
+
+uint64_t LatencySamples::getPercentile(double p) const
+{
+	LOCK(cs);
+	if (samples.empty()) return 0;
+	if (!sorted)
+	{
+		std::sort(samples.begin(), samples.end());
+		sorted = true;
+	}
+	size_t rank = (size_t) ceil(p / 100 * samples.size());
+	if (rank) --rank;
+	return samples[std::min(rank, samples.size() - 1)];
+}
+
+uint64_t LatencySamples::getMax() const
+{
+	return getPercentile(100);
+}
+
+void ScenarioResult::setLatency(const LatencySamples& samples)
+{
+	latencyCount = samples.count();
+	p50 = samples.getPercentile(50);
+	p90 = samples.getPercentile(90);
+	p99 = samples.getPercentile(99);
+	maxLatency = samples.getMax();
+}
+
+static string formatMs(uint64_t us)
+{
+	char buf[32];
+	sprintf(buf, "%.2f", us / 1000.0);
+	return buf;
+}
+
+void printReport(FILE* f, const vector<ScenarioResult>& results)
+{
+	fprintf(f, "%-14s %-5s %9s %7s %8s %10s %8s %9s %9s %9s %9s  %s\n",
+		"scenario", "proto", "items", "errors", "seconds", "items/s", "MiB/s", "p50 ms", "p90 ms", "p99 ms", "max ms", "notes");
+	for (const ScenarioResult& r : results)
+	{
+		const double seconds = r.elapsed / 1e6;
+		char rate[32], speed[32];
+		sprintf(rate, "%.1f", seconds > 0 ? r.items / seconds : 0.0);
+		if (r.bytes && seconds > 0)
+			sprintf(speed, "%.1f", r.bytes / seconds / (1024 * 1024));
+		else
+			strcpy(speed, "-");
+		const bool hasLatency = r.latencyCount != 0;
+		fprintf(f, "%-14s %-5s %9llu %7llu %8.2f %10s %8s %9s %9s %9s %9s  %s\n",
+			r.scenario.c_str(), r.protocol.c_str(), (unsigned long long) r.items, (unsigned long long) r.errors, seconds, rate, speed,
+			hasLatency ? formatMs(r.p50).c_str() : "-", hasLatency ? formatMs(r.p90).c_str() : "-",
+			hasLatency ? formatMs(r.p99).c_str() : "-", hasLatency ? formatMs(r.maxLatency).c_str() : "-",
+			r.notes.c_str());
+	}
+}
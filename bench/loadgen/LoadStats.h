@@ -0,0 +1,47 @@
+#ifndef LOAD_STATS_H_
+#define LOAD_STATS_H_
+
+#include "typedefs.h"
+#include "Locks.h"
+
+// Monotonic time in microseconds
+uint64_t getMicroTick();
+
+// Latencies in microseconds, samples are added from the socket threads
+class LatencySamples
+{
+	public:
+		void add(uint64_t value);
+		void clear();
+		size_t count() const;
+		// Nearest-rank percentile, p is in the range 0..100
+		uint64_t getPercentile(double p) const;
+		uint64_t getMax() const;
+
+	private:
+		mutable CriticalSection cs;
+		mutable vector<uint64_t> samples;
+		mutable bool sorted = true;
+};
+
+struct ScenarioResult
+{
+	string scenario;
+	string protocol;
+	uint64_t items = 0;
+	uint64_t bytes = 0;
+	uint64_t errors = 0;
+	uint64_t elapsed = 0; // microseconds
+	size_t latencyCount = 0;
+	uint64_t p50 = 0;
+	uint64_t p90 = 0;
+	uint64_t p99 = 0;
+	uint64_t maxLatency = 0;
+	string notes;
+
+	void setLatency(const LatencySamples& samples);
+};
+
+void printReport(FILE* f, const vector<ScenarioResult>& results);
+
+#endif // LOAD_STATS_H_
@@ -0,0 +1,507 @@
+#include "stdinc.h"
+#include "Scenarios.h"
+#include "SimHub.h"
+#include "SimPeer.h"
+#include "BenchCore.h"
+#include "DataGenerator.h"
+#include "ClientManager.h"
+#include "Client.h"
+#include "ConnectionManager.h"
+#include "UploadManager.h"
+#include "QueueManager.h"
+#include "WebServerManager.h"
+#include "WebClient.h"
+#include "SettingsManager.h"
+#include "ConfCore.h"
+#include "TimeUtil.h"
+#include "StrUtil.h"
+#include "PathUtil.h"
+#include "AppPaths.h"
+#include "File.h"
+
+static const int LOGIN_TIMEOUT = 60000;
+static const int REPLAY_TIMEOUT = 120000;
+static const int CONNECT_TIMEOUT = 30000;
+static const int CLEANUP_TIMEOUT = 10000;
+static const int WEB_TIMEOUT = 30000;
+
+// Files served by the web server: a template that is cached and compressed once, and a static file
+static const size_t WEB_SCRIPT_SIZE = 256 * 1024;
+static const size_t WEB_FILE_SIZE = 1024 * 1024;
+static const char WEB_RANGE[] = "bytes=0-65535";
+
+// A marker search follows each block of lines, its round trip is the latency of the block
+static const size_t MARKER_INTERVAL = 100;
+
+// Limits the lines queued in the socket of the hub when the core falls behind
+static const size_t MAX_PENDING_BLOCKS = 20;
+
+// Each peer of the connection storm downloads one small segment
+static const int64_t STORM_SEGMENT_SIZE = 64 * 1024;
+
+namespace
+{
+	class PeerSet : public SimHubListener
+	{
+		public:
+			SimPeer::Stats stats;
+
+			explicit PeerSet(unsigned count)
+			{
+				for (unsigned i = 0; i < count; ++i)
+					peers.emplace_back(new SimPeer(i, &stats));
+			}
+
+			~PeerSet()
+			{
+				close(peers.size());
+			}
+
+			void getUsers(StringList& users) const
+			{
+				for (const auto& peer : peers)
+					users.push_back(peer->getMyInfo());
+			}
+
+			// Starts the first count peers, the core gets all $RevConnectToMe at once
+			void start(SimHub& hub, size_t count, const SimPeer::Task& task)
+			{
+				StringList lines;
+				for (size_t i = 0; i < count; ++i)
+				{
+					peers[i]->start(task);
+					lines.push_back("$RevConnectToMe " + peers[i]->getNick() + ' ' + SimHub::CLIENT_NICK);
+				}
+				hub.sendLines(lines, 0, lines.size());
+			}
+
+			// Returns the number of peers that did not finish in time
+			size_t wait(size_t count, int timeout)
+			{
+				const uint64_t deadline = GET_TICK() + timeout;
+				while (true)
+				{
+					size_t unfinished = 0;
+					for (size_t i = 0; i < count; ++i)
+						if (!peers[i]->isFinished()) ++unfinished;
+					if (!unfinished || GET_TICK() > deadline) return unfinished;
+					Thread::sleep(1);
+				}
+			}
+
+			size_t countDone(size_t count) const
+			{
+				size_t result = 0;
+				for (size_t i = 0; i < count; ++i)
+					if (peers[i]->getState() == SimPeer::STATE_DONE) ++result;
+				return result;
+			}
+
+			void close(size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+					peers[i]->close();
+			}
+
+			void onConnectToMe(const string& nick, const string& address, uint16_t port) noexcept override
+			{
+				if (nick.compare(0, 4, "peer") != 0) return;
+				const size_t index = Util::toInt(nick.c_str() + 4);
+				if (index < peers.size() && peers[index]->getNick() == nick)
+					peers[index]->connect(address, port);
+			}
+
+		private:
+			vector<unique_ptr<SimPeer>> peers;
+	};
+}
+
+static string formatLatency(const char* name, const LatencySamples& samples)
+{
+	char buf[128];
+	sprintf(buf, "%s p50=%.2f p99=%.2f ms", name, samples.getPercentile(50) / 1000.0, samples.getPercentile(99) / 1000.0);
+	return buf;
+}
+
+// Upload connections are removed by the core after the peers disconnect,
+// a user can't have a second upload connection until then
+static bool waitCleanup(size_t baseTokenCount)
+{
+	const uint64_t deadline = GET_TICK() + CLEANUP_TIMEOUT;
+	while (ConnectionManager::tokenManager.getTokenCount() > baseTokenCount || UploadManager::getRunningCount())
+	{
+		if (GET_TICK() > deadline) return false;
+		Thread::sleep(10);
+	}
+	return true;
+}
+
+static void runReplay(SimHub& hub, const char* name, const StringList& lines, const LoadOptions& options, vector<ScenarioResult>& results)
+{
+	ScenarioResult r;
+	r.scenario = name;
+	r.protocol = hub.getProtocolName();
+	if (options.verbose)
+		fprintf(stderr, "%s/%s: sending %u lines\n", r.protocol.c_str(), name, (unsigned) options.lines);
+	hub.getMarkerLatency().clear();
+	const uint64_t prevResultCount = hub.getResultCount();
+	const uint64_t start = getMicroTick();
+	for (size_t i = 0; i < options.lines; i += MARKER_INTERVAL)
+	{
+		if (options.rate)
+		{
+			const uint64_t due = start + (uint64_t) i * 1000000 / options.rate;
+			const uint64_t now = getMicroTick();
+			if (due > now) Thread::sleep((unsigned) ((due - now) / 1000));
+		}
+		if (!hub.waitMarkers(REPLAY_TIMEOUT, MAX_PENDING_BLOCKS)) break;
+		hub.sendLines(lines, i, std::min(MARKER_INTERVAL, options.lines - i), true);
+	}
+	if (!hub.waitMarkers(REPLAY_TIMEOUT))
+		r.errors = hub.getMarkersSent() - hub.getMarkersReceived();
+	r.elapsed = getMicroTick() - start;
+	r.items = options.lines;
+	r.setLatency(hub.getMarkerLatency());
+	r.notes = "results=" + Util::toString(hub.getResultCount() - prevResultCount);
+	results.push_back(r);
+}
+
+static void runStorm(SimHub& hub, PeerSet& peers, const LoadOptions& options, vector<ScenarioResult>& results)
+{
+	ScenarioResult r;
+	r.scenario = "storm";
+	r.protocol = hub.getProtocolName();
+	peers.stats.clear();
+	const size_t baseTokenCount = ConnectionManager::tokenManager.getTokenCount();
+	SimPeer::Task task;
+	task.segmentSize = STORM_SEGMENT_SIZE;
+	task.maxSegments = 1;
+	unsigned cleanupTimeouts = 0;
+	for (unsigned round = 0; round < options.rounds; ++round)
+	{
+		if (options.verbose)
+			fprintf(stderr, "%s/storm: round %u, %u peers\n", r.protocol.c_str(), round + 1, options.peers);
+		const uint64_t start = getMicroTick();
+		peers.start(hub, options.peers, task);
+		r.errors += peers.wait(options.peers, CONNECT_TIMEOUT);
+		r.elapsed += getMicroTick() - start;
+		r.items += peers.countDone(options.peers);
+		peers.close(options.peers);
+		if (!waitCleanup(baseTokenCount)) ++cleanupTimeouts;
+	}
+	r.errors += peers.stats.errors;
+	r.bytes = peers.stats.bytes;
+	r.setLatency(peers.stats.firstSegmentLatency);
+	r.notes = "rounds=" + Util::toString(options.rounds) + ' ' + formatLatency("handshake", peers.stats.connectLatency);
+	if (cleanupTimeouts)
+		r.notes += " cleanup-timeouts=" + Util::toString(cleanupTimeouts);
+	results.push_back(r);
+}
+
+static void runTransfer(SimHub& hub, PeerSet& peers, const LoadOptions& options, vector<ScenarioResult>& results)
+{
+	ScenarioResult r;
+	r.scenario = "transfer";
+	r.protocol = hub.getProtocolName();
+	if (options.verbose)
+		fprintf(stderr, "%s/transfer: %u peers for %u s\n", r.protocol.c_str(), options.downloaders, options.duration);
+	peers.stats.clear();
+	const size_t baseTokenCount = ConnectionManager::tokenManager.getTokenCount();
+	const uint64_t start = getMicroTick();
+	SimPeer::Task task;
+	task.segmentSize = options.segmentSize;
+	task.deadline = start + (uint64_t) options.duration * 1000000;
+	peers.start(hub, options.downloaders, task);
+	r.errors = peers.wait(options.downloaders, options.duration * 1000 + CONNECT_TIMEOUT);
+	r.elapsed = getMicroTick() - start;
+	r.errors += peers.stats.errors;
+	r.items = peers.stats.segments;
+	r.bytes = peers.stats.bytes;
+	r.setLatency(peers.stats.segmentLatency);
+	r.notes = "peers=" + Util::toString(options.downloaders) + " segment=" + Util::toString(options.segmentSize / 1024) + "KiB";
+	peers.close(options.downloaders);
+	if (!waitCleanup(baseTokenCount))
+		r.notes += " cleanup-timeout";
+	results.push_back(r);
+}
+
+static void runProtocol(SimHub::Protocol protocol, const LoadOptions& options, vector<ScenarioResult>& results)
+{
+	const Dataset& ds = Dataset::get();
+	const bool nmdc = protocol == SimHub::PROTO_NMDC;
+	const StringList& traffic = nmdc ? ds.nmdcTraffic : ds.adcTraffic;
+	const string searchPrefix = nmdc ? "$Search " : "BSCH ";
+
+	// Connection storms and transfers are run on NMDC only
+	unique_ptr<PeerSet> peers;
+	if (nmdc && (options.scenarios & (LoadOptions::SCENARIO_STORM | LoadOptions::SCENARIO_TRANSFER)))
+		peers.reset(new PeerSet(std::max(options.peers, options.downloaders)));
+
+	SimHub hub(protocol, ds.sharedTTHs[0], peers.get());
+	ScenarioResult login;
+	login.scenario = "login";
+	login.protocol = hub.getProtocolName();
+	if (!hub.listen())
+	{
+		login.errors = 1;
+		results.push_back(login);
+		return;
+	}
+
+	StringList users(traffic.begin(), traffic.begin() + Dataset::HUB_USERS);
+	if (peers) peers->getUsers(users);
+	if (options.verbose)
+		fprintf(stderr, "%s: connecting to %s\n", login.protocol.c_str(), hub.getUrl().c_str());
+	const uint64_t start = getMicroTick();
+	ClientBasePtr cb = ClientManager::getInstance()->getClient(hub.getUrl());
+	Client* client = static_cast<Client*>(cb.get());
+	client->connect();
+	const bool loggedIn = hub.waitLogin(users, LOGIN_TIMEOUT);
+	login.elapsed = getMicroTick() - start;
+	login.items = users.size();
+	login.notes = "users=" + Util::toString(client->getUserCount());
+	if (!loggedIn)
+		login.errors = 1;
+	results.push_back(login);
+
+	if (loggedIn)
+	{
+		StringList searches, churn;
+		for (size_t i = Dataset::HUB_USERS; i < traffic.size(); ++i)
+		{
+			const string& line = traffic[i];
+			if (line.compare(0, searchPrefix.length(), searchPrefix) == 0)
+				searches.push_back(line);
+			else
+				churn.push_back(line);
+		}
+		if (options.scenarios & LoadOptions::SCENARIO_SEARCH)
+			runReplay(hub, "search", searches, options, results);
+		if (options.scenarios & LoadOptions::SCENARIO_CHURN)
+			runReplay(hub, "churn", churn, options, results);
+		if (peers && (options.scenarios & LoadOptions::SCENARIO_STORM))
+			runStorm(hub, *peers, options, results);
+		if (peers && (options.scenarios & LoadOptions::SCENARIO_TRANSFER))
+			runTransfer(hub, *peers, options, results);
+	}
+
+	ClientManager::getInstance()->putClient(cb);
+	hub.close();
+}
+
+namespace
+{
+	enum
+	{
+		WEB_CHANGE_QUEUE  = 1, // a queue item is added before each request
+		WEB_GZIP          = 2,
+		WEB_IF_NONE_MATCH = 4, // the ETag is taken from a response before the measured requests
+		WEB_RANGE_REQUEST = 8
+	};
+
+	struct WebCase
+	{
+		const char* name;
+		const char* uri;
+		int expectedStatus;
+		int flags;
+	};
+
+	class WebQueue
+	{
+		public:
+			WebQueue() : dir(BenchCore::getProfilePath() + "Downloads" PATH_SEPARATOR_STR "web" PATH_SEPARATOR_STR), count(0) {}
+
+			bool add(size_t items, string& error)
+			{
+				auto qm = QueueManager::getInstance();
+				try
+				{
+					for (size_t i = 0; i < items; ++i, ++count)
+					{
+						const TTHValue tth = gen.randomTTH();
+						QueueManager::QueueItemParams params;
+						params.size = (int64_t) gen.rand(1, 4096) << 20;
+						params.root = &tth;
+						bool getConnFlag = false;
+						qm->add(dir + gen.randomWord() + '-' + Util::toString(count) + ".bin", params, HintedUser(), 0, 0, getConnFlag);
+					}
+				}
+				catch (const Exception& e)
+				{
+					error = e.getError();
+					return false;
+				}
+				return true;
+			}
+
+		private:
+			DataGenerator gen;
+			const string dir;
+			size_t count;
+	};
+}
+
+// The HTML page keeps a copy of the whole queue in the session and copies it again when the queue changes,
+// the API selects one page from the queue for every request
+static const WebCase webCases[] =
+{
+	{ "queue-html",     "/queue",               200, 0                 },
+	{ "queue-html-add", "/queue",               200, WEB_CHANGE_QUEUE  },
+	{ "queue-api",      "/api/queue?limit=100", 200, 0                 },
+	{ "queue-api-add",  "/api/queue?limit=100", 200, WEB_CHANGE_QUEUE  },
+	{ "queue-api-gzip", "/api/queue?limit=100", 200, WEB_GZIP          },
+	{ "js",             "/bench.js",            200, 0                 },
+	{ "js-gzip",        "/bench.js",            200, WEB_GZIP          },
+	{ "js-304",         "/bench.js",            304, WEB_IF_NONE_MATCH },
+	{ "file",           "/bench.bin",           200, 0                 },
+	{ "file-range",     "/bench.bin",           206, WEB_RANGE_REQUEST },
+	{ "file-304",       "/bench.bin",           304, WEB_IF_NONE_MATCH }
+};
+
+static bool writeWebFiles(string& error)
+{
+	DataGenerator gen;
+	const string path = BenchCore::getProfilePath() + "WebServer" PATH_SEPARATOR_STR;
+	try
+	{
+		File::ensureDirectory(path + "templates" PATH_SEPARATOR_STR);
+		File::ensureDirectory(path + "static" PATH_SEPARATOR_STR);
+		File(path + "templates" PATH_SEPARATOR_STR "bench.js", File::WRITE, File::CREATE | File::TRUNCATE).write(gen.randomText(WEB_SCRIPT_SIZE));
+		File(path + "static" PATH_SEPARATOR_STR "bench.bin", File::WRITE, File::CREATE | File::TRUNCATE).write(gen.randomBytes(WEB_FILE_SIZE));
+	}
+	catch (const Exception& e)
+	{
+		error = e.getError();
+		return false;
+	}
+	Util::paths[Util::PATH_WEB_SERVER] = path;
+	return true;
+}
+
+static bool startWebServer(uint16_t& port, string& error)
+{
+	auto ss = SettingsManager::instance.getCoreSettings();
+	ss->lockWrite();
+	ss->setString(Conf::WEBSERVER_BIND_ADDRESS, "127.0.0.1");
+	ss->setString(Conf::WEBSERVER_USER, "bench");
+	ss->setString(Conf::WEBSERVER_PASS, "bench");
+	port = (uint16_t) ss->getInt(Conf::WEBSERVER_PORT);
+	ss->unlockWrite();
+	try
+	{
+		WebServerManager::getInstance()->start();
+	}
+	catch (const Exception& e)
+	{
+		error = e.getError();
+		return false;
+	}
+	return true;
+}
+
+static void runWebCase(WebClient& client, WebQueue& queue, const WebCase& wc, const LoadOptions& options, vector<ScenarioResult>& results)
+{
+	ScenarioResult r;
+	r.scenario = wc.name;
+	r.protocol = "http";
+	if (options.verbose)
+		fprintf(stderr, "http/%s: %u requests\n", wc.name, options.webRequests);
+	StringPairList headers;
+	if (wc.flags & WEB_GZIP)
+		headers.emplace_back("Accept-Encoding", "gzip, deflate");
+	if (wc.flags & WEB_RANGE_REQUEST)
+		headers.emplace_back("Range", WEB_RANGE);
+	LatencySamples latency;
+	WebClient::Result res;
+	string error;
+	if (wc.flags & WEB_IF_NONE_MATCH)
+	{
+		if (!client.request(wc.uri, headers, res, WEB_TIMEOUT) || res.etag.empty())
+		{
+			r.errors = 1;
+			r.notes = "no ETag " + client.getError();
+			results.push_back(r);
+			return;
+		}
+		headers.emplace_back("If-None-Match", res.etag);
+	}
+	for (unsigned i = 0; i < options.webRequests; ++i)
+	{
+		if ((wc.flags & WEB_CHANGE_QUEUE) && !queue.add(1, error))
+		{
+			++r.errors;
+			break;
+		}
+		// Only the time spent in requests is counted
+		const uint64_t start = getMicroTick();
+		const bool ok = client.request(wc.uri, headers, res, WEB_TIMEOUT);
+		const uint64_t elapsed = getMicroTick() - start;
+		r.elapsed += elapsed;
+		if (!ok || res.status != wc.expectedStatus)
+		{
+			++r.errors;
+			continue;
+		}
+		latency.add(elapsed);
+		r.bytes += res.bodySize;
+		++r.items;
+	}
+	r.setLatency(latency);
+	r.notes = "body=" + Util::toString(r.items ? r.bytes / r.items : 0) + 'B';
+	if (!res.encoding.empty())
+		r.notes += ' ' + res.encoding;
+	if (!error.empty())
+		r.notes += ' ' + error;
+	else if (r.errors)
+		r.notes += " status=" + Util::toString(res.status) + ' ' + client.getError();
+	results.push_back(r);
+}
+
+static void runWeb(const LoadOptions& options, vector<ScenarioResult>& results)
+{
+	ScenarioResult setup;
+	setup.scenario = "web-setup";
+	setup.protocol = "http";
+	if (options.verbose)
+		fprintf(stderr, "http: adding %u queue items\n", (unsigned) options.queueItems);
+	const uint64_t start = getMicroTick();
+	string error;
+	uint16_t port = 0;
+	WebQueue queue;
+	if (!writeWebFiles(error) || !queue.add(options.queueItems, error) || !startWebServer(port, error))
+	{
+		setup.errors = 1;
+		setup.notes = error;
+		results.push_back(setup);
+		return;
+	}
+	WebClient client(port);
+	if (!client.signIn("bench", "bench", WEB_TIMEOUT))
+	{
+		setup.errors = 1;
+		setup.notes = client.getError();
+		results.push_back(setup);
+		return;
+	}
+	setup.elapsed = getMicroTick() - start;
+	setup.items = options.queueItems;
+	setup.notes = "queue=" + Util::toString(options.queueItems);
+	results.push_back(setup);
+
+	for (const WebCase& wc : webCases)
+		runWebCase(client, queue, wc, options, results);
+	client.close();
+}
+
+void runScenarios(const LoadOptions& options, vector<ScenarioResult>& results)
+{
+	// The web server scenario doesn't need a hub
+	const bool hub = (options.scenarios & ~LoadOptions::SCENARIO_WEB) != 0;
+	if (hub && options.nmdc)
+		runProtocol(SimHub::PROTO_NMDC, options, results);
+	if (hub && options.adc)
+		runProtocol(SimHub::PROTO_ADC, options, results);
+	if (options.scenarios & LoadOptions::SCENARIO_WEB)
+		runWeb(options, results);
+}
@@ -0,0 +1,37 @@
+#ifndef SCENARIOS_H_
+#define SCENARIOS_H_
+
+#include "LoadStats.h"
+
+struct LoadOptions
+{
+	enum
+	{
+		SCENARIO_SEARCH   = 1,
+		SCENARIO_CHURN    = 2,
+		SCENARIO_STORM    = 4,
+		SCENARIO_TRANSFER = 8,
+		SCENARIO_WEB      = 16,
+		SCENARIO_ALL      = 31
+	};
+
+	bool nmdc = true;
+	bool adc = true;
+	int scenarios = SCENARIO_ALL;
+	size_t lines = 5000;
+	unsigned rate = 0; // lines per second, 0 means as fast as possible
+	unsigned peers = 100;
+	unsigned rounds = 3;
+	unsigned downloaders = 8;
+	int64_t segmentSize = 1024 * 1024;
+	unsigned duration = 10; // seconds
+	unsigned webRequests = 500; // for each request type
+	size_t queueItems = 5000;
+	bool verbose = false;
+};
+
+// Connects the core to a simulated hub for each protocol and runs the scenarios, the login is always measured.
+// The web server scenario is run once, with its own client.
+void runScenarios(const LoadOptions& options, vector<ScenarioResult>& results);
+
+#endif // SCENARIOS_H_
@@ -0,0 +1,245 @@
+#include "stdinc.h"
+#include "SimHub.h"
+#include "CID.h"
+#include "TimeUtil.h"
+#include "StrUtil.h"
+
+const string SimHub::CLIENT_NICK = "bench";
+const string SimHub::MARKER_NICK = "loadgen";
+
+static const string CLIENT_SID = "BNCH";
+static const string MARKER_SID = "LOAD";
+
+static const int POLL_TIMEOUT = 100;
+
+SimHub::SimHub(Protocol protocol, const TTHValue& markerTTH, SimHubListener* listener) :
+	protocol(protocol), markerTTH(markerTTH), listener(listener), separator(protocol == PROTO_NMDC ? '|' : '\n'),
+	port(0), sock(nullptr), loggedIn(false), failed(false), markersSent(0), markersReceived(0), resultCount(0)
+{
+}
+
+SimHub::~SimHub()
+{
+	close();
+}
+
+bool SimHub::listen()
+{
+	IpAddressEx ip;
+	Util::parseIpAddress(ip, string("127.0.0.1"));
+	try
+	{
+		listenSock.create(AF_INET, Socket::TYPE_TCP);
+		listenSock.setSocketOpt(SOL_SOCKET, SO_REUSEADDR, 1);
+		port = listenSock.bind(0, ip);
+		listenSock.listen();
+	}
+	catch (const Exception& e)
+	{
+		fprintf(stderr, "Hub: %s\n", e.getError().c_str());
+		return false;
+	}
+	return true;
+}
+
+string SimHub::getUrl() const
+{
+	return (protocol == PROTO_NMDC ? "dchub://127.0.0.1:" : "adc://127.0.0.1:") + Util::toString(port);
+}
+
+bool SimHub::waitLogin(const StringList& users, int timeout)
+{
+	const uint64_t deadline = GET_TICK() + timeout;
+	loginUsers = users;
+	try
+	{
+		while (!(listenSock.wait(POLL_TIMEOUT, Socket::WAIT_ACCEPT) & Socket::WAIT_ACCEPT))
+			if (GET_TICK() > deadline)
+			{
+				fprintf(stderr, "Hub: the client did not connect\n");
+				return false;
+			}
+		unique_ptr<Socket> newSock(new Socket);
+		uint16_t remotePort = newSock->accept(listenSock);
+		sock = BufferedSocket::getBufferedSocket(separator, this);
+		sock->addAcceptedSocket(std::move(newSock), remotePort);
+		if (protocol == PROTO_NMDC)
+			sock->write("$Lock EXTENDEDPROTOCOLABCABCABCABCABCABC Pk=loadgen|$HubName loadgen|");
+		sock->start();
+	}
+	catch (const Exception& e)
+	{
+		fprintf(stderr, "Hub: %s\n", e.getError().c_str());
+		return false;
+	}
+
+	while (!loggedIn)
+	{
+		if (failed || GET_TICK() > deadline)
+		{
+			fprintf(stderr, "Hub: login was not completed\n");
+			return false;
+		}
+		Thread::sleep(1);
+	}
+	sendMarker();
+	const uint64_t now = GET_TICK();
+	return waitMarkers(now < deadline ? (int) (deadline - now) : 0);
+}
+
+void SimHub::sendLine(const string& line)
+{
+	string data = line;
+	data += separator;
+	sock->write(data);
+}
+
+void SimHub::sendLines(const StringList& lines, size_t start, size_t count, bool withMarker)
+{
+	string data;
+	for (size_t i = start; i < start + count; ++i)
+	{
+		const string& line = lines[i % lines.size()];
+		data += line;
+		data += separator;
+	}
+	if (withMarker)
+		writeMarker(data);
+	else
+		sock->write(data);
+}
+
+void SimHub::sendMarker()
+{
+	string data;
+	writeMarker(data);
+}
+
+// The marker is written with the preceding lines, otherwise a small write can be delayed by the TCP stack
+void SimHub::writeMarker(string& data)
+{
+	if (protocol == PROTO_NMDC)
+		data += "$Search Hub:" + MARKER_NICK + " F?T?0?9?TTH:" + markerTTH.toBase32();
+	else
+		data += "BSCH " + MARKER_SID + " TR" + markerTTH.toBase32() + " TO" + Util::toString(markersSent);
+	data += separator;
+	LOCK(cs);
+	markerTicks.push_back(getMicroTick());
+	++markersSent;
+	sock->write(data);
+}
+
+bool SimHub::waitMarkers(int timeout, uint64_t maxPending)
+{
+	const uint64_t deadline = GET_TICK() + timeout;
+	while (markersSent - markersReceived > maxPending)
+	{
+		if (failed || GET_TICK() > deadline)
+			return false;
+		Thread::sleep(1);
+	}
+	return true;
+}
+
+void SimHub::close()
+{
+	if (sock)
+	{
+		sock->disconnect(true);
+		sock->joinThread();
+		BufferedSocket::destroyBufferedSocket(sock);
+		sock = nullptr;
+	}
+	listenSock.disconnect();
+}
+
+void SimHub::markerReceived()
+{
+	const uint64_t now = getMicroTick();
+	LOCK(cs);
+	if (markerTicks.empty()) return;
+	markerLatency.add(now - markerTicks.front());
+	markerTicks.pop_front();
+	++markersReceived;
+}
+
+void SimHub::sendLoginUsers()
+{
+	string data;
+	for (const string& line : loginUsers)
+	{
+		data += line;
+		data += separator;
+	}
+	if (protocol == PROTO_NMDC)
+		data += "$MyINFO $ALL " + MARKER_NICK + " <++ V:0.868,M:P,H:1/0/0,S:1>$ $100\x01$$0$|";
+	else
+		data += "BINF " + MARKER_SID + " ID" + CID::generate().toBase32() + " NI" + MARKER_NICK + " SS0 SF0 HN1 HR0 HO0 SL1 SUADC0\n";
+	sock->write(data);
+}
+
+void SimHub::onNmdcLine(const string& line)
+{
+	if (line.compare(0, 4, "$SR ") == 0)
+	{
+		// Passive results end with 0x05 and the nick of the user who searched
+		const string::size_type pos = line.rfind('\x05');
+		if (pos != string::npos && line.compare(pos + 1, string::npos, MARKER_NICK) == 0)
+			markerReceived();
+		else
+			++resultCount;
+	}
+	else if (line.compare(0, 13, "$ConnectToMe ") == 0)
+	{
+		const string::size_type i = line.find(' ', 13);
+		if (i == string::npos || !listener) return;
+		const string::size_type j = line.rfind(':');
+		if (j == string::npos || j < i) return;
+		listener->onConnectToMe(line.substr(13, i - 13), line.substr(i + 1, j - i - 1), (uint16_t) Util::toInt(line.c_str() + j + 1));
+	}
+	else if (line.compare(0, 14, "$ValidateNick ") == 0)
+		sock->write("$Hello " + line.substr(14) + '|');
+	else if (!loggedIn && line.compare(0, 14 + CLIENT_NICK.length(), "$MyINFO $ALL " + CLIENT_NICK + ' ') == 0)
+	{
+		sendLoginUsers();
+		loggedIn = true;
+	}
+}
+
+void SimHub::onAdcLine(const string& line)
+{
+	if (line.compare(0, 10, "DRES " + CLIENT_SID + ' ') == 0)
+	{
+		if (line.compare(10, 5, MARKER_SID + ' ') == 0)
+			markerReceived();
+		else
+			++resultCount;
+	}
+	else if (line.compare(0, 5, "HSUP ") == 0)
+		sock->write("ISUP ADBASE ADTIGR\nISID " + CLIENT_SID + "\nIINF CT32 NIloadgen\n");
+	else if (line.compare(0, 10, "BINF " + CLIENT_SID + ' ') == 0)
+	{
+		// The core is logged in when the hub sends its INF back
+		sock->write(line + '\n');
+		if (!loggedIn)
+		{
+			sendLoginUsers();
+			loggedIn = true;
+		}
+	}
+}
+
+void SimHub::onDataLine(const char* buf, size_t len) noexcept
+{
+	if (!len) return;
+	const string line(buf, len);
+	if (protocol == PROTO_NMDC)
+		onNmdcLine(line);
+	else
+		onAdcLine(line);
+}
+
+void SimHub::onFailed(const string&) noexcept
+{
+	failed = true;
+}
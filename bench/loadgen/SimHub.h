@@ -0,0 +1,90 @@
+#ifndef SIM_HUB_H_
+#define SIM_HUB_H_
+
+#include "BufferedSocket.h"
+#include "HashValue.h"
+#include "LoadStats.h"
+#include <atomic>
+#include <deque>
+
+class SimHubListener
+{
+	public:
+		virtual ~SimHubListener() {}
+		// The core asked a user to connect to it
+		virtual void onConnectToMe(const string& nick, const string& address, uint16_t port) noexcept = 0;
+};
+
+// A hub on the loopback interface with the core as its only real client.
+// Lines from the core are parsed only as far as the scenarios need: login, results for the marker user and $ConnectToMe.
+// The marker user searches for a shared TTH; since the core handles hub lines in order,
+// its result proves that every line sent before the search has been processed.
+class SimHub : private BufferedSocketListener
+{
+	public:
+		enum Protocol
+		{
+			PROTO_NMDC,
+			PROTO_ADC
+		};
+
+		static const string CLIENT_NICK;
+		static const string MARKER_NICK;
+
+		SimHub(Protocol protocol, const TTHValue& markerTTH, SimHubListener* listener = nullptr);
+		~SimHub();
+
+		SimHub(const SimHub&) = delete;
+		SimHub& operator= (const SimHub&) = delete;
+
+		Protocol getProtocol() const { return protocol; }
+		const char* getProtocolName() const { return protocol == PROTO_NMDC ? "nmdc" : "adc"; }
+		bool listen();
+		string getUrl() const;
+
+		// Accepts the connection of the core and sends users after the login, returns when the core has processed them
+		bool waitLogin(const StringList& users, int timeout);
+		void sendLine(const string& line);
+		// Lines are written as one block, indexes wrap around
+		void sendLines(const StringList& lines, size_t start, size_t count, bool withMarker = false);
+		void sendMarker();
+		// Waits until no more than maxPending markers are unanswered
+		bool waitMarkers(int timeout, uint64_t maxPending = 0);
+		void close();
+
+		LatencySamples& getMarkerLatency() { return markerLatency; }
+		uint64_t getResultCount() const { return resultCount; }
+		uint64_t getMarkersSent() const { return markersSent; }
+		uint64_t getMarkersReceived() const { return markersReceived; }
+		bool isFailed() const { return failed; }
+
+	private:
+		const Protocol protocol;
+		const TTHValue markerTTH;
+		SimHubListener* const listener;
+		const char separator;
+		Socket listenSock;
+		uint16_t port;
+		BufferedSocket* sock;
+		StringList loginUsers;
+		std::atomic_bool loggedIn;
+		std::atomic_bool failed;
+
+		CriticalSection cs;
+		std::deque<uint64_t> markerTicks;
+		std::atomic<uint64_t> markersSent;
+		std::atomic<uint64_t> markersReceived;
+		std::atomic<uint64_t> resultCount;
+		LatencySamples markerLatency;
+
+		void writeMarker(string& data);
+		void markerReceived();
+		void sendLoginUsers();
+		void onNmdcLine(const string& line);
+		void onAdcLine(const string& line);
+
+		void onDataLine(const char* buf, size_t len) noexcept override;
+		void onFailed(const string&) noexcept override;
+};
+
+#endif // SIM_HUB_H_
@@ -0,0 +1,180 @@
+#include "stdinc.h"
+#include "SimPeer.h"
+#include "BenchCore.h"
+#include "NmdcHub.h"
+#include "StrUtil.h"
+
+SimPeer::SimPeer(unsigned index, Stats* stats) :
+	index(index), nick("peer" + Util::toString(index)), stats(stats), state(STATE_IDLE), sock(nullptr),
+	startTick(0), requestTick(0), segmentIndex(0), fileIndex(0), segmentStart(0), segmentSize(0), received(0), hasSegment(false)
+{
+}
+
+SimPeer::~SimPeer()
+{
+	close();
+}
+
+// Share sizes are different: the core treats users with the same IP and share size as one user
+string SimPeer::getMyInfo() const
+{
+	return "$MyINFO $ALL " + nick + " <++ V:0.868,M:P,H:1/0/0,S:1>$ $100\x01$$" + Util::toString((int64_t) (index + 1) << 30) + '$';
+}
+
+void SimPeer::start(const Task& newTask)
+{
+	LOCK(cs);
+	dcassert(!sock);
+	task = newTask;
+	segmentIndex = 0;
+	hasSegment = false;
+	startTick = getMicroTick();
+	state = STATE_CONNECTING;
+}
+
+void SimPeer::connect(const string& address, uint16_t port)
+{
+	LOCK(cs);
+	if (state != STATE_CONNECTING || sock) return;
+	sock = BufferedSocket::getBufferedSocket('|', this);
+	try
+	{
+		sock->connect(address, port, false, true, false, Socket::PROTO_NMDC);
+		sock->start();
+	}
+	catch (const Exception&)
+	{
+		BufferedSocket::destroyBufferedSocket(sock);
+		sock = nullptr;
+		++stats->errors;
+		state = STATE_FAILED;
+	}
+}
+
+void SimPeer::close()
+{
+	BufferedSocket* s;
+	{
+		LOCK(cs);
+		s = sock;
+		state = STATE_IDLE;
+	}
+	if (!s) return;
+	s->disconnect(true);
+	s->joinThread();
+	{
+		LOCK(cs);
+		sock = nullptr;
+		state = STATE_IDLE;
+	}
+	BufferedSocket::destroyBufferedSocket(s);
+}
+
+void SimPeer::requestSegment()
+{
+	const auto& files = BenchCore::getTransferFiles();
+	fileIndex = (index + segmentIndex) % files.size();
+	const BenchCore::TransferFile& file = files[fileIndex];
+	const int64_t fileSize = file.data.length();
+	const int64_t segmentCount = (fileSize + task.segmentSize - 1) / task.segmentSize;
+	segmentStart = (int64_t) (segmentIndex / files.size() % segmentCount) * task.segmentSize;
+	segmentSize = std::min(task.segmentSize, fileSize - segmentStart);
+	received = 0;
+	state = STATE_REQUEST;
+	requestTick = getMicroTick();
+	sock->write("$ADCGET file TTH/" + file.root.toBase32() + ' ' + Util::toString(segmentStart) + ' ' + Util::toString(segmentSize) + '|');
+}
+
+void SimPeer::fail()
+{
+	const int prevState = state.exchange(STATE_FAILED);
+	if (prevState == STATE_DONE || prevState == STATE_FAILED || prevState == STATE_IDLE)
+	{
+		state = prevState;
+		return;
+	}
+	++stats->errors;
+	sock->disconnect(true);
+}
+
+void SimPeer::onConnected() noexcept
+{
+	state = STATE_HANDSHAKE;
+	sock->write("$MyNick " + nick + "|$Lock EXTENDEDPROTOCOLABCABCABCABCABCABC Pk=loadgen|");
+}
+
+void SimPeer::onDataLine(const char* buf, size_t len) noexcept
+{
+	if (len < 2 || buf[0] != '$') return;
+	const string line(buf, len);
+	if (line.compare(0, 6, "$Lock ") == 0)
+	{
+		if (state != STATE_HANDSHAKE) return;
+		const string lock = line.substr(6, line.find(' ', 6) - 6);
+		sock->write("$Supports ADCGet TTHF MiniSlots|$Direction Download " + Util::toString(index + 1) +
+			"|$Key " + NmdcHub::makeKeyFromLock(lock) + '|');
+	}
+	else if (line.compare(0, 5, "$Key ") == 0)
+	{
+		if (state != STATE_HANDSHAKE) return;
+		stats->connectLatency.add(getMicroTick() - startTick);
+		requestSegment();
+	}
+	else if (line.compare(0, 8, "$ADCSND ") == 0)
+	{
+		if (state != STATE_REQUEST) return;
+		// $ADCSND file TTH/<root> <start> <bytes>
+		const string::size_type i = line.rfind(' ');
+		const string::size_type j = line.rfind(' ', i - 1);
+		if (Util::toInt64(line.c_str() + j + 1) != segmentStart || Util::toInt64(line.c_str() + i + 1) != segmentSize)
+		{
+			fail();
+			return;
+		}
+		state = STATE_DATA;
+		sock->setDataMode(segmentSize);
+	}
+	else if (line.compare(0, 9, "$MaxedOut") == 0 || line.compare(0, 7, "$Error ") == 0 || line.compare(0, 8, "$Failed ") == 0)
+		fail();
+}
+
+void SimPeer::onData(const uint8_t* data, size_t len)
+{
+	if (state != STATE_DATA) return;
+	const string& fileData = BenchCore::getTransferFiles()[fileIndex].data;
+	if (received + (int64_t) len > segmentSize || memcmp(data, fileData.data() + segmentStart + received, len))
+	{
+		fail();
+		return;
+	}
+	received += len;
+}
+
+void SimPeer::onModeChange() noexcept
+{
+	if (state != STATE_DATA) return;
+	if (received != segmentSize)
+	{
+		fail();
+		return;
+	}
+	const uint64_t now = getMicroTick();
+	stats->segmentLatency.add(now - requestTick);
+	stats->bytes += segmentSize;
+	++stats->segments;
+	if (!hasSegment)
+	{
+		stats->firstSegmentLatency.add(now - startTick);
+		hasSegment = true;
+	}
+	++segmentIndex;
+	if ((task.maxSegments && segmentIndex >= task.maxSegments) || (task.deadline && now >= task.deadline))
+		state = STATE_DONE;
+	else
+		requestSegment();
+}
+
+void SimPeer::onFailed(const string&) noexcept
+{
+	fail();
+}
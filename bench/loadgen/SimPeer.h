@@ -0,0 +1,96 @@
+#ifndef SIM_PEER_H_
+#define SIM_PEER_H_
+
+#include "BufferedSocket.h"
+#include "LoadStats.h"
+#include <atomic>
+
+// A passive NMDC user downloading from the core. It connects when the core sends $ConnectToMe through the hub,
+// completes the handshake and requests segments of the transfer files with $ADCGET until its task is done.
+// Received data is compared with the files.
+class SimPeer : private BufferedSocketListener
+{
+	public:
+		enum State
+		{
+			STATE_IDLE,
+			STATE_CONNECTING,
+			STATE_HANDSHAKE,
+			STATE_REQUEST,
+			STATE_DATA,
+			STATE_DONE,
+			STATE_FAILED
+		};
+
+		// Shared by all peers of a scenario, latencies are measured from the moment the peer is started
+		struct Stats
+		{
+			LatencySamples connectLatency;
+			LatencySamples firstSegmentLatency;
+			LatencySamples segmentLatency;
+			std::atomic<uint64_t> bytes{0};
+			std::atomic<uint64_t> segments{0};
+			std::atomic<uint64_t> errors{0};
+
+			void clear()
+			{
+				connectLatency.clear();
+				firstSegmentLatency.clear();
+				segmentLatency.clear();
+				bytes = segments = errors = 0;
+			}
+		};
+
+		struct Task
+		{
+			int64_t segmentSize = 0;
+			unsigned maxSegments = 0; // 0 means no limit
+			uint64_t deadline = 0; // from getMicroTick, no new segments are requested after it
+		};
+
+		SimPeer(unsigned index, Stats* stats);
+		~SimPeer();
+
+		SimPeer(const SimPeer&) = delete;
+		SimPeer& operator= (const SimPeer&) = delete;
+
+		const string& getNick() const { return nick; }
+		string getMyInfo() const;
+		State getState() const { return (State) state.load(); }
+		bool isFinished() const { return state == STATE_DONE || state == STATE_FAILED; }
+
+		// Must be called before $RevConnectToMe is sent to the core
+		void start(const Task& newTask);
+		// Called from the hub thread
+		void connect(const string& address, uint16_t port);
+		void close();
+
+	private:
+		const unsigned index;
+		const string nick;
+		Stats* const stats;
+		Task task;
+		std::atomic<int> state;
+		CriticalSection cs;
+		BufferedSocket* sock;
+
+		uint64_t startTick;
+		uint64_t requestTick;
+		unsigned segmentIndex;
+		size_t fileIndex;
+		int64_t segmentStart;
+		int64_t segmentSize;
+		int64_t received;
+		bool hasSegment;
+
+		void requestSegment();
+		void fail();
+
+		void onConnected() noexcept override;
+		void onDataLine(const char* buf, size_t len) noexcept override;
+		void onData(const uint8_t* data, size_t len) override;
+		void onModeChange() noexcept override;
+		void onFailed(const string&) noexcept override;
+};
+
+#endif // SIM_PEER_H_
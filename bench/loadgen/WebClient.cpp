@@ -0,0 +1,208 @@
+#include "stdinc.h"
+#include "WebClient.h"
+#include "HttpMessage.h"
+#include "HttpHeaders.h"
+#include "TimeUtil.h"
+#include "StrUtil.h"
+#include "UriUtil.h"
+#include "Text.h"
+
+static const size_t READ_BUFFER_SIZE = 64 * 1024;
+
+bool WebClient::signIn(const string& user, const string& password, int timeout)
+{
+	const string body = "user=" + Util::encodeUriQuery(user) + "&password=" + Util::encodeUriQuery(password);
+	Http::Request req;
+	req.setMethodId(Http::METHOD_POST);
+	req.setUri("/signin");
+	req.setVersion(1, 1);
+	req.addHeader(Http::HEADER_HOST, "127.0.0.1");
+	req.addHeader(Http::HEADER_CONTENT_TYPE, "application/x-www-form-urlencoded");
+	req.addHeader(Http::HEADER_CONTENT_LENGTH, Util::toString(body.length()));
+	string data;
+	req.print(data);
+	data += body;
+
+	Result result;
+	if (!sendRequest(data, result, GET_TICK() + timeout)) return false;
+	if (authCookie.empty())
+	{
+		error = "Sign in failed, status " + Util::toString(result.status);
+		return false;
+	}
+	return true;
+}
+
+bool WebClient::request(const string& uri, const StringPairList& headers, Result& result, int timeout)
+{
+	Http::Request req;
+	req.setMethodId(Http::METHOD_GET);
+	req.setUri(uri);
+	req.setVersion(1, 1);
+	req.addHeader(Http::HEADER_HOST, "127.0.0.1");
+	for (const auto& header : headers)
+		req.addHeader(header.first, header.second);
+	if (!authCookie.empty())
+		req.addHeader(Http::HEADER_COOKIE, "auth=" + authCookie);
+	string data;
+	req.print(data);
+	return sendRequest(data, result, GET_TICK() + timeout);
+}
+
+void WebClient::close()
+{
+	sock.disconnect();
+	connected = false;
+	buf.clear();
+}
+
+bool WebClient::sendRequest(const string& data, Result& result, uint64_t deadline)
+{
+	error.clear();
+	try
+	{
+		// A kept connection may have been closed by the server, the request is sent once more on a new one
+		for (int attempt = 0; attempt < 2; ++attempt)
+		{
+			const bool reused = connected;
+			if (!connected && !connect(deadline)) return false;
+			if (!writeData(data, deadline)) return false;
+			if (readResponse(result, deadline)) return true;
+			if (!reused || connected) return false;
+		}
+	}
+	catch (const Exception& e)
+	{
+		error = e.getError();
+		close();
+	}
+	return false;
+}
+
+bool WebClient::connect(uint64_t deadline)
+{
+	close();
+	sock.connect("127.0.0.1", port);
+	const uint64_t now = GET_TICK();
+	if (now >= deadline || !sock.waitConnected((unsigned) (deadline - now)))
+	{
+		error = "Connection timeout";
+		close();
+		return false;
+	}
+	connected = true;
+	++connects;
+	return true;
+}
+
+bool WebClient::writeData(const string& data, uint64_t deadline)
+{
+	size_t pos = 0;
+	while (pos < data.length())
+	{
+		const int len = sock.write(data.data() + pos, (int) (data.length() - pos));
+		if (len > 0)
+		{
+			pos += len;
+			continue;
+		}
+		const uint64_t now = GET_TICK();
+		if (now >= deadline || !(sock.wait((int) (deadline - now), Socket::WAIT_WRITE) & Socket::WAIT_WRITE))
+		{
+			error = "Write timeout";
+			close();
+			return false;
+		}
+	}
+	return true;
+}
+
+bool WebClient::readData(uint64_t deadline)
+{
+	char tmp[READ_BUFFER_SIZE];
+	while (true)
+	{
+		const int len = sock.read(tmp, sizeof(tmp));
+		if (len > 0)
+		{
+			buf.append(tmp, len);
+			return true;
+		}
+		if (len == 0)
+		{
+			error = "Connection closed";
+			close();
+			return false;
+		}
+		const uint64_t now = GET_TICK();
+		if (now >= deadline || !(sock.wait((int) (deadline - now), Socket::WAIT_READ) & Socket::WAIT_READ))
+		{
+			error = "Read timeout";
+			close();
+			return false;
+		}
+	}
+}
+
+bool WebClient::readResponse(Result& result, uint64_t deadline)
+{
+	Http::Response resp;
+	size_t pos = 0;
+	while (!resp.isComplete())
+	{
+		const auto end = buf.find('\n', pos);
+		if (end == string::npos)
+		{
+			buf.erase(0, pos);
+			pos = 0;
+			if (!readData(deadline)) return false;
+			continue;
+		}
+		string line = buf.substr(pos, end - pos);
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		pos = end + 1;
+		if (!resp.parseLine(line) && !resp.isComplete())
+		{
+			error = "Bad response header";
+			close();
+			return false;
+		}
+	}
+	buf.erase(0, pos);
+
+	result.status = resp.getResponseCode();
+	result.etag = resp.getHeaderValue(Http::HEADER_ETAG);
+	result.encoding = resp.getHeaderValue(Http::HEADER_CONTENT_ENCODING);
+	int64_t length = 0;
+	if (result.status != 304 && result.status != 204)
+	{
+		length = resp.parseContentLength();
+		if (length < 0)
+		{
+			error = "No Content-Length in response";
+			close();
+			return false;
+		}
+	}
+	result.bodySize = length;
+
+	// The body is only counted
+	while (length > 0)
+	{
+		if (buf.empty() && !readData(deadline)) return false;
+		const size_t len = (size_t) std::min<int64_t>(length, buf.length());
+		buf.erase(0, len);
+		length -= len;
+	}
+
+	for (int index = resp.findHeader(Http::HEADER_SET_COOKIE); index != -1; index = resp.findHeader(Http::HEADER_SET_COOKIE, index + 1))
+	{
+		const string& value = resp.at(index);
+		if (value.compare(0, 5, "auth=") != 0) continue;
+		const auto end = value.find(';');
+		authCookie = value.substr(5, end == string::npos ? string::npos : end - 5);
+	}
+	if (Text::isAsciiPrefix2(resp.getHeaderValue(Http::HEADER_CONNECTION), string("close")))
+		close();
+	return true;
+}
@@ -0,0 +1,50 @@
+#ifndef WEB_CLIENT_H_
+#define WEB_CLIENT_H_
+
+#include "Socket.h"
+
+// HTTP/1.1 client for the embedded web server. Requests are sent one at a time over a keep-alive connection,
+// which is opened again when the server closes it. The auth cookie is taken from every response:
+// the server changes it on each authenticated request.
+class WebClient
+{
+	public:
+		struct Result
+		{
+			int status = 0;
+			string etag;
+			string encoding;
+			int64_t bodySize = 0;
+		};
+
+		explicit WebClient(uint16_t port) : port(port), connected(false), connects(0) {}
+
+		WebClient(const WebClient&) = delete;
+		WebClient& operator= (const WebClient&) = delete;
+
+		bool signIn(const string& user, const string& password, int timeout);
+		// Returns false on socket errors, timeouts and malformed responses
+		bool request(const string& uri, const StringPairList& headers, Result& result, int timeout);
+		void close();
+
+		const string& getError() const { return error; }
+		unsigned getConnectCount() const { return connects; }
+		bool hasAuthCookie() const { return !authCookie.empty(); }
+
+	private:
+		const uint16_t port;
+		Socket sock;
+		bool connected;
+		unsigned connects;
+		string buf;
+		string authCookie;
+		string error;
+
+		bool sendRequest(const string& data, Result& result, uint64_t deadline);
+		bool connect(uint64_t deadline);
+		bool writeData(const string& data, uint64_t deadline);
+		bool readData(uint64_t deadline);
+		bool readResponse(Result& result, uint64_t deadline);
+};
+
+#endif // WEB_CLIENT_H_
@@ -0,0 +1,148 @@
+// Load generator for the client core. A simulated hub and simulated peers talk to the core over the loopback
+// interface: the hub replays the synthetic traffic of the benchmark dataset, the peers connect and download shared files.
+
+#include "stdinc.h"
+#include "Scenarios.h"
+#include "BenchCore.h"
+#include "Metrics.h"
+#include "File.h"
+#include "StrUtil.h"
+#include "StringTokenizer.h"
+
+#include <signal.h>
+
+static void printUsage(const char* name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --protocol nmdc|adc|all     Hub protocol (default: all)\n"
+		"  --scenario <list>           Comma separated: search, churn, storm, transfer, web (default: all)\n"
+		"  --lines <n>                 Hub lines sent by the search and churn scenarios (default: 5000)\n"
+		"  --rate <n>                  Hub lines per second, 0 for no limit (default: 0)\n"
+		"  --peers <n>                 Peers connecting in each storm round (default: 100)\n"
+		"  --rounds <n>                Connection storm rounds (default: 3)\n"
+		"  --downloaders <n>           Peers downloading at the same time (default: 8)\n"
+		"  --segment-size <KiB>        Segment size of the transfers (default: 1024)\n"
+		"  --duration <seconds>        Duration of the transfers (default: 10)\n"
+		"  --requests <n>              Web server requests of each type (default: 500)\n"
+		"  --queue-items <n>           Download queue size for the web server scenario (default: 5000)\n"
+		"  --metrics <file>            Write the core metrics to a file\n"
+		"  --verbose                   Print progress\n"
+		"Storm and transfer scenarios are run on NMDC only, the web scenario runs without a hub.\n", name);
+}
+
+static bool parseScenarios(const string& s, int& scenarios)
+{
+	scenarios = 0;
+	const StringTokenizer<string> st(s, ',');
+	for (const string& name : st.getTokens())
+	{
+		if (name == "search")
+			scenarios |= LoadOptions::SCENARIO_SEARCH;
+		else if (name == "churn")
+			scenarios |= LoadOptions::SCENARIO_CHURN;
+		else if (name == "storm")
+			scenarios |= LoadOptions::SCENARIO_STORM;
+		else if (name == "transfer")
+			scenarios |= LoadOptions::SCENARIO_TRANSFER;
+		else if (name == "web")
+			scenarios |= LoadOptions::SCENARIO_WEB;
+		else if (name == "all")
+			scenarios |= LoadOptions::SCENARIO_ALL;
+		else
+			return false;
+	}
+	return scenarios != 0;
+}
+
+int main(int argc, char* argv[])
+{
+	LoadOptions options;
+	string metricsPath;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(arg, "--protocol") && hasValue)
+		{
+			const string value = argv[++i];
+			options.nmdc = value == "nmdc" || value == "all";
+			options.adc = value == "adc" || value == "all";
+			if (!options.nmdc && !options.adc)
+			{
+				printUsage(argv[0]);
+				return 2;
+			}
+		}
+		else if (!strcmp(arg, "--scenario") && hasValue)
+		{
+			if (!parseScenarios(argv[++i], options.scenarios))
+			{
+				printUsage(argv[0]);
+				return 2;
+			}
+		}
+		else if (!strcmp(arg, "--lines") && hasValue)
+			options.lines = Util::toInt(argv[++i]);
+		else if (!strcmp(arg, "--rate") && hasValue)
+			options.rate = Util::toInt(argv[++i]);
+		else if (!strcmp(arg, "--peers") && hasValue)
+			options.peers = Util::toInt(argv[++i]);
+		else if (!strcmp(arg, "--rounds") && hasValue)
+			options.rounds = Util::toInt(argv[++i]);
+		else if (!strcmp(arg, "--downloaders") && hasValue)
+			options.downloaders = Util::toInt(argv[++i]);
+		else if (!strcmp(arg, "--segment-size") && hasValue)
+			options.segmentSize = Util::toInt64(argv[++i]) * 1024;
+		else if (!strcmp(arg, "--duration") && hasValue)
+			options.duration = Util::toInt(argv[++i]);
+		else if (!strcmp(arg, "--requests") && hasValue)
+			options.webRequests = Util::toInt(argv[++i]);
+		else if (!strcmp(arg, "--queue-items") && hasValue)
+			options.queueItems = Util::toInt(argv[++i]);
+		else if (!strcmp(arg, "--metrics") && hasValue)
+			metricsPath = argv[++i];
+		else if (!strcmp(arg, "--verbose"))
+			options.verbose = true;
+		else
+		{
+			printUsage(argv[0]);
+			return 2;
+		}
+	}
+	if (!options.lines || !options.peers || !options.rounds || !options.downloaders || options.segmentSize <= 0 || !options.duration ||
+	    !options.webRequests)
+	{
+		printUsage(argv[0]);
+		return 2;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	if (!BenchCore::startup(options.verbose, true))
+		return 1;
+
+	vector<ScenarioResult> results;
+	runScenarios(options, results);
+	printReport(stdout, results);
+
+	if (!metricsPath.empty())
+	{
+		string metrics;
+		Metrics::print(metrics);
+		try
+		{
+			File f(metricsPath, File::WRITE, File::CREATE | File::TRUNCATE);
+			f.write(metrics);
+		}
+		catch (const FileException& e)
+		{
+			fprintf(stderr, "Can't write metrics to %s: %s\n", metricsPath.c_str(), e.getError().c_str());
+		}
+	}
+
+	BenchCore::shutdown();
+
+	for (const ScenarioResult& r : results)
+		if (r.errors) return 1;
+	return 0;
+}
@@ -0,0 +1,56 @@
+// Benchmarks of the core hot paths. All data is synthetic and generated with a fixed seed,
+// the benchmarks that need the managers run against a core started in a temporary profile.
+
+#include "stdinc.h"
+#include "DataGenerator.h"
+#include "BenchCore.h"
+
+#include <benchmark/benchmark.h>
+#include <signal.h>
+
+static void printUsage(const char* name)
+{
+	fprintf(stderr,
+		"Usage: %s [benchmark options] [options]\n"
+		"  --dump-dataset <dir>  Write the dataset to a directory and exit\n"
+		"  --verbose             Print core startup progress\n", name);
+}
+
+int main(int argc, char* argv[])
+{
+	benchmark::Initialize(&argc, argv);
+
+	string dumpPath;
+	bool verbose = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		if (!strcmp(arg, "--dump-dataset") && i + 1 < argc)
+			dumpPath = argv[++i];
+		else if (!strcmp(arg, "--verbose"))
+			verbose = true;
+		else
+		{
+			printUsage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (!dumpPath.empty())
+	{
+		if (!Dataset::write(dumpPath))
+		{
+			fprintf(stderr, "Can't write dataset to %s\n", dumpPath.c_str());
+			return 1;
+		}
+		return 0;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	if (!BenchCore::startup(verbose))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	BenchCore::shutdown();
+	return 0;
+}
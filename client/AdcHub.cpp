@@ -258,6 +258,7 @@ void AdcHub::handle(AdcCommand::INF, const AdcCommand& c) noexcept
 	auto& id = ou->getIdentity();
 	string ip4;
 	string ip6;
+	bool nickChanged = false;
 	for (auto i = c.getParameters().cbegin(); i != c.getParameters().cend(); ++i)
 	{
 		if (i->length() < 2)
@@ -376,6 +377,7 @@ void AdcHub::handle(AdcCommand::INF, const AdcCommand& c) noexcept
 			case TAG('N', 'I'):
 			{
 				id.setNick(i->substr(2));
+				nickChanged = true;
 				break;
 			}
 			case TAG('A', 'W'):
@@ -401,6 +403,8 @@ void AdcHub::handle(AdcCommand::INF, const AdcCommand& c) noexcept
 			}
 		}
 	}
+	if (nickChanged)
+		ClientManager::updateNickIndex(ou);
 	if (!ip4.empty())
 	{
 		Ip4Address ip;
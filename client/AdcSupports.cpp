@@ -37,6 +37,7 @@ const string AdcSupports::NAT0_FEATURE("NAT0");
 const string AdcSupports::SEGA_FEATURE("SEGA");
 const string AdcSupports::CCPM_FEATURE("CCPM");
 const string AdcSupports::SUD1_FEATURE("SUD1");
+const string AdcSupports::DHTB_FEATURE("DHTB"); // DHT: several files in one PUB command
 const string AdcSupports::BASE_SUPPORT("ADBASE");
 const string AdcSupports::BAS0_SUPPORT("ADBAS0");
 const string AdcSupports::TIGR_SUPPORT("ADTIGR");
@@ -81,6 +82,7 @@ string AdcSupports::getSupports(const Identity& id)
 #define CHECK_FEAT(feat) if (su & feat##_FEATURE_BIT) { tmp += feat##_FEATURE + ' '; }
 
 	CHECK_FEAT(SEGA);
+	CHECK_FEAT(DHTB);
 
 #undef CHECK_FEAT
 
@@ -107,7 +109,8 @@ void AdcSupports::setSupports(Identity& id, const StringList& su, const string&
 		CHECK_FEAT(ADCS) else
 		CHECK_FEAT(NAT0) else
 		CHECK_FEAT(CCPM) else
-		CHECK_SUP_BIT(SEGA)
+		CHECK_SUP_BIT(SEGA) else
+		CHECK_SUP_BIT(DHTB)
 
 #ifdef BL_FEATURE_COLLECT_UNKNOWN_FEATURES
 		else
@@ -36,6 +36,7 @@ class AdcSupports
 		static const string SEGA_FEATURE;
 		static const string CCPM_FEATURE;
 		static const string SUD1_FEATURE;
+		static const string DHTB_FEATURE;
 		static const string BASE_SUPPORT;
 		static const string BAS0_SUPPORT;
 		static const string TIGR_SUPPORT;
@@ -47,6 +48,7 @@ class AdcSupports
 		enum KnownSupports
 		{
 			SEGA_FEATURE_BIT = 1,
+			DHTB_FEATURE_BIT = 2
 		};
 
 		static string getSupports(const Identity& id);
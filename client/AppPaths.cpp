@@ -21,6 +21,7 @@
 
 // In local mode, all config and temp files are kept in the same dir as the executable
 static bool localMode;
+static string userConfigPath;
 
 string Util::paths[Util::PATH_LAST];
 string Util::sysPaths[Util::SYS_PATH_LAST];
@@ -208,6 +209,8 @@ void Util::initAppPaths()
 #else // USE_APPDATA
 	paths[PATH_USER_CONFIG] = paths[PATH_GLOBAL_CONFIG] + "Settings" PATH_SEPARATOR_STR;
 #endif //USE_APPDATA
+	if (!userConfigPath.empty())
+		paths[PATH_USER_CONFIG] = userConfigPath;
 	paths[PATH_LANGUAGES] = paths[PATH_GLOBAL_CONFIG] + "Lang" PATH_SEPARATOR_STR;
 	paths[PATH_THEMES] = paths[PATH_GLOBAL_CONFIG] + "Themes" PATH_SEPARATOR_STR;
 	paths[PATH_SOUNDS] = paths[PATH_GLOBAL_CONFIG] + "Sounds" PATH_SEPARATOR_STR;
@@ -244,6 +247,12 @@ void Util::initAppPaths()
 	File::ensureDirectory(getTempPath());
 }
 
+void Util::setUserConfigPath(const string& path)
+{
+	userConfigPath = path;
+	appendPathSeparator(userConfigPath);
+}
+
 bool Util::isLocalMode()
 {
 	return localMode;
@@ -59,6 +59,8 @@ namespace Util
 	extern string sysPaths[SYS_PATH_LAST];
 
 	void initAppPaths();
+	// Overrides the per-user configuration path, must be called before initAppPaths
+	void setUserConfigPath(const string& path);
 	bool isLocalMode();
 
 	// Path of temporary storage
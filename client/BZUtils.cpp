@@ -20,6 +20,7 @@
 #include "BZUtils.h"
 #include "Exception.h"
 #include "ResourceManager.h"
+#include "BaseStreams.h"
 
 BZFilter::BZFilter()
 {
@@ -105,6 +106,108 @@ bool UnBZFilter::operator()(const void* in, size_t& insize, void* out, size_t& o
 	return err == BZ_OK;
 }
 
+static const uint64_t BZ_BLOCK_MAGIC = 0x314159265359ull;
+static const uint64_t BZ_EOS_MAGIC = 0x177245385090ull;
+static const size_t BZ_HEADER_BITS = 32;
+
+static uint64_t getBits(const uint8_t* data, uint64_t pos, int count)
+{
+	uint64_t result = 0;
+	for (int i = 0; i < count; ++i, ++pos)
+		result = result << 1 | ((data[pos >> 3] >> (7 - (pos & 7))) & 1);
+	return result;
+}
+
+void BZBlock::compress(const void* in, size_t size)
+{
+	dcassert(size && size <= MAX_INPUT_SIZE);
+	ByteVector out(size + size / 100 + 600);
+	unsigned outSize = (unsigned) out.size();
+	if (BZ2_bzBuffToBuffCompress((char*) out.data(), &outSize, (char*) in, (unsigned) size, 9, 0, 30) != BZ_OK || outSize < 24)
+		throw Exception(STRING(COMPRESSION_ERROR));
+
+	// Stream layout: "BZh9", block magic, block CRC, block data,
+	// end of stream magic, combined CRC (the same as block CRC) and padding
+	const uint8_t* p = out.data();
+	if (getBits(p, BZ_HEADER_BITS, 48) != BZ_BLOCK_MAGIC)
+		throw Exception(STRING(COMPRESSION_ERROR));
+	crc = (uint32_t) getBits(p, BZ_HEADER_BITS + 48, 32);
+	const uint64_t totalBits = (uint64_t) outSize << 3;
+	uint64_t end = 0;
+	for (int pad = 0; pad < 8; ++pad)
+	{
+		uint64_t pos = totalBits - pad - 80;
+		if (getBits(p, pos, 48) == BZ_EOS_MAGIC && getBits(p, pos + 48, 32) == crc && getBits(p, pos + 80, pad) == 0)
+		{
+			end = pos;
+			break;
+		}
+	}
+	if (!end)
+		throw Exception(STRING(COMPRESSION_ERROR));
+	bits = end - BZ_HEADER_BITS;
+	data.assign(p + BZ_HEADER_BITS / 8, p + (end + 7) / 8);
+}
+
+BZBlockWriter::BZBlockWriter(OutputStream* out) : out(out), bitBuf(0), bitCount(0), combinedCRC(0)
+{
+	buf.reserve(64 * 1024);
+	static const uint8_t header[] = { 'B', 'Z', 'h', '9' };
+	buf.insert(buf.end(), header, header + sizeof(header));
+}
+
+void BZBlockWriter::putBits(uint32_t value, int count)
+{
+	dcassert(count <= 32);
+	bitBuf = bitBuf << count | (value & (uint32_t) ((1ull << count) - 1));
+	bitCount += count;
+	while (bitCount >= 8)
+	{
+		bitCount -= 8;
+		buf.push_back((uint8_t) (bitBuf >> bitCount));
+	}
+}
+
+void BZBlockWriter::flushBuf(bool force)
+{
+	if (buf.empty() || (!force && buf.size() < 64 * 1024)) return;
+	out->write(buf.data(), buf.size());
+	buf.clear();
+}
+
+void BZBlockWriter::write(const BZBlock& block)
+{
+	const uint8_t* p = block.data.data();
+	uint64_t fullBytes = block.bits >> 3;
+	if (bitCount == 0)
+	{
+		flushBuf(true);
+		out->write(p, (size_t) fullBytes);
+	}
+	else
+	{
+		for (uint64_t i = 0; i < fullBytes; ++i)
+		{
+			putBits(p[i], 8);
+			flushBuf(false);
+		}
+	}
+	int rest = block.bits & 7;
+	if (rest)
+		putBits(p[fullBytes] >> (8 - rest), rest);
+	combinedCRC = (combinedCRC << 1 | combinedCRC >> 31) ^ block.crc;
+}
+
+void BZBlockWriter::finish()
+{
+	putBits((uint32_t) (BZ_EOS_MAGIC >> 24), 24);
+	putBits((uint32_t) (BZ_EOS_MAGIC & 0xFFFFFF), 24);
+	putBits(combinedCRC, 32);
+	if (bitCount)
+		putBits(0, 8 - bitCount);
+	flushBuf(true);
+}
+
 extern "C" void bz_internal_error(int errcode)
 {
 	dcdebug("bzip2 internal error: %d\n", errcode);
@@ -24,6 +24,9 @@
 #endif
 
 #include <bzlib.h>
+#include "typedefs.h"
+
+class OutputStream;
 
 class BZFilter
 {
@@ -63,4 +66,41 @@ class UnBZFilter
 		bz_stream zs;
 };
 
+/**
+ * A single compressed bzip2 block without the stream header and trailer.
+ * Blocks compressed separately can be joined into one stream by BZBlockWriter,
+ * the result is readable by any bzip2 decoder.
+ */
+struct BZBlock
+{
+	// Guarantees that the input fits in a single 900k block even after the initial RLE
+	static const size_t MAX_INPUT_SIZE = 700000;
+
+	ByteVector data;
+	uint64_t bits = 0;
+	uint32_t crc = 0;
+
+	void compress(const void* in, size_t size);
+};
+
+class BZBlockWriter
+{
+	public:
+		explicit BZBlockWriter(OutputStream* out);
+
+		void write(const BZBlock& block);
+		// Writes the end of stream marker
+		void finish();
+
+	private:
+		OutputStream* const out;
+		ByteVector buf;
+		uint64_t bitBuf;
+		int bitCount;
+		uint32_t combinedCRC;
+
+		void putBits(uint32_t value, int count);
+		void flushBuf(bool force);
+};
+
 #endif // !defined(BZ_UTILS_H_)
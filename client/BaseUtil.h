@@ -64,6 +64,19 @@ namespace Util
 	extern const wstring emptyStringW;		
 	extern const std::vector<uint8_t> emptyByteVector;
 
+	// Number of bits set, the compiler builtin is used where it's available
+	inline size_t countBits(uint64_t x) noexcept
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return (size_t) __builtin_popcountll(x);
+#else
+		x = x - ((x >> 1) & 0x5555555555555555ULL);
+		x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+		x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+		return (size_t) ((x * 0x0101010101010101ULL) >> 56);
+#endif
+	}
+
 	string translateError(unsigned error) noexcept;
 	inline string translateError() noexcept
 	{
@@ -0,0 +1,147 @@
+#ifndef BLOCK_BITMAP_H_
+#define BLOCK_BITMAP_H_
+
+#include "typedefs.h"
+#include "BaseUtil.h"
+#include "debug.h"
+
+/**
+ * Fixed size set of block flags.
+ * The number of set bits is maintained, searches skip whole words.
+ */
+class BlockBitmap
+{
+	public:
+		static const size_t npos = (size_t) -1;
+
+		BlockBitmap() : bitCount(0), setCount(0) {}
+
+		// Clears all bits
+		void resize(size_t count)
+		{
+			bitCount = count;
+			setCount = 0;
+			words.assign((count + 63) / 64, 0);
+		}
+
+		void clear()
+		{
+			std::fill(words.begin(), words.end(), 0);
+			setCount = 0;
+		}
+
+		size_t size() const { return bitCount; }
+		size_t count() const { return setCount; }
+		bool isFull() const { return bitCount && setCount == bitCount; }
+
+		bool get(size_t i) const
+		{
+			dcassert(i < bitCount);
+			return (words[i >> 6] >> (i & 63)) & 1;
+		}
+
+		// Sets bits [first, last), returns the number of bits that were clear
+		size_t set(size_t first, size_t last)
+		{
+			dcassert(last <= bitCount);
+			size_t added = 0;
+			for (size_t i = first; i < last;)
+			{
+				uint64_t mask = getMask(i, last);
+				uint64_t& word = words[i >> 6];
+				added += Util::countBits(mask & ~word);
+				word |= mask;
+				i = (i | 63) + 1;
+			}
+			setCount += added;
+			return added;
+		}
+
+		// Clears bits [first, last), returns the number of bits that were set
+		size_t clear(size_t first, size_t last)
+		{
+			dcassert(last <= bitCount);
+			size_t removed = 0;
+			for (size_t i = first; i < last;)
+			{
+				uint64_t mask = getMask(i, last);
+				uint64_t& word = words[i >> 6];
+				removed += Util::countBits(mask & word);
+				word &= ~mask;
+				i = (i | 63) + 1;
+			}
+			setCount -= removed;
+			return removed;
+		}
+
+		bool anySet(size_t first, size_t last) const
+		{
+			for (size_t i = first; i < last; i = (i | 63) + 1)
+				if (words[i >> 6] & getMask(i, last)) return true;
+			return false;
+		}
+
+		bool allSet(size_t first, size_t last) const
+		{
+			for (size_t i = first; i < last; i = (i | 63) + 1)
+			{
+				uint64_t mask = getMask(i, last);
+				if ((words[i >> 6] & mask) != mask) return false;
+			}
+			return true;
+		}
+
+		// First set bit at or after from, npos if none
+		size_t findSet(size_t from) const { return find(from, 0); }
+
+		// First clear bit at or after from, npos if none
+		size_t findClear(size_t from) const { return find(from, ~(uint64_t) 0); }
+
+		// Last clear bit before the given position, npos if none
+		size_t findLastClear(size_t before) const
+		{
+			while (before)
+			{
+				size_t i = before - 1;
+				uint64_t word = ~words[i >> 6] & getMask(i & ~(size_t) 63, i + 1);
+				if (word)
+				{
+					size_t bit = 63;
+					while (!(word >> bit & 1)) --bit;
+					return (i & ~(size_t) 63) + bit;
+				}
+				before = i & ~(size_t) 63;
+			}
+			return npos;
+		}
+
+	private:
+		// Bits [i, last) of the word containing bit i
+		static uint64_t getMask(size_t i, size_t last)
+		{
+			uint64_t mask = ~(uint64_t) 0 << (i & 63);
+			if ((last >> 6) == (i >> 6)) mask &= ~(~(uint64_t) 0 << (last & 63));
+			return mask;
+		}
+
+		size_t find(size_t from, uint64_t invert) const
+		{
+			for (size_t i = from; i < bitCount; i = (i | 63) + 1)
+			{
+				uint64_t word = (words[i >> 6] ^ invert) & getMask(i, bitCount);
+				if (word)
+				{
+					size_t bit = 0;
+					while (!(word >> bit & 1)) ++bit;
+					return (i & ~(size_t) 63) + bit;
+				}
+			}
+			return npos;
+		}
+
+		size_t bitCount;
+		size_t setCount;
+		vector<uint64_t> words;
+};
+
+#endif // BLOCK_BITMAP_H_
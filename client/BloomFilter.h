@@ -20,19 +20,47 @@
 #define DCPLUSPLUS_DCPP_BLOOM_FILTER_H
 
 #include "typedefs.h"
+#include "BaseUtil.h"
 
+/**
+ * Bloom filter of the N-grams of strings.
+ * The table is split into blocks of one cache line, all bits of an N-gram are in the same block,
+ * so each lookup touches a single cache line. N-gram hashes are computed with a rolling hash.
+ */
 template<size_t N>
 class BloomFilter
 {
 	public:
+		static const size_t BLOCK_WORDS = 8;
+		static const size_t BLOCK_BITS = BLOCK_WORDS * 64;
+		static const unsigned HASH_COUNT = 3; // bits per N-gram
+
 		explicit BloomFilter(size_t tableSize)
 		{
-			table.resize(tableSize);
+			reset(tableSize);
+		}
+
+		// Clears the filter and sets the size in bits, rounded up to whole blocks
+		void reset(size_t tableSize)
+		{
+			blockCount = std::max<size_t>(1, (tableSize + BLOCK_BITS - 1) / BLOCK_BITS);
+			table.assign(blockCount * BLOCK_WORDS, 0);
 		}
-		
+
 		void add(const string& s)
 		{
-			xadd(s, N);
+			if (s.length() < N) return;
+			RollingHash rh(s);
+			do
+			{
+				const uint64_t hash = rh.get();
+				uint64_t* block = table.data() + getBlockIndex(hash) * BLOCK_WORDS;
+				for (unsigned i = 0; i < HASH_COUNT; ++i)
+				{
+					const unsigned bit = getBit(hash, i);
+					block[bit >> 6] |= (uint64_t) 1 << (bit & 63);
+				}
+			} while (rh.next());
 		}
 		bool match(const StringList& s) const
 		{
@@ -45,58 +73,93 @@ class BloomFilter
 		}
 		bool match(const string& s) const
 		{
-			if (s.length() >= N)
+			if (s.length() < N) return true;
+			RollingHash rh(s);
+			do
 			{
-				string::size_type l = s.length() - N;
-				for (string::size_type i = 0; i <= l; ++i)
+				const uint64_t hash = rh.get();
+				const uint64_t* block = table.data() + getBlockIndex(hash) * BLOCK_WORDS;
+				for (unsigned i = 0; i < HASH_COUNT; ++i)
 				{
-					if (!table[getPos(s, i, N)])
-					{
+					const unsigned bit = getBit(hash, i);
+					if (!(block[bit >> 6] & (uint64_t) 1 << (bit & 63)))
 						return false;
-					}
 				}
-			}
+			} while (rh.next());
 			return true;
 		}
+		size_t getSize() const
+		{
+			return table.size() * 64;
+		}
 		void clear()
 		{
-			std::fill_n(table.begin(), table.size(), false);
+			std::fill(table.begin(), table.end(), 0);
 		}
 		void getInfo(size_t& size, size_t& used) const
 		{
-			size = table.size();
+			size = table.size() * 64;
 			size_t total = 0;
-			for (bool value : table) if (value) ++total;
+			for (uint64_t value : table) total += Util::countBits(value);
 			used = total;
 		}
 
 	private:
-		void xadd(const string& s, size_t n)
+		class RollingHash
 		{
-			if (s.length() >= n)
-			{
-				string::size_type l = s.length() - n;
-				for (string::size_type i = 0; i <= l; ++i)
+			public:
+				explicit RollingHash(const string& s) : p(reinterpret_cast<const uint8_t*>(s.data())), end(p + s.length() - N), h(0)
 				{
-					table[getPos(s, i, n)] = true;
+					for (size_t i = 0; i < N; ++i)
+						h = h * BASE + p[i];
 				}
-			}
+
+				bool next()
+				{
+					if (p == end) return false;
+					h = (h - p[0] * power(N - 1)) * BASE + p[N];
+					++p;
+					return true;
+				}
+
+				uint64_t get() const
+				{
+					// Final mixing of the bits (MurmurHash3 finalizer)
+					uint64_t x = h;
+					x ^= x >> 33;
+					x *= 0xff51afd7ed558ccdULL;
+					x ^= x >> 33;
+					x *= 0xc4ceb9fe1a85ec53ULL;
+					x ^= x >> 33;
+					return x;
+				}
+
+			private:
+				static const uint64_t BASE = 0x100000001b3ULL;
+
+				static constexpr uint64_t power(size_t n)
+				{
+					return n ? BASE * power(n - 1) : 1;
+				}
+
+				const uint8_t* p;
+				const uint8_t* const end;
+				uint64_t h;
+		};
+
+		// Low bits of the hash select the bits within the block, high bits select the block
+		static unsigned getBit(uint64_t hash, unsigned i)
+		{
+			return (hash >> (i * 9)) & (BLOCK_BITS - 1);
 		}
-		
-		/* This is roughly how boost::hash does it */
-		size_t getPos(const string& s, size_t i, size_t l) const
+
+		size_t getBlockIndex(uint64_t hash) const
 		{
-			size_t h = 0;
-			const char* c = s.data() + i;
-			const char* end = s.data() + i + l;
-			for (; c < end; ++c)
-			{
-				h ^= *c + 0x9e3779b9 + (h << 6) + (h >> 2);
-			}
-			return (h % table.size());
+			return (size_t) (((hash >> 32) * (uint64_t) blockCount) >> 32);
 		}
-		
-		std::vector<bool> table;
+
+		size_t blockCount;
+		std::vector<uint64_t> table;
 };
 
 #endif // !defined(BLOOM_FILTER_H)
@@ -670,10 +670,21 @@ void BufferedSocket::connect(const string& address, uint16_t port, uint16_t loca
 
 	protocol = proto;
 
+	// The name is looked up while the socket thread is starting
+	auto resolveState = std::make_shared<ResolveState>();
+	resolveState->event.create();
+	Resolver::resolveHostAsync(ipVersion, useProxy ? proxy.host : address,
+		[resolveState](const Resolver::Result& result)
+		{
+			resolveState->result = result;
+			resolveState->event.notify();
+		});
+
 	{
 		LOCK(cs);
 		dcassert(!connectInfo);
 		connectInfo = new ConnectInfo(address, port, localPort, natRole, secure, allowUntrusted, expKP, useProxy ? &proxy : nullptr);
+		connectInfo->resolveState = std::move(resolveState);
 		task = TASK_CONNECT;
 	}
 }
@@ -898,9 +909,12 @@ void BufferedSocket::doConnect(const BufferedSocket::ConnectInfo* ci, bool sslSo
 					host = &ci->addr;
 					port = ci->port;
 				}
+				if (!waitForResolver(ci))
+					return;
 				IpAddressEx ip;
-				bool isNumeric;
-				if (!Resolver::resolveHost(ip, ipVersion, *host, &isNumeric))
+				const Resolver::Result& resolved = ci->resolveState->result;
+				const bool isNumeric = resolved.isNumeric;
+				if (!Resolver::getAddress(ip, ipVersion, resolved))
 				{
 					if (doLog)
 						LogManager::message("Error resolving " + *host, false);
@@ -980,6 +994,14 @@ void BufferedSocket::doConnect(const BufferedSocket::ConnectInfo* ci, bool sslSo
 	throw SocketException(state == CONNECT_PROXY ? STRING(SOCKS_CONN_FAILED) : STRING(CONNECTION_TIMEOUT));
 }
 
+bool BufferedSocket::waitForResolver(const ConnectInfo* ci)
+{
+	while (!ci->resolveState->event.timedWait(POLL_TIMEOUT))
+		if (stopFlag)
+			return false;
+	return true;
+}
+
 void BufferedSocket::doAccept()
 {
 	dcassert(state == STARTING);
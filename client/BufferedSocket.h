@@ -6,6 +6,8 @@
 #include "Thread.h"
 #include "Locks.h"
 #include "ThrottleState.h"
+#include "Resolver.h"
+#include "WaitableEvent.h"
 
 class UnZFilter;
 class InputStream;
@@ -157,6 +159,13 @@ class BufferedSocket : private Thread
 			void clear() noexcept;
 		};
 
+		// Completed by a resolver thread, outlives the socket if the lookup takes longer
+		struct ResolveState
+		{
+			WaitableEvent event;
+			Resolver::Result result;
+		};
+
 		struct ConnectInfo
 		{
 			ConnectInfo(const string& addr, uint16_t port, uint16_t localPort, NatRoles natRole, bool secure, bool allowUntrusted, const string& expKP, const Socket::ProxyConfig* proxy) :
@@ -179,6 +188,7 @@ class BufferedSocket : private Thread
 			string expKP;
 			NatRoles natRole;
 			Socket::ProxyConfig proxy;
+			std::shared_ptr<ResolveState> resolveState;
 		};
 
 		std::unique_ptr<Socket> sock;
@@ -221,6 +231,7 @@ class BufferedSocket : private Thread
 		void setSocket(std::unique_ptr<Socket>&& s);
 		void setOptions();
 		void doConnect(const ConnectInfo* ci, bool sslSocks);
+		bool waitForResolver(const ConnectInfo* ci);
 		void doAccept();
 		void createSocksMessage(const ConnectInfo* ci);
 		void checkSocksReply();
@@ -199,6 +199,7 @@ void Client::reloadSettings(bool updateNick)
 			myNick = nick;
 			csState.unlock();
 			myOnlineUser->getIdentity().setNick(nick);
+			ClientManager::updateNickIndex(myOnlineUser);
 		}
 
 		if (!hub->getUserDescription().empty())
@@ -297,6 +298,7 @@ void Client::reloadSettings(bool updateNick)
 			myNick = nick;
 			csState.unlock();
 			myOnlineUser->getIdentity().setNick(nick);
+			ClientManager::updateNickIndex(myOnlineUser);
 		}
 		setCurrentDescription(
 #ifdef IRAINMAN_ENABLE_SLOTS_AND_LIMIT_IN_DESCRIPTION
@@ -56,6 +56,7 @@ std::unique_ptr<RWLock> ClientManager::g_csOnlineUsers = std::unique_ptr<RWLock>
 std::unique_ptr<RWLock> ClientManager::g_csUsers = std::unique_ptr<RWLock>(RWLock::create());
 
 ClientManager::OnlineMap ClientManager::g_onlineUsers;
+OnlineUserIndex ClientManager::g_userIndex;
 ClientManager::UserMap ClientManager::g_users;
 
 ClientManager::ClientManager()
@@ -166,6 +167,7 @@ void ClientManager::clear()
 		WRITE_LOCK(*g_csOnlineUsers);
 		g_onlineUsers.clear();
 	}
+	g_userIndex.clear();
 	{
 		WRITE_LOCK(*g_csUsers);
 		//LOCK(g_csUsers);
@@ -618,29 +620,9 @@ UserPtr ClientManager::findLegacyUser(const string& nick, const string& hubUrl,
 	dcassert(!nick.empty());
 	if (!nick.empty())
 	{
-		READ_LOCK(*g_csClients);
-		if (!hubUrl.empty())
-		{
-			const auto& i = g_clients.find(hubUrl);
-			if (i != g_clients.end())
-			{
-				const Client* c = static_cast<const Client*>(i->second.get());
-				const auto& ou = c->findUser(nick);
-				if (ou)
-					return ou->getUser();
-			}
-			return UserPtr();
-		}
-		for (auto j = g_clients.cbegin(); j != g_clients.cend(); ++j)
-		{
-			const Client* c = static_cast<const Client*>(j->second.get());
-			const auto& ou = c->findUser(nick);
-			if (ou)
-			{
-				if (foundHubUrl) *foundHubUrl = j->first;
-				return ou->getUser();
-			}
-		}
+		const auto ou = g_userIndex.findNick(nick, hubUrl, foundHubUrl);
+		if (ou)
+			return ou->getUser();
 	}
 	return UserPtr();
 }
@@ -727,6 +709,7 @@ void ClientManager::putOnline(const OnlineUserPtr& ou, bool fireFlag) noexcept
 			const auto l_res = g_onlineUsers.insert(make_pair(user->getCID(), ou));
 			dcassert(l_res->second);
 		}
+		g_userIndex.addUser(ou);
 		
 		if (!(user->setFlagEx(User::ONLINE) & User::ONLINE) && fireFlag)
 		{
@@ -761,6 +744,8 @@ void ClientManager::putOffline(const OnlineUserPtr& ou, bool disconnectFlag) noe
 				}
 			}
 		}
+		if (diff)
+			g_userIndex.removeUser(ou);
 		
 		if (diff == 1) //last user
 		{
@@ -779,16 +764,32 @@ void ClientManager::putOffline(const OnlineUserPtr& ou, bool disconnectFlag) noe
 
 void ClientManager::removeOnlineUser(const OnlineUserPtr& ou) noexcept
 {
-	WRITE_LOCK(*g_csOnlineUsers);
-	auto op = g_onlineUsers.equal_range(ou->getUser()->getCID());
-	for (auto i = op.first; i != op.second; ++i)
+	bool found = false;
 	{
-		if (ou == i->second)
+		WRITE_LOCK(*g_csOnlineUsers);
+		auto op = g_onlineUsers.equal_range(ou->getUser()->getCID());
+		for (auto i = op.first; i != op.second; ++i)
 		{
-			g_onlineUsers.erase(i);
-			break;
+			if (ou == i->second)
+			{
+				g_onlineUsers.erase(i);
+				found = true;
+				break;
+			}
 		}
 	}
+	if (found)
+		g_userIndex.removeUser(ou);
+}
+
+void ClientManager::updateNickIndex(const OnlineUserPtr& ou) noexcept
+{
+	g_userIndex.updateNick(ou);
+}
+
+void ClientManager::updateIpIndex(const User* user) noexcept
+{
+	g_userIndex.updateIP(user);
 }
 
 OnlineUserPtr ClientManager::findOnlineUserHintL(const CID& cid, const string& hintUrl, OnlinePairC& p)
@@ -1204,6 +1205,7 @@ void ClientManager::flushRatio()
 
 void ClientManager::usersCleanup()
 {
+	IdentityAttribs::reclaim();
 	WRITE_LOCK(*g_csUsers);
 	auto i = g_users.begin();
 	while (i != g_users.end())
@@ -1397,26 +1399,13 @@ void ClientManager::dumpUserInfo(const HintedUser& user)
 StringList ClientManager::getNicksByIp(const IpAddress& ip)
 {
 	std::unordered_set<string> nicks;
+	vector<UserPtr> users;
+	g_userIndex.getUsersByIp(ip, users);
+	for (const auto& user : users)
 	{
-		READ_LOCK(*g_csOnlineUsers);
-		for (auto i = g_onlineUsers.cbegin(); i != g_onlineUsers.cend(); ++i)
-		{
-			const auto& user = i->second->getUser();
-			if (!user) continue;
-			string nick;
-			if (ip.type == AF_INET)
-			{
-				if (user->getIP4() == ip.data.v4)
-					nick = user->getLastNick();
-			}
-			else if (ip.type == AF_INET6)
-			{
-				if (user->getIP6() == ip.data.v6)
-					nick = user->getLastNick();
-			}
-			if (!nick.empty())
-				nicks.insert(nick);
-		}
+		string nick = user->getLastNick();
+		if (!nick.empty())
+			nicks.insert(nick);
 	}
 	StringList result;
 	result.reserve(nicks.size());
@@ -28,6 +28,7 @@
 #include "Singleton.h"
 #include "ConnectionStatus.h"
 #include "NoCaseHash.h"
+#include "OnlineUserIndex.h"
 
 class UserCommand;
 
@@ -157,6 +158,8 @@ class ClientManager : public Speaker<ClientManagerListener>,
 		void putOnline(const OnlineUserPtr& ou, bool fireFlag) noexcept;
 		void putOffline(const OnlineUserPtr& ou, bool disconnectFlag = false) noexcept;
 		static void removeOnlineUser(const OnlineUserPtr& ou) noexcept;
+		static void updateNickIndex(const OnlineUserPtr& ou) noexcept;
+		static void updateIpIndex(const User* user) noexcept;
 
 		static void getOnlineClients(StringSet& onlineClients) noexcept;
 		static void getClientStatus(boost::unordered_map<string, ConnectionStatus::Status>& result) noexcept;
@@ -233,6 +236,7 @@ class ClientManager : public Speaker<ClientManagerListener>,
 		
 		static OnlineMap g_onlineUsers;
 		static std::unique_ptr<RWLock> g_csOnlineUsers;
+		static OnlineUserIndex g_userIndex;
 #ifdef FLYLINKDC_USE_ASYN_USER_UPDATE
 		static OnlineUserList g_UserUpdateQueue;
 		static std::unique_ptr<RWLock> g_csOnlineUsersUpdateQueue;
@@ -966,13 +966,40 @@ bool Commands::processCommand(const ParsedCommand& pc, Result& res)
 				res.text += "\nState: ";
 				res.text += Util::toString(d->getState());
 				res.text += '\n';
-				size_t nodeCount = 0;
+				size_t nodeCount = 0, bucketCount = 0, replacementCount = 0;
 				{
 					dht::DHT::LockInstanceNodes lock(d);
-					const auto nodes = lock.getNodes();
-					if (nodes) nodeCount = nodes->size();
+					const dht::KBucket* bucket = lock.getBucket();
+					if (bucket)
+					{
+						nodeCount = bucket->getNodeCount();
+						bucketCount = bucket->getBucketCount();
+						replacementCount = bucket->getReplacementCount();
+					}
 				}
 				res.text += "Nodes: " + Util::toString(nodeCount) + '\n';
+				res.text += "Buckets: " + Util::toString(bucketCount) + '\n';
+				res.text += "Replacement nodes: " + Util::toString(replacementCount) + '\n';
+				auto im = dht::IndexManager::getInstance();
+				if (im)
+				{
+					res.text += "Indexed sources: " + Util::toString(im->getSourceCount()) + '\n';
+					dht::PublishStats ps;
+					im->getPublishStats(ps);
+					res.text += "Publish queue: " + Util::toString(ps.queuedFiles) + " files, ";
+					res.text += Util::toString(ps.pendingRequests) + " pending requests, ";
+					res.text += Util::toString(ps.runningLookups) + " running lookups\n";
+					res.text += "Published: " + Util::toString(ps.publishedFiles) + " files, ";
+					res.text += Util::toString(ps.lookups) + " lookups, ";
+					res.text += Util::toString(ps.sentPackets) + " PUB packets\n";
+					if (ps.cycleStart)
+					{
+						uint64_t elapsed = (GET_TICK() - ps.cycleStart) / 1000;
+						res.text += "Current cycle: " + Util::toString(ps.cycleFiles) + " files";
+						if (elapsed) res.text += " (" + Util::toString(ps.cycleFiles / elapsed) + " files/s)";
+						res.text += '\n';
+					}
+				}
 				res.what = RESULT_LOCAL_TEXT;
 				return true;
 			}
@@ -984,13 +1011,10 @@ bool Commands::processCommand(const ParsedCommand& pc, Result& res)
 				vector<dht::Node::Ptr> nv;
 				{
 					dht::DHT::LockInstanceNodes lock(d);
-					const auto nodes = lock.getNodes();
-					if (nodes)
-					{
-						for (const auto& node : *nodes)
-							if (node->getType() <= maxType) nv.push_back(node);
-					}
+					const dht::KBucket* bucket = lock.getBucket();
+					if (bucket) bucket->getNodes(nv);
 				}
+				nv.erase(std::remove_if(nv.begin(), nv.end(), [maxType](const dht::Node::Ptr& node) { return node->getType() > maxType; }), nv.end());
 				std::sort(nv.begin(), nv.end(), [](const dht::Node::Ptr& n1, const dht::Node::Ptr& n2) { return n1->getUser()->getCID() < n2->getUser()->getCID(); });
 				uint64_t now = GET_TICK();
 				res.text  = "Nodes: " + Util::toString(nv.size()) + '\n';
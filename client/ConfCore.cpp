@@ -40,6 +40,7 @@ static BaseSettingsImpl::MinMaxValidator<int> validatePartialSlots(0, 100);
 static BaseSettingsImpl::MinMaxValidator<int> validateExtraSlots(0, 20);
 static BaseSettingsImpl::MinMaxValidator<int> validateHubSlots(0, 10);
 static BaseSettingsImpl::MinMaxValidator<int> validateDownloadSlots(0, 100);
+static BaseSettingsImpl::MinMaxValidator<int> validateDhtPublishRate(1, 1000);
 static BaseSettingsImpl::MinMaxValidator<int> validateMinislotSize(16, 32768); // 16Kb - 32Mb
 static BaseSettingsImpl::MinMaxValidator<int> validateSegments(1, 200);
 static BaseSettingsImpl::MinMaxValidator<int> validateUserCheckBatch(5, 50);
@@ -194,6 +195,7 @@ void Conf::initCoreSettings()
 	s->addInt(SOCKS_PORT, "SocksPort", 1080, 0, &validatePort);
 	s->addBool(SOCKS_RESOLVE, "SocksResolve", true);
 	s->addBool(USE_DHT, "UseDHT");
+	s->addInt(DHT_PUBLISH_RATE, "DHTPublishRate", 50, 0, &validateDhtPublishRate);
 	s->addBool(USE_HTTP_PROXY, "UseHTTPProxy");
 
 	// Directories
@@ -204,6 +206,7 @@ void Conf::initCoreSettings()
 	s->addString(SKIPLIST_SHARE, "SkiplistShare", "*.dctmp;*.!ut", Settings::FLAG_FIX_VALUE, &noSpaceValidator);
 	s->addInt(AUTO_REFRESH_TIME, "AutoRefreshTime", 60);
 	s->addBool(AUTO_REFRESH_ON_STARTUP, "AutoRefreshOnStartup", true);
+	s->addBool(WATCH_SHARE_CHANGES, "WatchShareChanges", true);
 	s->addBool(SHARE_HIDDEN, "ShareHidden");
 	s->addBool(SHARE_SYSTEM, "ShareSystem");
 	s->addBool(SHARE_VIRTUAL, "ShareVirtual", true);
@@ -106,6 +106,7 @@ namespace Conf
 		SOCKS_PORT,
 		SOCKS_RESOLVE,
 		USE_DHT,
+		DHT_PUBLISH_RATE,
 		USE_HTTP_PROXY,
 
 		// Directories
@@ -119,6 +120,7 @@ namespace Conf
 		// ints
 		AUTO_REFRESH_TIME,
 		AUTO_REFRESH_ON_STARTUP,
+		WATCH_SHARE_CHANGES,
 		SHARE_HIDDEN,
 		SHARE_SYSTEM,
 		SHARE_VIRTUAL,
@@ -31,6 +31,7 @@
 #include "NetworkUtil.h"
 #include "SettingsUtil.h"
 #include "ConfCore.h"
+#include "Resolver.h"
 #include "dht/DHT.h"
 
 std::atomic_bool ConnectivityManager::ipv6Supported(false);
@@ -171,6 +172,8 @@ void ConnectivityManager::setupConnections(bool forcePortTest)
 	cs.unlock();
 
 	disconnect();
+	// Lookups made over the previous connection may be stale or failed
+	Resolver::clearCache();
 
 	auto ss = SettingsManager::instance.getCoreSettings();
 	ss->lockRead();
@@ -42,6 +42,7 @@
 #include "SettingsUtil.h"
 #include "dht/DHT.h"
 #include "ConfCore.h"
+#include "JobPool.h"
 
 #include "IpGuard.h"
 #include "IpTrust.h"
@@ -238,6 +239,8 @@ void shutdown(GUIINITPROC pGuiInitProc, void *pGuiParam)
 	DatabaseManager::getInstance()->shutdown();
 	DatabaseManager::deleteInstance();
 
+	JobPool::instance.shutdown();
+
 	TimerManager::getInstance()->shutdown();
 	TimerManager::deleteInstance();
 
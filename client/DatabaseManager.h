@@ -442,7 +442,7 @@ class DatabaseManager : public Singleton<DatabaseManager>, public HttpClientList
 		uint64_t timeLoadGlobalRatio;
 #endif
 
-		JobExecutor backgroundThread;
+		JobExecutor backgroundThread{"Database"};
 
 		static const size_t TREE_CACHE_SIZE = 300;
 
@@ -0,0 +1,227 @@
+#include "stdinc.h"
+#include "DirWatcher.h"
+#include "LogManager.h"
+#include "TimeUtil.h"
+#include "BaseUtil.h"
+#include "Path.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+static const uint64_t QUIET_TIME = 2000;
+static const uint64_t MAX_DELAY = 30000;
+
+DirWatcher::DirWatcher() : firstEventTick(0), lastEventTick(0), overflow(false), failed(false), stopFlag(false)
+#ifdef __linux__
+	, fd(-1)
+#endif
+{
+}
+
+DirWatcher::~DirWatcher()
+{
+	shutdown();
+}
+
+#ifdef __linux__
+static const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB |
+	IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+bool DirWatcher::init() noexcept
+{
+	if (fd != -1) return true;
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd == -1)
+	{
+		LogManager::message("Can't initialize inotify: " + Util::translateError(), false);
+		return false;
+	}
+	stopFlag.store(false);
+	try
+	{
+		start(0, "DirWatcher");
+	}
+	catch (const ThreadException&)
+	{
+		close(fd);
+		fd = -1;
+		return false;
+	}
+	return true;
+}
+
+void DirWatcher::shutdown() noexcept
+{
+	if (fd == -1) return;
+	stopFlag.store(true);
+	join();
+	close(fd);
+	fd = -1;
+	LOCK(cs);
+	watches.clear();
+	changedDirs.clear();
+}
+
+bool DirWatcher::isActive() const noexcept
+{
+	LOCK(cs);
+	return fd != -1 && !failed;
+}
+
+bool DirWatcher::addDir(const string& path) noexcept
+{
+	dcassert(!path.empty() && path.back() == PATH_SEPARATOR);
+	LOCK(cs);
+	if (fd == -1 || failed) return false;
+	int wd = inotify_add_watch(fd, path.c_str(), WATCH_MASK);
+	if (wd == -1)
+	{
+		// ENOSPC means the user's watch limit (fs.inotify.max_user_watches) was reached
+		if (errno == ENOSPC)
+		{
+			failed = true;
+			LogManager::message("Can't watch directory " + path + ": " + Util::translateError() + ", using periodic refresh", false);
+		}
+		return false;
+	}
+	// Same inode returns the same descriptor, this also updates the path of a renamed directory
+	watches[wd] = path;
+	return true;
+}
+
+void DirWatcher::clear() noexcept
+{
+	LOCK(cs);
+	if (fd != -1)
+		for (const auto& i : watches)
+			inotify_rm_watch(fd, i.first);
+	watches.clear();
+	changedDirs.clear();
+	overflow = failed = false;
+}
+
+void DirWatcher::removeWatchesL(const string& path) noexcept
+{
+	for (auto i = watches.begin(); i != watches.end();)
+		if (i->second.compare(0, path.length(), path) == 0)
+		{
+			inotify_rm_watch(fd, i->first);
+			i = watches.erase(i);
+		}
+		else
+			++i;
+}
+
+void DirWatcher::processEvents(const uint8_t* buf, size_t size) noexcept
+{
+	const uint64_t tick = GET_TICK();
+	LOCK(cs);
+	size_t offset = 0;
+	while (offset + sizeof(inotify_event) <= size)
+	{
+		const inotify_event* event = reinterpret_cast<const inotify_event*>(buf + offset);
+		offset += sizeof(inotify_event) + event->len;
+		if (event->mask & IN_Q_OVERFLOW)
+		{
+			overflow = true;
+			continue;
+		}
+		auto i = watches.find(event->wd);
+		if (i == watches.end()) continue;
+		if (event->mask & IN_IGNORED)
+		{
+			watches.erase(i);
+			continue;
+		}
+		const string& path = i->second;
+		if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+		{
+			// The parent directory gets its own event, a share root is rescanned to find it's gone
+			changedDirs.insert(path);
+		}
+		else
+		{
+			if ((event->mask & (IN_MOVED_FROM | IN_ISDIR)) == (IN_MOVED_FROM | IN_ISDIR) && event->len)
+			{
+				string fullPath = path;
+				fullPath += event->name;
+				fullPath += PATH_SEPARATOR;
+				removeWatchesL(fullPath);
+			}
+			changedDirs.insert(path);
+		}
+		if (!firstEventTick) firstEventTick = tick;
+		lastEventTick = tick;
+	}
+}
+
+int DirWatcher::run() noexcept
+{
+	std::unique_ptr<uint8_t[]> buf(new uint8_t[64 * 1024]);
+	while (!stopFlag)
+	{
+		pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		int result = poll(&pfd, 1, 500);
+		if (result <= 0 || !(pfd.revents & POLLIN)) continue;
+		for (;;)
+		{
+			ssize_t size = read(fd, buf.get(), 64 * 1024);
+			if (size <= 0) break;
+			processEvents(buf.get(), size);
+		}
+	}
+	return 0;
+}
+#else
+bool DirWatcher::init() noexcept
+{
+	return false;
+}
+
+void DirWatcher::shutdown() noexcept
+{
+}
+
+bool DirWatcher::isActive() const noexcept
+{
+	return false;
+}
+
+bool DirWatcher::addDir(const string&) noexcept
+{
+	return false;
+}
+
+void DirWatcher::clear() noexcept
+{
+}
+
+int DirWatcher::run() noexcept
+{
+	return 0;
+}
+#endif
+
+int DirWatcher::getChanges(StringList& dirs, uint64_t tick) noexcept
+{
+	LOCK(cs);
+	if (overflow)
+	{
+		overflow = false;
+		changedDirs.clear();
+		firstEventTick = lastEventTick = 0;
+		return RESULT_OVERFLOW;
+	}
+	if (changedDirs.empty()) return RESULT_NONE;
+	if (tick < lastEventTick + QUIET_TIME && tick < firstEventTick + MAX_DELAY) return RESULT_NONE;
+	dirs.assign(changedDirs.begin(), changedDirs.end());
+	changedDirs.clear();
+	firstEventTick = lastEventTick = 0;
+	return RESULT_CHANGES;
+}
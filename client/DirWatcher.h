@@ -0,0 +1,62 @@
+#ifndef DIR_WATCHER_H_
+#define DIR_WATCHER_H_
+
+#include "Thread.h"
+#include "Locks.h"
+#include "typedefs.h"
+#include <boost/unordered/unordered_map.hpp>
+#include <boost/unordered/unordered_set.hpp>
+
+/**
+ * Collects the directories changed since the last call to getChanges.
+ * Only implemented on Linux (inotify), elsewhere init() fails and
+ * the caller should keep using periodic full rescans.
+ */
+class DirWatcher : private Thread
+{
+	public:
+		enum
+		{
+			RESULT_NONE,
+			RESULT_CHANGES,
+			RESULT_OVERFLOW
+		};
+
+		DirWatcher();
+		~DirWatcher();
+
+		DirWatcher(const DirWatcher&) = delete;
+		DirWatcher& operator= (const DirWatcher&) = delete;
+
+		bool init() noexcept;
+		void shutdown() noexcept;
+		bool isActive() const noexcept;
+
+		// Path must end with PATH_SEPARATOR. Subdirectories are not watched automatically.
+		bool addDir(const string& path) noexcept;
+		void clear() noexcept;
+
+		// Changes are returned only after no events were received for a while,
+		// so a directory being copied is not scanned many times.
+		int getChanges(StringList& dirs, uint64_t tick) noexcept;
+
+	private:
+		mutable CriticalSection cs;
+		boost::unordered_set<string> changedDirs;
+		uint64_t firstEventTick;
+		uint64_t lastEventTick;
+		bool overflow;
+		bool failed;
+		std::atomic_bool stopFlag;
+#ifdef __linux__
+		int fd;
+		boost::unordered_map<int, string> watches;
+
+		void processEvents(const uint8_t* buf, size_t size) noexcept;
+		void removeWatchesL(const string& path) noexcept;
+#endif
+
+		virtual int run() noexcept override;
+};
+
+#endif // DIR_WATCHER_H_
@@ -36,6 +36,7 @@
 #include "ClientManager.h"
 #include "SettingsManager.h"
 #include "ConfCore.h"
+#include "DirectoryListingCache.h"
 
 static const int PROGRESS_REPORT_TIME = 2000;
 
@@ -170,23 +171,44 @@ void DirectoryListing::loadFile(const string& fileName, ProgressNotif *progressN
 	// For now, we detect type by ending...
 	if (!ClientManager::isBeforeShutdown())
 	{
+		const bool isDclst = Util::isDclstFile(fileName);
+		const bool isBZ2 = isDclst || Util::checkFileExt(fileName, extBZ2);
+		const bool isXML = !isBZ2 && Util::checkFileExt(fileName, extXML);
+
+		// Lists of other users are cached in the parsed form
+		string cacheFile;
+		TTHValue cacheKey;
+		if (!ownList && !isDclst && (isBZ2 || isXML) && DirectoryListingCache::getListKey(fileName, abortFlag, cacheKey))
+		{
+			cacheFile = DirectoryListingCache::getCacheFileName(fileName);
+			DirectoryListingCache cache;
+			if (cache.load(cacheFile, cacheKey))
+			{
+				loadCache(cache);
+				return;
+			}
+		}
+
 		::File ff(fileName, ::File::READ, ::File::OPEN);
-		if (Util::checkFileExt(fileName, extBZ2) || Util::isDclstFile(fileName))
+		if (isBZ2)
 		{
 			FilteredInputStream<UnBZFilter, false> f(&ff);
 			loadXML(f, progressNotif, ownList);
 		}
-		else if (Util::checkFileExt(fileName, extXML))
+		else if (isXML)
 		{
 			loadXML(ff, progressNotif, ownList);
 		}
+
+		if (!cacheFile.empty() && root)
+			DirectoryListingCache::write(cacheFile, cacheKey, *this);
 	}
 }
 
 class ListLoader : public SimpleXMLReader::CallBack
 {
 	public:
-		ListLoader(DirectoryListing* list, InputStream &is, DirectoryListing::Directory* root,
+		ListLoader(DirectoryListing* list, InputStream* is, DirectoryListing::Directory* root,
 		           const UserPtr& user, bool ownList, int scanOptions)
 			: list(list), current(root), inListing(false), ownList(ownList),
 			  emptyFileNameCounter(0), progressNotif(nullptr), stream(is),
@@ -224,6 +246,8 @@ class ListLoader : public SimpleXMLReader::CallBack
 			totalFileCount++;
 			notifyProgress();
 		}
+
+		void loadCache(const DirectoryListingCache& cache);
 		
 	private:
 		DirectoryListing* list;
@@ -238,11 +262,17 @@ class ListLoader : public SimpleXMLReader::CallBack
 
 		uint64_t nextProgressReport;
 		DirectoryListing::ProgressNotif *progressNotif;
-		InputStream& stream;
+		InputStream* stream;
 		size_t totalFileCount;
 		size_t totalDirCount;
 
 		void notifyProgress();
+		void checkAbort();
+		void addFile(const string& name, int64_t size, const TTHValue& tth, uint32_t uploadCount, int64_t shared, const MediaInfoUtil::Info* media);
+		void addDirectory(const string& name, bool incomplete, int64_t date);
+		void closeDirectory(bool sort);
+		void closeListing();
+		void loadCacheDir(const DirectoryListingCache& cache, uint32_t& dirIndex, uint32_t& fileIndex);
 };
 
 void DirectoryListing::loadXML(const string& xml, DirectoryListing::ProgressNotif *progressNotif, bool ownList)
@@ -257,12 +287,19 @@ void DirectoryListing::loadXML(const string& xml, DirectoryListing::ProgressNoti
 
 void DirectoryListing::loadXML(InputStream& is, DirectoryListing::ProgressNotif *progressNotif, bool ownList)
 {
-	ListLoader ll(this, is, getRoot(), getUser(), ownList, scanOptions);
+	ListLoader ll(this, &is, getRoot(), getUser(), ownList, scanOptions);
 	ll.setProgressNotif(progressNotif);
 	SimpleXMLReader(&ll).parse(is);
 	this->ownList = ownList;
 }
 
+void DirectoryListing::loadCache(const DirectoryListingCache& cache)
+{
+	ListLoader ll(this, nullptr, getRoot(), getUser(), false, scanOptions);
+	ll.loadCache(cache);
+	ownList = false;
+}
+
 static const string tagFileListing = "FileListing";
 static const string attrBase = "Base";
 static const string attrCID = "CID";
@@ -292,7 +329,7 @@ static bool isValidName(const string& name)
 	return true;
 }
 
-void ListLoader::startTag(const string& name, StringPairList& attribs, bool simple)
+void ListLoader::checkAbort()
 {
 	if (ClientManager::isBeforeShutdown())
 	{
@@ -303,6 +340,11 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool simp
 		list->aborted = true;
 		throw AbortException("ListLoader::startTag - " + STRING(ABORT_EM));
 	}
+}
+
+void ListLoader::startTag(const string& name, StringPairList& attribs, bool simple)
+{
+	checkAbort();
 	
 	if (inListing)
 	{
@@ -415,80 +457,7 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool simp
 				media = &tempMedia;
 			}
 
-			DirectoryListing::File* f;
-			if (valFilename && isValidName(*valFilename))
-				f = new DirectoryListing::File(current, *valFilename, size, tth, uploadCount, shared, media);
-			else
-				f = new DirectoryListing::File(current, *valTTH, size, tth, uploadCount, shared, media);
-			current->files.push_back(f);
-			if (shared > current->maxTS) current->maxTS = shared;
-			if (media && media->bitrate)
-			{
-				if (media->bitrate < current->minBitrate) current->minBitrate = media->bitrate;
-				if (media->bitrate > current->maxBitrate) current->maxBitrate = media->bitrate;
-			}
-			
-			if (size)
-			{
-				if (!ownList)
-				{
-					if (QueueManager::fileQueue.isQueued(f->getTTH()))
-					{
-						f->setFlag(DirectoryListing::FLAG_QUEUED);
-						current->setFlag(DirectoryListing::FLAG_HAS_QUEUED);
-					}
-					string path;
-					if ((scanFlags & DatabaseManager::FLAG_SHARED) && ShareManager::getInstance()->getFileInfo(f->getTTH(), path))
-					{
-						f->setFlag(DirectoryListing::FLAG_SHARED);
-						f->setPath(path);
-						current->setFlag(DirectoryListing::FLAG_HAS_SHARED);
-					}
-					else if (scanFlags & (DatabaseManager::FLAG_DOWNLOADED | DatabaseManager::FLAG_DOWNLOAD_CANCELED))
-					{
-						unsigned flags;
-						if (hashDb && !f->getTTH().isZero())
-						{
-							hashDb->getFileInfo(f->getTTH().data, flags, nullptr, &path, nullptr, nullptr);
-							flags &= scanFlags;
-						}
-						else
-							flags = 0;
-						if (flags & DatabaseManager::FLAG_SHARED)
-						{
-							f->setFlag(DirectoryListing::FLAG_SHARED);
-							f->setPath(path);
-							current->setFlag(DirectoryListing::FLAG_HAS_SHARED);
-						}
-						else if (flags & DatabaseManager::FLAG_DOWNLOADED)
-						{
-							f->setFlag(DirectoryListing::FLAG_DOWNLOADED);
-							f->setPath(path);
-							current->setFlag(DirectoryListing::FLAG_HAS_DOWNLOADED);
-						}
-						else if (flags & DatabaseManager::FLAG_DOWNLOAD_CANCELED)
-						{
-							f->setFlag(DirectoryListing::FLAG_CANCELED);
-							current->setFlag(DirectoryListing::FLAG_HAS_CANCELED);
-						}
-						else
-							current->setFlag(DirectoryListing::FLAG_HAS_OTHER);
-					}
-					else
-						current->setFlag(DirectoryListing::FLAG_HAS_OTHER);
-				}
-				else if (useUploadCounter && hashDb && !f->getTTH().isZero())
-				{
-					unsigned flags;
-					hashDb->getFileInfo(f->getTTH().data, flags, nullptr, nullptr, nullptr, &uploadCount);
-					f->setUploadCount(uploadCount);
-				}
-			}
-
-			current->totalSize += size;
-			current->totalUploadCount += uploadCount;
-
-			fileProcessed();
+			addFile(valFilename && isValidName(*valFilename) ? *valFilename : *valTTH, size, tth, uploadCount, shared, media);
 		}
 		else if (name == tagDirectory)
 		{
@@ -498,28 +467,12 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool simp
 				const string &fileName = getAttrib(attribs, attrName, 0);
 				const bool incomp = getAttrib(attribs, attrIncomplete, 1) == "1";
 				const string& valDate = getAttrib(attribs, attrDate, 1);
+				const int64_t date = valDate.empty() ? 0 : Util::toInt64(valDate);
 
-				DirectoryListing::Directory* d;
 				if (isValidName(fileName))
-					d = new DirectoryListing::Directory(current, fileName, !incomp);
+					addDirectory(fileName, incomp, date);
 				else
-					d = new DirectoryListing::Directory(current, "invalid_folder_name_" + Util::toString(++emptyFileNameCounter), !incomp);
-
-				if (!valDate.empty())
-				{
-					int64_t val = Util::toInt64(valDate);
-					if (val > 0)
-					{
-						d->maxTS = val;
-						d->setFlag(DirectoryListing::FLAG_DIR_TIMESTAMP);
-						list->hasTimestampsFlag = true;
-					}
-				}
-				current->directories.push_back(d);
-				current = d;
-
-				if (incomp)
-					list->incomplete = true;
+					addDirectory("invalid_folder_name_" + Util::toString(++emptyFileNameCounter), incomp, date);
 			}
 			
 			if (simple)
@@ -607,37 +560,203 @@ void ListLoader::endTag(const string& name, const string&)
 	if (name == tagDirectory)
 	{
 		if (current)
+			closeDirectory(true);
+	}
+	else if (name == tagFileListing)
+	{
+		closeListing();
+		inListing = false;
+	}
+}
+
+void ListLoader::addFile(const string& name, int64_t size, const TTHValue& tth, uint32_t uploadCount, int64_t shared, const MediaInfoUtil::Info* media)
+{
+	DirectoryListing::File* f = new DirectoryListing::File(current, name, size, tth, uploadCount, shared, media);
+	current->files.push_back(f);
+	if (shared > current->maxTS) current->maxTS = shared;
+	if (media && media->bitrate)
+	{
+		if (media->bitrate < current->minBitrate) current->minBitrate = media->bitrate;
+		if (media->bitrate > current->maxBitrate) current->maxBitrate = media->bitrate;
+	}
+
+	if (size)
+	{
+		if (!ownList)
+		{
+			if (QueueManager::fileQueue.isQueued(f->getTTH()))
+			{
+				f->setFlag(DirectoryListing::FLAG_QUEUED);
+				current->setFlag(DirectoryListing::FLAG_HAS_QUEUED);
+			}
+			string path;
+			if ((scanFlags & DatabaseManager::FLAG_SHARED) && ShareManager::getInstance()->getFileInfo(f->getTTH(), path))
+			{
+				f->setFlag(DirectoryListing::FLAG_SHARED);
+				f->setPath(path);
+				current->setFlag(DirectoryListing::FLAG_HAS_SHARED);
+			}
+			else if (scanFlags & (DatabaseManager::FLAG_DOWNLOADED | DatabaseManager::FLAG_DOWNLOAD_CANCELED))
+			{
+				unsigned flags;
+				if (hashDb && !f->getTTH().isZero())
+				{
+					hashDb->getFileInfo(f->getTTH().data, flags, nullptr, &path, nullptr, nullptr);
+					flags &= scanFlags;
+				}
+				else
+					flags = 0;
+				if (flags & DatabaseManager::FLAG_SHARED)
+				{
+					f->setFlag(DirectoryListing::FLAG_SHARED);
+					f->setPath(path);
+					current->setFlag(DirectoryListing::FLAG_HAS_SHARED);
+				}
+				else if (flags & DatabaseManager::FLAG_DOWNLOADED)
+				{
+					f->setFlag(DirectoryListing::FLAG_DOWNLOADED);
+					f->setPath(path);
+					current->setFlag(DirectoryListing::FLAG_HAS_DOWNLOADED);
+				}
+				else if (flags & DatabaseManager::FLAG_DOWNLOAD_CANCELED)
+				{
+					f->setFlag(DirectoryListing::FLAG_CANCELED);
+					current->setFlag(DirectoryListing::FLAG_HAS_CANCELED);
+				}
+				else
+					current->setFlag(DirectoryListing::FLAG_HAS_OTHER);
+			}
+			else
+				current->setFlag(DirectoryListing::FLAG_HAS_OTHER);
+		}
+		else if (useUploadCounter && hashDb && !f->getTTH().isZero())
 		{
-			uint16_t addFlags = 0;
-			current->updateSubDirs(addFlags);
-			current->setFlags((current->getFlags() & ~DirectoryListing::FLAG_DIR_TIMESTAMP) | addFlags);
-			sortList(current->files);
-			sortList(current->directories);
-			current = current->getParent();
+			unsigned flags;
+			hashDb->getFileInfo(f->getTTH().data, flags, nullptr, nullptr, nullptr, &uploadCount);
+			f->setUploadCount(uploadCount);
 		}
 	}
-	else if (name == tagFileListing)
+
+	current->totalSize += size;
+	current->totalUploadCount += uploadCount;
+
+	fileProcessed();
+}
+
+void ListLoader::addDirectory(const string& name, bool incomplete, int64_t date)
+{
+	DirectoryListing::Directory* d = new DirectoryListing::Directory(current, name, !incomplete);
+	if (date > 0)
 	{
-		if (current)
+		d->maxTS = date;
+		d->setFlag(DirectoryListing::FLAG_DIR_TIMESTAMP);
+		list->hasTimestampsFlag = true;
+	}
+	current->directories.push_back(d);
+	current = d;
+
+	if (incomplete)
+		list->incomplete = true;
+}
+
+void ListLoader::closeDirectory(bool sort)
+{
+	uint16_t addFlags = 0;
+	current->updateSubDirs(addFlags);
+	current->setFlags((current->getFlags() & ~DirectoryListing::FLAG_DIR_TIMESTAMP) | addFlags);
+	if (sort)
+	{
+		sortList(current->files);
+		sortList(current->directories);
+	}
+	current = current->getParent();
+}
+
+void ListLoader::closeListing()
+{
+	if (current)
+	{
+		uint16_t unused = 0;
+		current->updateSubDirs(unused);
+		sortList(current->directories);
+	}
+}
+
+// Cached lists were written from a loaded tree, their directories are already sorted
+void ListLoader::loadCache(const DirectoryListingCache& cache)
+{
+	const DirectoryListingCache::Header& header = cache.getHeader();
+	const string basePath = cache.getString(header.basePath);
+	if (!basePath.empty())
+		list->basePath = basePath;
+	list->setIncludeSelf((header.flags & DirectoryListingCache::FLAG_INCLUDE_SELF) != 0);
+	if (header.flags & DirectoryListingCache::FLAG_INCOMPLETE)
+		list->incomplete = true;
+	if (header.flags & DirectoryListingCache::FLAG_HAS_TIMESTAMPS)
+		list->hasTimestampsFlag = true;
+	if (!list->getUser())
+	{
+		const CID cid(header.cid);
+		if (!cid.isZero())
+			list->setHintedUser(HintedUser(ClientManager::createUser(cid, Util::emptyString, Util::emptyString), Util::emptyString));
+	}
+
+	if (!current)
+	{
+		// Only the TTH column is needed
+		const DirectoryListingCache::FileRecord* files = cache.getFiles();
+		const TTHValue* tths = cache.getTTHs();
+		for (uint32_t i = 0; i < header.fileCount; ++i)
+			if (list->tthSet && files[i].size)
+				list->tthSet->insert(make_pair(tths[i], files[i].size));
+		return;
+	}
+
+	uint32_t dirIndex = 0, fileIndex = 0;
+	loadCacheDir(cache, dirIndex, fileIndex);
+	closeListing();
+}
+
+void ListLoader::loadCacheDir(const DirectoryListingCache& cache, uint32_t& dirIndex, uint32_t& fileIndex)
+{
+	checkAbort();
+	const DirectoryListingCache::DirRecord& dir = cache.getDirs()[dirIndex++];
+	MediaInfoUtil::Info media;
+	for (uint32_t i = 0; i < dir.fileCount; ++i, ++fileIndex)
+	{
+		const DirectoryListingCache::FileRecord& file = cache.getFiles()[fileIndex];
+		const MediaInfoUtil::Info* fileMedia = nullptr;
+		if (file.media)
 		{
-			uint16_t unused = 0;
-			current->updateSubDirs(unused);
-			sortList(current->directories);
+			const DirectoryListingCache::MediaRecord& rec = cache.getMedia()[file.media - 1];
+			media.width = rec.width;
+			media.height = rec.height;
+			media.bitrate = rec.bitrate;
+			media.audio = cache.getString(rec.audio);
+			media.video = cache.getString(rec.video);
+			fileMedia = &media;
 		}
-		inListing = false;
+		addFile(cache.getString(file.name), file.size, cache.getTTHs()[fileIndex], file.uploadCount, file.ts, fileMedia);
+	}
+	for (uint32_t i = 0; i < dir.dirCount; ++i)
+	{
+		const DirectoryListingCache::DirRecord& subdir = cache.getDirs()[dirIndex];
+		addDirectory(cache.getString(subdir.name), (subdir.flags & DirectoryListingCache::DIR_FLAG_INCOMPLETE) != 0, subdir.maxTS);
+		loadCacheDir(cache, dirIndex, fileIndex);
+		closeDirectory(false);
 	}
 }
 
 void ListLoader::notifyProgress()
 {
-	if (progressNotif)
+	if (progressNotif && stream)
 	{
 		uint64_t tick = GET_TICK();
 		if (tick > nextProgressReport)
 		{
 			int progress;
-			int64_t size = stream.getInputSize();
-			int64_t pos = stream.getTotalRead();
+			int64_t size = stream->getInputSize();
+			int64_t pos = stream->getTotalRead();
 			if (size < 0 || pos < 0)
 				progress = 0;
 			else
@@ -28,6 +28,8 @@
 
 STANDARD_EXCEPTION(AbortException);
 
+class DirectoryListingCache;
+
 class DirectoryListing
 {
 	public:
@@ -331,6 +333,7 @@ class DirectoryListing
 		void matchTTHSet(const TTHMap& l);
 
 		bool isOwnList() const { return ownList; }
+		bool isIncomplete() const { return incomplete; }
 		const string& getBasePath() const { return basePath; }
 
 		Directory* findDirPath(const string& path) const;
@@ -351,6 +354,8 @@ class DirectoryListing
 	private:
 		friend class ListLoader;
 		
+		void loadCache(const DirectoryListingCache& cache);
+
 		Directory* root;
 		TTHMap* tthSet;
 		bool ownList;
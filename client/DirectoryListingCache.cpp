@@ -0,0 +1,249 @@
+#include "stdinc.h"
+#include "DirectoryListingCache.h"
+#include "HashUtil.h"
+#include "PathUtil.h"
+#include "File.h"
+#include "User.h"
+
+static const int MAX_DIR_DEPTH = 1024;
+static const size_t KEY_HASH_BUF_SIZE = 256 * 1024;
+
+static const string extBZ2 = ".bz2";
+static const string extXML = ".xml";
+static const string extCache = ".dlc";
+
+static_assert(sizeof(DirectoryListingCache::DirRecord) % 8 == 0 && sizeof(DirectoryListingCache::FileRecord) % 8 == 0 &&
+	sizeof(DirectoryListingCache::MediaRecord) % 8 == 0, "Records must keep the sections aligned");
+
+namespace
+{
+	// Section offsets, all sections start on 8-byte boundaries
+	struct Layout
+	{
+		uint64_t dirs;
+		uint64_t files;
+		uint64_t tths;
+		uint64_t media;
+		uint64_t pool;
+		uint64_t total;
+
+		explicit Layout(const DirectoryListingCache::Header& h)
+		{
+			dirs = align(sizeof(DirectoryListingCache::Header));
+			files = dirs + (uint64_t) h.dirCount * sizeof(DirectoryListingCache::DirRecord);
+			tths = files + (uint64_t) h.fileCount * sizeof(DirectoryListingCache::FileRecord);
+			media = align(tths + (uint64_t) h.fileCount * sizeof(TTHValue));
+			pool = media + (uint64_t) h.mediaCount * sizeof(DirectoryListingCache::MediaRecord);
+			total = pool + h.poolSize;
+		}
+
+		static uint64_t align(uint64_t offset) { return (offset + 7) & ~(uint64_t) 7; }
+	};
+
+	class Builder
+	{
+		public:
+			vector<DirectoryListingCache::DirRecord> dirs;
+			vector<DirectoryListingCache::FileRecord> files;
+			vector<TTHValue> tths;
+			vector<DirectoryListingCache::MediaRecord> media;
+			string pool;
+
+			DirectoryListingCache::StringRef addString(const string& s)
+			{
+				DirectoryListingCache::StringRef ref = { (uint32_t) pool.length(), (uint32_t) s.length() };
+				pool += s;
+				return ref;
+			}
+
+			void addDir(const DirectoryListing::Directory* dir)
+			{
+				const size_t index = dirs.size();
+				dirs.emplace_back();
+				DirectoryListingCache::DirRecord rec = {};
+				rec.name = addString(dir->getName());
+				rec.maxTS = dir->getMaxTS();
+				if (!dir->getComplete()) rec.flags |= DirectoryListingCache::DIR_FLAG_INCOMPLETE;
+				for (const DirectoryListing::File* file : dir->files)
+				{
+					if (file->getAdls()) continue;
+					DirectoryListingCache::FileRecord fileRec = {};
+					fileRec.name = addString(file->getName());
+					fileRec.size = file->getSize();
+					fileRec.ts = file->getTS();
+					fileRec.uploadCount = file->getUploadCount();
+					const MediaInfoUtil::Info* info = file->getMedia();
+					if (info) fileRec.media = addMedia(*info);
+					files.push_back(fileRec);
+					tths.push_back(file->getTTH());
+					++rec.fileCount;
+				}
+				for (const DirectoryListing::Directory* subdir : dir->directories)
+				{
+					if (subdir->getAdls()) continue;
+					addDir(subdir);
+					++rec.dirCount;
+				}
+				dirs[index] = rec;
+			}
+
+		private:
+			// Media descriptions repeat a lot, they are stored once
+			boost::unordered_map<string, DirectoryListingCache::StringRef> sharedStrings;
+
+			DirectoryListingCache::StringRef addSharedString(const string& s)
+			{
+				auto i = sharedStrings.find(s);
+				if (i != sharedStrings.end()) return i->second;
+				DirectoryListingCache::StringRef ref = addString(s);
+				sharedStrings.emplace(s, ref);
+				return ref;
+			}
+
+			uint32_t addMedia(const MediaInfoUtil::Info& info)
+			{
+				DirectoryListingCache::MediaRecord rec = {};
+				rec.width = info.width;
+				rec.height = info.height;
+				rec.bitrate = info.bitrate;
+				rec.audio = addSharedString(info.audio);
+				rec.video = addSharedString(info.video);
+				media.push_back(rec);
+				return (uint32_t) media.size();
+			}
+	};
+}
+
+template<typename T>
+static void copySection(string& out, uint64_t offset, const vector<T>& v)
+{
+	if (!v.empty()) memcpy(&out[offset], v.data(), v.size() * sizeof(T));
+}
+
+string DirectoryListingCache::getCacheFileName(const string& listFile)
+{
+	string name = listFile;
+	if (Util::checkFileExt(name, extBZ2)) name.erase(name.length() - extBZ2.length());
+	if (Util::checkFileExt(name, extXML)) name.erase(name.length() - extXML.length());
+	return name + extCache;
+}
+
+bool DirectoryListingCache::getListKey(const string& listFile, std::atomic_bool& stopFlag, TTHValue& key) noexcept
+{
+	TigerTree tree;
+	if (!Util::getTTH(listFile, true, KEY_HASH_BUF_SIZE, stopFlag, tree))
+		return false;
+	key = tree.getRoot();
+	return true;
+}
+
+bool DirectoryListingCache::write(const string& path, const TTHValue& key, const DirectoryListing& dl) noexcept
+{
+	const DirectoryListing::Directory* root = dl.getRoot();
+	if (!root) return false;
+
+	Builder b;
+	b.addDir(root);
+	Header header = {};
+	header.basePath = b.addString(dl.getBasePath());
+	if (b.pool.length() > UINT32_MAX || b.files.size() > UINT32_MAX || b.dirs.size() > UINT32_MAX)
+		return false;
+
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.key = key;
+	if (dl.getIncludeSelf()) header.flags |= FLAG_INCLUDE_SELF;
+	if (dl.isIncomplete()) header.flags |= FLAG_INCOMPLETE;
+	if (dl.hasTimestamps()) header.flags |= FLAG_HAS_TIMESTAMPS;
+	header.dirCount = (uint32_t) b.dirs.size();
+	header.fileCount = (uint32_t) b.files.size();
+	header.mediaCount = (uint32_t) b.media.size();
+	header.poolSize = (uint32_t) b.pool.length();
+	const UserPtr& user = dl.getUser();
+	if (user && !(user->getFlags() & User::FAKE))
+		memcpy(header.cid, user->getCID().data(), CID::SIZE);
+
+	const Layout layout(header);
+	string out;
+	out.resize(layout.total);
+	memcpy(&out[0], &header, sizeof(header));
+	copySection(out, layout.dirs, b.dirs);
+	copySection(out, layout.files, b.files);
+	copySection(out, layout.tths, b.tths);
+	copySection(out, layout.media, b.media);
+	if (!b.pool.empty()) memcpy(&out[layout.pool], b.pool.data(), b.pool.length());
+
+	// Written under a temporary name, a partially written cache is never picked up
+	const string tempPath = path + ".dctmp";
+	try
+	{
+		File f(tempPath, File::WRITE, File::CREATE | File::TRUNCATE);
+		f.write(out);
+		f.close();
+	}
+	catch (const FileException&)
+	{
+		File::deleteFile(tempPath);
+		return false;
+	}
+	if (!File::renameFile(tempPath, path))
+	{
+		File::deleteFile(tempPath);
+		return false;
+	}
+	return true;
+}
+
+bool DirectoryListingCache::load(const string& path, const TTHValue& key) noexcept
+{
+	try
+	{
+		File f(path, File::READ, File::OPEN);
+		data = f.read();
+	}
+	catch (const FileException&)
+	{
+		return false;
+	}
+	if (data.length() < sizeof(Header))
+		return false;
+
+	header = reinterpret_cast<const Header*>(data.data());
+	if (header->magic != MAGIC || header->version != VERSION || header->key != key || !header->dirCount)
+		return false;
+	const Layout layout(*header);
+	if (layout.total != data.length())
+		return false;
+
+	dirs = reinterpret_cast<const DirRecord*>(data.data() + layout.dirs);
+	files = reinterpret_cast<const FileRecord*>(data.data() + layout.files);
+	tths = reinterpret_cast<const TTHValue*>(data.data() + layout.tths);
+	media = reinterpret_cast<const MediaRecord*>(data.data() + layout.media);
+	pool = data.data() + layout.pool;
+
+	// Everything is checked here, the loader uses the records as is
+	if (!checkString(header->basePath))
+		return false;
+	for (uint32_t i = 0; i < header->fileCount; ++i)
+		if (!checkString(files[i].name) || files[i].media > header->mediaCount)
+			return false;
+	for (uint32_t i = 0; i < header->mediaCount; ++i)
+		if (!checkString(media[i].audio) || !checkString(media[i].video))
+			return false;
+	uint32_t dirIndex = 0, fileIndex = 0;
+	return checkDir(dirIndex, fileIndex, 0) && dirIndex == header->dirCount && fileIndex == header->fileCount;
+}
+
+bool DirectoryListingCache::checkDir(uint32_t& dirIndex, uint32_t& fileIndex, int depth) const
+{
+	if (dirIndex >= header->dirCount || depth > MAX_DIR_DEPTH)
+		return false;
+	const DirRecord& dir = dirs[dirIndex++];
+	if (!checkString(dir.name) || dir.fileCount > header->fileCount - fileIndex)
+		return false;
+	fileIndex += dir.fileCount;
+	for (uint32_t i = 0; i < dir.dirCount; ++i)
+		if (!checkDir(dirIndex, fileIndex, depth + 1))
+			return false;
+	return true;
+}
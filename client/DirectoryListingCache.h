@@ -0,0 +1,116 @@
+#ifndef DIRECTORY_LISTING_CACHE_H_
+#define DIRECTORY_LISTING_CACHE_H_
+
+#include "DirectoryListing.h"
+
+/**
+ * Binary form of a parsed file list, stored next to the list file and keyed by the TTH of the list.
+ * Sections are arrays of fixed size records referring to a shared name pool by offset,
+ * they are used in place after the file is read. Directories are stored in preorder,
+ * the files of each directory follow the files of the previous one.
+ * File status flags are not stored: they depend on the local share and queue.
+ */
+class DirectoryListingCache
+{
+	public:
+		static const uint32_t MAGIC = 0x434c4c44; // DLLC
+		static const uint32_t VERSION = 1;
+
+		enum
+		{
+			FLAG_INCLUDE_SELF   = 1,
+			FLAG_INCOMPLETE     = 2,
+			FLAG_HAS_TIMESTAMPS = 4
+		};
+
+		enum
+		{
+			DIR_FLAG_INCOMPLETE = 1
+		};
+
+		struct StringRef
+		{
+			uint32_t offset;
+			uint32_t len;
+		};
+
+		struct Header
+		{
+			uint32_t magic;
+			uint32_t version;
+			TTHValue key;
+			uint32_t flags;
+			uint32_t dirCount;
+			uint32_t fileCount;
+			uint32_t mediaCount;
+			uint32_t poolSize;
+			uint32_t reserved;
+			StringRef basePath;
+			uint8_t cid[CID::SIZE];
+		};
+
+		struct DirRecord
+		{
+			StringRef name;
+			uint32_t dirCount;
+			uint32_t fileCount;
+			int64_t maxTS;
+			uint32_t flags;
+			uint32_t reserved;
+		};
+
+		struct FileRecord
+		{
+			StringRef name;
+			int64_t size;
+			int64_t ts;
+			uint32_t uploadCount;
+			uint32_t media; // index + 1, 0 if none
+		};
+
+		struct MediaRecord
+		{
+			uint16_t width;
+			uint16_t height;
+			uint16_t bitrate;
+			uint16_t reserved;
+			StringRef audio;
+			StringRef video;
+		};
+
+		// Returns the cache file of a list file
+		static string getCacheFileName(const string& listFile);
+		static bool getListKey(const string& listFile, std::atomic_bool& stopFlag, TTHValue& key) noexcept;
+		static bool write(const string& path, const TTHValue& key, const DirectoryListing& dl) noexcept;
+
+		// Reads the cache file, returns false if it doesn't exist, is damaged or was made for a different list
+		bool load(const string& path, const TTHValue& key) noexcept;
+
+		const Header& getHeader() const { return *header; }
+		const DirRecord* getDirs() const { return dirs; }
+		const FileRecord* getFiles() const { return files; }
+		const TTHValue* getTTHs() const { return tths; }
+		const MediaRecord* getMedia() const { return media; }
+
+		string getString(const StringRef& ref) const
+		{
+			return string(pool + ref.offset, ref.len);
+		}
+
+	private:
+		string data;
+		const Header* header = nullptr;
+		const DirRecord* dirs = nullptr;
+		const FileRecord* files = nullptr;
+		const TTHValue* tths = nullptr;
+		const MediaRecord* media = nullptr;
+		const char* pool = nullptr;
+
+		bool checkString(const StringRef& ref) const
+		{
+			return ref.offset <= header->poolSize && ref.len <= header->poolSize - ref.offset;
+		}
+		bool checkDir(uint32_t& dirIndex, uint32_t& fileIndex, int depth) const;
+};
+
+#endif // DIRECTORY_LISTING_CACHE_H_
@@ -49,6 +49,12 @@ class DownloadManager : public Speaker<DownloadManagerListener>,
 		static void setRunningAverage(int64_t avg) { g_runningAverage = avg; }
 
 		size_t getDownloadCount() const noexcept;
+		template<typename F> void forEachDownload(F f) const
+		{
+			READ_LOCK(*csDownloads);
+			for (const DownloadPtr& d : downloads)
+				f(d);
+		}
 		void clearDownloads() noexcept;
 
 		bool isStartDownload(QueueItem::Priority prio) const noexcept;
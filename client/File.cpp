@@ -410,6 +410,33 @@ bool File::getVolumeInfo(const wstring& path, VolumeInfo &vi) noexcept
 	return true;
 }
 
+string File::getVolumeId(const string& path) noexcept
+{
+	wstring wpath = formatPath(Text::utf8ToWide(path));
+	wchar_t volume[MAX_PATH];
+	if (!GetVolumePathNameW(wpath.c_str(), volume, MAX_PATH))
+	{
+		// File may not exist yet, use the drive letter or UNC share
+		auto pos = path.find(':');
+		return pos == string::npos ? path.substr(0, path.find(PATH_SEPARATOR, 2)) : Text::toLower(path.substr(0, pos + 1));
+	}
+	return Text::toLower(Text::wideToUtf8(volume));
+}
+
+bool File::getFileId(const string& path, FileId& id) noexcept
+{
+	HANDLE h = CreateFileW(formatPath(Text::utf8ToWide(path)).c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+	                       nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+	if (h == INVALID_HANDLE_VALUE) return false;
+	BY_HANDLE_FILE_INFORMATION info;
+	BOOL result = GetFileInformationByHandle(h, &info);
+	CloseHandle(h);
+	if (!result) return false;
+	id.device = info.dwVolumeSerialNumber;
+	id.inode = (uint64_t) info.nFileIndexHigh << 32 | info.nFileIndexLow;
+	return true;
+}
+
 uint64_t File::calcFilesSize(const string& path, const string& pattern)
 {
 	uint64_t size = 0;
@@ -631,6 +658,10 @@ void File::init(const string& fileName, int access, int mode, bool, int perm)
 	h = open(fileName.c_str(), m, perm);
 	if (h == -1)
 		throw FileException(Util::translateError());
+#ifdef POSIX_FADV_SEQUENTIAL
+	if (!(mode & NO_CACHE_HINT))
+		posix_fadvise(h, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
 }
 
 size_t File::read(void* buf, size_t& len)
@@ -881,6 +912,30 @@ bool File::getVolumeInfo(const string& path, VolumeInfo &vi) noexcept
 	return true;
 }
 
+string File::getVolumeId(const string& path) noexcept
+{
+	string dir = path;
+	struct stat st;
+	while (stat(dir.c_str(), &st))
+	{
+		// File may not exist yet, go up to the nearest existing directory
+		auto pos = dir.rfind(PATH_SEPARATOR, dir.length() > 1 ? dir.length() - 2 : 0);
+		if (pos == string::npos || pos == 0)
+			return Util::emptyString;
+		dir.erase(pos + 1);
+	}
+	return Util::toString((unsigned long long) st.st_dev);
+}
+
+bool File::getFileId(const string& path, FileId& id) noexcept
+{
+	struct stat st;
+	if (stat(path.c_str(), &st)) return false;
+	id.device = st.st_dev;
+	id.inode = st.st_ino;
+	return true;
+}
+
 StringList File::findFiles(const string& path, const string& pattern, bool appendPath /*= true */)
 {
 	StringList ret;
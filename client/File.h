@@ -69,6 +69,12 @@ class File : public IOStream
 			uint64_t freeBytes;
 		};
 
+		struct FileId
+		{
+			uint64_t device;
+			uint64_t inode;
+		};
+
 		File(const string& fileName, int access, int mode, bool isAbsolutePath = true, int perm = 0644);
 #ifdef _WIN32
 		typedef HANDLE Handle;
@@ -137,6 +143,8 @@ class File : public IOStream
 		static bool getCurrentDirectory(string& path) noexcept;
 		static bool setCurrentDirectory(const string& path) noexcept;
 		static bool getVolumeInfo(const string& path, VolumeInfo &vi) noexcept;
+		static string getVolumeId(const string& path) noexcept;
+		static bool getFileId(const string& path, FileId& id) noexcept;
 
 		static uint64_t getTimeStamp(const string& fileName) noexcept;
 		static void setTimeStamp(const string& fileName, const uint64_t stamp);
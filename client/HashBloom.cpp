@@ -47,19 +47,21 @@ void HashBloom::add(const TTHValue& tth)
 {
 	for (size_t i = 0; i < k; ++i)
 	{
-		bloom[pos(tth, i)] = true;
+		const size_t bit = pos(tth, i);
+		bloom[bit >> 6] |= (uint64_t) 1 << (bit & 63);
 	}
 }
 
 bool HashBloom::match(const TTHValue& tth) const
 {
-	if (bloom.empty())
+	if (!bits)
 	{
 		return false;
 	}
 	for (size_t i = 0; i < k; ++i)
 	{
-		if (!bloom[pos(tth, i)])
+		const size_t bit = pos(tth, i);
+		if (!(bloom[bit >> 6] & (uint64_t) 1 << (bit & 63)))
 		{
 			return false;
 		}
@@ -67,14 +69,11 @@ bool HashBloom::match(const TTHValue& tth) const
 	return true;
 }
 
-void HashBloom::push_back(bool v)
-{
-	bloom.push_back(v);
-}
-
 void HashBloom::reset(size_t k_, size_t m, size_t h_)
 {
-	bloom.resize(m);
+	dcassert(h_ <= 64);
+	bloom.assign((m + 63) / 64, 0);
+	bits = m;
 	k = k_;
 	h = h_;
 }
@@ -86,28 +85,43 @@ size_t HashBloom::pos(const TTHValue& tth, size_t n) const
 		return 0;
 	}
 	
+	// Bits are numbered from the least significant bit of the first byte
+	const size_t start = n * h;
+	const uint8_t* data = tth.data + start / 8;
+	const unsigned shift = start % 8;
+	const size_t bytes = (shift + h + 7) / 8;
 	uint64_t x = 0;
-	
-	size_t start = n * h;
-	for (size_t i = 0; i < h; ++i)
+	for (size_t i = 0; i < bytes && i < 8; ++i)
 	{
-		size_t bit = start + i;
-		size_t byte = bit / 8;
-		size_t pos = bit % 8;
-		
-		if (tth.data[byte] & (1 << pos))
-		{
-			x |= (uint64_t) 1 << i;
-		}
+		x |= (uint64_t) data[i] << (i * 8);
+	}
+	x >>= shift;
+	if (bytes > 8)
+	{
+		x |= (uint64_t) data[8] << (64 - shift);
 	}
-	return x % bloom.size();
+	if (h < 64)
+	{
+		x &= ((uint64_t) 1 << h) - 1;
+	}
+	return x % bits;
 }
 
 void HashBloom::copy_to(ByteVector& v) const
 {
-	v.resize(bloom.size() / 8);
-	for (size_t i = 0; i < bloom.size(); ++i)
+	v.resize(bits / 8);
+	for (size_t i = 0; i < v.size(); ++i)
+	{
+		v[i] = (uint8_t) (bloom[i >> 3] >> ((i & 7) * 8));
+	}
+}
+
+void HashBloom::copy_from(const ByteVector& v)
+{
+	bits = v.size() * 8;
+	bloom.assign((bits + 63) / 64, 0);
+	for (size_t i = 0; i < v.size(); ++i)
 	{
-		v[i / 8] |= bloom[i] << (i % 8);
+		bloom[i >> 3] |= (uint64_t) v[i] << ((i & 7) * 8);
 	}
 }
@@ -38,7 +38,7 @@
 class HashBloom
 {
 	public:
-		HashBloom() : k(0), h(0) { }
+		HashBloom() : k(0), h(0), bits(0) { }
 		
 		/** Return a suitable value for k based on n */
 		static size_t get_k(size_t n, size_t h);
@@ -48,16 +48,18 @@ class HashBloom
 		void add(const TTHValue& tth);
 		bool match(const TTHValue& tth) const;
 		void reset(size_t k, size_t m, size_t h);
-		void push_back(bool v);
 		
+		// Bit i of the filter is bit i % 8 of byte i / 8
 		void copy_to(ByteVector& v) const;
+		void copy_from(const ByteVector& v);
 	private:
 	
 		size_t pos(const TTHValue& tth, size_t n) const;
 		
-		std::vector<bool> bloom;
+		std::vector<uint64_t> bloom;
 		size_t k;
 		size_t h;
+		size_t bits;
 };
 
 #endif /*HASHBLOOM_H_*/
@@ -8,10 +8,16 @@
 #include "TimeUtil.h"
 #include "LogManager.h"
 #include "unaligned.h"
+#include "Metrics.h"
 
 static const size_t TTH_SIZE = TigerTree::BYTES;
 static const size_t BASE_ITEM_SIZE = 10;
 
+// File identity records: tag, device, inode -> file size, timestamp, TTH
+static const uint8_t FILE_IDENTITY_TAG = 0xFF;
+static const size_t FILE_IDENTITY_KEY_SIZE = 17;
+static const size_t FILE_IDENTITY_DATA_SIZE = 16 + TTH_SIZE;
+
 enum
 {
 	ITEM_TIGER_TREE   = 1,
@@ -86,6 +92,7 @@ void HashDatabaseLMDB::close() noexcept
 bool HashDatabaseLMDB::checkError(int error, const char* what, HashDatabaseConnection* conn) noexcept
 {
 	if (!error) return true;
+	Metrics::dbErrors.add();
 	string errorText = "LMDB error: " + Util::toString(error);
 	if (what)
 	{
@@ -217,6 +224,7 @@ void HashDatabaseConnection::completeReadTxn() noexcept
 {
 	mdb_txn_reset(txnRead);
 	parent->releaseTransaction(this);
+	Metrics::dbReads.add();
 }
 
 bool HashDatabaseConnection::createWriteTxn(MDB_dbi &dbi, MDB_txn* &txnWrite) noexcept
@@ -263,7 +271,10 @@ bool HashDatabaseConnection::writeData(MDB_txn *txnWrite, MDB_dbi dbi, MDB_val &
 			abortWriteTxn(txnWrite);
 			break;
 		}
-		error = mdb_txn_commit(txnWrite);
+		{
+			Metrics::Histogram::Timer timer(Metrics::dbCommitTime);
+			error = mdb_txn_commit(txnWrite);
+		}
 		if (error) HashDatabaseLMDB::printWarning(error, "mdb_txn_commit");
 		txnWrite = nullptr; // Must not call mdb_txn_abort after mdb_txn_commit, even when an error is returned
 		if (error == MDB_MAP_FULL)
@@ -280,6 +291,7 @@ bool HashDatabaseConnection::writeData(MDB_txn *txnWrite, MDB_dbi dbi, MDB_val &
 	{
 		mdb_dbi_close(parent->env, dbi); // dbi is always 1, so mdb_dbi_close does nothing
 		parent->releaseTransaction(this);
+		Metrics::dbWrites.add();
 	}
 	return result;
 }
@@ -303,7 +315,10 @@ bool HashDatabaseConnection::deleteData(MDB_txn *txnWrite, MDB_dbi dbi, MDB_val
 			abortWriteTxn(txnWrite);
 			break;
 		}
-		error = mdb_txn_commit(txnWrite);
+		{
+			Metrics::Histogram::Timer timer(Metrics::dbCommitTime);
+			error = mdb_txn_commit(txnWrite);
+		}
 		txnWrite = nullptr;
 		if (error == MDB_MAP_FULL)
 		{
@@ -319,6 +334,7 @@ bool HashDatabaseConnection::deleteData(MDB_txn *txnWrite, MDB_dbi dbi, MDB_val
 	{
 		mdb_dbi_close(parent->env, dbi); // dbi is always 1, so mdb_dbi_close does nothing
 		parent->releaseTransaction(this);
+		Metrics::dbWrites.add();
 	}
 	return result;
 }
@@ -702,6 +718,69 @@ bool HashDatabaseConnection::removeTigerTree(const void *tth) noexcept
 	return false;
 }
 
+static void makeFileIdentityKey(uint8_t *key, const HashDatabaseConnection::FileIdentity &id) noexcept
+{
+	key[0] = FILE_IDENTITY_TAG;
+	storeUnaligned64(key + 1, id.device);
+	storeUnaligned64(key + 9, id.inode);
+}
+
+bool HashDatabaseConnection::getFileIdentity(const FileIdentity &id, void *tth) noexcept
+{
+	MDB_dbi dbi;
+	if (!createReadTxn(dbi)) return false;
+
+	uint8_t keyData[FILE_IDENTITY_KEY_SIZE];
+	makeFileIdentityKey(keyData, id);
+	MDB_val key, val;
+	key.mv_data = keyData;
+	key.mv_size = FILE_IDENTITY_KEY_SIZE;
+	int error = mdb_get(txnRead, dbi, &key, &val);
+	bool result = false;
+	if (!error && val.mv_size == FILE_IDENTITY_DATA_SIZE)
+	{
+		const uint8_t *ptr = static_cast<const uint8_t*>(val.mv_data);
+		if (loadUnaligned64(ptr) == id.fileSize && loadUnaligned64(ptr + 8) == id.timestamp)
+		{
+			memcpy(tth, ptr + 16, TTH_SIZE);
+			result = true;
+		}
+	}
+	completeReadTxn();
+	return result;
+}
+
+bool HashDatabaseConnection::putFileIdentity(const FileIdentity &id, const void *tth) noexcept
+{
+	MDB_txn *txnWrite = nullptr;
+	MDB_dbi dbi;
+	if (!createWriteTxn(dbi, txnWrite)) return false;
+
+	uint8_t keyData[FILE_IDENTITY_KEY_SIZE];
+	makeFileIdentityKey(keyData, id);
+	MDB_val key, val;
+	key.mv_data = keyData;
+	key.mv_size = FILE_IDENTITY_KEY_SIZE;
+	int error = mdb_get(txnWrite, dbi, &key, &val);
+	if (!error && val.mv_size == FILE_IDENTITY_DATA_SIZE)
+	{
+		const uint8_t *ptr = static_cast<const uint8_t*>(val.mv_data);
+		if (loadUnaligned64(ptr) == id.fileSize && loadUnaligned64(ptr + 8) == id.timestamp && !memcmp(ptr + 16, tth, TTH_SIZE))
+		{
+			abortWriteTxn(txnWrite);
+			return true;
+		}
+	}
+
+	uint8_t data[FILE_IDENTITY_DATA_SIZE];
+	storeUnaligned64(data, id.fileSize);
+	storeUnaligned64(data + 8, id.timestamp);
+	memcpy(data + 16, tth, TTH_SIZE);
+	val.mv_data = data;
+	val.mv_size = FILE_IDENTITY_DATA_SIZE;
+	return writeData(txnWrite, dbi, key, val);
+}
+
 bool HashDatabaseLMDB::getDBInfo(size_t &dataItems, uint64_t &dbSize) noexcept
 {
 	MDB_stat stat;
@@ -822,7 +901,7 @@ bool HashDatabaseConnection::getDBInfo(DbInfo &info, int flags) noexcept
 				hashKeys.update(key.mv_data, key.mv_size);
 				hashValues.update(val.mv_data, val.mv_size);
 			}
-			if (flags & GET_DB_INFO_TREES)
+			if ((flags & GET_DB_INFO_TREES) && key.mv_size == TTH_SIZE)
 			{
 				ItemParser parser(static_cast<const uint8_t*>(val.mv_data) + BASE_ITEM_SIZE, val.mv_size - BASE_ITEM_SIZE);
 				int itemType;
@@ -25,6 +25,15 @@ class HashDatabaseConnection
 			uint8_t dataHash[24];
 		};
 
+		// Identifies file contents by location on disk, used to avoid rehashing moved files
+		struct FileIdentity
+		{
+			uint64_t device;
+			uint64_t inode;
+			uint64_t fileSize;
+			uint64_t timestamp;
+		};
+
 		enum
 		{
 			GET_DB_INFO_DETAILS  = 1,
@@ -42,6 +51,8 @@ class HashDatabaseConnection
 		bool putFileInfo(const void *tth, unsigned flags, uint64_t fileSize, const string *path, bool incUploadCount) noexcept;
 		bool putTigerTree(const TigerTree &tree) noexcept;
 		bool removeTigerTree(const void *tth) noexcept;
+		bool getFileIdentity(const FileIdentity &id, void *tth) noexcept;
+		bool putFileIdentity(const FileIdentity &id, const void *tth) noexcept;
 		bool getDBInfo(DbInfo &info, int flags) noexcept;
 
 	private:
@@ -31,6 +31,7 @@
 #include "FormatUtil.h"
 #include "Util.h"
 #include "ConfCore.h"
+#include "Metrics.h"
 
 // Return values of fastHash and slowHash
 enum
@@ -171,6 +172,17 @@ void HashManager::hashDone(uint64_t tick, int64_t fileID, const SharedFilePtr& f
 	if (hashDb)
 	{
 		db->addTree(hashDb, tth);
+		File::FileId fileId;
+		FileAttributes attr;
+		if (File::getFileId(fileName, fileId) && File::getAttributes(fileName, attr) && attr.getSize() == size)
+		{
+			HashDatabaseConnection::FileIdentity id;
+			id.device = fileId.device;
+			id.inode = fileId.inode;
+			id.fileSize = size;
+			id.timestamp = attr.getTimeStamp();
+			hashDb->putFileIdentity(id, tth.getRoot().data);
+		}
 		db->putHashDatabaseConnection(hashDb);
 	}
 	fire(HashManagerListener::FileHashed(), fileID, file, fileName, tth.getRoot(), size);
@@ -191,6 +203,33 @@ void HashManager::hashDone(uint64_t tick, int64_t fileID, const SharedFilePtr& f
 	}
 }
 
+bool HashManager::findHashedFile(const string& path, int64_t size, uint64_t timestamp, TTHValue& tth) noexcept
+{
+	File::FileId fileId;
+	if (!File::getFileId(path, fileId))
+		return false;
+	HashDatabaseConnection::FileIdentity id;
+	id.device = fileId.device;
+	id.inode = fileId.inode;
+	id.fileSize = size;
+	id.timestamp = timestamp;
+
+	auto db = DatabaseManager::getInstance();
+	auto hashDb = db->getHashDatabaseConnection();
+	if (!hashDb)
+		return false;
+	bool result = hashDb->getFileIdentity(id, tth.data);
+	if (result && TigerTree::calcBlocks(size, TigerTree::getMaxBlockSize(size)) > 1)
+	{
+		// Make sure the tree is still there
+		unsigned flags;
+		size_t treeSize;
+		result = hashDb->getFileInfo(tth.data, flags, nullptr, nullptr, &treeSize, nullptr) && treeSize;
+	}
+	db->putHashDatabaseConnection(hashDb);
+	return result;
+}
+
 void HashManager::reportError(int64_t fileID, const SharedFilePtr& file, const string& fileName, const string& error)
 {
 	LogManager::message(STRING(ERROR_HASHING) + ' ' + fileName + ": " + error);
@@ -613,6 +652,9 @@ int HashManager::Hasher::run()
 				if (mediaInfoFileTypes & currentItem.file->getFileTypes())
 					processMediaFile(currentItem);
 				const uint64_t speed = end > start ? size * 1000 / (end - start) : 0;
+				Metrics::hashFiles.add();
+				Metrics::hashBytes.add(size);
+				Metrics::hashFileTime.observe((end - start) * 1000);
 				hashManager->hashDone(end, currentItem.fileID, currentItem.file, filename, tree, speed, size);
 #ifdef _WIN32
 				if (!SysVersion::isWine() && size >= optSaveTreeMinSize)
@@ -100,6 +100,9 @@ class HashManager : public Singleton<HashManager>, public Speaker<HashManagerLis
 			return hasher.isHashing();
 		}
 
+		// Finds the TTH of a file hashed before under another name (same device, inode, size and timestamp)
+		static bool findHashedFile(const string& path, int64_t size, uint64_t timestamp, TTHValue& tth) noexcept;
+
 #ifdef _WIN32
 		static bool doLoadTree(const string& filePath, TigerTree& tree, int64_t fileSize, bool checkTimestamp) noexcept;
 		static bool loadTree(const string& filePath, TigerTree& tree, int64_t fileSize = -1) noexcept;
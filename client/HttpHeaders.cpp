@@ -7,12 +7,12 @@
 
 #include <string.h>
 
-#define TOTAL_KEYWORDS 44
+#define TOTAL_KEYWORDS 45
 #define MIN_WORD_LENGTH 2
 #define MAX_WORD_LENGTH 19
 #define MIN_HASH_VALUE 3
-#define MAX_HASH_VALUE 57
-/* maximum key range = 55, duplicates = 0 */
+#define MAX_HASH_VALUE 61
+/* maximum key range = 59, duplicates = 0 */
 
 static inline int asciiToLower(int c)
 {
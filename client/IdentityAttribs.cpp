@@ -0,0 +1,154 @@
+#include "stdinc.h"
+#include "IdentityAttribs.h"
+#include "Locks.h"
+
+namespace
+{
+	struct Retired
+	{
+		void* array;
+		const string* value;
+	};
+
+	// Two reader counters: replaced data goes to the waiting list when the epoch is switched
+	// and is freed once the readers that started in the previous epoch are gone
+	static std::atomic<int> readers[2];
+	static std::atomic<int> epoch(0);
+	static CriticalSection csRetired;
+	static vector<Retired> retired;
+	static vector<Retired> waiting;
+
+	static const size_t RECLAIM_THRESHOLD = 256;
+
+	void freeRetired(vector<Retired>& v)
+	{
+		for (const Retired& r : v)
+		{
+			free(r.array);
+			if (r.value) StringPool::release(r.value);
+		}
+		v.clear();
+	}
+}
+
+IdentityAttribs::ReadGuard::ReadGuard() noexcept
+{
+	for (;;)
+	{
+		int e = epoch.load();
+		readers[e]++;
+		if (epoch.load() == e)
+		{
+			slot = e;
+			break;
+		}
+		readers[e]--;
+	}
+}
+
+IdentityAttribs::ReadGuard::~ReadGuard() noexcept
+{
+	readers[slot]--;
+}
+
+IdentityAttribs::~IdentityAttribs()
+{
+	Array* a = data.load();
+	if (!a) return;
+	for (uint16_t i = 0; i < a->count; ++i)
+		StringPool::release(a->items[i].value);
+	free(a);
+}
+
+IdentityAttribs::Array* IdentityAttribs::allocArray(uint16_t count) noexcept
+{
+	Array* a = static_cast<Array*>(malloc(offsetof(Array, items) + count * sizeof(Item)));
+	a->count = count;
+	return a;
+}
+
+void IdentityAttribs::set(uint16_t tag, const string& value) noexcept
+{
+	Array* old = data.load();
+	const uint16_t count = old ? old->count : 0;
+	uint16_t pos = 0;
+	while (pos < count && old->items[pos].tag < tag) ++pos;
+	const bool found = pos < count && old->items[pos].tag == tag;
+	if (value.empty())
+	{
+		if (!found) return;
+	}
+	else if (found && *old->items[pos].value == value)
+		return;
+
+	const string* newValue = value.empty() ? nullptr : StringPool::add(value);
+	const uint16_t newCount = count - (found ? 1 : 0) + (newValue ? 1 : 0);
+	Array* a = nullptr;
+	if (newCount)
+	{
+		a = allocArray(newCount);
+		uint16_t j = 0;
+		for (uint16_t i = 0; i < pos; ++i)
+			a->items[j++] = old->items[i];
+		if (newValue)
+		{
+			a->items[j].tag = tag;
+			a->items[j++].value = newValue;
+		}
+		for (uint16_t i = found ? pos + 1 : pos; i < count; ++i)
+			a->items[j++] = old->items[i];
+		dcassert(j == newCount);
+	}
+	data.store(a);
+	// Unchanged values are owned by the new array now
+	if (old) retire(old, found ? old->items[pos].value : nullptr);
+}
+
+const string* IdentityAttribs::get(uint16_t tag) const noexcept
+{
+	const Array* a = data.load();
+	if (!a) return nullptr;
+	for (uint16_t i = 0; i < a->count; ++i)
+	{
+		const Item& item = a->items[i];
+		if (item.tag == tag) return item.value;
+		if (item.tag > tag) break;
+	}
+	return nullptr;
+}
+
+void IdentityAttribs::retire(Array* a, const string* value) noexcept
+{
+	bool doReclaim;
+	{
+		LOCK(csRetired);
+		retired.push_back(Retired{a, value});
+		doReclaim = retired.size() >= RECLAIM_THRESHOLD;
+	}
+	if (doReclaim) reclaim();
+}
+
+void IdentityAttribs::reclaim() noexcept
+{
+	vector<Retired> toFree;
+	{
+		LOCK(csRetired);
+		if (!waiting.empty())
+		{
+			if (readers[1 - epoch.load()].load() != 0) return;
+			toFree.swap(waiting);
+		}
+		if (!retired.empty())
+		{
+			waiting.swap(retired);
+			epoch.store(1 - epoch.load());
+		}
+	}
+	freeRetired(toFree);
+}
+
+size_t IdentityAttribs::getPendingCount() noexcept
+{
+	LOCK(csRetired);
+	return retired.size() + waiting.size();
+}
@@ -0,0 +1,71 @@
+#ifndef IDENTITY_ATTRIBS_H_
+#define IDENTITY_ATTRIBS_H_
+
+#include "StringPool.h"
+#include <atomic>
+
+/**
+ * Compact storage of the string attributes of Identity: a sorted array of tags and pooled values.
+ * The array is immutable, a writer replaces it with a modified copy, so readers don't need a lock.
+ * Writers must be serialized by the owner. Readers must hold a ReadGuard while they use the returned values,
+ * replaced arrays and values are released only when no reader can see them.
+ */
+class IdentityAttribs
+{
+	public:
+		struct Item
+		{
+			uint16_t tag;
+			const string* value;
+		};
+
+		class ReadGuard
+		{
+			public:
+				ReadGuard() noexcept;
+				~ReadGuard() noexcept;
+
+				ReadGuard(const ReadGuard&) = delete;
+				ReadGuard& operator= (const ReadGuard&) = delete;
+
+			private:
+				int slot;
+		};
+
+		IdentityAttribs() : data(nullptr) {}
+		~IdentityAttribs();
+
+		IdentityAttribs(const IdentityAttribs&) = delete;
+		IdentityAttribs& operator= (const IdentityAttribs&) = delete;
+
+		// Empty value removes the attribute
+		void set(uint16_t tag, const string& value) noexcept;
+
+		// Require ReadGuard
+		const string* get(uint16_t tag) const noexcept;
+		template<typename F> void forEach(F f) const
+		{
+			const Array* a = data.load();
+			if (!a) return;
+			for (uint16_t i = 0; i < a->count; ++i)
+				f(a->items[i].tag, *a->items[i].value);
+		}
+
+		// Frees the data replaced before all current readers have started
+		static void reclaim() noexcept;
+		static size_t getPendingCount() noexcept;
+
+	private:
+		struct Array
+		{
+			uint16_t count;
+			Item items[1];
+		};
+
+		std::atomic<Array*> data;
+
+		static Array* allocArray(uint16_t count) noexcept;
+		static void retire(Array* a, const string* value) noexcept;
+};
+
+#endif // IDENTITY_ATTRIBS_H_
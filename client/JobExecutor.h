@@ -1,56 +1,49 @@
 #ifndef JOB_EXECUTOR_H_
 #define JOB_EXECUTOR_H_
 
-#include "Thread.h"
-#include "Locks.h"
-#include "WaitableEvent.h"
+#include "JobPool.h"
 
-class JobExecutor : public Thread
+// Serial (by default) job queue running on the shared JobPool
+class JobExecutor
 {
 	public:
-		class Job
+		typedef JobPool::Job Job;
+
+		explicit JobExecutor(const char* name = "JobExecutor", JobPool::Priority priority = JobPool::PRIORITY_NORMAL, int maxConcurrency = 1) :
+			lane(name, priority, maxConcurrency) {}
+
+		bool addJob(Job* job, const string& key = string(), JobPool::JobHandle* handle = nullptr) noexcept
 		{
-			public:
-				virtual ~Job() {}
-				virtual void run() = 0;
-		};
-	
-	public:
-		JobExecutor() : shutdownFlag(false), runningFlag(false), maxSleepTime(15000) {}
+			return lane.addJob(job, key, handle);
+		}
 
-		~JobExecutor()
+		void shutdown(bool finishJob = false) noexcept
 		{
-			dcassert(!runningFlag);
+			lane.shutdown(finishJob);
 		}
 
-		bool addJob(Job* job) noexcept;
-		void shutdown(bool finishJob = false) noexcept;
+		void wait() noexcept
+		{
+			lane.wait();
+		}
 
-		void setMaxSleepTime(int milliseconds) noexcept
+		void setMaxConcurrency(int value) noexcept
 		{
-			cs.lock();
-			maxSleepTime = milliseconds;
-			cs.unlock();
+			lane.setMaxConcurrency(value);
 		}
 
 		bool isRunning() const noexcept
 		{
-			cs.lock();
-			bool result = runningFlag;
-			cs.unlock();
-			return result;
+			return lane.isBusy();
 		}
 
-	protected:
-		virtual int run() noexcept override;
+		void getStats(JobPool::LaneStats& stats) const noexcept
+		{
+			lane.getStats(stats);
+		}
 
 	private:
-		std::list<Job*> jobs;
-		mutable CriticalSection cs;
-		WaitableEvent event;
-		bool shutdownFlag;
-		bool runningFlag;
-		int maxSleepTime;
+		JobPool::Lane lane;
 };
 
 #endif // JOB_EXECUTOR_H_
@@ -0,0 +1,466 @@
+#include "stdinc.h"
+#include "JobPool.h"
+#include "TimeUtil.h"
+#include <thread>
+
+JobPool JobPool::instance;
+
+thread_local JobPool::Worker* JobPool::currentWorker = nullptr;
+thread_local JobPool::JobState* JobPool::currentJob = nullptr;
+
+static const int DEFAULT_IDLE_TIMEOUT = 15000;
+
+bool JobPool::JobHandle::cancel() noexcept
+{
+	if (!state) return false;
+	state->cancelled.store(true);
+	int expected = JobState::STATE_QUEUED;
+	return state->state.compare_exchange_strong(expected, JobState::STATE_CANCELLED);
+}
+
+bool JobPool::JobHandle::isFinished() const noexcept
+{
+	if (!state) return true;
+	int value = state->state.load();
+	return value == JobState::STATE_FINISHED || value == JobState::STATE_CANCELLED;
+}
+
+JobPool::Lane::Lane(const char* name, Priority priority, int maxConcurrency, JobPool* pool) :
+	pool(pool ? *pool : JobPool::instance), name(name), priority(priority),
+	maxConcurrency(max(maxConcurrency, 1)), shutdownFlag(false), waiters(0)
+{
+	memset(&stats, 0, sizeof(stats));
+	finishedEvent.create();
+	this->pool.addLane(this);
+}
+
+JobPool::Lane::~Lane()
+{
+	shutdown(false);
+	pool.removeLane(this);
+}
+
+bool JobPool::Lane::addJob(Job* job, const string& key, JobHandle* handle) noexcept
+{
+	Item item;
+	item.job = job;
+	item.key = key;
+	item.state = std::make_shared<JobState>();
+	item.queueTime = GET_TICK();
+	LOCK(pool.cs);
+	if (shutdownFlag || pool.shutdownFlag)
+		return false;
+	jobs.push_back(std::move(item));
+	if (jobs.size() > stats.maxQueued)
+		stats.maxQueued = jobs.size();
+	if (handle)
+		*handle = JobHandle(jobs.back().state);
+	if (stats.running < maxConcurrency)
+		pool.wakeWorkerL(false);
+	return true;
+}
+
+void JobPool::Lane::shutdown(bool finishJobs) noexcept
+{
+	std::deque<Item> savedJobs;
+	{
+		LOCK(pool.cs);
+		shutdownFlag = true;
+		std::swap(jobs, savedJobs);
+	}
+	for (;;)
+	{
+		{
+			LOCK(pool.cs);
+			if (!stats.running) break;
+		}
+		finishedEvent.timedWait(100);
+		finishedEvent.reset();
+	}
+	for (Item& item : savedJobs)
+	{
+		if (finishJobs && !item.state->cancelled.load())
+			item.job->run();
+		delete item.job;
+	}
+}
+
+void JobPool::Lane::wait() noexcept
+{
+	{
+		LOCK(pool.cs);
+		if (!stats.running && jobs.empty()) return;
+		waiters++;
+	}
+	for (;;)
+	{
+		finishedEvent.timedWait(100);
+		finishedEvent.reset();
+		LOCK(pool.cs);
+		if (!stats.running && jobs.empty())
+		{
+			waiters--;
+			break;
+		}
+	}
+}
+
+bool JobPool::Lane::isBusy() const noexcept
+{
+	LOCK(pool.cs);
+	return stats.running || !jobs.empty();
+}
+
+void JobPool::Lane::setMaxConcurrency(int value) noexcept
+{
+	LOCK(pool.cs);
+	maxConcurrency = max(value, 1);
+	if (!jobs.empty() && stats.running < maxConcurrency)
+		pool.wakeWorkerL(false);
+}
+
+void JobPool::Lane::getStats(LaneStats& result) const noexcept
+{
+	LOCK(pool.cs);
+	result = stats;
+	result.queued = jobs.size();
+}
+
+JobPool::TaskGroup::TaskGroup(JobPool* pool) : pool(pool ? *pool : JobPool::instance), pending(0)
+{
+}
+
+void JobPool::TaskGroup::run(std::function<void()>&& func) noexcept
+{
+	++pending;
+	pool.pushTask(Task{std::move(func), this});
+}
+
+void JobPool::TaskGroup::wait(int maxPending) noexcept
+{
+	int spinCount = 0;
+	while (pending.load() > maxPending)
+	{
+		// When only waiting for a free slot give other workers a chance first,
+		// so the caller can get back to its own work sooner
+		Task task;
+		if ((maxPending == 0 || spinCount >= 64) && pool.getTask(currentWorker, task))
+		{
+			pool.runTask(task);
+			spinCount = 0;
+			continue;
+		}
+		if (++spinCount < 64)
+			BaseThread::yield();
+		else
+			BaseThread::sleep(1);
+	}
+}
+
+JobPool::JobPool() : nextLane(0), activeWorkers(0), idleTimeout(DEFAULT_IDLE_TIMEOUT), shutdownFlag(false), taskCount(0), stealCount(0)
+{
+	hardwareThreads = max<int>(std::thread::hardware_concurrency(), 2);
+}
+
+JobPool::~JobPool()
+{
+	shutdown();
+	for (Worker* worker : workers)
+		delete worker;
+}
+
+void JobPool::shutdown() noexcept
+{
+	{
+		LOCK(cs);
+		if (shutdownFlag) return;
+		shutdownFlag = true;
+		for (Worker* worker : workers)
+			if (worker->active)
+				worker->event.notify();
+	}
+	for (Worker* worker : workers)
+		worker->join();
+	std::deque<Task> savedTasks;
+	{
+		LOCK(cs);
+		std::swap(injectedTasks, savedTasks);
+	}
+	for (Task& task : savedTasks)
+		runTask(task);
+}
+
+void JobPool::getStats(Stats& stats) const noexcept
+{
+	LOCK(cs);
+	stats.workers = activeWorkers;
+	stats.idleWorkers = 0;
+	for (const Worker* worker : workers)
+		if (worker->active && worker->idle)
+			++stats.idleWorkers;
+	stats.tasks = taskCount.load();
+	stats.steals = stealCount.load();
+}
+
+void JobPool::getLaneStats(vector<pair<string, LaneStats>>& result) const noexcept
+{
+	LOCK(cs);
+	result.clear();
+	for (const Lane* lane : lanes)
+	{
+		result.emplace_back(lane->name, lane->stats);
+		result.back().second.queued = lane->jobs.size();
+	}
+}
+
+bool JobPool::isCancelled() noexcept
+{
+	return currentJob && currentJob->cancelled.load();
+}
+
+void JobPool::addLane(Lane* lane) noexcept
+{
+	LOCK(cs);
+	lanes.push_back(lane);
+}
+
+void JobPool::removeLane(Lane* lane) noexcept
+{
+	LOCK(cs);
+	auto i = std::find(lanes.begin(), lanes.end(), lane);
+	if (i != lanes.end()) lanes.erase(i);
+	nextLane = 0;
+}
+
+void JobPool::wakeWorkerL(bool forTask) noexcept
+{
+	if (shutdownFlag) return;
+	for (Worker* worker : workers)
+		if (worker->active && worker->idle)
+		{
+			worker->idle = false;
+			worker->event.notify();
+			return;
+		}
+	// Every lane may occupy a worker with a long running job, so they are not
+	// counted against the number of threads available for short tasks
+	int maxWorkers = hardwareThreads + (forTask ? 0 : (int) lanes.size());
+	if (activeWorkers >= maxWorkers) return;
+	Worker* worker = nullptr;
+	for (Worker* w : workers)
+		if (!w->active)
+		{
+			worker = w;
+			break;
+		}
+	if (!worker)
+	{
+		worker = new Worker(*this);
+		worker->event.create();
+		workers.push_back(worker);
+	}
+	try
+	{
+		worker->active = true;
+		worker->idle = false;
+		worker->start(0, "JobPool");
+		++activeWorkers;
+	}
+	catch (const ThreadException&)
+	{
+		worker->active = false;
+	}
+}
+
+bool JobPool::getLaneJobL(Lane*& result, Lane::Item& item) noexcept
+{
+	const size_t count = lanes.size();
+	for (int priority = PRIORITY_HIGH; priority < PRIORITY_LAST; ++priority)
+		for (size_t i = 0; i < count; ++i)
+		{
+			Lane* lane = lanes[(nextLane + i) % count];
+			if (lane->priority != priority || lane->shutdownFlag || lane->stats.running >= lane->maxConcurrency) continue;
+			auto& jobs = lane->jobs;
+			for (auto j = jobs.begin(); j != jobs.end();)
+			{
+				if (j->state->state.load() == JobState::STATE_CANCELLED)
+				{
+					delete j->job;
+					j = jobs.erase(j);
+					lane->stats.cancelled++;
+					continue;
+				}
+				if (!j->key.empty() && std::find(lane->runningKeys.begin(), lane->runningKeys.end(), j->key) != lane->runningKeys.end())
+				{
+					++j;
+					continue;
+				}
+				item = std::move(*j);
+				jobs.erase(j);
+				if (!item.key.empty()) lane->runningKeys.push_back(item.key);
+				lane->stats.running++;
+				nextLane = (nextLane + i + 1) % count;
+				result = lane;
+				return true;
+			}
+		}
+	return false;
+}
+
+void JobPool::runLaneJob(Lane* lane, Lane::Item& item) noexcept
+{
+	const uint64_t startTime = GET_TICK();
+	int expected = JobState::STATE_QUEUED;
+	bool started = item.state->state.compare_exchange_strong(expected, JobState::STATE_RUNNING);
+	if (started)
+	{
+		currentJob = item.state.get();
+		item.job->run();
+		currentJob = nullptr;
+		item.state->state.store(JobState::STATE_FINISHED);
+	}
+	delete item.job;
+	const uint64_t endTime = GET_TICK();
+
+	LOCK(cs);
+	LaneStats& stats = lane->stats;
+	stats.running--;
+	if (!item.key.empty())
+	{
+		auto i = std::find(lane->runningKeys.begin(), lane->runningKeys.end(), item.key);
+		if (i != lane->runningKeys.end()) lane->runningKeys.erase(i);
+	}
+	if (started)
+	{
+		uint64_t waitTime = startTime - item.queueTime;
+		stats.completed++;
+		stats.totalWaitTime += waitTime;
+		if (waitTime > stats.maxWaitTime) stats.maxWaitTime = waitTime;
+		stats.totalRunTime += endTime - startTime;
+	}
+	else
+		stats.cancelled++;
+	if (lane->shutdownFlag || lane->waiters)
+		lane->finishedEvent.notify();
+}
+
+void JobPool::runTask(Task& task) noexcept
+{
+	task.func();
+	task.group->pending--;
+	++taskCount;
+}
+
+void JobPool::pushTask(Task&& task) noexcept
+{
+	Worker* worker = currentWorker;
+	if (worker && &worker->pool == this)
+	{
+		worker->csTasks.lock();
+		worker->tasks.push_back(std::move(task));
+		worker->csTasks.unlock();
+	}
+	else
+	{
+		LOCK(cs);
+		if (shutdownFlag)
+		{
+			runTask(task);
+			return;
+		}
+		injectedTasks.push_back(std::move(task));
+	}
+	LOCK(cs);
+	wakeWorkerL(true);
+}
+
+bool JobPool::getTask(Worker* self, Task& task) noexcept
+{
+	if (self && &self->pool == this && self->popTask(task))
+		return true;
+	{
+		LOCK(cs);
+		if (!injectedTasks.empty())
+		{
+			task = std::move(injectedTasks.front());
+			injectedTasks.pop_front();
+			return true;
+		}
+	}
+	cs.lock();
+	vector<Worker*> victims = workers;
+	cs.unlock();
+	for (Worker* worker : victims)
+		if (worker != self && worker->stealTask(task))
+		{
+			++stealCount;
+			return true;
+		}
+	return false;
+}
+
+bool JobPool::Worker::popTask(Task& task) noexcept
+{
+	LOCK(csTasks);
+	if (tasks.empty()) return false;
+	task = std::move(tasks.back());
+	tasks.pop_back();
+	return true;
+}
+
+bool JobPool::Worker::stealTask(Task& task) noexcept
+{
+	LOCK(csTasks);
+	if (tasks.empty()) return false;
+	task = std::move(tasks.front());
+	tasks.pop_front();
+	return true;
+}
+
+int JobPool::Worker::run() noexcept
+{
+	currentWorker = this;
+	for (;;)
+	{
+		Task task;
+		if (pool.getTask(this, task))
+		{
+			pool.runTask(task);
+			continue;
+		}
+		Lane* lane;
+		Lane::Item item;
+		pool.cs.lock();
+		if (pool.shutdownFlag)
+		{
+			active = idle = false;
+			pool.activeWorkers--;
+			pool.cs.unlock();
+			break;
+		}
+		if (pool.getLaneJobL(lane, item))
+		{
+			pool.cs.unlock();
+			pool.runLaneJob(lane, item);
+			continue;
+		}
+		idle = true;
+		int waitTime = pool.idleTimeout;
+		pool.cs.unlock();
+		bool signalled = event.timedWait(waitTime);
+		if (signalled) event.reset();
+		pool.cs.lock();
+		if (idle && !signalled && !pool.shutdownFlag)
+		{
+			// Nobody woke us up, release the thread
+			active = idle = false;
+			pool.activeWorkers--;
+			pool.cs.unlock();
+			break;
+		}
+		idle = false;
+		pool.cs.unlock();
+	}
+	currentWorker = nullptr;
+	return 0;
+}
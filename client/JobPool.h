@@ -0,0 +1,223 @@
+#ifndef JOB_POOL_H_
+#define JOB_POOL_H_
+
+#include "Thread.h"
+#include "Locks.h"
+#include "WaitableEvent.h"
+#include "typedefs.h"
+#include <atomic>
+
+/**
+ * Shared pool of worker threads.
+ * Long running jobs are queued to lanes, each lane has a priority and a limit
+ * on the number of jobs it may run at the same time. Short tasks created
+ * by a running job (see TaskGroup) are pushed to the worker's own deque and
+ * can be stolen by idle workers.
+ */
+class JobPool
+{
+	public:
+		enum Priority
+		{
+			PRIORITY_HIGH,
+			PRIORITY_NORMAL,
+			PRIORITY_LOW,
+			PRIORITY_LAST
+		};
+
+		class Job
+		{
+			public:
+				virtual ~Job() {}
+				virtual void run() = 0;
+		};
+
+		struct JobState
+		{
+			enum
+			{
+				STATE_QUEUED,
+				STATE_RUNNING,
+				STATE_FINISHED,
+				STATE_CANCELLED
+			};
+
+			std::atomic<int> state;
+			std::atomic_bool cancelled;
+
+			JobState() : state(STATE_QUEUED), cancelled(false) {}
+		};
+
+		class JobHandle
+		{
+			public:
+				JobHandle() {}
+				explicit JobHandle(const std::shared_ptr<JobState>& state) : state(state) {}
+
+				// Returns true if the job was removed from the queue before it started.
+				// A running job is only notified, it should check JobPool::isCancelled().
+				bool cancel() noexcept;
+				bool isCancelled() const noexcept { return state && state->cancelled.load(); }
+				bool isFinished() const noexcept;
+				void reset() noexcept { state.reset(); }
+				explicit operator bool() const noexcept { return state != nullptr; }
+
+			private:
+				std::shared_ptr<JobState> state;
+		};
+
+		struct LaneStats
+		{
+			size_t queued;
+			size_t maxQueued;
+			int running;
+			uint64_t completed;
+			uint64_t cancelled;
+			uint64_t totalWaitTime; // milliseconds
+			uint64_t maxWaitTime;
+			uint64_t totalRunTime;
+		};
+
+		struct Stats
+		{
+			int workers;
+			int idleWorkers;
+			uint64_t tasks;
+			uint64_t steals;
+		};
+
+		class Lane
+		{
+				friend class JobPool;
+
+			public:
+				explicit Lane(const char* name, Priority priority = PRIORITY_NORMAL, int maxConcurrency = 1, JobPool* pool = nullptr);
+				~Lane();
+
+				Lane(const Lane&) = delete;
+				Lane& operator= (const Lane&) = delete;
+
+				// Jobs with the same non-empty key are never run concurrently.
+				// On failure the caller retains ownership of the job.
+				bool addJob(Job* job, const string& key = string(), JobHandle* handle = nullptr) noexcept;
+				void shutdown(bool finishJobs) noexcept;
+				// Blocks until the queue is empty and no job is running
+				void wait() noexcept;
+				bool isBusy() const noexcept;
+				void setMaxConcurrency(int value) noexcept;
+				void getStats(LaneStats& stats) const noexcept;
+				const char* getName() const { return name; }
+				Priority getPriority() const { return priority; }
+
+			private:
+				struct Item
+				{
+					Job* job;
+					string key;
+					std::shared_ptr<JobState> state;
+					uint64_t queueTime;
+				};
+
+				JobPool& pool;
+				const char* const name;
+				const Priority priority;
+				int maxConcurrency;
+				bool shutdownFlag;
+				int waiters;
+				std::deque<Item> jobs;
+				StringList runningKeys;
+				LaneStats stats;
+				WaitableEvent finishedEvent;
+		};
+
+		class TaskGroup
+		{
+			public:
+				explicit TaskGroup(JobPool* pool = nullptr);
+				~TaskGroup() { wait(); }
+
+				TaskGroup(const TaskGroup&) = delete;
+				TaskGroup& operator= (const TaskGroup&) = delete;
+
+				void run(std::function<void()>&& func) noexcept;
+				// Waits until no more than maxPending tasks of the group are left.
+				// Pending tasks are executed in the calling thread when other workers are busy.
+				void wait(int maxPending = 0) noexcept;
+				int getPending() const noexcept { return pending.load(); }
+				bool isDone() const noexcept { return pending.load() == 0; }
+
+			private:
+				JobPool& pool;
+				std::atomic<int> pending;
+
+				friend class JobPool;
+		};
+
+		JobPool();
+		~JobPool();
+
+		JobPool(const JobPool&) = delete;
+		JobPool& operator= (const JobPool&) = delete;
+
+		void shutdown() noexcept;
+		void setIdleTimeout(int milliseconds) noexcept { idleTimeout = milliseconds; }
+		void getStats(Stats& stats) const noexcept;
+		void getLaneStats(vector<pair<string, LaneStats>>& result) const noexcept;
+		int getHardwareThreads() const { return hardwareThreads; }
+
+		// Returns true if the job running in the calling thread was cancelled
+		static bool isCancelled() noexcept;
+
+		static JobPool instance;
+
+	private:
+		struct Task
+		{
+			std::function<void()> func;
+			TaskGroup* group;
+		};
+
+		class Worker : public Thread
+		{
+			public:
+				Worker(JobPool& pool) : pool(pool), active(false), idle(false) {}
+				bool popTask(Task& task) noexcept;
+				bool stealTask(Task& task) noexcept;
+
+				JobPool& pool;
+				std::deque<Task> tasks;
+				FastCriticalSection csTasks;
+				WaitableEvent event;
+				bool active;
+				bool idle;
+
+			protected:
+				int run() noexcept override;
+		};
+
+		mutable CriticalSection cs;
+		vector<Lane*> lanes;
+		vector<Worker*> workers;
+		std::deque<Task> injectedTasks;
+		size_t nextLane;
+		int hardwareThreads;
+		int activeWorkers;
+		int idleTimeout;
+		bool shutdownFlag;
+		std::atomic<uint64_t> taskCount;
+		std::atomic<uint64_t> stealCount;
+
+		static thread_local Worker* currentWorker;
+		static thread_local JobState* currentJob;
+
+		void addLane(Lane* lane) noexcept;
+		void removeLane(Lane* lane) noexcept;
+		void wakeWorkerL(bool forTask) noexcept;
+		bool getLaneJobL(Lane*& lane, Lane::Item& item) noexcept;
+		bool getTask(Worker* self, Task& task) noexcept;
+		void runLaneJob(Lane* lane, Lane::Item& item) noexcept;
+		void runTask(Task& task) noexcept;
+		void pushTask(Task&& task) noexcept;
+};
+
+#endif // JOB_POOL_H_
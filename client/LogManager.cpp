@@ -39,6 +39,7 @@ static const int CLOSE_FILES_TIME = 300*1000; // 5 min
 bool LogManager::g_isInit = false;
 int  LogManager::g_LogMessageID = 0;
 bool LogManager::g_isLogSpeakerEnabled = false;
+bool LogManager::g_printMessages = false;
 int64_t LogManager::nextCloseTime = 0;
 std::atomic_int LogManager::options(0);
 
@@ -358,6 +359,8 @@ void LogManager::message(const string& message, bool useStatus) noexcept
 {
 	if (getLogOptions() & OPT_LOG_SYSTEM)
 		log(SYSTEM, message);
+	if (g_printMessages)
+		fprintf(stderr, "%s\n", message.c_str());
 	if (useStatus)
 		speakStatusMessage(message);
 }
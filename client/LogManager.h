@@ -94,6 +94,7 @@ class LogManager
 		static HWND g_mainWnd;
 #endif
 		static bool g_isLogSpeakerEnabled;
+		static bool g_printMessages; // message() also writes to stderr
 		static int  g_LogMessageID;
 
 	private:
@@ -0,0 +1,251 @@
+#include "stdinc.h"
+#include "Metrics.h"
+#include "Locks.h"
+#include "Socket.h"
+#include "ShareManager.h"
+#include "QueueManager.h"
+#include "DownloadManager.h"
+#include "UploadManager.h"
+#include "JobPool.h"
+
+namespace
+{
+	struct Registry
+	{
+		CriticalSection cs;
+		vector<const Metrics::Metric*> metrics;
+	};
+
+	// Function-local to be constructed before the first metric registers itself
+	Registry& getRegistry()
+	{
+		static Registry registry;
+		return registry;
+	}
+
+	static std::atomic<unsigned> nextShard(0);
+
+	// Microseconds
+	static const uint64_t histogramBounds[Metrics::Histogram::BUCKET_COUNT] =
+	{
+		100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+		100000, 250000, 500000, 1000000, 2500000, 10000000, 60000000
+	};
+
+	void appendHeader(string& out, const char* name, const char* help, const char* type)
+	{
+		out += "# HELP ";
+		out += name;
+		out += ' ';
+		out += help;
+		out += "\n# TYPE ";
+		out += name;
+		out += ' ';
+		out += type;
+		out += '\n';
+	}
+
+	void appendSample(string& out, const char* name, const char* suffix, const char* labels, const char* extraLabel, const string& value)
+	{
+		out += name;
+		if (suffix) out += suffix;
+		if (labels || extraLabel)
+		{
+			out += '{';
+			if (labels) out += labels;
+			if (labels && extraLabel) out += ',';
+			if (extraLabel) out += extraLabel;
+			out += '}';
+		}
+		out += ' ';
+		out += value;
+		out += '\n';
+	}
+
+	string formatSeconds(uint64_t microseconds)
+	{
+		char buf[64];
+		snprintf(buf, sizeof(buf), "%g", microseconds / 1e6);
+		return buf;
+	}
+
+	void appendValue(string& out, const char* name, const char* help, const char* type, int64_t value)
+	{
+		appendHeader(out, name, help, type);
+		appendSample(out, name, nullptr, nullptr, nullptr, Util::toString(value));
+	}
+
+	// Values owned by the managers are read when the metrics are printed
+	void printSampled(string& out)
+	{
+		const auto& ss = Socket::g_stats;
+		appendHeader(out, "dcpp_socket_bytes_total", "Bytes transferred by sockets", "counter");
+		appendSample(out, "dcpp_socket_bytes_total", nullptr, "proto=\"tcp\",direction=\"in\"", nullptr, Util::toString(ss.tcp.downloaded));
+		appendSample(out, "dcpp_socket_bytes_total", nullptr, "proto=\"tcp\",direction=\"out\"", nullptr, Util::toString(ss.tcp.uploaded));
+		appendSample(out, "dcpp_socket_bytes_total", nullptr, "proto=\"udp\",direction=\"in\"", nullptr, Util::toString(ss.udp.downloaded));
+		appendSample(out, "dcpp_socket_bytes_total", nullptr, "proto=\"udp\",direction=\"out\"", nullptr, Util::toString(ss.udp.uploaded));
+		appendSample(out, "dcpp_socket_bytes_total", nullptr, "proto=\"ssl\",direction=\"in\"", nullptr, Util::toString(ss.ssl.downloaded));
+		appendSample(out, "dcpp_socket_bytes_total", nullptr, "proto=\"ssl\",direction=\"out\"", nullptr, Util::toString(ss.ssl.uploaded));
+
+		appendValue(out, "dcpp_download_speed_bytes", "Current total download speed", "gauge", DownloadManager::getRunningAverage());
+		appendValue(out, "dcpp_upload_speed_bytes", "Current total upload speed", "gauge", UploadManager::getRunningAverage());
+
+		if (ShareManager::isValidInstance())
+			appendValue(out, "dcpp_share_hits_total", "Search requests matched by the share", "counter", ShareManager::getInstance()->getHits());
+
+		if (QueueManager::isValidInstance())
+		{
+			size_t queued;
+			{
+				QueueManager::LockFileQueueShared fileQueue;
+				queued = fileQueue.getQueueL().size();
+			}
+			appendValue(out, "dcpp_queue_items", "Files in the download queue", "gauge", queued);
+		}
+
+		vector<pair<string, JobPool::LaneStats>> lanes;
+		JobPool::instance.getLaneStats(lanes);
+		if (!lanes.empty())
+		{
+			string label;
+			appendHeader(out, "dcpp_job_lane_queued", "Jobs waiting in the lane", "gauge");
+			for (const auto& lane : lanes)
+			{
+				label = "lane=\"" + lane.first + '"';
+				appendSample(out, "dcpp_job_lane_queued", nullptr, label.c_str(), nullptr, Util::toString(lane.second.queued));
+			}
+			appendHeader(out, "dcpp_job_lane_completed_total", "Jobs completed by the lane", "counter");
+			for (const auto& lane : lanes)
+			{
+				label = "lane=\"" + lane.first + '"';
+				appendSample(out, "dcpp_job_lane_completed_total", nullptr, label.c_str(), nullptr, Util::toString(lane.second.completed));
+			}
+		}
+	}
+}
+
+unsigned Metrics::getShardIndex() noexcept
+{
+	static thread_local unsigned index = nextShard++ % SHARD_COUNT;
+	return index;
+}
+
+Metrics::Metric::Metric(const char* name, const char* help, const char* labels) noexcept :
+	name(name), help(help), labels(labels)
+{
+	Registry& registry = getRegistry();
+	LOCK(registry.cs);
+	registry.metrics.push_back(this);
+}
+
+Metrics::Counter::Counter(const char* name, const char* help, const char* labels) noexcept : Metric(name, help, labels)
+{
+	for (Shard& shard : shards)
+		shard.value.store(0);
+}
+
+uint64_t Metrics::Counter::getValue() const noexcept
+{
+	uint64_t value = 0;
+	for (const Shard& shard : shards)
+		value += shard.value.load(std::memory_order_relaxed);
+	return value;
+}
+
+void Metrics::Counter::print(string& out) const noexcept
+{
+	appendSample(out, name, "_total", labels, nullptr, Util::toString(getValue()));
+}
+
+Metrics::Histogram::Histogram(const char* name, const char* help, const char* labels) noexcept : Metric(name, help, labels)
+{
+	for (Shard& shard : shards)
+	{
+		for (auto& bucket : shard.buckets)
+			bucket.store(0);
+		shard.sum.store(0);
+	}
+}
+
+void Metrics::Histogram::observe(uint64_t value) noexcept
+{
+	unsigned i = 0;
+	while (i < BUCKET_COUNT && value > histogramBounds[i]) ++i;
+	Shard& shard = shards[getShardIndex()];
+	shard.buckets[i].fetch_add(1, std::memory_order_relaxed);
+	shard.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+void Metrics::Histogram::print(string& out) const noexcept
+{
+	uint64_t counts[BUCKET_COUNT + 1] = {};
+	uint64_t sum = 0;
+	for (const Shard& shard : shards)
+	{
+		for (unsigned i = 0; i <= BUCKET_COUNT; ++i)
+			counts[i] += shard.buckets[i].load(std::memory_order_relaxed);
+		sum += shard.sum.load(std::memory_order_relaxed);
+	}
+	// Shards are read without a snapshot, buckets are cumulative so the total is derived from them
+	uint64_t total = 0;
+	string le;
+	for (unsigned i = 0; i < BUCKET_COUNT; ++i)
+	{
+		total += counts[i];
+		le = "le=\"" + formatSeconds(histogramBounds[i]) + '"';
+		appendSample(out, name, "_bucket", labels, le.c_str(), Util::toString(total));
+	}
+	total += counts[BUCKET_COUNT];
+	appendSample(out, name, "_bucket", labels, "le=\"+Inf\"", Util::toString(total));
+	appendSample(out, name, "_sum", labels, nullptr, formatSeconds(sum));
+	appendSample(out, name, "_count", labels, nullptr, Util::toString(total));
+}
+
+void Metrics::print(string& out) noexcept
+{
+	Registry& registry = getRegistry();
+	{
+		LOCK(registry.cs);
+		const char* prevName = nullptr;
+		for (const Metric* metric : registry.metrics)
+		{
+			// Metrics sharing a name differ by labels and are registered next to each other
+			if (!prevName || strcmp(prevName, metric->getName()))
+			{
+				string fullName = metric->getName();
+				if (!strcmp(metric->getType(), "counter")) fullName += "_total";
+				appendHeader(out, fullName.c_str(), metric->getHelp(), metric->getType());
+				prevName = metric->getName();
+			}
+			metric->print(out);
+		}
+	}
+	printSampled(out);
+}
+
+namespace Metrics
+{
+	Counter socketAccepted("dcpp_socket_connections", "TCP connections established", "direction=\"in\"");
+	Counter socketConnected("dcpp_socket_connections", "TCP connections established", "direction=\"out\"");
+	Counter hashFiles("dcpp_hash_files", "Files hashed");
+	Counter hashBytes("dcpp_hash_bytes", "Bytes hashed");
+	Histogram hashFileTime("dcpp_hash_file_duration_seconds", "Time to hash one file");
+	Counter searchNmdc("dcpp_share_searches", "Search requests processed by the share", "proto=\"nmdc\"");
+	Counter searchAdc("dcpp_share_searches", "Search requests processed by the share", "proto=\"adc\"");
+	Counter searchTTH("dcpp_share_tth_lookups", "TTH lookups in the share");
+	Histogram searchTime("dcpp_share_search_duration_seconds", "Time to search the share");
+	Counter queueSegments("dcpp_queue_segments", "Download segments finished");
+	Counter queueSegmentBytes("dcpp_queue_segment_bytes", "Bytes of finished download segments");
+	Counter queueFiles("dcpp_queue_files", "Queued files completed");
+	Counter dbReads("dcpp_db_reads", "Hash database read transactions");
+	Counter dbWrites("dcpp_db_writes", "Hash database write transactions");
+	Counter dbErrors("dcpp_db_errors", "Hash database errors");
+	Histogram dbCommitTime("dcpp_db_commit_duration_seconds", "Time to commit a hash database transaction");
+	Counter udpPacketsReceived("dcpp_udp_packets_received", "UDP search packets received");
+	Counter udpPacketsDropped("dcpp_udp_packets_dropped", "UDP search packets dropped because the parser queue was full");
+	Histogram udpParseTime("dcpp_udp_batch_parse_duration_seconds", "Time to parse a batch of UDP search packets");
+	Counter udpPacketsSent("dcpp_udp_packets_sent", "UDP search packets sent");
+	Counter udpSendErrors("dcpp_udp_send_errors", "UDP search packets that could not be encrypted or sent");
+	Counter udpSendDeferred("dcpp_udp_send_deferred", "UDP search packets delayed by per-destination pacing");
+	Counter udpSendDropped("dcpp_udp_send_dropped", "UDP search packets dropped because the send queue was full");
+}
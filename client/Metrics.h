@@ -0,0 +1,130 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include "typedefs.h"
+#include <atomic>
+#include <chrono>
+
+/**
+ * Process-wide registry of counters and histograms exported in the Prometheus text format.
+ * Values are sharded by thread: updating a metric is a relaxed atomic add to the calling thread's shard,
+ * shards are summed only when the registry is printed. The registry lock is taken only at registration and printing.
+ */
+namespace Metrics
+{
+	static const unsigned SHARD_COUNT = 16;
+	static const size_t CACHE_LINE_SIZE = 64;
+
+	// Returns the shard of the calling thread, threads are assigned to shards in turn
+	unsigned getShardIndex() noexcept;
+
+	class Metric
+	{
+		public:
+			Metric(const char* name, const char* help, const char* labels) noexcept;
+			virtual ~Metric() {}
+
+			Metric(const Metric&) = delete;
+			Metric& operator= (const Metric&) = delete;
+
+			const char* getName() const { return name; }
+			const char* getHelp() const { return help; }
+			virtual const char* getType() const = 0;
+			virtual void print(string& out) const noexcept = 0;
+
+		protected:
+			const char* const name;
+			const char* const help;
+			const char* const labels; // without braces, may be null
+	};
+
+	class Counter : public Metric
+	{
+		public:
+			Counter(const char* name, const char* help, const char* labels = nullptr) noexcept;
+
+			void add(uint64_t value = 1) noexcept
+			{
+				shards[getShardIndex()].value.fetch_add(value, std::memory_order_relaxed);
+			}
+			uint64_t getValue() const noexcept;
+
+			const char* getType() const override { return "counter"; }
+			void print(string& out) const noexcept override;
+
+		private:
+			struct alignas(CACHE_LINE_SIZE) Shard
+			{
+				std::atomic<uint64_t> value;
+			};
+			Shard shards[SHARD_COUNT];
+	};
+
+	// Durations in microseconds, printed in seconds
+	class Histogram : public Metric
+	{
+		public:
+			static const unsigned BUCKET_COUNT = 16;
+
+			Histogram(const char* name, const char* help, const char* labels = nullptr) noexcept;
+
+			void observe(uint64_t value) noexcept;
+
+			const char* getType() const override { return "histogram"; }
+			void print(string& out) const noexcept override;
+
+			class Timer
+			{
+				public:
+					explicit Timer(Histogram& h) : h(h), start(std::chrono::steady_clock::now()) {}
+					~Timer() noexcept
+					{
+						h.observe(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+					}
+
+					Timer(const Timer&) = delete;
+					Timer& operator= (const Timer&) = delete;
+
+				private:
+					Histogram& h;
+					const std::chrono::steady_clock::time_point start;
+			};
+
+		private:
+			struct alignas(CACHE_LINE_SIZE) Shard
+			{
+				std::atomic<uint64_t> buckets[BUCKET_COUNT + 1]; // last one is +Inf
+				std::atomic<uint64_t> sum;
+			};
+			Shard shards[SHARD_COUNT];
+	};
+
+	// Prints all registered metrics and the values sampled from the managers
+	void print(string& out) noexcept;
+
+	extern Counter socketAccepted;
+	extern Counter socketConnected;
+	extern Counter hashFiles;
+	extern Counter hashBytes;
+	extern Histogram hashFileTime;
+	extern Counter searchNmdc;
+	extern Counter searchAdc;
+	extern Counter searchTTH;
+	extern Histogram searchTime;
+	extern Counter queueSegments;
+	extern Counter queueSegmentBytes;
+	extern Counter queueFiles;
+	extern Counter dbReads;
+	extern Counter dbWrites;
+	extern Counter dbErrors;
+	extern Histogram dbCommitTime;
+	extern Counter udpPacketsReceived;
+	extern Counter udpPacketsDropped;
+	extern Histogram udpParseTime;
+	extern Counter udpPacketsSent;
+	extern Counter udpSendErrors;
+	extern Counter udpSendDeferred;
+	extern Counter udpSendDropped;
+}
+
+#endif // METRICS_H_
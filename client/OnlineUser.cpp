@@ -228,13 +228,11 @@ void Identity::getParams(StringMap& sm, const string& prefix, bool compatibility
 		}
 	}
 	{
-		LOCK(cs);
-		SKIP_EMPTY("VE", getStringParamL(TAG('V', 'E')));
-		SKIP_EMPTY("AP", getStringParamL(TAG('A', 'P')));
-		for (auto i = stringInfo.cbegin(); i != stringInfo.cend(); ++i)
+		IdentityAttribs::ReadGuard guard;
+		attribs.forEach([&sm, &prefix](uint16_t tag, const string& value)
 		{
-			sm[prefix + string((char*)(&i->first), 2)] = i->second;
-		}
+			sm[prefix + string((const char*) &tag, 2)] = value;
+		});
 	}
 #undef APPEND
 #undef SKIP_EMPTY
@@ -242,48 +240,45 @@ void Identity::getParams(StringMap& sm, const string& prefix, bool compatibility
 
 string Identity::getTag() const
 {
-	cs.lock();
-	auto itAP = stringInfo.find(TAG('A', 'P'));
-	auto itVE = stringInfo.find(TAG('V', 'E'));
-	if (itAP != stringInfo.cend() || itVE != stringInfo.cend())
+	string result;
 	{
-		string result;
-		char tagItem[128];
-		if (itAP != stringInfo.cend())
+		IdentityAttribs::ReadGuard guard;
+		const string* ap = attribs.get(TAG('A', 'P'));
+		const string* ve = attribs.get(TAG('V', 'E'));
+		if (ap)
 		{
-			result = '<' + itAP->second + " V:";
+			result = '<' + *ap + " V:";
 			// TODO: check if "V:" followed by empty string is OK
-			if (itVE != stringInfo.cend()) result += itVE->second;
+			if (ve) result += *ve;
 		}
-		else
-		{
-			result = '<' + itVE->second;
-		}
-		cs.unlock();
+		else if (ve)
+			result = '<' + *ve;
+	}
+	if (!result.empty())
+	{
+		char tagItem[128];
 		snprintf(tagItem, sizeof(tagItem), ",M:%c,H:%u/%u/%u,S:%u>",
 			isTcpActive() ? 'A' : 'P', getHubsNormal(), getHubsRegistered(), getHubsOperator(), getSlots());
 		result += tagItem;
-		return result;
 	}
-	cs.unlock();
-	return Util::emptyString;
+	return result;
 }
 
 string Identity::getApplication() const
 {
-	LOCK(cs);
-	const string& application = getStringParamL(TAG('A', 'P'));
-	const string& version = getStringParamL(TAG('V', 'E'));
-	if (version.empty())
+	IdentityAttribs::ReadGuard guard;
+	const string* application = getStringParamG(TAG('A', 'P'));
+	const string* version = getStringParamG(TAG('V', 'E'));
+	if (!version)
 	{
-		return application;
+		return application ? *application : Util::emptyString;
 	}
-	if (application.empty())
+	if (!application)
 	{
 		// AP is an extension, so we can't guarantee that the other party supports it, so default to VE.
-		return version;
+		return *version;
 	}
-	return application + ' ' + version;
+	return *application + ' ' + *version;
 }
 
 #define ENABLE_CHECK_GET_SET_IN_IDENTITY
@@ -329,7 +324,7 @@ string Identity::getApplication() const
 # define CHECK_GET_SET_COMMAND()
 #endif // ENABLE_CHECK_GET_SET_IN_IDENTITY
 
-const string& Identity::getStringParamL(uint16_t tag) const
+const string* Identity::getStringParamG(uint16_t tag) const
 {
 	CHECK_GET_SET_COMMAND();
 
@@ -338,21 +333,18 @@ const string& Identity::getStringParamL(uint16_t tag) const
 		case TAG('E', 'M'):
 		{
 			if (!getNotEmptyStringBit(EM))
-				return Util::emptyString;
+				return nullptr;
 			break;
 		}
 		case TAG('D', 'E'):
 		{
 			if (!getNotEmptyStringBit(DE))
-				return Util::emptyString;
+				return nullptr;
 			break;
 		}
 	}
 
-	const auto i = stringInfo.find(tag);
-	if (i != stringInfo.end())
-		return i->second;
-	return Util::emptyString;
+	return attribs.get(tag);
 }
 
 string Identity::getStringParam(const char* name) const
@@ -375,13 +367,9 @@ string Identity::getStringParam(const char* name) const
 			break;
 		}
 	}
-	{
-		LOCK(cs);
-		const auto i = stringInfo.find(tag);
-		if (i != stringInfo.end())
-			return i->second;
-	}
-	return Util::emptyString;
+	IdentityAttribs::ReadGuard guard;
+	const string* value = attribs.get(tag);
+	return value ? *value : Util::emptyString;
 }
 
 void Identity::setStringParam(const char* name, const string& val)
@@ -404,10 +392,7 @@ void Identity::setStringParam(const char* name, const string& val)
 	}
 
 	LOCK(cs);
-	if (val.empty())
-		stringInfo.erase(tag);
-	else
-		stringInfo[tag] = val;
+	attribs.set(tag, val);
 }
 
 void FavoriteUser::update(const OnlineUser& info)
@@ -525,14 +510,13 @@ void Identity::getReport(string& report)
 
 		string keyPrint;
 		{
-			LOCK(cs);
-			for (auto i = stringInfo.cbegin(); i != stringInfo.cend(); ++i)
+			IdentityAttribs::ReadGuard guard;
+			attribs.forEach([&](uint16_t tag, const string& value)
 			{
-				auto name = string((char*)(&i->first), 2);
-				const auto& value = i->second;
+				auto name = string((const char*) &tag, 2);
 				// TODO: translate known tags and format values to something more readable
 				bool append = true;
-				switch (i->first)
+				switch (tag)
 				{
 					case TAG('C', 'S'):
 						name = "Cheat description";
@@ -564,7 +548,7 @@ void Identity::getReport(string& report)
 				}
 				if (append)
 					appendIfValueNotEmpty(name, value);
-			}
+			});
 		}
 
 		unsigned countNormal = getHubsNormal();
@@ -639,7 +623,7 @@ void Identity::getReport(string& report)
 			appendIfValueNotEmpty("IPv6 address", formatIpString(ip));
 		}
 
-		// "AP" and "VE" are not stored in stringInfo
+		// "AP" and "VE" are not included in the list of attributes above
 		appendIfValueNotEmpty("DC client", getStringParam("AP"));
 		appendIfValueNotEmpty("Client version", getStringParam("VE"));
 
@@ -24,6 +24,7 @@
 #include "UserInfoBase.h"
 #include "UserInfoColumns.h"
 #include "StrUtil.h"
+#include "IdentityAttribs.h"
 
 #ifdef _DEBUG
 #include <atomic>
@@ -518,7 +519,7 @@ class Identity
 		
 	private:
 		mutable FastCriticalSection cs;
-		boost::unordered_map<uint16_t, string> stringInfo;
+		IdentityAttribs attribs; // written under cs, read with IdentityAttribs::ReadGuard
 	
 #pragma pack(push,1)
 		struct
@@ -530,7 +531,7 @@ class Identity
 		} values;
 #pragma pack(pop)
 
-		const string& getStringParamL(uint16_t tag) const;
+		const string* getStringParamG(uint16_t tag) const;
 };
 
 class OnlineUser :  public UserInfoBase
@@ -0,0 +1,206 @@
+#include "stdinc.h"
+#include "OnlineUserIndex.h"
+#include "Client.h"
+
+OnlineUserIndex::OnlineUserIndex() : cs(RWLock::create())
+{
+}
+
+template<typename T>
+static void removeFromVector(vector<T>& v, const T& value)
+{
+	auto i = std::find(v.begin(), v.end(), value);
+	if (i != v.end())
+	{
+		*i = std::move(v.back());
+		v.pop_back();
+	}
+}
+
+static bool isHubUser(const OnlineUser* ou)
+{
+	const ClientBasePtr& cb = ou->getClientBase();
+	return cb && cb->getType() != ClientBase::TYPE_DHT;
+}
+
+void OnlineUserIndex::setIPL(UserItem& item) noexcept
+{
+	const User* user = item.user.get();
+	item.ip4 = user->getIP4();
+	item.ip6 = user->getIP6();
+	if (item.ip4)
+		ip4Index[item.ip4].push_back(user);
+	if (Util::isValidIp6(item.ip6))
+	{
+		IpKey key;
+		key.setIP(item.ip6);
+		ip6Index[key].push_back(user);
+	}
+}
+
+void OnlineUserIndex::removeIPL(const UserItem& item) noexcept
+{
+	const User* user = item.user.get();
+	if (item.ip4)
+	{
+		auto i = ip4Index.find(item.ip4);
+		if (i != ip4Index.end())
+		{
+			removeFromVector(i->second, user);
+			if (i->second.empty()) ip4Index.erase(i);
+		}
+	}
+	if (Util::isValidIp6(item.ip6))
+	{
+		IpKey key;
+		key.setIP(item.ip6);
+		auto i = ip6Index.find(key);
+		if (i != ip6Index.end())
+		{
+			removeFromVector(i->second, user);
+			if (i->second.empty()) ip6Index.erase(i);
+		}
+	}
+}
+
+void OnlineUserIndex::addNickL(const string& nick, const OnlineUserPtr& ou) noexcept
+{
+	if (!nick.empty())
+		nickIndex[nick].push_back(ou);
+}
+
+void OnlineUserIndex::removeNickL(const string& nick, const OnlineUser* ou) noexcept
+{
+	if (nick.empty()) return;
+	auto i = nickIndex.find(nick);
+	if (i == nickIndex.end()) return;
+	OnlineUserList& v = i->second;
+	for (auto j = v.begin(); j != v.end(); ++j)
+		if (j->get() == ou)
+		{
+			*j = std::move(v.back());
+			v.pop_back();
+			break;
+		}
+	if (v.empty()) nickIndex.erase(i);
+}
+
+void OnlineUserIndex::addUser(const OnlineUserPtr& ou) noexcept
+{
+	const UserPtr& user = ou->getUser();
+	const bool hubUser = isHubUser(ou.get());
+	WRITE_LOCK(*cs);
+	auto res = users.insert(make_pair(user.get(), UserItem()));
+	UserItem& item = res.first->second;
+	if (res.second)
+	{
+		item.user = user;
+		item.onlineCount = 1;
+		setIPL(item);
+	}
+	else
+		item.onlineCount++;
+	if (hubUser)
+	{
+		auto nickRes = onlineNicks.insert(make_pair(ou.get(), ou->getIdentity().getNick()));
+		if (nickRes.second)
+			addNickL(nickRes.first->second, ou);
+	}
+}
+
+void OnlineUserIndex::removeUser(const OnlineUserPtr& ou) noexcept
+{
+	WRITE_LOCK(*cs);
+	auto i = onlineNicks.find(ou.get());
+	if (i != onlineNicks.end())
+	{
+		removeNickL(i->second, ou.get());
+		onlineNicks.erase(i);
+	}
+	auto j = users.find(ou->getUser().get());
+	if (j == users.end()) return;
+	if (--j->second.onlineCount == 0)
+	{
+		removeIPL(j->second);
+		users.erase(j);
+	}
+}
+
+void OnlineUserIndex::clear() noexcept
+{
+	WRITE_LOCK(*cs);
+	users.clear();
+	ip4Index.clear();
+	ip6Index.clear();
+	onlineNicks.clear();
+	nickIndex.clear();
+}
+
+void OnlineUserIndex::updateNick(const OnlineUserPtr& ou) noexcept
+{
+	WRITE_LOCK(*cs);
+	auto i = onlineNicks.find(ou.get());
+	if (i == onlineNicks.end()) return;
+	string nick = ou->getIdentity().getNick();
+	if (i->second == nick) return;
+	removeNickL(i->second, ou.get());
+	i->second = std::move(nick);
+	addNickL(i->second, ou);
+}
+
+void OnlineUserIndex::updateIP(const User* user) noexcept
+{
+	WRITE_LOCK(*cs);
+	auto i = users.find(user);
+	if (i == users.end()) return;
+	removeIPL(i->second);
+	setIPL(i->second);
+}
+
+void OnlineUserIndex::getUsersByIp(const IpAddress& ip, vector<UserPtr>& result) const noexcept
+{
+	READ_LOCK(*cs);
+	const UserVector* v = nullptr;
+	if (ip.type == AF_INET)
+	{
+		auto i = ip4Index.find(ip.data.v4);
+		if (i != ip4Index.end()) v = &i->second;
+	}
+	else if (ip.type == AF_INET6)
+	{
+		IpKey key;
+		key.setIP(ip.data.v6);
+		auto i = ip6Index.find(key);
+		if (i != ip6Index.end()) v = &i->second;
+	}
+	if (!v) return;
+	for (const User* user : *v)
+	{
+		auto j = users.find(user);
+		dcassert(j != users.end());
+		if (j != users.end()) result.push_back(j->second.user);
+	}
+}
+
+OnlineUserPtr OnlineUserIndex::findNick(const string& nick, const string& hubUrl, string* foundHubUrl) const noexcept
+{
+	READ_LOCK(*cs);
+	auto i = nickIndex.find(nick);
+	if (i == nickIndex.end()) return OnlineUserPtr();
+	// the index is case-insensitive, hubs compare nicks exactly
+	for (const OnlineUserPtr& ou : i->second)
+	{
+		if (onlineNicks.find(ou.get())->second != nick) continue;
+		const string& url = ou->getClientBase()->getHubUrl();
+		if (!hubUrl.empty() && !NoCaseStringEq()(url, hubUrl)) continue;
+		if (foundHubUrl) *foundHubUrl = url;
+		return ou;
+	}
+	return OnlineUserPtr();
+}
+
+size_t OnlineUserIndex::getUserCount() const noexcept
+{
+	READ_LOCK(*cs);
+	return users.size();
+}
@@ -0,0 +1,65 @@
+#ifndef ONLINE_USER_INDEX_H_
+#define ONLINE_USER_INDEX_H_
+
+#include "OnlineUser.h"
+#include "IpKey.h"
+#include "RWLock.h"
+#include "NoCaseHash.h"
+#include <boost/unordered/unordered_map.hpp>
+
+/**
+ * Secondary indexes of online users: IP address of the user and nick of the online user (case-insensitive).
+ * Kept up to date by ClientManager when users go online/offline and when their nick or IP changes.
+ */
+class OnlineUserIndex
+{
+	public:
+		OnlineUserIndex();
+
+		OnlineUserIndex(const OnlineUserIndex&) = delete;
+		OnlineUserIndex& operator= (const OnlineUserIndex&) = delete;
+
+		void addUser(const OnlineUserPtr& ou) noexcept;
+		void removeUser(const OnlineUserPtr& ou) noexcept;
+		void clear() noexcept;
+
+		// Called after the nick in user's identity has changed
+		void updateNick(const OnlineUserPtr& ou) noexcept;
+		// Called after the last IP of the user has changed; ignored if the user is offline
+		void updateIP(const User* user) noexcept;
+
+		void getUsersByIp(const IpAddress& ip, vector<UserPtr>& users) const noexcept;
+
+		// Returns online user with exactly this nick, hubUrl can be empty to search all hubs
+		OnlineUserPtr findNick(const string& nick, const string& hubUrl, string* foundHubUrl) const noexcept;
+
+		size_t getUserCount() const noexcept;
+
+	private:
+		struct UserItem
+		{
+			UserPtr user;
+			unsigned onlineCount;
+			Ip4Address ip4;
+			Ip6Address ip6;
+		};
+
+		typedef vector<const User*> UserVector;
+
+		boost::unordered_map<const User*, UserItem> users;
+		boost::unordered_map<Ip4Address, UserVector> ip4Index;
+		boost::unordered_map<IpKey, UserVector> ip6Index;
+
+		// Indexed nick of each online user is stored to find it when the nick changes
+		boost::unordered_map<const OnlineUser*, string> onlineNicks;
+		std::unordered_map<string, OnlineUserList, NoCaseStringHash, NoCaseStringEq> nickIndex;
+
+		std::unique_ptr<RWLock> cs;
+
+		void setIPL(UserItem& item) noexcept;
+		void removeIPL(const UserItem& item) noexcept;
+		void addNickL(const string& nick, const OnlineUserPtr& ou) noexcept;
+		void removeNickL(const string& nick, const OnlineUser* ou) noexcept;
+};
+
+#endif // ONLINE_USER_INDEX_H_
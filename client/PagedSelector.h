@@ -0,0 +1,73 @@
+#ifndef PAGED_SELECTOR_H_
+#define PAGED_SELECTOR_H_
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+/**
+ * Selects one page of items ordered by key from a collection iterated in any order.
+ * Only the items following the cursor are considered and at most limit + 1 of them are kept in a heap,
+ * so a page is produced in a single pass without copying or sorting the whole collection.
+ */
+template<typename Key, typename Value, typename Less = std::less<Key>>
+class PagedSelector
+{
+	public:
+		typedef std::pair<Key, Value> Item;
+
+		PagedSelector(size_t limit, const Key* after = nullptr, const Less& less = Less()) :
+			limit(limit), after(after), less(less)
+		{
+			dcassert(limit);
+			items.reserve(limit + 1);
+		}
+
+		void add(const Key& key, const Value& value)
+		{
+			if (after && !less(*after, key)) return;
+			if (items.size() <= limit)
+			{
+				items.emplace_back(key, value);
+				std::push_heap(items.begin(), items.end(), ItemLess(less));
+			}
+			else if (less(key, items.front().first))
+			{
+				std::pop_heap(items.begin(), items.end(), ItemLess(less));
+				items.back() = Item(key, value);
+				std::push_heap(items.begin(), items.end(), ItemLess(less));
+			}
+		}
+
+		// Sorts the page, returns true if more items follow it
+		bool finish()
+		{
+			std::sort_heap(items.begin(), items.end(), ItemLess(less));
+			if (items.size() <= limit) return false;
+			items.pop_back();
+			return true;
+		}
+
+		const std::vector<Item>& getItems() const { return items; }
+
+	private:
+		struct ItemLess
+		{
+			const Less& less;
+			explicit ItemLess(const Less& less) : less(less) {}
+			bool operator()(const Item& a, const Item& b) const { return less(a.first, b.first); }
+		};
+
+		const size_t limit;
+		const Key* const after;
+		const Less less;
+		std::vector<Item> items;
+};
+
+// Compares keys stored by pointer
+struct PagedSelectorPtrLess
+{
+	template<typename T> bool operator()(const T* a, const T* b) const { return *a < *b; }
+};
+
+#endif // PAGED_SELECTOR_H_
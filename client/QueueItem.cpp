@@ -62,6 +62,7 @@ QueueItem::QueueItem(const string& target, int64_t size, Priority priority, Mask
 	prioQueue(QueueItem::DEFAULT),
 	tempTarget(tempTarget)
 {
+	initDoneBlocksL();
 }
 
 QueueItem::QueueItem(const string& target, int64_t size, Priority priority, MaskType flags, MaskType extraFlags,
@@ -83,6 +84,7 @@ QueueItem::QueueItem(const string& target, int64_t size, Priority priority, Mask
 	prioQueue(QueueItem::DEFAULT),
 	tempTarget(tempTarget)
 {
+	initDoneBlocksL();
 }
 
 QueueItem::QueueItem(const string& newTarget, QueueItem& src) :
@@ -96,7 +98,8 @@ QueueItem::QueueItem(const string& newTarget, QueueItem& src) :
 	priority(src.priority),
 	maxSegments(src.maxSegments),
 	downloads(std::move(src.downloads)),
-	doneSegments(std::move(src.doneSegments)),
+	doneBlocks(std::move(src.doneBlocks)),
+	doneBlockSize(src.doneBlockSize),
 	doneSegmentsSize(src.doneSegmentsSize),
 	downloadedBytes(src.downloadedBytes),
 	timeFileBegin(src.timeFileBegin),
@@ -113,7 +116,7 @@ QueueItem::QueueItem(const string& newTarget, QueueItem& src) :
 	if (downloadedBytes)
 		tempTarget = std::move(src.tempTarget);
 	src.downloads.clear();
-	src.doneSegments.clear();
+	src.initDoneBlocksL();
 	src.sources.clear();
 	src.badSources.clear();
 }
@@ -290,34 +293,78 @@ void QueueItem::resetDownloaded()
 
 void QueueItem::resetDownloadedL()
 {
-	doneSegments.clear();
+	doneBlocks.clear();
 	doneSegmentsSize = downloadedBytes = 0;
 }
 
+void QueueItem::setSize(int64_t value)
+{
+	LOCK(csSegments);
+	if (size == value) return;
+	size = value;
+	initDoneBlocksL();
+}
+
+void QueueItem::initDoneBlocksL()
+{
+	doneBlockSize = blockSize;
+	doneBlocks.resize(size > 0 ? (size_t) ((size + doneBlockSize - 1) / doneBlockSize) : 0);
+	doneSegmentsSize = 0;
+}
+
+// Blocks touched by the range [start, end)
+void QueueItem::getDoneBlockRange(int64_t start, int64_t end, size_t& first, size_t& last) const
+{
+	first = (size_t) (start / doneBlockSize);
+	last = std::min(doneBlocks.size(), (size_t) ((end + doneBlockSize - 1) / doneBlockSize));
+}
+
+void QueueItem::updateRunningBlocksL() const
+{
+	if (runningBlocks.size() != doneBlocks.size())
+		runningBlocks.resize(doneBlocks.size());
+	else
+		runningBlocks.clear();
+	size_t first, last;
+	for (const RunningSegment& rs : downloads)
+		if (rs.seg.getSize() > 0)
+		{
+			getDoneBlockRange(rs.seg.getStart(), rs.seg.getEnd(), first, last);
+			if (first < last) runningBlocks.set(first, last);
+		}
+}
+
+// Calls f(start, end) for each run of done blocks until it returns false
+template<typename F> void QueueItem::forEachDoneRunL(F f) const
+{
+	size_t i = doneBlocks.findSet(0);
+	while (i != BlockBitmap::npos)
+	{
+		size_t j = doneBlocks.findClear(i);
+		if (!f(getDoneBlockPos(i), j == BlockBitmap::npos ? size : getDoneBlockPos(j)) || j == BlockBitmap::npos)
+			break;
+		i = doneBlocks.findSet(j);
+	}
+}
+
 bool QueueItem::isFinished() const
 {
 	LOCK(csSegments);
-	return doneSegments.size() == 1 &&
-		doneSegments.begin()->getStart() == 0 &&
-		doneSegments.begin()->getSize() == getSize();
+	return doneBlocks.isFull();
 }
 
 bool QueueItem::isChunkDownloaded(int64_t startPos, int64_t& len) const
 {
-	if (len <= 0)
+	if (len <= 0 || startPos < 0)
 		return false;
 	LOCK(csSegments);
-	for (auto i = doneSegments.cbegin(); i != doneSegments.cend(); ++i)
-	{
-		const int64_t start = i->getStart();
-		const int64_t end   = i->getEnd();
-		if (start <= startPos && startPos < end)
-		{
-			len = min(len, end - startPos);
-			return true;
-		}
-	}
-	return false;
+	size_t i = (size_t) (startPos / doneBlockSize);
+	if (i >= doneBlocks.size() || !doneBlocks.get(i))
+		return false;
+	size_t j = doneBlocks.findClear(i);
+	const int64_t end = j == BlockBitmap::npos ? size : getDoneBlockPos(j);
+	len = min(len, end - startPos);
+	return true;
 }
 
 void QueueItem::removeSourceL(const UserPtr& user, MaskType reason)
@@ -413,36 +460,20 @@ bool QueueItem::removeDownload(const Segment& seg)
 
 Segment QueueItem::getNextSegmentForward(const int64_t blockSize, const int64_t targetSize, vector<Segment>* neededParts, const vector<int64_t>& posArray) const
 {
-	int64_t start = 0;
+	const size_t firstClear = doneBlocks.findClear(0);
+	if (firstClear == BlockBitmap::npos) return Segment(0, 0);
+	int64_t start = getDoneBlockPos(firstClear);
 	int64_t curSize = targetSize;
-	if (!doneSegments.empty())
-	{
-		const Segment& segBegin = *doneSegments.begin();
-		if (segBegin.getStart() == 0) start = segBegin.getEnd();
-	}
+	size_t first, last;
 	while (start < getSize())
 	{
 		int64_t end = std::min(getSize(), start + curSize);
 		Segment block(start, end - start);
-		bool overlaps = false;
-		for (auto i = doneSegments.cbegin(); !overlaps && i != doneSegments.cend(); ++i)
-		{
-			if (curSize <= blockSize)
-			{
-				int64_t dstart = i->getStart();
-				int64_t dend = i->getEnd();
-				// We accept partial overlaps, only consider the block done if it is fully consumed by the done block
-				if (dstart <= start && dend >= end)
-					overlaps = true;
-			}
-			else
-				overlaps = block.overlaps(*i);
-		}
+		getDoneBlockRange(start, end, first, last);
+		// We accept partial overlaps, only consider the block done if it is fully consumed by done blocks
+		bool overlaps = curSize <= blockSize ? doneBlocks.allSet(first, last) : doneBlocks.anySet(first, last);
 		if (!overlaps)
-		{
-			for (auto i = downloads.cbegin(); !overlaps && i != downloads.cend(); ++i)
-				overlaps = block.overlaps(i->seg);
-		}
+			overlaps = runningBlocks.anySet(first, last);
 
 		if (!overlaps)
 		{
@@ -479,37 +510,21 @@ Segment QueueItem::getNextSegmentForward(const int64_t blockSize, const int64_t
 
 Segment QueueItem::getNextSegmentBackward(const int64_t blockSize, const int64_t targetSize, vector<Segment>* neededParts, const vector<int64_t>& posArray) const
 {
-	int64_t end = 0;
+	const size_t lastClear = doneBlocks.findLastClear(doneBlocks.size());
+	if (lastClear == BlockBitmap::npos) return Segment(0, 0);
+	int64_t end = lastClear + 1 < doneBlocks.size() ? getDoneBlockPos(lastClear + 1) : 0;
 	int64_t curSize = targetSize;
-	if (!doneSegments.empty())
-	{
-		const Segment& segEnd = *doneSegments.crbegin();
-		if (segEnd.getEnd() == getSize()) end = segEnd.getStart();
-	}
 	if (!end) end = Util::roundUp(getSize(), blockSize);
+	size_t first, last;
 	while (end > 0)
 	{
 		int64_t start = std::max<int64_t>(0, end - curSize);
 		Segment block(start, std::min(end, getSize()) - start);
-		bool overlaps = false;
-		for (auto i = doneSegments.crbegin(); !overlaps && i != doneSegments.crend(); ++i)
-		{
-			if (curSize <= blockSize)
-			{
-				int64_t dstart = i->getStart();
-				int64_t dend = i->getEnd();
-				// We accept partial overlaps, only consider the block done if it is fully consumed by the done block
-				if (dstart <= start && dend >= end)
-					overlaps = true;
-			}
-			else
-				overlaps = i->overlaps(block);
-		}
+		getDoneBlockRange(start, std::min(end, getSize()), first, last);
+		// We accept partial overlaps, only consider the block done if it is fully consumed by done blocks
+		bool overlaps = curSize <= blockSize ? doneBlocks.allSet(first, last) : doneBlocks.anySet(first, last);
 		if (!overlaps)
-		{
-			for (auto i = downloads.crbegin(); !overlaps && i != downloads.crend(); ++i)
-				overlaps = i->seg.overlaps(block);
-		}
+			overlaps = runningBlocks.anySet(first, last);
 
 		if (!overlaps)
 		{
@@ -546,14 +561,14 @@ Segment QueueItem::getNextSegmentBackward(const int64_t blockSize, const int64_t
 
 bool QueueItem::shouldSearchBackward() const
 {
-	if (!(flags & FLAG_WANT_END) || doneSegments.empty()) return false;
-	const Segment& segBegin = *doneSegments.begin();
-	if (segBegin.getStart() != 0 || segBegin.getSize() < 1024*1204) return false;
-	const Segment& segEnd = *doneSegments.rbegin();
-	if (segEnd.getEnd() == getSize())
+	if (!(flags & FLAG_WANT_END) || !doneBlocks.count() || !doneBlocks.get(0)) return false;
+	const size_t firstClear = doneBlocks.findClear(0);
+	if (firstClear == BlockBitmap::npos) return false;
+	if (getDoneBlockPos(firstClear) < 1024*1204) return false;
+	if (doneBlocks.get(doneBlocks.size() - 1))
 	{
 		int64_t requiredSize = getSize()*3/100; // 3% of file
-		if (segEnd.getSize() > requiredSize) return false;
+		if (getSize() - getDoneBlockPos(doneBlocks.findLastClear(doneBlocks.size()) + 1) > requiredSize) return false;
 	}
 	return true;
 }
@@ -583,21 +598,24 @@ Segment QueueItem::getNextSegmentL(const GetSegmentParams& gsp, const PartialSou
 		int64_t start = 0;
 		int64_t end = getSize();
 
-		if (!doneSegments.empty())
+		if (doneBlocks.count())
 		{
-			const Segment& first = *doneSegments.begin();
-			if (first.getStart() > 0)
+			if (!doneBlocks.get(0))
 			{
-				end = Util::roundUp(first.getStart(), blockSize);
+				end = Util::roundUp(getDoneBlockPos(doneBlocks.findSet(0)), blockSize);
 			}
 			else
 			{
-				start = Util::roundDown(first.getEnd(), blockSize);
-				if (doneSegments.size() > 1)
+				const size_t firstClear = doneBlocks.findClear(0);
+				if (firstClear == BlockBitmap::npos)
 				{
-					const Segment& second = *(++doneSegments.begin());
-					end = Util::roundUp(second.getStart(), blockSize);
+					if (error) *error = ERROR_NO_FREE_BLOCK;
+					return Segment(-1, 0);
 				}
+				start = Util::roundDown(getDoneBlockPos(firstClear), blockSize);
+				const size_t nextSet = doneBlocks.findSet(firstClear);
+				if (nextSet != BlockBitmap::npos)
+					end = Util::roundUp(getDoneBlockPos(nextSet), blockSize);
 			}
 		}
 		if (error) *error = SUCCESS;
@@ -616,16 +634,30 @@ Segment QueueItem::getNextSegmentL(const GetSegmentParams& gsp, const PartialSou
 	vector<int64_t> posArray;
 	vector<Segment> neededParts;
 
-	if (partialSource && partialSource->getBlockSize() == blockSize)
+	if (availabilityVersion != getSourcesVersion() || availabilityBlockSize != (uint64_t) blockSize)
+		updateAvailabilityL();
+
+	if (partialSource)
 	{
-		posArray.reserve(partialSource->getParts().size());
-		// Convert block index to file position
-		for (auto i = partialSource->getParts().cbegin(); i != partialSource->getParts().cend(); ++i)
+		if (partialSource->getBlockSize() == blockSize)
 		{
-			int64_t pos = (int64_t) *i * blockSize;
-			posArray.push_back(min(getSize(), pos));
+			posArray.reserve(partialSource->getParts().size());
+			// Convert block index to file position
+			for (auto i = partialSource->getParts().cbegin(); i != partialSource->getParts().cend(); ++i)
+			{
+				int64_t pos = (int64_t) *i * blockSize;
+				posArray.push_back(min(getSize(), pos));
+			}
 		}
 	}
+	else if (!availability.empty() && !(flags & FLAG_WANT_END))
+	{
+		// Partial sources are known, a full source prefers the blocks they don't have
+		posArray.push_back(0);
+		posArray.push_back(getSize());
+	}
+	const bool selectRarest = !posArray.empty() || partialSource;
+	updateRunningBlocksL();
 
 	double donePart = static_cast<double>(doneSegmentsSize) / getSize();
 
@@ -641,8 +673,8 @@ Segment QueueItem::getNextSegmentL(const GetSegmentParams& gsp, const PartialSou
 		targetSize = blockSize;
 
 	Segment block = shouldSearchBackward()?
-		getNextSegmentBackward(blockSize, targetSize, partialSource? &neededParts : nullptr, posArray) :
-		getNextSegmentForward(blockSize, targetSize, partialSource? &neededParts : nullptr, posArray);
+		getNextSegmentBackward(blockSize, targetSize, selectRarest ? &neededParts : nullptr, posArray) :
+		getNextSegmentForward(blockSize, targetSize, selectRarest ? &neededParts : nullptr, posArray);
 	if (block.getSize())
 	{
 		if (error) *error = SUCCESS;
@@ -651,56 +683,124 @@ Segment QueueItem::getNextSegmentL(const GetSegmentParams& gsp, const PartialSou
 
 	if (!neededParts.empty())
 	{
-		// select random chunk for download
 		dcdebug("Found partial chunks: %d\n", int(neededParts.size()));
-		Segment& selected = neededParts[Util::rand(0, static_cast<uint32_t>(neededParts.size()))];
-		selected.setSize(std::min(selected.getSize(), targetSize)); // request only wanted size
 		if (error) *error = SUCCESS;
-		return selected;
+		return getRarestSegment(neededParts, blockSize, targetSize);
+	}
+
+	block = getEndgameSegment(gsp, blockSize, posArray, partialSource != nullptr);
+	if (block.getSize())
+	{
+		if (error) *error = SUCCESS;
+		return block;
 	}
 
-#if 0 // Disabled
-	if (!partialSource && gsp.overlapChunks && gsp.lastSpeed > 10 * 1024)
+	if (error) *error = ERROR_NO_NEEDED_PART;
+	return Segment(-1, 0);
+}
+
+void QueueItem::updateAvailabilityL() const
+{
+	availability.clear();
+	availabilityVersion = getSourcesVersion();
+	availabilityBlockSize = blockSize;
+	const size_t blockCount = (size_t) ((getSize() + blockSize - 1) / blockSize);
+	for (auto i = sources.cbegin(); i != sources.cend(); ++i)
 	{
-		// overlap slow running chunk
-		const uint64_t currentTick = GET_TICK();
-		for (auto i = downloads.cbegin(); i != downloads.cend(); ++i)
+		const PartialSource* ps = i->second.partialSource.get();
+		if (!ps || ps->getBlockSize() != (int64_t) blockSize) continue;
+		// Left empty while there are no partial sources
+		if (availability.empty()) availability.resize(blockCount);
+		const PartsInfo& parts = ps->getParts();
+		for (size_t j = 0; j + 1 < parts.size(); j += 2)
 		{
-			const Download* d = i->d.get();
-			if (!d)
-				continue;
+			size_t end = std::min<size_t>(parts[j + 1], blockCount);
+			for (size_t k = parts[j]; k < end; ++k)
+				if (availability[k] != UINT16_MAX) ++availability[k];
+		}
+	}
+}
 
-			// current chunk mustn't be already overlapped
-			if (d->getOverlapped())
+Segment QueueItem::getRarestSegment(const vector<Segment>& neededParts, int64_t blockSize, int64_t targetSize) const
+{
+	// Start at the block held by the fewest partial sources, ties are broken randomly
+	const Segment* best = nullptr;
+	int64_t bestStart = 0;
+	unsigned bestCount = UINT_MAX;
+	uint32_t ties = 0;
+	for (const Segment& part : neededParts)
+		for (int64_t pos = part.getStart(); pos < part.getEnd(); pos += blockSize)
+		{
+			size_t index = (size_t) (pos / blockSize);
+			unsigned count = index < availability.size() ? availability[index] : 0;
+			if (count < bestCount)
+			{
+				bestCount = count;
+				ties = 1;
+			}
+			else if (count > bestCount || Util::rand(0, ++ties))
 				continue;
+			best = &part;
+			bestStart = pos;
+		}
+	dcassert(best);
+	return Segment(bestStart, std::min(best->getEnd() - bestStart, targetSize));
+}
 
-			// current chunk must be running at least for 2 seconds
-			if (d->getStartTime() == 0 || currentTick - d->getStartTime() < 2000)
-				continue;
+Segment QueueItem::getEndgameSegment(const GetSegmentParams& gsp, int64_t blockSize, const vector<int64_t>& posArray, bool isPartial) const
+{
+	// Nothing is left to start: a source at least twice as fast takes over the unfinished blocks of a running segment,
+	// the slow connection is closed when the new one starts
+	if (!gsp.overlapChunks || gsp.lastSpeed <= 10 * 1024)
+		return Segment(0, 0);
+	const uint64_t currentTick = GET_TICK();
+	for (auto i = downloads.cbegin(); i != downloads.cend(); ++i)
+	{
+		const Download* d = i->d.get();
+		if (!d)
+			continue;
 
-			// current chunk mustn't be finished in next 10 seconds
-			int64_t secondsLeft = d->getSecondsLeft();
-			if (secondsLeft < 10)
-				continue;
+		// current chunk mustn't be already overlapped
+		if (d->getOverlapped())
+			continue;
 
-			// overlap current chunk at last block boundary
-			int64_t pos = d->getPos() - (d->getPos() % blockSize);
-			int64_t size = d->getSize() - pos;
+		// current chunk must be running at least for 2 seconds
+		if (d->getStartTime() == 0 || currentTick - d->getStartTime() < 2000)
+			continue;
 
-			// new user should finish this chunk more than 2x faster
-			int64_t newChunkLeft = size / gsp.lastSpeed;
-			if (2 * newChunkLeft < secondsLeft)
-			{
-				dcdebug("Overlapping... old user: " I64_FMT " s, new user: " I64_FMT " s\n", d->getSecondsLeft(), newChunkLeft);
-				if (error) *error = SUCCESS;
-				return Segment(d->getStartPos() + pos, size, true);
-			}
+		// current chunk mustn't be finished in next 10 seconds
+		int64_t secondsLeft = d->getSecondsLeft();
+		if (secondsLeft < 10)
+			continue;
+
+		// overlap current chunk at last block boundary
+		int64_t pos = d->getPos() - (d->getPos() % blockSize);
+		int64_t size = d->getSize() - pos;
+		int64_t start = d->getStartPos() + pos;
+
+		// a partial source must have all the blocks
+		if (isPartial)
+		{
+			bool found = false;
+			for (size_t j = 0; j < posArray.size(); j += 2)
+				if (posArray[j] <= start && start + size <= posArray[j + 1])
+				{
+					found = true;
+					break;
+				}
+			if (!found)
+				continue;
 		}
-	}
-#endif
 
-	if (error) *error = ERROR_NO_NEEDED_PART;
-	return Segment(-1, 0);
+		// new user should finish this chunk more than 2x faster
+		int64_t newChunkLeft = size / gsp.lastSpeed;
+		if (2 * newChunkLeft < secondsLeft)
+		{
+			dcdebug("Overlapping... old user: " I64_FMT " s, new user: " I64_FMT " s\n", d->getSecondsLeft(), newChunkLeft);
+			return Segment(start, size, true);
+		}
+	}
+	return Segment(0, 0);
 }
 
 void QueueItem::setOverlapped(const Segment& segment, bool isOverlapped)
@@ -750,29 +850,30 @@ void QueueItem::addSegment(const Segment& segment)
 void QueueItem::addSegmentL(const Segment& segment)
 {
 	dcassert(!segment.getOverlapped());
-	doneSegments.insert(segment);
-	doneSegmentsSize += segment.getSize();
-	// Consolidate segments
-	if (doneSegments.size() == 1)
-		return;
-	for (auto current = ++doneSegments.cbegin(); current != doneSegments.cend();)
-	{
-		auto prev = current;
-		--prev;
-		const Segment& segCurrent = *current;
-		const Segment& segPrev = *prev;
-		if (segPrev.getEnd() >= segCurrent.getStart())
-		{
-			int64_t bigEnd = std::max(segCurrent.getEnd(), segPrev.getEnd());
-			Segment big(segPrev.getStart(), bigEnd - segPrev.getStart());
-			int64_t removedSize = segPrev.getSize() + segCurrent.getSize();
-			doneSegments.erase(current);
-			doneSegments.erase(prev);
-			current = ++doneSegments.insert(big).first;
-			doneSegmentsSize -= removedSize;
-			doneSegmentsSize += big.getSize();
-		} else ++current;
-	}
+	if (segment.getSize() <= 0 || segment.getStart() < 0) return;
+	// Only whole blocks are marked, the last block is whole if the segment reaches the end of file
+	const size_t count = doneBlocks.size();
+	const size_t first = (size_t) ((segment.getStart() + doneBlockSize - 1) / doneBlockSize);
+	const size_t last = segment.getEnd() >= getSize() ? count : (size_t) (segment.getEnd() / doneBlockSize);
+	if (first >= last) return;
+	const bool lastBlockAdded = last == count && !doneBlocks.get(count - 1);
+	doneSegmentsSize += doneBlocks.set(first, last) * doneBlockSize;
+	if (lastBlockAdded)
+		doneSegmentsSize -= count * doneBlockSize - getSize();
+}
+
+void QueueItem::removeSegmentL(const Segment& segment)
+{
+	if (segment.getSize() <= 0 || segment.getStart() < 0) return;
+	// Every block touched by the segment is cleared
+	const size_t count = doneBlocks.size();
+	size_t first, last;
+	getDoneBlockRange(segment.getStart(), segment.getEnd(), first, last);
+	if (first >= last) return;
+	const bool lastBlockRemoved = last == count && doneBlocks.get(count - 1);
+	doneSegmentsSize -= doneBlocks.clear(first, last) * doneBlockSize;
+	if (lastBlockRemoved)
+		doneSegmentsSize += count * doneBlockSize - getSize();
 }
 
 bool QueueItem::isNeededPart(const PartsInfo& theirParts, const PartsInfo& ourParts)
@@ -819,18 +920,16 @@ void QueueItem::getParts(PartsInfo& partialInfo, uint64_t blockSize) const
 		return;
 
 	LOCK(csSegments);
-	const size_t maxSize = min(doneSegments.size() * 2, (size_t) 510);
-	partialInfo.reserve(maxSize);
-
-	for (auto i = doneSegments.cbegin(); i != doneSegments.cend() && partialInfo.size() < maxSize; ++i)
+	const size_t maxSize = 510;
+	forEachDoneRunL([&](int64_t start, int64_t end) -> bool
 	{
-		uint16_t s = (uint16_t)((i->getStart() + blockSize - 1) / blockSize); // round up
-		int64_t end = i->getEnd();
+		uint16_t s = (uint16_t)((start + blockSize - 1) / blockSize); // round up
 		if (end >= getSize()) end += blockSize - 1;
 		uint16_t e = (uint16_t)(end / blockSize); // round down for all chunks but last
 		partialInfo.push_back(s);
 		partialInfo.push_back(e);
-	}
+		return partialInfo.size() < maxSize;
+	});
 }
 
 int QueueItem::countParts(const QueueItem::PartsInfo& pi)
@@ -851,9 +950,11 @@ void QueueItem::getDoneSegments(vector<Segment>& done) const
 {
 	done.clear();
 	LOCK(csSegments);
-	done.reserve(doneSegments.size());
-	for (auto i = doneSegments.cbegin(); i != doneSegments.cend(); ++i)
-		done.push_back(*i);
+	forEachDoneRunL([&done](int64_t start, int64_t end) -> bool
+	{
+		done.push_back(Segment(start, end - start));
+		return true;
+	});
 }
 
 void QueueItem::getChunksVisualisation(vector<SegmentEx>& running, vector<Segment>& done) const
@@ -872,9 +973,11 @@ void QueueItem::getChunksVisualisation(vector<SegmentEx>& running, vector<Segmen
 		rs.pos = d ? d->getPos() : 0;
 		running.push_back(rs);
 	}
-	done.reserve(doneSegments.size());
-	for (auto i = doneSegments.cbegin(); i != doneSegments.cend(); ++i)
-		done.push_back(*i);
+	forEachDoneRunL([&done](int64_t start, int64_t end) -> bool
+	{
+		done.push_back(Segment(start, end - start));
+		return true;
+	});
 }
 
 bool QueueItem::isMultipleSegments() const
@@ -21,6 +21,7 @@
 #define DCPLUSPLUS_DCPP_QUEUE_ITEM_H
 
 #include "Segment.h"
+#include "BlockBitmap.h"
 #include "HintedUser.h"
 #include "RWLock.h"
 #include "Download.h"
@@ -286,6 +287,7 @@ class QueueItem
 
 		void addSegment(const Segment& segment);
 		void addSegmentL(const Segment& segment);
+		void removeSegmentL(const Segment& segment);
 		void resetDownloaded();
 		void resetDownloadedL();
 
@@ -317,6 +319,9 @@ class QueueItem
 		Segment getNextSegmentForward(const int64_t blockSize, const int64_t targetSize, vector<Segment>* neededParts, const vector<int64_t>& posArray) const;
 		Segment getNextSegmentBackward(const int64_t blockSize, const int64_t targetSize, vector<Segment>* neededParts, const vector<int64_t>& posArray) const;
 		bool shouldSearchBackward() const;
+		void updateAvailabilityL() const;
+		Segment getRarestSegment(const vector<Segment>& neededParts, int64_t blockSize, int64_t targetSize) const;
+		Segment getEndgameSegment(const GetSegmentParams& gsp, int64_t blockSize, const vector<int64_t>& posArray, bool isPartial) const;
 
 	public:
 		MaskType getFlags() const { return flags; }
@@ -352,6 +357,7 @@ class QueueItem
 
 		bool updateBlockSize(uint64_t treeBlockSize);
 		uint64_t getBlockSize() const { return blockSize; }
+		uint64_t getDoneBlockSize() const { return doneBlockSize; }
 
 		static string getDCTempName(const string& fileName, const TTHValue* tth);
 
@@ -359,10 +365,28 @@ class QueueItem
 		mutable CriticalSection csSegments;
 		std::vector<RunningSegment> downloads;
 
-		SegmentSet doneSegments;
+		// Done blocks of doneBlockSize bytes, the last block may be shorter.
+		// doneBlockSize is the block size when the file size becomes known, later block sizes are its multiples.
+		// Leaves of trees received from other users can be smaller: such ranges must be merged before they are added.
+		BlockBitmap doneBlocks;
+		uint64_t doneBlockSize;
 		int64_t doneSegmentsSize;
 		int64_t downloadedBytes;
 
+		// Blocks covered by the running segments, rebuilt when a segment is selected
+		mutable BlockBitmap runningBlocks;
+
+		void initDoneBlocksL();
+		int64_t getDoneBlockPos(size_t index) const { return std::min<int64_t>(index * doneBlockSize, size); }
+		void getDoneBlockRange(int64_t start, int64_t end, size_t& first, size_t& last) const;
+		void updateRunningBlocksL() const;
+		template<typename F> void forEachDoneRunL(F f) const;
+
+		// Number of partial sources having each block, rebuilt when the sources change
+		mutable vector<uint16_t> availability;
+		mutable uint32_t availabilityVersion = 0;
+		mutable uint64_t availabilityBlockSize = 0;
+
 	public:
 		void getDoneSegments(vector<Segment>& done) const;
 
@@ -383,7 +407,7 @@ class QueueItem
 		void setMaxSegmentsL(uint8_t value) { maxSegments = value; }
 
 		int64_t getSize() const { return size; }
-		void setSize(int64_t value) { size = value; }
+		void setSize(int64_t value);
 
 		const string& getTempTargetL() const { return tempTarget; }
 		void setTempTargetL(const string& value) { tempTarget = value; }
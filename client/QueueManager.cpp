@@ -32,7 +32,6 @@
 #include "ConnectionManager.h"
 #include "DatabaseManager.h"
 #include "DebugManager.h"
-#include "MerkleCheckOutputStream.h"
 #include "SearchResult.h"
 #include "PathUtil.h"
 #include "Util.h"
@@ -43,6 +42,7 @@
 #include "Random.h"
 #include "ConfCore.h"
 #include "version.h"
+#include "Metrics.h"
 
 #ifdef _WIN32
 #include "SysVersion.h"
@@ -54,6 +54,9 @@ static const int64_t MOVER_LIMIT = 10 * 1024 * 1024;
 static const int MAX_MATCH_QUEUE_ITEMS = 10;
 static const size_t PFS_SOURCES = 10;
 static const int PFS_QUERY_INTERVAL = 300000; // 5 minutes
+static const int64_t RECHECK_CHUNK_SIZE = 4 * 1024 * 1024;
+static const int64_t RECHECK_MAX_BUFFER_SIZE = 128 * 1024 * 1024;
+static const unsigned RECHECK_UPDATE_INTERVAL = 1000;
 
 QueueManager::FileQueue QueueManager::fileQueue;
 QueueManager::UserQueue QueueManager::userQueue;
@@ -189,6 +192,20 @@ bool QueueManager::FileQueue::isQueued(const TTHValue& tth) const
 	return queueTTH.find(tth) != queueTTH.end();
 }
 
+void QueueManager::FileQueue::getTTHSnapshot(QueueTTHMap& result) const
+{
+	QueueRLock(*csFQ);
+	for (const auto& i : queueTTH)
+		for (const QueueItemPtr& qi : i.second)
+		{
+			if (qi->getFlags() & (QueueItem::FLAG_USER_LIST | QueueItem::FLAG_USER_GET_IP))
+				continue;
+			if (qi->isFinished())
+				continue;
+			result[i.first].push_back(qi);
+		}
+}
+
 bool QueueManager::FileQueue::add(const QueueItemPtr& qi)
 {
 	QueueWLock(*csFQ);
@@ -709,6 +726,7 @@ void QueueManager::shutdown()
 	dclstLoaderAbortFlag.store(true);
 	recheckerAbortFlag.store(true);
 	listMatcher.shutdown();
+	listMatchWorkers.shutdown();
 	dclstLoader.shutdown();
 	fileMover.shutdown();
 	rechecker.shutdown();
@@ -735,6 +753,7 @@ void QueueManager::deleteFileLists()
 	uint64_t currentTime = Util::getFileTime();
 	getOldFiles(delList, path + "*.xml.bz2", currentTime, days);
 	getOldFiles(delList, path + "*.xml", currentTime, days);
+	getOldFiles(delList, path + "*.dlc", currentTime, days);
 	getOldFiles(delList, path + "*.dctmp", currentTime, 0);
 	for (const string& filename : delList)
 		File::deleteFile(path + filename);
@@ -1089,7 +1108,7 @@ void QueueManager::add(const string& target, const QueueItemParams& params, cons
 			{
 				newItem = false;
 				FileMoverJob* job = new FileMoverJob(*this, FileMoverJob::COPY_QI_FILE, sharedFilePath, targetPath, false, q);
-				if (!fileMover.addJob(job))
+				if (!fileMover.addJob(job, File::getVolumeId(targetPath)))
 					delete job;
 			}
 			else if (waitForUserInput)
@@ -1736,6 +1755,13 @@ DownloadPtr QueueManager::getDownload(const UserConnectionPtr& ucPtr, Download::
 		return d;
 	}
 
+	if (qs.seg.getOverlapped())
+	{
+		// endgame, the running segment is taken over when this download starts
+		q->setOverlapped(qs.seg, true);
+		d->setFlag(Download::FLAG_OVERLAP);
+	}
+
 	if (segmentAdded)
 		q->setDownloadForSegment(qs.seg, d);
 	else
@@ -1930,7 +1956,7 @@ void QueueManager::moveFile(const string& source, const string& target, int64_t
 	if (useMover)
 	{
 		FileMoverJob* job = new FileMoverJob(*this, FileMoverJob::MOVE_FILE, source, target, moveToOtherDir, QueueItemPtr());
-		if (!fileMover.addJob(job))
+		if (!fileMover.addJob(job, File::getVolumeId(target)))
 			delete job;
 		return;
 	}
@@ -1943,7 +1969,7 @@ void QueueManager::moveFile(const string& source, const string& target, int64_t
 	if (size > MOVER_LIMIT)
 	{
 		FileMoverJob* job = new FileMoverJob(*this, FileMoverJob::MOVE_FILE_RETRY, source, target, moveToOtherDir, QueueItemPtr());
-		if (!fileMover.addJob(job))
+		if (!fileMover.addJob(job, File::getVolumeId(target)))
 			delete job;
 		return;
 	}
@@ -2136,6 +2162,9 @@ void QueueManager::putDownload(DownloadPtr download, bool finished, bool reportF
 						download->setOverlapped(false);
 						q->addSegment(download->getSegment());
 						isFinishedFile = q->isFinished();
+						Metrics::queueSegments.add();
+						Metrics::queueSegmentBytes.add(download->getSize());
+						if (isFinishedFile) Metrics::queueFiles.add();
 					}
 
 					if (!isFile || isFinishedFile)
@@ -2235,15 +2264,17 @@ void QueueManager::putDownload(DownloadPtr download, bool finished, bool reportF
 					}
 					if (download->getType() == Transfer::TYPE_FILE)
 					{
-						// mark partially downloaded chunk, but align it to block size
-						int64_t downloaded = download->getPos();
-						downloaded -= downloaded % download->getTigerTree().getBlockSize();
+						// mark partially downloaded chunk, but align it to the done blocks of the item:
+						// leaves of the downloaded tree can be smaller
+						const int64_t start = download->getStartPos();
+						int64_t end = start + download->getPos();
+						end -= end % (int64_t) q->getDoneBlockSize();
 
-						if (downloaded > 0)
+						if (end > start)
 						{
 							// since download is not finished, it should never happen that downloaded size is same as segment size
 							//dcassert(downloaded < download->getSize());
-							q->addSegment(Segment(download->getStartPos(), downloaded));
+							q->addSegment(Segment(start, end - start));
 							setDirty();
 						}
 					}
@@ -3341,10 +3372,15 @@ bool QueueManager::handlePartialResult(const UserPtr& user, const TTHValue& tth,
 				uint16_t oldPort = ps->getUdpPort();
 				uint16_t newPort = partialSource.getUdpPort();
 				if (!newPort) newPort = oldPort;
-				if ((logOptions & LogManager::OPT_LOG_PSR) &&
-					(!QueueItem::compareParts(ps->getParts(), partialSource.getParts()) || oldPort != newPort))
+				const bool partsChanged = !QueueItem::compareParts(ps->getParts(), partialSource.getParts());
+				if ((logOptions & LogManager::OPT_LOG_PSR) && (partsChanged || oldPort != newPort))
 					logPartialSourceInfo(partialSource, user, tth, "updating partial source", wantConnection);
-				ps->setParts(partialSource.getParts());
+				if (partsChanged)
+				{
+					ps->setParts(partialSource.getParts());
+					// block availability is rebuilt from the parts
+					qi->updateSourcesVersion();
+				}
 				ps->setUdpPort(newPort);
 				ps->setNextQueryTime(GET_TICK() + PFS_QUERY_INTERVAL);
 			}
@@ -3412,26 +3448,113 @@ void QueueManager::FileQueue::findPFSSources(QueueItem::SourceList& sl, uint64_t
 
 void QueueManager::ListMatcherJob::run()
 {
-	StringList list = File::findFiles(Util::getListPath(), "*.xml*");
-	for (auto i = list.cbegin(); i != list.cend(); ++i)
+	auto state = std::make_shared<ListMatchState>();
+	fileQueue.getTTHSnapshot(state->queueTTH);
+	StringList list;
+	if (!state->queueTTH.empty())
+		list = File::findFiles(Util::getListPath(), "*.xml*");
+	if (list.empty())
 	{
-		UserPtr u = DirectoryListing::getUserFromFilename(*i);
-		if (!u)
-			continue;
+		manager.listMatcherRunning.clear();
+		return;
+	}
+	state->pending = list.size();
+	for (const string& path : list)
+	{
+		ListMatchJob* job = new ListMatchJob(manager, state, path);
+		if (!manager.listMatchWorkers.addJob(job))
+			delete job;
+	}
+}
 
-		DirectoryListing dl(manager.listMatcherAbortFlag, false);
-		dl.setHintedUser(HintedUser(u, Util::emptyString));
-		try
+QueueManager::ListMatchJob::~ListMatchJob()
+{
+	if (--state->pending == 0)
+		manager.listMatcherRunning.clear();
+}
+
+void QueueManager::ListMatchJob::run()
+{
+	if (manager.listMatcherAbortFlag.load() || ClientManager::isBeforeShutdown())
+		return;
+	UserPtr u = DirectoryListing::getUserFromFilename(path);
+	if (!u)
+		return;
+
+	DirectoryListing dl(manager.listMatcherAbortFlag, false);
+	dl.setHintedUser(HintedUser(u, Util::emptyString));
+	try
+	{
+		dl.loadFile(path, nullptr, false);
+	}
+	catch (const Exception&)
+	{
+		return;
+	}
+
+	// Probe the smaller of the two maps
+	QueueItemList matched;
+	if (!dl.getTTHSet()) dl.buildTTHSet();
+	const DirectoryListing::TTHMap& tthMap = *dl.getTTHSet();
+	const QueueTTHMap& queueTTH = state->queueTTH;
+	if (tthMap.size() < queueTTH.size())
+	{
+		for (const auto& file : tthMap)
 		{
-			dl.loadFile(*i, nullptr, false);
-			logMatchedFiles(u, QueueManager::getInstance()->matchListing(dl));
+			const auto i = queueTTH.find(file.first);
+			if (i == queueTTH.cend()) continue;
+			for (const QueueItemPtr& qi : i->second)
+				if (qi->getSize() == file.second)
+					matched.push_back(qi);
 		}
-		catch (const Exception&)
+	}
+	else
+	{
+		for (const auto& item : queueTTH)
 		{
-			if (ClientManager::isBeforeShutdown() || dl.isAborted()) break;
+			const auto i = tthMap.find(item.first);
+			if (i == tthMap.cend()) continue;
+			for (const QueueItemPtr& qi : item.second)
+				if (qi->getSize() == i->second)
+					matched.push_back(qi);
+		}
+	}
+	logMatchedFiles(u, matched.empty() ? 0 : manager.addMatchedSources(u, matched));
+}
+
+// Items could be removed or finished after the snapshot was taken, they are checked again under the lock
+int QueueManager::addMatchedSources(const UserPtr& user, const QueueItemList& items) noexcept
+{
+	int matches = 0;
+	bool sourceAdded = false;
+	const bool addSource = !(user->getFlags() & User::FAKE);
+	{
+		QueueWLock(*QueueItem::g_cs);
+		LockFileQueueShared lockQueue;
+		const auto& queue = lockQueue.getQueueL();
+		for (const QueueItemPtr& qi : items)
+		{
+			const auto i = queue.find(Text::toLower(qi->getTarget()));
+			if (i == queue.cend() || i->second != qi || qi->isFinished())
+				continue;
+			matches++;
+			if (addSource)
+			{
+				try
+				{
+					addSourceL(qi, user, QueueItem::Source::FLAG_FILE_NOT_AVAILABLE);
+					sourceAdded = true;
+				}
+				catch (const Exception&)
+				{
+					// Ignore...
+				}
+			}
 		}
 	}
-	manager.listMatcherRunning.clear();
+	if (sourceAdded)
+		getDownloadConnection(HintedUser(user, Util::emptyString));
+	return matches;
 }
 
 bool QueueManager::matchAllFileLists()
@@ -3502,8 +3625,17 @@ void QueueManager::FileMoverJob::run()
 
 bool QueueManager::recheck(const string& target)
 {
+	string tempTarget;
+	QueueItemPtr q = fileQueue.findTarget(target);
+	if (q)
+	{
+		q->lockAttributes();
+		tempTarget = q->getTempTargetL();
+		q->unlockAttributes();
+	}
+	// Files on different volumes are checked in parallel
 	RecheckerJob* job = new RecheckerJob(*this, target);
-	if (!rechecker.addJob(job))
+	if (!rechecker.addJob(job, File::getVolumeId(tempTarget.empty() ? target : tempTarget)))
 	{
 		delete job;
 		return false;
@@ -3511,18 +3643,6 @@ bool QueueManager::recheck(const string& target)
 	return true;
 }
 
-struct DummyOutputStream : OutputStream
-{
-	size_t write(const void*, size_t n) override
-	{
-		return n;
-	}
-	size_t flushBuffers(bool force) override
-	{
-		return 0;
-	}
-};
-
 void QueueManager::RecheckerJob::run()
 {
 	QueueItemPtr q;
@@ -3594,55 +3714,120 @@ void QueueManager::RecheckerJob::run()
 	tempTarget = q->getTempTargetL();
 	q->unlockAttributes();
 
-	//Merklecheck
-	int64_t startPos = 0;
-	DummyOutputStream dummy;
-	int64_t blockSize = tt.getBlockSize();
-	bool hasBadBlocks = false;
-	vector<uint8_t> buf((size_t)min((int64_t)1024 * 1024, blockSize));
-	vector< pair<int64_t, int64_t> > sizes;
-
+	// Read the file sequentially in large chunks and verify leaf blocks on the job pool.
+	// Verified blocks are added to the queue item as each chunk is checked, blocks that failed
+	// are cleared at the end. An aborted recheck only adds blocks that were verified.
+	// Chunks contain whole done blocks, so merged leaves of a chunk are not rounded away.
+	const int64_t blockSize = tt.getBlockSize();
+	const int64_t align = max<int64_t>(blockSize, q->getDoneBlockSize());
+	const int64_t chunkSize = align >= RECHECK_CHUNK_SIZE ? align : RECHECK_CHUNK_SIZE - RECHECK_CHUNK_SIZE % align;
+	const int maxChunks = (int) max<int64_t>(2, min<int64_t>(JobPool::instance.getHardwareThreads() + 1, RECHECK_MAX_BUFFER_SIZE / chunkSize));
+	const bool wasFinished = q->isFinished();
+
+	FastCriticalSection csVerified;
+	vector<Segment> badSegments;
+	vector<ByteVector> freeBuffers;
+	std::atomic_bool hasBadBlocks(false);
+	uint64_t nextUpdate = GET_TICK() + RECHECK_UPDATE_INTERVAL;
+
+	JobPool::TaskGroup tasks;
 	try
 	{
 		File inFile(tempTarget, File::READ, File::OPEN);
-		while (startPos < tempSize)
+		for (int64_t chunkPos = 0; chunkPos < tempSize; chunkPos += chunkSize)
 		{
-			try
+			if (manager.recheckerAbortFlag.load() || JobPool::isCancelled())
 			{
-				MerkleCheckOutputStream<TigerTree, false> os(tt, &dummy, startPos);
+				tasks.wait();
+				manager.fireStatusUpdated(q);
+				return;
+			}
+			tasks.wait(maxChunks - 1);
 
-				inFile.setPos(startPos);
-				int64_t bytesLeft = min(tempSize - startPos, blockSize); //Take care of the last incomplete block
-				int64_t segmentSize = bytesLeft;
-				while (bytesLeft > 0)
-				{
-					if (manager.recheckerAbortFlag.load())
-						return;
-					size_t n = (size_t)min((int64_t)buf.size(), bytesLeft);
-					size_t nr = inFile.read(&buf[0], n);
-					os.write(&buf[0], nr);
-					bytesLeft -= nr;
-					if (bytesLeft > 0 && nr == 0)
-					{
-						// Huh??
-						throw Exception();
-					}
-				}
-				os.flushBuffers(true);
-				sizes.push_back(make_pair(startPos, segmentSize));
+			uint64_t tick = GET_TICK();
+			if (tick >= nextUpdate)
+			{
+				manager.fireStatusUpdated(q);
+				nextUpdate = tick + RECHECK_UPDATE_INTERVAL;
 			}
-			catch (const Exception&)
+
+			ByteVector buf;
+			csVerified.lock();
+			if (!freeBuffers.empty())
+			{
+				buf = std::move(freeBuffers.back());
+				freeBuffers.pop_back();
+			}
+			csVerified.unlock();
+			size_t len = (size_t) min(tempSize - chunkPos, chunkSize);
+			buf.resize(len);
+			size_t pos = 0;
+			while (pos < len)
 			{
+				size_t n = len - pos;
+				inFile.read(&buf[pos], n);
+				if (n == 0) break;
+				pos += n;
+			}
+			if (pos < len)
+			{
+				// File was truncated, the rest is cleared
 				hasBadBlocks = true;
-				dcdebug("Found bad block at " I64_FMT "\n", startPos);
+				csVerified.lock();
+				badSegments.push_back(Segment(chunkPos + pos, q->getSize() - (chunkPos + pos)));
+				csVerified.unlock();
+				len = pos;
+				if (!len) break;
 			}
-			startPos += blockSize;
+
+			tasks.run([&, chunkPos, len, buffer = std::move(buf)]() mutable
+			{
+				// Adjacent good leaves are joined
+				vector<Segment> good, bad;
+				const auto& leaves = tt.getLeaves();
+				for (size_t offset = 0; offset < len; offset += (size_t) blockSize)
+				{
+					const int64_t startPos = chunkPos + offset;
+					const size_t index = (size_t) (startPos / blockSize);
+					const size_t size = (size_t) min<int64_t>(blockSize, len - offset);
+					TigerTree block(blockSize);
+					block.update(&buffer[offset], size);
+					block.finalize();
+					vector<Segment>& result = index < leaves.size() && block.getRoot() == leaves[index] ? good : bad;
+					if (!result.empty() && result.back().getEnd() == startPos)
+						result.back().setSize(result.back().getSize() + size);
+					else
+						result.push_back(Segment(startPos, size));
+				}
+				if (!bad.empty())
+				{
+					hasBadBlocks = true;
+					dcdebug("Found bad block at " I64_FMT "\n", bad.front().getStart());
+				}
+				if (!good.empty())
+				{
+					LOCK(q->csSegments);
+					for (const Segment& segment : good)
+						q->addSegmentL(segment);
+					q->downloadedBytes = q->doneSegmentsSize;
+				}
+				LOCK(csVerified);
+				badSegments.insert(badSegments.end(), bad.begin(), bad.end());
+				freeBuffers.push_back(std::move(buffer));
+			});
 		}
 	}
 	catch (const FileException&)
 	{
+		tasks.wait();
+		manager.fireStatusUpdated(q);
 		return;
 	}
+	tasks.wait();
+
+	// The part of the file that was not there before it was resized
+	if (tempSize < q->getSize())
+		badSegments.push_back(Segment(tempSize, q->getSize() - tempSize));
 
 	// get q again in case it has been (re)moved
 	q = fileQueue.findTarget(file);
@@ -3650,8 +3835,17 @@ void QueueManager::RecheckerJob::run()
 	if (!q)
 		return;
 
+	if (!badSegments.empty())
+	{
+		LOCK(q->csSegments);
+		for (const Segment& segment : badSegments)
+			q->removeSegmentL(segment);
+		q->downloadedBytes = q->doneSegmentsSize;
+	}
+	manager.fireStatusUpdated(q);
+
 	//If no bad blocks then the file probably got stuck in the temp folder for some reason
-	if (!hasBadBlocks && q->isFinished())
+	if (!hasBadBlocks && wasFinished)
 	{
 		manager.moveFile(tempTarget, file, -1);
 		userQueue.removeQueueItem(q);
@@ -3659,14 +3853,6 @@ void QueueManager::RecheckerJob::run()
 		return;
 	}
 
-	{
-		LOCK(q->csSegments);
-		q->resetDownloadedL();
-		for (auto i = sizes.cbegin(); i != sizes.cend(); ++i)
-			q->addSegmentL(Segment(i->first, i->second));
-		q->downloadedBytes = q->doneSegmentsSize;
-	}
-
 	manager.rechecked(q);
 }
 
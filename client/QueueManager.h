@@ -143,6 +143,9 @@ class QueueManager : public Singleton<QueueManager>,
 		bool matchAllFileLists();
 		
 	private:
+		typedef boost::unordered_map<TTHValue, QueueItemList> QueueTTHMap;
+
+		// Collects the file lists and starts a ListMatchJob for each of them
 		class ListMatcherJob : public JobExecutor::Job
 		{
 				QueueManager& manager;
@@ -152,7 +155,32 @@ class QueueManager : public Singleton<QueueManager>,
 				virtual void run();
 		};
 
-		JobExecutor listMatcher;
+		JobExecutor listMatcher{"ListMatcher", JobPool::PRIORITY_LOW};
+
+		struct ListMatchState
+		{
+			QueueTTHMap queueTTH; // read-only snapshot of the queue
+			std::atomic<size_t> pending;
+		};
+
+		// Loads one file list and probes the snapshot, the last job clears listMatcherRunning
+		class ListMatchJob : public JobExecutor::Job
+		{
+				QueueManager& manager;
+				const std::shared_ptr<ListMatchState> state;
+				const string path;
+
+			public:
+				ListMatchJob(QueueManager& manager, const std::shared_ptr<ListMatchState>& state, const string& path) :
+					manager(manager), state(state), path(path) {}
+				~ListMatchJob();
+				virtual void run();
+		};
+
+		static const int MAX_LIST_MATCH_THREADS = 4;
+		JobExecutor listMatchWorkers{"ListMatchWorker", JobPool::PRIORITY_LOW, MAX_LIST_MATCH_THREADS};
+
+		int addMatchedSources(const UserPtr& user, const QueueItemList& items) noexcept;
 
 		class DclstLoaderJob : public JobExecutor::Job
 		{
@@ -164,7 +192,7 @@ class QueueManager : public Singleton<QueueManager>,
 				virtual void run();
 		};
 
-		JobExecutor dclstLoader;
+		JobExecutor dclstLoader{"DclstLoader"};
 
 		class FileMoverJob : public JobExecutor::Job
 		{
@@ -189,7 +217,8 @@ class QueueManager : public Singleton<QueueManager>,
 				QueueItemPtr qi;
 		};
 
-		JobExecutor fileMover;
+		// One mover per destination volume
+		JobExecutor fileMover{"FileMover", JobPool::PRIORITY_NORMAL, 4};
 
 		class RecheckerJob : public JobExecutor::Job
 		{
@@ -201,7 +230,8 @@ class QueueManager : public Singleton<QueueManager>,
 				virtual void run();
 		};
 
-		JobExecutor rechecker;
+		// One file per volume
+		JobExecutor rechecker{"Rechecker", JobPool::PRIORITY_LOW, 4};
 
 	public:
 		void shutdown();
@@ -309,6 +339,7 @@ class QueueManager : public Singleton<QueueManager>,
 				void clearAll();
 
 				bool isQueued(const TTHValue& tth) const;
+				void getTTHSnapshot(QueueTTHMap& result) const;
 				void updatePriority(QueueItem::Priority& p, bool& autoPriority, const string& fileName, int64_t size, QueueItem::MaskType flags) noexcept;
 				uint64_t getGenerationId() const;
 
@@ -322,7 +353,7 @@ class QueueManager : public Singleton<QueueManager>,
 #endif
 				QueueItem::QIStringMap queue;
 				uint64_t generationId;
-				boost::unordered_map<TTHValue, QueueItemList> queueTTH;
+				QueueTTHMap queueTTH;
 				std::regex reAutoPriority;
 				string autoPriorityPattern;
 		};
@@ -2,6 +2,11 @@
 #include "Resolver.h"
 #include "BaseUtil.h"
 #include "SocketAddr.h"
+#include "JobExecutor.h"
+#include "WaitableEvent.h"
+#include "TimeUtil.h"
+#include "Text.h"
+#include <boost/unordered/unordered_map.hpp>
 
 #ifdef _WIN32
 
@@ -15,46 +20,89 @@
 
 #endif
 
+// getaddrinfo doesn't report the TTL of the records, fixed times are used
+static const uint64_t POSITIVE_TTL = 10 * 60 * 1000;
+static const uint64_t NEGATIVE_TTL = 30 * 1000;
+static const size_t MAX_CACHE_SIZE = 1024;
+static const int MAX_RESOLVER_THREADS = 4;
+
+namespace
+{
+	struct CacheEntry
+	{
+		Resolver::Result result;
+		uint64_t expires = 0;
+		vector<Resolver::Callback> callbacks; // not empty while the lookup is running
+	};
+
+	static FastCriticalSection csCache;
+	static boost::unordered_map<string, CacheEntry> cache;
+
+	// Created on first use, the lane needs JobPool::instance
+	JobExecutor& getExecutor()
+	{
+		static JobExecutor executor("Resolver", JobPool::PRIORITY_HIGH, MAX_RESOLVER_THREADS);
+		return executor;
+	}
+
+	class LookupJob : public JobExecutor::Job
+	{
+		public:
+			LookupJob(const string& key, const string& host, int af) : key(key), host(host), af(af), done(false) {}
+			~LookupJob();
+			virtual void run();
+
+		private:
+			const string key;
+			const string host;
+			const int af;
+			bool done;
+	};
+}
+
 // af = AF_INET / AF_INET6 - return only IPv4 or IPv6
 // af = 0 - return both
-int Resolver::resolveHost(Ip4Address* v4, Ip6AddressEx* v6, int af, const string& host, bool* isNumeric) noexcept
+static bool parseNumericHost(Resolver::Result& r, int af, const string& host)
 {
-	if (v4) *v4 = 0;
-	if (v6) memset(v6, 0, sizeof(*v6));
-	if (isNumeric) *isNumeric = false;
+	r.flags = 0;
+	r.v4 = 0;
+	memset(&r.v6, 0, sizeof(r.v6));
+	r.isNumeric = false;
 	if (host.find(':') != string::npos)
 	{
-		if (!(af == 0 || af == AF_INET6)) return 0;
-		Ip6AddressEx ip6;
-		if (Util::parseIpAddress(ip6, host))
+		if (!(af == 0 || af == AF_INET6)) return true;
+		if (Util::parseIpAddress(r.v6, host))
 		{
-			if (v6) *v6 = ip6;
-			if (isNumeric) *isNumeric = true;
-			return RESOLVE_RESULT_V6;
+			r.isNumeric = true;
+			r.flags = Resolver::RESOLVE_RESULT_V6;
+			return true;
 		}
 	}
-	else
+	else if (Util::parseIpAddress(r.v4, host))
 	{
-		Ip4Address ip4;
-		if (Util::parseIpAddress(ip4, host))
-		{
-			if (!(af == 0 || af == AF_INET)) return 0;
-			if (v4) *v4 = ip4;
-			if (isNumeric) *isNumeric = true;
-			return RESOLVE_RESULT_V4;
-		}
+		r.isNumeric = true;
+		if (af == 0 || af == AF_INET) r.flags = Resolver::RESOLVE_RESULT_V4;
+		return true;
 	}
+	return false;
+}
+
+static void lookupHost(Resolver::Result& r, int af, const string& host)
+{
+	r.flags = 0;
+	r.v4 = 0;
+	memset(&r.v6, 0, sizeof(r.v6));
+	r.isNumeric = false;
 	addrinfo hints;
 	memset(&hints, 0, sizeof(hints));
 	hints.ai_family = af;
 	if (!af) hints.ai_flags = AI_V4MAPPED | AI_ALL;
 	addrinfo* result = nullptr;
 	if (getaddrinfo(host.c_str(), nullptr, &hints, &result))
-		return 0;
+		return;
 	const addrinfo* ai = result;
 	const sockaddr* v4Result = nullptr;
 	const sockaddr* v6Result = nullptr;
-	int outFlags = 0;
 	while (ai)
 	{
 		if (ai->ai_family == AF_INET)
@@ -80,41 +128,185 @@ int Resolver::resolveHost(Ip4Address* v4, Ip6AddressEx* v6, int af, const string
 	}
 	if (v4Result)
 	{
-		outFlags |= RESOLVE_RESULT_V4;
-		if (v4)
+		r.flags |= Resolver::RESOLVE_RESULT_V4;
+		if (v4Result->sa_family == AF_INET6)
 		{
-			if (v4Result->sa_family == AF_INET6)
-			{
-				const sockaddr_in6* sa = (const sockaddr_in6*) v4Result;
-				uint32_t val = *(const uint32_t *) (((const uint8_t *) &sa->sin6_addr) + 12);
-				*v4 = ntohl(val);
-			}
-			else
-			{
-				const sockaddr_in* sa = (const sockaddr_in*) v4Result;
-				*v4 = ntohl(sa->sin_addr.s_addr);
-			}
+			const sockaddr_in6* sa = (const sockaddr_in6*) v4Result;
+			uint32_t val = *(const uint32_t *) (((const uint8_t *) &sa->sin6_addr) + 12);
+			r.v4 = ntohl(val);
+		}
+		else
+		{
+			const sockaddr_in* sa = (const sockaddr_in*) v4Result;
+			r.v4 = ntohl(sa->sin_addr.s_addr);
 		}
 	}
 	if (v6Result)
 	{
-		outFlags |= RESOLVE_RESULT_V6;
-		if (v6)
+		r.flags |= Resolver::RESOLVE_RESULT_V6;
+		const sockaddr_in6* sa = (const sockaddr_in6*) v6Result;
+		memcpy(&r.v6, &sa->sin6_addr, sizeof(r.v6));
+	}
+	freeaddrinfo(result);
+}
+
+static string getCacheKey(int af, const string& host)
+{
+	string key = host;
+	Text::asciiMakeLower(key);
+	key += '/';
+	key += af == AF_INET ? '4' : af == AF_INET6 ? '6' : '*';
+	return key;
+}
+
+static void removeExpiredL(uint64_t tick)
+{
+	for (auto i = cache.begin(); i != cache.end();)
+	{
+		if (i->second.callbacks.empty() && i->second.expires <= tick)
+			i = cache.erase(i);
+		else
+			++i;
+	}
+	if (cache.size() < MAX_CACHE_SIZE) return;
+	for (auto i = cache.begin(); i != cache.end();)
+	{
+		if (i->second.callbacks.empty())
+			i = cache.erase(i);
+		else
+			++i;
+	}
+}
+
+static void completeLookup(const string& key, const Resolver::Result& r, bool storeResult)
+{
+	vector<Resolver::Callback> callbacks;
+	{
+		LOCK(csCache);
+		auto i = cache.find(key);
+		if (i == cache.end()) return;
+		callbacks.swap(i->second.callbacks);
+		if (storeResult)
 		{
-			const sockaddr_in6* sa = (const sockaddr_in6*) v6Result;
-			memcpy(v6, &sa->sin6_addr, sizeof(*v6));
+			i->second.result = r;
+			i->second.expires = GET_TICK() + (r.flags ? POSITIVE_TTL : NEGATIVE_TTL);
 		}
+		else
+			cache.erase(i);
 	}
-	freeaddrinfo(result);
-	return outFlags;
+	for (const auto& callback : callbacks)
+		callback(r);
 }
 
-bool Resolver::resolveHost(IpAddressEx& addr, int type, const string& host, bool* isNumeric) noexcept
+void LookupJob::run()
+{
+	Resolver::Result r;
+	lookupHost(r, af, host);
+	done = true;
+	completeLookup(key, r, true);
+}
+
+// The job is deleted without running when the lane is shut down
+LookupJob::~LookupJob()
+{
+	if (done) return;
+	Resolver::Result r;
+	memset(&r, 0, sizeof(r));
+	completeLookup(key, r, false);
+}
+
+enum
+{
+	LOOKUP_DONE,
+	LOOKUP_PENDING,
+	LOOKUP_START
+};
+
+// LOOKUP_DONE: the result is known, the callback is not used.
+// LOOKUP_PENDING: the callback is queued to the running lookup.
+// LOOKUP_START: the callback is queued, the caller must run the lookup.
+static int beginLookup(int af, const string& host, const string& key, Resolver::Callback& callback, Resolver::Result& r)
+{
+	if (parseNumericHost(r, af, host))
+		return LOOKUP_DONE;
+	LOCK(csCache);
+	const uint64_t tick = GET_TICK();
+	auto i = cache.find(key);
+	if (i == cache.end())
+	{
+		if (cache.size() >= MAX_CACHE_SIZE) removeExpiredL(tick);
+		i = cache.insert(make_pair(key, CacheEntry())).first;
+	}
+	CacheEntry& entry = i->second;
+	if (entry.callbacks.empty() && entry.expires > tick)
+	{
+		r = entry.result;
+		return LOOKUP_DONE;
+	}
+	const bool pending = !entry.callbacks.empty();
+	entry.callbacks.push_back(std::move(callback));
+	return pending ? LOOKUP_PENDING : LOOKUP_START;
+}
+
+void Resolver::resolveHostAsync(int type, const string& host, Callback callback) noexcept
 {
-	int af = type & ~RESOLVE_TYPE_EXACT;
-	Ip4Address v4;
-	Ip6AddressEx v6;
-	int result = resolveHost(&v4, &v6, (type & RESOLVE_TYPE_EXACT) ? af : 0, host, isNumeric);
+	const int af = (type & RESOLVE_TYPE_EXACT) ? type & ~RESOLVE_TYPE_EXACT : 0;
+	const string key = getCacheKey(af, host);
+	Result r;
+	switch (beginLookup(af, host, key, callback, r))
+	{
+		case LOOKUP_DONE:
+			callback(r);
+			break;
+		case LOOKUP_START:
+		{
+			LookupJob* job = new LookupJob(key, host, af);
+			if (!getExecutor().addJob(job))
+			{
+				job->run();
+				delete job;
+			}
+		}
+	}
+}
+
+int Resolver::resolveHost(Ip4Address* v4, Ip6AddressEx* v6, int af, const string& host, bool* isNumeric) noexcept
+{
+	struct Waiter
+	{
+		WaitableEvent event;
+		Result result;
+	};
+	const string key = getCacheKey(af, host);
+	auto waiter = std::make_shared<Waiter>();
+	waiter->event.create();
+	Callback callback = [waiter](const Result& r)
+	{
+		waiter->result = r;
+		waiter->event.notify();
+	};
+	Result r;
+	switch (beginLookup(af, host, key, callback, r))
+	{
+		case LOOKUP_START:
+			// The calling thread does the lookup itself instead of waiting for a resolver thread
+			LookupJob(key, host, af).run();
+			r = waiter->result;
+			break;
+		case LOOKUP_PENDING:
+			waiter->event.wait();
+			r = waiter->result;
+	}
+	if (v4) *v4 = r.v4;
+	if (v6) *v6 = r.v6;
+	if (isNumeric) *isNumeric = r.isNumeric;
+	return r.flags;
+}
+
+bool Resolver::getAddress(IpAddressEx& addr, int type, const Result& r) noexcept
+{
+	const int af = type & ~RESOLVE_TYPE_EXACT;
+	int result = r.flags;
 	if (!result) return false;
 	unsigned flag[2];
 	if (af == AF_INET6)
@@ -135,18 +327,39 @@ bool Resolver::resolveHost(IpAddressEx& addr, int type, const string& host, bool
 			if (flag[i] == RESOLVE_RESULT_V4)
 			{
 				addr.type = AF_INET;
-				addr.data.v4 = v4;
+				addr.data.v4 = r.v4;
 			}
 			else
 			{
 				addr.type = AF_INET6;
-				addr.data.v6 = v6;
+				addr.data.v6 = r.v6;
 			}
 			return true;
 		}
 	return false;
 }
 
+bool Resolver::resolveHost(IpAddressEx& addr, int type, const string& host, bool* isNumeric) noexcept
+{
+	const int af = type & ~RESOLVE_TYPE_EXACT;
+	Result r;
+	r.flags = resolveHost(&r.v4, &r.v6, (type & RESOLVE_TYPE_EXACT) ? af : 0, host, &r.isNumeric);
+	if (isNumeric) *isNumeric = r.isNumeric;
+	return getAddress(addr, type, r);
+}
+
+void Resolver::clearCache() noexcept
+{
+	LOCK(csCache);
+	for (auto i = cache.begin(); i != cache.end();)
+	{
+		if (i->second.callbacks.empty())
+			i = cache.erase(i);
+		else
+			++i;
+	}
+}
+
 string Resolver::getHostName(const IpAddress& ip)
 {
 	char buf[NI_MAXHOST];
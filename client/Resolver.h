@@ -2,6 +2,7 @@
 #define RESOLVER_H_
 
 #include "IpAddress.h"
+#include <functional>
 
 namespace Resolver
 {
@@ -9,8 +10,28 @@ namespace Resolver
 		static const int RESOLVE_RESULT_V6 = 2;
 		static const int RESOLVE_TYPE_EXACT = 1024;
 
+		struct Result
+		{
+			int flags; // RESOLVE_RESULT_V4, RESOLVE_RESULT_V6, 0 if not resolved
+			Ip4Address v4;
+			Ip6AddressEx v6;
+			bool isNumeric;
+		};
+
+		typedef std::function<void(const Result&)> Callback;
+
+		// Names are resolved through the cache, concurrent lookups of the same name are coalesced
 		int resolveHost(Ip4Address* v4, Ip6AddressEx* v6, int af, const string& host, bool* isNumeric = nullptr) noexcept;
 		bool resolveHost(IpAddressEx& addr, int type, const string& host, bool* isNumeric = nullptr) noexcept;
+
+		// Lookups run on a bounded set of resolver threads.
+		// The callback is called by the calling thread for numeric and cached names, by a resolver thread otherwise.
+		void resolveHostAsync(int type, const string& host, Callback callback) noexcept;
+
+		// Selects the address according to type (AF_INET or AF_INET6, optionally with RESOLVE_TYPE_EXACT)
+		bool getAddress(IpAddressEx& addr, int type, const Result& result) noexcept;
+
+		void clearCache() noexcept;
 		string getHostName(const IpAddress& ip);
 }
 
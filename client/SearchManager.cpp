@@ -35,6 +35,7 @@
 #include "ConfCore.h"
 #include "dht/DHT.h"
 #include "unaligned.h"
+#include "Metrics.h"
 #include <openssl/evp.h>
 #include <openssl/rand.h>
 
@@ -70,7 +71,20 @@ ResourceManager::Strings SearchManager::getTypeStr(int type)
 	return types[type];
 }
 
-SearchManager::SearchManager(): stopFlag(false), failed{false, false}, options(0), decryptKeyLock(RWLock::create())
+static const int RECV_BATCH_SIZE = 32;
+static const int RECV_BUFFER_SIZE = 8192;
+static const int MAX_PENDING_BATCHES = 1024;
+static const int MAX_PARSER_THREADS = 4;
+
+static const size_t SEND_QUEUE_SIZE = 4096; // power of 2
+static const size_t MAX_DEFERRED_ITEMS = SEND_QUEUE_SIZE;
+static const unsigned SEND_PACING_INTERVAL = 100; // ms
+static const int SEND_PACING_MAX_PACKETS = 32; // per destination address and interval
+
+SearchManager::SearchManager(): stopFlag(false), failed{false, false}, options(0), decryptKeyLock(RWLock::create()),
+	sendQueue(SEND_QUEUE_SIZE), sendQueueHead(0), sendQueueTail(0), pacingWindowStart(0),
+	parser("SearchParser", JobPool::PRIORITY_HIGH, MAX_PARSER_THREADS),
+	pendingBatches(0)
 {
 #ifdef _WIN32
 	events[EVENT_COMMAND].create();
@@ -190,6 +204,9 @@ void SearchManager::shutdown()
 	stopFlag = true;
 	sendNotif();
 	join();
+	// Queued batches are skipped by the parser once stopFlag is set.
+	// The lane is not shut down because the manager may be started again.
+	parser.wait();
 	for (int i = 0; i < 2; ++i)
 	{
 		if (sockets[i])
@@ -242,14 +259,15 @@ int SearchManager::run()
 	while (!isShutdown())
 	{
 #ifdef _WIN32
-		int result = (int) WaitForMultipleObjects(numEvents, handle, FALSE, INFINITE) - (int) WAIT_OBJECT_0;
+		DWORD timeout = deferredItems.empty() ? INFINITE : SEND_PACING_INTERVAL;
+		int result = (int) WaitForMultipleObjects(numEvents, handle, FALSE, timeout) - (int) WAIT_OBJECT_0;
 		if (result >= 0 && result < numEvents)
 		{
 			int index = eventInfo[result];
 			if ((index == 0 || index == 1) && receivePackets(index)) goto terminate;
 		}
 #else
-		poll(pfd, numEvents, -1);
+		poll(pfd, numEvents, deferredItems.empty() ? -1 : (int) SEND_PACING_INTERVAL);
 		for (int i = 0; i < numEvents; ++i)
 			if (pfd[i].revents & POLLIN)
 			{
@@ -266,24 +284,78 @@ int SearchManager::run()
 
 bool SearchManager::receivePackets(int index)
 {
-	static const int BUFSIZE = 8192;
-	char buf[BUFSIZE];
-	IpAddress remoteIp;
-	uint16_t remotePort;
+	static thread_local unique_ptr<char[]> buffers;
+	if (!buffers) buffers.reset(new char[RECV_BATCH_SIZE * RECV_BUFFER_SIZE]);
+	Socket::Packet packets[RECV_BATCH_SIZE];
+	for (int i = 0; i < RECV_BATCH_SIZE; ++i)
+	{
+		packets[i].buffer = buffers.get() + i * RECV_BUFFER_SIZE;
+		packets[i].bufLen = RECV_BUFFER_SIZE;
+	}
 	Socket& socket = *sockets[index].get();
 	for (;;)
 	{
-		int len = socket.receivePacket(buf, BUFSIZE, remoteIp, remotePort);
+		int count = socket.receivePackets(packets, RECV_BATCH_SIZE);
 		if (isShutdown())
 			return true;
-		if (len < 0 && Socket::getLastError() == SE_EWOULDBLOCK)
+		if (count == 0)
 			break;
-		if (len >= 4)
-			onData(buf, len, remoteIp, remotePort);
+		if (count < 0)
+			continue;
+		Metrics::udpPacketsReceived.add(count);
+
+		// Packets are copied compactly, the receive buffers are reused at once
+		ParseJob* job = new ParseJob;
+		PacketBatch& batch = job->batch;
+		size_t size = 0;
+		for (int i = 0; i < count; ++i)
+			if (packets[i].len >= 4) size += packets[i].len;
+		batch.data.resize(size);
+		batch.items.reserve(count);
+		size = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			const Socket::Packet& p = packets[i];
+			if (p.len < 4) continue;
+			memcpy(&batch.data[size], p.buffer, p.len);
+			batch.items.push_back(PacketBatch::Item{size, p.len, p.ip, p.port});
+			size += p.len;
+		}
+		if (batch.items.empty())
+		{
+			delete job;
+			continue;
+		}
+		if (++pendingBatches > MAX_PENDING_BATCHES)
+		{
+			--pendingBatches;
+			Metrics::udpPacketsDropped.add(batch.items.size());
+			delete job;
+			continue;
+		}
+		job->pending = &pendingBatches;
+		if (!parser.addJob(job))
+		{
+			processBatch(batch);
+			delete job;
+		}
 	}
 	return false;
 }
 
+void SearchManager::ParseJob::run()
+{
+	SearchManager::getInstance()->processBatch(batch);
+}
+
+void SearchManager::processBatch(const PacketBatch& batch)
+{
+	if (isShutdown()) return;
+	Metrics::Histogram::Timer timer(Metrics::udpParseTime);
+	for (const auto& item : batch.items)
+		onData(batch.data.data() + item.offset, item.len, item.ip, item.port);
+}
+
 static inline bool isText(char ch)
 {
 	return ch >= 0x20 && !(ch & 0x80);
@@ -496,7 +568,8 @@ bool SearchManager::processSUDP(const char* buf, int len, const IpAddress& remot
 	uint64_t tick = Util::getTick();
 	bool result = false;
 	string data;
-	decryptKeyLock->acquireShared();
+	// The cipher contexts are reused, packets can be decrypted by one thread at a time
+	decryptKeyLock->acquireExclusive();
 	if (lastDecryptState != -1)
 	{
 		int index = lastDecryptState;
@@ -511,7 +584,7 @@ bool SearchManager::processSUDP(const char* buf, int len, const IpAddress& remot
 			if (index == lastDecryptState) break;
 		}
 	}
-	decryptKeyLock->releaseShared();
+	decryptKeyLock->releaseExclusive();
 	if (result)
 	{
 		if (LogManager::getLogOptions() & LogManager::OPT_LOG_UDP_PACKETS)
@@ -836,33 +909,132 @@ bool SearchManager::isShutdown() const
 void SearchManager::addToSendQueue(string& data, const IpAddress& address, uint16_t port, uint16_t flags, const void* encKey) noexcept
 {
 	csSendQueue.lock();
-	sendQueue.emplace_back(data, address, port, flags, encKey);
+	if (sendQueueTail - sendQueueHead == SEND_QUEUE_SIZE)
+	{
+		csSendQueue.unlock();
+		Metrics::udpSendDropped.add();
+		return;
+	}
+	SendQueueItem& item = sendQueue[sendQueueTail & (SEND_QUEUE_SIZE - 1)];
+	item.data.assign(data);
+	item.address = address;
+	item.port = port;
+	item.flags = flags;
+	if (flags & FLAG_ENC_KEY)
+		memcpy(item.encKey, encKey, 16);
+	++sendQueueTail;
 	csSendQueue.unlock();
 	sendNotif();
 }
 
+namespace
+{
+	struct SendBatch
+	{
+		Socket::Packet packets[Socket::MAX_PACKET_BATCH];
+		int count = 0;
+	};
+}
+
+static void flushSendBatch(Socket* socket, SendBatch& batch)
+{
+	if (!batch.count) return;
+	int sent = socket->sendPackets(batch.packets, batch.count);
+	Metrics::udpPacketsSent.add(sent);
+	if (sent < batch.count)
+		Metrics::udpSendErrors.add(batch.count - sent);
+	batch.count = 0;
+}
+
+bool SearchManager::canSendTo(const IpAddress& address) noexcept
+{
+	IpKey key;
+	if (address.type == AF_INET6)
+		key.setIP(address.data.v6);
+	else
+		key.setIP(address.data.v4);
+	int& count = pacing[key];
+	if (count >= SEND_PACING_MAX_PACKETS) return false;
+	++count;
+	return true;
+}
+
 void SearchManager::processSendQueue() noexcept
 {
-	string tmp;
 	csSendQueue.lock();
-	for (SendQueueItem& item : sendQueue)
+	const size_t head = sendQueueHead;
+	const size_t tail = sendQueueTail;
+	csSendQueue.unlock();
+	if (head == tail && deferredItems.empty()) return;
+
+	uint64_t tick = Util::getTick();
+	if (tick >= pacingWindowStart + SEND_PACING_INTERVAL)
+	{
+		pacing.clear();
+		pacingWindowStart = tick;
+	}
+
+	// Packets are encrypted in place and point into the slot buffers until the batch is flushed
+	SendBatch batches[2];
+	auto addToBatch = [this, &batches](SendQueueItem& item)
 	{
 		int index = item.address.type == AF_INET6 ? 1 : 0;
-		if (sockets[index])
+		Socket* socket = sockets[index].get();
+		if (!socket) return;
+		if ((LogManager::getLogOptions() & LogManager::OPT_LOG_UDP_PACKETS) && !(item.flags & FLAG_NO_TRACE))
+			LogManager::commandTrace(item.data.data(), item.data.length(), LogManager::FLAG_UDP, Util::printIpAddress(item.address, true), item.port);
+		if ((item.flags & FLAG_ENC_KEY) && !encryptState.encrypt(item.data, item.encKey))
+		{
+			Metrics::udpSendErrors.add();
+			return;
+		}
+		SendBatch& batch = batches[index];
+		Socket::Packet& p = batch.packets[batch.count++];
+		p.buffer = &item.data[0];
+		p.len = (int) item.data.length();
+		p.ip = item.address;
+		p.port = item.port;
+		if (batch.count == Socket::MAX_PACKET_BATCH)
+			flushSendBatch(socket, batch);
+	};
+	auto flushAll = [this, &batches]()
+	{
+		for (int i = 0; i < 2; ++i)
+			if (sockets[i]) flushSendBatch(sockets[i].get(), batches[i]);
+	};
+
+	// Deferred packets are older and go first, the ones still over the limit stay at the front
+	if (!deferredItems.empty())
+	{
+		auto i = std::stable_partition(deferredItems.begin(), deferredItems.end(),
+			[this](const SendQueueItem& item) { return !canSendTo(item.address); });
+		for (auto j = i; j != deferredItems.end(); ++j)
+			addToBatch(*j);
+		flushAll();
+		deferredItems.erase(i, deferredItems.end());
+	}
+
+	for (size_t i = head; i != tail; ++i)
+	{
+		SendQueueItem& item = sendQueue[i & (SEND_QUEUE_SIZE - 1)];
+		if (!canSendTo(item.address))
 		{
-			const string& data = item.data;
-			if ((LogManager::getLogOptions() & LogManager::OPT_LOG_UDP_PACKETS) && !(item.flags & FLAG_NO_TRACE))
-				LogManager::commandTrace(data.data(), data.length(), LogManager::FLAG_UDP, Util::printIpAddress(item.address, true), item.port);
-			if (item.flags & FLAG_ENC_KEY)
+			if (deferredItems.size() < MAX_DEFERRED_ITEMS)
 			{
-				encryptState.encrypt(tmp, data, item.encKey);
-				sockets[index]->sendPacket(tmp.data(), tmp.length(), item.address, item.port);
+				deferredItems.emplace_back();
+				std::swap(deferredItems.back(), item);
+				Metrics::udpSendDeferred.add();
 			}
 			else
-				sockets[index]->sendPacket(data.data(), data.length(), item.address, item.port);
+				Metrics::udpSendDropped.add();
+			continue;
 		}
+		addToBatch(item);
 	}
-	sendQueue.clear();
+	flushAll();
+
+	csSendQueue.lock();
+	sendQueueHead = tail;
 	csSendQueue.unlock();
 }
 
@@ -922,24 +1094,17 @@ void SearchManager::addEncryptionKey(AdcCommand& cmd) noexcept
 		cmd.addParam(TAG('K', 'Y'), key);
 }
 
-SearchManager::SendQueueItem::SendQueueItem(string& data, const IpAddress& address, uint16_t port, uint16_t flags, const void* encKey) :
-	data(std::move(data)), address(address), port(port), flags(flags)
-{
-	if (flags & FLAG_ENC_KEY)
-		memcpy(this->encKey, encKey, 16);
-}
-
 static const unsigned char zeroIV[16] = {};
 
-bool SearchManager::EncryptState::encrypt(string& out, const string& in, const void* key) const noexcept
+bool SearchManager::EncryptState::encrypt(string& data, const void* key) const noexcept
 {
-	int len = (int) in.length();
+	int len = (int) data.length();
 	int pad = 16 - (len & 15);
 	int outLen = len + pad + 16;
-	out.resize(outLen);
-	unsigned char* outBuf = (unsigned char*) &out[0];
+	data.resize(outLen);
+	unsigned char* outBuf = (unsigned char*) &data[0];
+	memmove(outBuf + 16, outBuf, len);
 	RAND_bytes(outBuf, 16);
-	memcpy(outBuf + 16, in.data(), len);
 	memset(outBuf + 16 + len, pad, pad);
 
 	bool result = false;
@@ -29,6 +29,8 @@
 #include "QueueItem.h"
 #include "Speaker.h"
 #include "Singleton.h"
+#include "JobExecutor.h"
+#include "IpKey.h"
 
 #ifdef _WIN32
 #include "WinEvent.h"
@@ -101,8 +103,6 @@ class SearchManager : public Speaker<SearchManagerListener>, public Singleton<Se
 			uint16_t port;
 			uint16_t flags;
 			uint8_t encKey[16];
-
-			SendQueueItem(string& data, const IpAddress& address, uint16_t port, uint16_t flags, const void* encKey);
 		};
 
 		struct EncryptState
@@ -113,7 +113,7 @@ class SearchManager : public Speaker<SearchManagerListener>, public Singleton<Se
 			~EncryptState() noexcept { clearCipher(); }
 
 			bool create() noexcept;
-			bool encrypt(string& out, const string& in, const void* key) const noexcept;
+			bool encrypt(string& data, const void* key) const noexcept;
 
 		private:
 			void clearCipher() noexcept;
@@ -135,15 +135,46 @@ class SearchManager : public Speaker<SearchManagerListener>, public Singleton<Se
 			void clearCipher() noexcept;
 		};
 
+		// Packets received in one pass are parsed together by the parser lane
+		struct PacketBatch
+		{
+			struct Item
+			{
+				size_t offset;
+				int len;
+				IpAddress ip;
+				uint16_t port;
+			};
+			string data;
+			vector<Item> items;
+		};
+
+		struct ParseJob : public JobExecutor::Job
+		{
+			PacketBatch batch;
+			std::atomic<int>* pending = nullptr; // decremented when the job is deleted, whether it ran or not
+			~ParseJob() { if (pending) --*pending; }
+			void run() override;
+		};
+
 		unique_ptr<Socket> sockets[2];
 		bool failed[2];
 		static uint16_t udpPort;
 		std::atomic_bool stopFlag;
 		std::atomic_bool restartFlag;
 		std::atomic_int options;
+		// Ring of send slots, the slot buffers are kept between uses.
+		// Producers fill the slots at the tail under csSendQueue, the thread sends the slots between head and tail.
 		vector<SendQueueItem> sendQueue;
+		size_t sendQueueHead;
+		size_t sendQueueTail;
 		CriticalSection csSendQueue;
 
+		// Used only by the thread
+		vector<SendQueueItem> deferredItems;
+		boost::unordered_map<IpKey, int> pacing;
+		uint64_t pacingWindowStart;
+
 		// SUDP
 		EncryptState encryptState;
 		DecryptState decryptState[MAX_SUDP_KEYS];
@@ -151,10 +182,14 @@ class SearchManager : public Speaker<SearchManagerListener>, public Singleton<Se
 		uint64_t newKeyTime;
 		std::unique_ptr<RWLock> decryptKeyLock;
 
+		JobExecutor parser;
+		std::atomic<int> pendingBatches;
+
 		SearchManager();
 
 		virtual int run() override;
 		bool receivePackets(int index);
+		void processBatch(const PacketBatch& batch);
 
 		void onData(const char* buf, int len, const IpAddress& address, uint16_t remotePort);
 		bool processNMDC(const char* buf, int len, const IpAddress& address, uint16_t remotePort);
@@ -166,6 +201,7 @@ class SearchManager : public Speaker<SearchManagerListener>, public Singleton<Se
 		static string getPartsString(const QueueItem::PartsInfo& partsInfo);
 		bool isShutdown() const;
 		void processSendQueue() noexcept;
+		bool canSendTo(const IpAddress& address) noexcept;
 		void sendNotif();
 };
 
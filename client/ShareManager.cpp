@@ -42,7 +42,10 @@
 #include "SettingsManager.h"
 #include "ConfCore.h"
 #include "MediaInfoUtil.h"
+#include "JobPool.h"
 #include "Tag16.h"
+#include "PagedSelector.h"
+#include "Metrics.h"
 #include "unaligned.h"
 #include "version.h"
 
@@ -71,6 +74,11 @@ static const string fileShareData("Share.dat");
 static const string fileBZXml("files.xml.bz2");
 static const string fileAttrXml("FileAttr.xml");
 
+// Size of the name bloom filter in bits, see getBloomSize
+static const size_t BLOOM_MIN_SIZE = 1 << 20;
+static const size_t BLOOM_MAX_SIZE = 1 << 28;
+static const size_t BLOOM_BITS_PER_NAME = 16;
+
 enum
 {
 	SCAN_SHARE_FLAG_ADDED         = 1,
@@ -97,6 +105,9 @@ enum
 
 static const size_t MAX_PARTIAL_LIST_SIZE = 512 * 1024;
 
+// Interval of the full refresh when shared directories are watched for changes
+static const uint64_t WATCHED_SHARE_REFRESH_TIME = 6 * 3600 * 1000;
+
 class ShareLoader : public SimpleXMLReader::CallBack
 {
 	public:
@@ -374,19 +385,20 @@ ShareManager::ShareManager() :
 	shareListChanged(false),
 	fileListChanged(false),
 	versionCounter(0),
-	bloom(1<<20),
+	bloom(BLOOM_MIN_SIZE),
 	hits(0),
 	doingScanDirs(false),
 	doingHashFiles(false),
 	doingCreateFileList(false),
 	stopScanning(false),
 	finishedScanDirs(false),
-	bloomNew(1<<20),
+	bloomNew(BLOOM_MIN_SIZE),
 	scanShareFlags(0), scanAllFlags(0),
 	nextFileID(0), maxSharedFileID(0), maxHashedFileID(0),
 	optionShareHidden(false), optionShareSystem(false), optionShareVirtual(false),
 	optionIncludeUploadCount(false), optionIncludeTimestamp(false),
 	optionUseMediaInfo(false), optionForceUpdateMediaInfo(false),
+	optionWatchChanges(false), watchingShares(false),
 	hashDb(nullptr),
 	tickUpdateList(std::numeric_limits<uint64_t>::max()),
 	tickLastRefresh(0),
@@ -414,8 +426,12 @@ ShareManager::ShareManager() :
 	ss->lockRead();
 	autoRefreshTime = ss->getInt(Conf::AUTO_REFRESH_TIME) * 60000;
 	bool autoRefreshOnStartup = ss->getBool(Conf::AUTO_REFRESH_ON_STARTUP);
+	bool watchChanges = ss->getBool(Conf::WATCH_SHARE_CHANGES);
 	ss->unlockRead();
 
+	if (watchChanges)
+		optionWatchChanges = dirWatcher.init();
+
 	if (autoRefreshOnStartup)
 	{
 		autoRefreshMode = REFRESH_MODE_FULL;
@@ -1434,6 +1450,138 @@ bool ShareManager::getFileInfo(const TTHValue& tth, int64_t& size) const noexcep
 	return true;
 }
 
+void ShareManager::getSharedFiles(vector<pair<TTHValue, int64_t>>& files, int64_t minSize) const noexcept
+{
+	files.clear();
+	{
+		READ_LOCK(*csShare);
+		for (const auto& i : tthIndex)
+		{
+			int64_t size = i.second.file->getSize();
+			if (size > minSize)
+				files.emplace_back(i.first, size);
+		}
+	}
+	std::sort(files.begin(), files.end(),
+		[](const pair<TTHValue, int64_t>& a, const pair<TTHValue, int64_t>& b) { return a.first < b.first; });
+	files.erase(std::unique(files.begin(), files.end(),
+		[](const pair<TTHValue, int64_t>& a, const pair<TTHValue, int64_t>& b) { return a.first == b.first; }), files.end());
+}
+
+static void addDirectoryEntry(vector<ShareManager::DirectoryEntry>& entries, const SharedDir* dir, uint16_t flags, int64_t totalSize)
+{
+	entries.emplace_back();
+	ShareManager::DirectoryEntry& entry = entries.back();
+	entry.name = dir->getName();
+	entry.size = (flags & BaseDirItem::FLAG_SIZE_UNKNOWN) ? -1 : totalSize;
+	entry.isDirectory = true;
+}
+
+bool ShareManager::getDirectoryPage(const string& virtualPath, const string& cursor, size_t limit, vector<DirectoryEntry>& entries, string& nextCursor) const noexcept
+{
+	entries.clear();
+	nextCursor.clear();
+	if (!limit || virtualPath.empty() || virtualPath[0] != '/')
+		return false;
+
+	// Cursor is 'd' or 'f' followed by the lower case name of the last entry
+	const bool filesOnly = !cursor.empty() && cursor[0] == 'f';
+	const string cursorName = cursor.empty() ? string() : cursor.substr(1);
+	const string* cursorKey = &cursorName;
+	const string* lastKey = nullptr;
+	bool more = false;
+
+	READ_LOCK(*csShare);
+	const SharedDir* dir = nullptr;
+	string::size_type j = 1;
+	while (j < virtualPath.length())
+	{
+		string::size_type i = virtualPath.find('/', j);
+		if (i == string::npos) i = virtualPath.length();
+		if (i != j)
+		{
+			string name = virtualPath.substr(j, i - j);
+			if (!dir)
+			{
+				auto share = getByVirtualL(name);
+				if (share == shares.cend())
+					return false;
+				dir = share->dir;
+			}
+			else
+			{
+				Text::makeLower(name);
+				auto k = dir->dirs.find(name);
+				if (k == dir->dirs.cend())
+					return false;
+				dir = k->second;
+			}
+		}
+		j = i + 1;
+	}
+
+	if (!filesOnly)
+	{
+		if (!dir)
+		{
+			// Root lists the shares, they are not sorted
+			PagedSelector<const string*, const SharedDir*, PagedSelectorPtrLess> selector(limit, cursor.empty() ? nullptr : &cursorKey);
+			for (const ShareListItem& share : shares)
+				if (!(share.dir->flags & BaseDirItem::FLAG_SHARE_REMOVED))
+					selector.add(&share.dir->getLowerName(), share.dir);
+			more = selector.finish();
+			for (const auto& item : selector.getItems())
+			{
+				addDirectoryEntry(entries, item.second, item.second->flags, item.second->totalSize);
+				lastKey = item.first;
+			}
+		}
+		else
+		{
+			auto k = cursor.empty() ? dir->dirs.cbegin() : dir->dirs.upper_bound(cursorName);
+			for (; k != dir->dirs.cend(); ++k)
+			{
+				if (entries.size() == limit)
+				{
+					more = true;
+					break;
+				}
+				addDirectoryEntry(entries, k->second, k->second->flags, k->second->totalSize);
+				lastKey = &k->first;
+			}
+			if (!more && entries.size() == limit)
+				more = !dir->files.empty();
+		}
+	}
+
+	if (dir && !more && entries.size() < limit)
+	{
+		// Files are stored in a hash map
+		PagedSelector<const string*, const SharedFile*, PagedSelectorPtrLess> selector(limit - entries.size(), filesOnly ? &cursorKey : nullptr);
+		for (const auto& k : dir->files)
+			selector.add(&k.first, k.second.get());
+		more = selector.finish();
+		for (const auto& item : selector.getItems())
+		{
+			const SharedFile* file = item.second;
+			entries.emplace_back();
+			DirectoryEntry& entry = entries.back();
+			entry.name = file->getName();
+			entry.size = file->getSize();
+			entry.tth = file->getTTH();
+			entry.isDirectory = false;
+			lastKey = item.first;
+		}
+	}
+
+	if (more && lastKey)
+	{
+		nextCursor = entries.back().isDirectory ? 'd' : 'f';
+		nextCursor += *lastKey;
+	}
+	return true;
+}
+
 bool ShareManager::getXmlFileInfo(const CID& id, bool compressed, TTHValue& tth, int64_t& size) const noexcept
 {
 	READ_LOCK(*csShare);
@@ -1836,10 +1984,163 @@ struct FileListFilter
 	}
 };
 
+struct ShareManager::FileListFragment
+{
+	BZBlock block;
+};
+
+class TreeHashOutputStream : public OutputStream
+{
+	public:
+		explicit TreeHashOutputStream(OutputStream* out) : out(out), size(0) {}
+
+		size_t write(const void* buf, size_t len) override
+		{
+			tree.update(buf, len);
+			size += len;
+			return out->write(buf, len);
+		}
+
+		size_t flushBuffers(bool force) override
+		{
+			return out->flushBuffers(force);
+		}
+
+		BufferedTigerTreeHasher tree;
+		int64_t size;
+
+	private:
+		OutputStream* const out;
+};
+
+/**
+ * Splits the full file list into fragments starting at directory boundaries.
+ * Each fragment is compressed into a separate bzip2 block and cached by the hash of its contents,
+ * the blocks are then joined into a single stream. A change in one directory only requires
+ * compressing the fragment it belongs to.
+ */
+class FileListWriter : public OutputStream
+{
+	public:
+		using OutputStream::write;
+
+		FileListWriter(OutputStream* out, ShareManager::FileListFragmentMap& cache) :
+			cache(cache), compressedOut(out), blockWriter(&compressedOut),
+			sizeOriginal(0), compressedCount(0), reusedCount(0), finished(false)
+		{
+			maxPending = JobPool::instance.getHardwareThreads() * 2;
+		}
+
+		~FileListWriter()
+		{
+			tasks.wait();
+		}
+
+		size_t write(const void* buf, size_t len) override
+		{
+			treeOriginal.update(buf, len);
+			sizeOriginal += len;
+			const char* data = static_cast<const char*>(buf);
+			size_t result = len;
+			while (len)
+			{
+				size_t part = std::min(len, BZBlock::MAX_INPUT_SIZE - chunk.length());
+				chunk.append(data, part);
+				data += part;
+				len -= part;
+				if (chunk.length() == BZBlock::MAX_INPUT_SIZE)
+					flushChunk();
+			}
+			return result;
+		}
+
+		size_t flushBuffers(bool force) override
+		{
+			if (finished) return 0;
+			finished = true;
+			flushChunk();
+			tasks.wait();
+			for (const auto& fragment : fragments)
+			{
+				if (fragment->block.data.empty())
+					throw Exception(STRING(COMPRESSION_ERROR));
+				blockWriter.write(fragment->block);
+			}
+			blockWriter.finish();
+			return compressedOut.flushBuffers(force);
+		}
+
+		void startDirectory(const string& lowerName)
+		{
+			// Fragment boundaries depend on directory names, so inserting data doesn't shift all following fragments
+			if (chunk.length() >= MAX_FRAGMENT_SIZE ||
+			    (chunk.length() >= MIN_FRAGMENT_SIZE && (boost::hash<string>()(lowerName) & 7) == 0))
+				flushChunk();
+		}
+
+		BufferedTigerTreeHasher treeOriginal;
+		int64_t sizeOriginal;
+		TreeHashOutputStream compressedOut;
+		vector<ShareManager::FileListFragmentPtr> fragments;
+		int compressedCount;
+		int reusedCount;
+
+	private:
+		// Smaller blocks compress noticeably worse
+		static const size_t MIN_FRAGMENT_SIZE = 256 * 1024;
+		static const size_t MAX_FRAGMENT_SIZE = 512 * 1024;
+
+		ShareManager::FileListFragmentMap& cache;
+		BZBlockWriter blockWriter;
+		string chunk;
+		JobPool::TaskGroup tasks;
+		int maxPending;
+		bool finished;
+
+		void flushChunk()
+		{
+			if (chunk.empty()) return;
+			TigerHash hasher;
+			hasher.update(chunk.data(), chunk.length());
+			const TTHValue key(hasher.finalize());
+			auto& item = cache[key];
+			ShareManager::FileListFragmentPtr fragment = item.lock();
+			if (fragment)
+			{
+				reusedCount++;
+				chunk.clear();
+			}
+			else
+			{
+				fragment = std::make_shared<ShareManager::FileListFragment>();
+				item = fragment;
+				compressedCount++;
+				auto data = std::make_shared<string>(std::move(chunk));
+				chunk.clear();
+				ShareManager::FileListFragment* p = fragment.get();
+				tasks.run([p, data]
+				{
+					try
+					{
+						p->block.compress(data->data(), data->length());
+					}
+					catch (const Exception&)
+					{
+						p->block.data.clear();
+					}
+				});
+				tasks.wait(maxPending);
+			}
+			fragments.push_back(std::move(fragment));
+		}
+};
+
 #define LITERAL(n) n, sizeof(n)-1
 
-void ShareManager::writeXmlL(const SharedDir* dir, OutputStream& xmlFile, string& indent, string& tmp, int mode) const
+void ShareManager::writeXmlL(const SharedDir* dir, OutputStream& xmlFile, FileListWriter* writer, string& indent, string& tmp, int mode) const
 {
+	if (writer)
+		writer->startDirectory(dir->getLowerName());
 	if (!indent.empty())
 		xmlFile.write(indent);
 	xmlFile.write(LITERAL("<Directory Name=\""));
@@ -1861,7 +2162,7 @@ void ShareManager::writeXmlL(const SharedDir* dir, OutputStream& xmlFile, string
 		indent += '\t';
 
 		for (auto i = dir->dirs.cbegin(); i != dir->dirs.cend(); ++i)
-			writeXmlL(i->second, xmlFile, indent, tmp, mode);
+			writeXmlL(i->second, xmlFile, writer, indent, tmp, mode);
 
 		writeXmlFilesL(dir, xmlFile, indent, tmp);
 
@@ -2003,9 +2304,11 @@ bool ShareManager::writeShareGroupXml(const CID& id)
 	for (int i = 0; i < MAX_FILE_ATTR; ++i) attr[i].size = -1;
 	bool result = false;
 
+	vector<FileListFragmentPtr> fragments;
 	{
 		File outFileXml(newXmlName, File::WRITE, File::TRUNCATE | File::CREATE);
-		FilteredOutputStream<FileListFilter, false> newXmlFile(&outFileXml);
+		BufferedOutputStream<false> bufferedFile(&outFileXml, 256 * 1024);
+		FileListWriter newXmlFile(&bufferedFile, fileListFragments);
 
 		if (optionIncludeUploadCount && !hashDb)
 			hashDb = DatabaseManager::getInstance()->getHashDatabaseConnection();
@@ -2020,17 +2323,18 @@ bool ShareManager::writeShareGroupXml(const CID& id)
 			{
 				if (sli.flags & BaseDirItem::FLAG_SHARE_REMOVED) continue;
 				if (selectedShares.find(sli.realPath.getLowerName()) == selectedShares.end()) continue;
-				writeXmlL(sli.dir, newXmlFile, indent, tmp, MODE_FULL_LIST);
+				writeXmlL(sli.dir, newXmlFile, &newXmlFile, indent, tmp, MODE_FULL_LIST);
 			}
 		}
 		newXmlFile.write(LITERAL("</FileListing>"));
 		newXmlFile.flushBuffers(true);
 
-		newXmlFile.getFilter().treeOriginal.finalize(attr[FILE_ATTR_FILES_XML].root);
-		newXmlFile.getFilter().treeCompressed.finalize(attr[FILE_ATTR_FILES_BZ_XML].root);
+		newXmlFile.treeOriginal.finalize(attr[FILE_ATTR_FILES_XML].root);
+		newXmlFile.compressedOut.tree.finalize(attr[FILE_ATTR_FILES_BZ_XML].root);
 
-		attr[FILE_ATTR_FILES_XML].size = newXmlFile.getFilter().sizeOriginal;
-		attr[FILE_ATTR_FILES_BZ_XML].size = newXmlFile.getFilter().sizeCompressed;
+		attr[FILE_ATTR_FILES_XML].size = newXmlFile.sizeOriginal;
+		attr[FILE_ATTR_FILES_BZ_XML].size = newXmlFile.compressedOut.size;
+		fragments = std::move(newXmlFile.fragments);
 
 		if (hashDb)
 		{
@@ -2043,6 +2347,8 @@ bool ShareManager::writeShareGroupXml(const CID& id)
 		LogManager::message(origXmlName + " uncompressed TTH: " + attr[FILE_ATTR_FILES_XML].root.toBase32(), false);
 		LogManager::message(origXmlName + " compressed size: " + Util::toString(attr[FILE_ATTR_FILES_BZ_XML].size), false);
 		LogManager::message(origXmlName + " compressed TTH: " + attr[FILE_ATTR_FILES_BZ_XML].root.toBase32(), false);
+		LogManager::message(origXmlName + " fragments compressed: " + Util::toString(newXmlFile.compressedCount) +
+			", reused: " + Util::toString(newXmlFile.reusedCount), false);
 #endif
 	}
 
@@ -2058,6 +2364,7 @@ bool ShareManager::writeShareGroupXml(const CID& id)
 		if (i == shareGroups.end()) return true;
 		ShareGroup& sg = i->second;
 		if (result) sg.tempXmlFile.clear(); else sg.tempXmlFile = std::move(tempFileName);
+		sg.fragments = std::move(fragments);
 		sg.attrUncomp = attr[FILE_ATTR_FILES_XML];
 		sg.attrComp = attr[FILE_ATTR_FILES_BZ_XML];
 	}
@@ -2145,6 +2452,13 @@ bool ShareManager::generateFileList(uint64_t tick) noexcept
 				result = false;
 		}
 
+		// Fragments are kept alive by the share groups using them
+		for (auto i = fileListFragments.begin(); i != fileListFragments.end();)
+			if (i->second.expired())
+				i = fileListFragments.erase(i);
+			else
+				++i;
+
 		if (!result)
 			tickRestoreFileList.store(GET_TICK() + 60000);
 		tickUpdateList = std::numeric_limits<uint64_t>::max();
@@ -2210,7 +2524,7 @@ MemoryInputStream* ShareManager::generatePartialList(const string& dir, bool rec
 				if (sli.realPath.getLowerName() == item.getLowerName())
 				{
 					tmp.clear();
-					writeXmlL(sli.dir, sos, indent, tmp, mode);
+					writeXmlL(sli.dir, sos, nullptr, indent, tmp, mode);
 					break;
 				}
 			}
@@ -2260,7 +2574,7 @@ MemoryInputStream* ShareManager::generatePartialList(const string& dir, bool rec
 			return nullptr;
 			
 		for (auto it = root->dirs.cbegin(); it != root->dirs.cend(); ++it)
-			writeXmlL(it->second, sos, indent, tmp, mode);
+			writeXmlL(it->second, sos, nullptr, indent, tmp, mode);
 		writeXmlFilesL(root, sos, indent, tmp);
 	}
 	
@@ -2313,6 +2627,9 @@ void ShareManager::init()
 	dcassert(ClientManager::isStartup());
 	string xmlFile = Util::getConfigPath() + fileBZXml;
 	updateSharedSizeL();
+	// The loaded names were added to a filter of the minimum size
+	if (bloom.getSize() != getBloomSizeL())
+		updateBloomL();
 	initDefaultShareGroupL();
 	if (!File::isExist(xmlFile))
 	{
@@ -2327,6 +2644,7 @@ void ShareManager::init()
 
 bool ShareManager::searchTTH(const TTHValue& tth, vector<SearchResultCore>& results, const Client* client, const CID& shareGroup) noexcept
 {
+	Metrics::searchTTH.add();
 	bool result = false;
 	string name;
 	csShare->acquireShared();
@@ -2445,6 +2763,8 @@ void ShareManager::search(vector<SearchResultCore>& results, const NmdcSearchPar
 {
 	if (ClientManager::isBeforeShutdown())
 		return;
+	Metrics::searchNmdc.add();
+	Metrics::Histogram::Timer timer(Metrics::searchTime);
 	if (sp.fileType == FILE_TYPE_TTH)
 	{
 		if (Util::isTTHBase32(sp.filter))
@@ -2716,6 +3036,8 @@ void ShareManager::search(vector<SearchResultCore>& results, AdcSearchParam& sp)
 {
 	if (ClientManager::isBeforeShutdown())
 		return;
+	Metrics::searchAdc.add();
+	Metrics::Histogram::Timer timer(Metrics::searchTime);
 		
 	if (sp.hasRoot)
 	{
@@ -2785,6 +3107,59 @@ bool ShareManager::isDirectoryExcludedL(const string& path) const noexcept
 	return false;
 }
 
+bool ShareManager::isExcludedEntry(const FileFindIter::DirData& data, const string& fileName) const noexcept
+{
+	if (Util::isReservedDirName(fileName) || fileName.empty())
+		return true;
+	if (data.isTemporary())
+		return true;
+	if (data.isHidden() && !optionShareHidden)
+		return true;
+	if (data.isSystem() && !optionShareSystem)
+		return true;
+	if (data.isVirtual() && !optionShareVirtual)
+		return true;
+	return false;
+}
+
+bool ShareManager::isExcludedDir(const string& fullPath, const string& tempDownloadDir, const string& logDir) const noexcept
+{
+	if (Util::locatedInSysPath(fullPath))
+		return true;
+	return stricmp(fullPath, tempDownloadDir) == 0 ||
+	       stricmp(fullPath, Util::getConfigPath()) == 0 ||
+	       stricmp(fullPath, logDir) == 0 ||
+	       isDirectoryExcludedL(fullPath);
+}
+
+bool ShareManager::getSharedFileSize(const FileFindIter::DirData& data, const string& lowerName, const string& fullPath, int64_t& size) const
+{
+	size = data.getSize();
+	if (isInSkipList(lowerName))
+	{
+		// !qb, jc!, ob!, dmf, mta, dmfr, !ut, !bt, bc!, getright, antifrag, pusd, dusd, download, crdownload
+		string pathStr = Util::ellipsizePath(fullPath);
+		string sizeStr = Util::formatBytes(size);
+		LogManager::message(STRING_F(SKIPPING_FILE, pathStr % sizeStr));
+		return false;
+	}
+#ifdef _WIN32
+	if (data.isLink() && size == 0) // https://github.com/pavel-pimenov/flylinkdc-r5xx/issues/14
+	{
+		try
+		{
+			File f(fullPath, File::READ, File::OPEN | File::SHARED);
+			size = f.getSize();
+		}
+		catch (FileException&)
+		{
+			return false;
+		}
+	}
+#endif
+	return true;
+}
+
 void ShareManager::scanDir(SharedDir* dir, const string& path)
 {
 	scanProgress[0]++;
@@ -2806,32 +3181,22 @@ void ShareManager::scanDir(SharedDir* dir, const string& path)
 	const string logDir = ss->getString(Conf::LOG_DIRECTORY);
 	ss->unlockRead();
 
+	if (optionWatchChanges)
+		dirWatcher.addDir(path);
+
 	string lowerName;
 	for (FileFindIter i(path + '*'); i != FileFindIter::end; ++i)
 	{
 		if (stopScanning) break;
 		const string& fileName = i->getFileName();
-		if (Util::isReservedDirName(fileName) || fileName.empty())
-			continue;
-		if (i->isTemporary())
-			continue;
-		if (i->isHidden() && !optionShareHidden)
-			continue;
-		if (i->isSystem() && !optionShareSystem)
-			continue;
-		if (i->isVirtual() && !optionShareVirtual)
+		if (isExcludedEntry(*i, fileName))
 			continue;
 		Text::toLower(fileName, lowerName);
 		if (i->isDirectory())
 		{
 			const string fullPath = path + fileName + PATH_SEPARATOR;
-			if (Util::locatedInSysPath(fullPath))
+			if (isExcludedDir(fullPath, tempDownloadDir, logDir))
 				continue;
-				
-			if (stricmp(fullPath, tempDownloadDir) == 0 ||
-			    stricmp(fullPath, Util::getConfigPath()) == 0 ||
-			    stricmp(fullPath, logDir) == 0 ||
-			    isDirectoryExcludedL(fullPath)) continue;
 
 			SharedDir* subdir;
 			auto itDir = dir->dirs.find(lowerName);
@@ -2858,31 +3223,10 @@ void ShareManager::scanDir(SharedDir* dir, const string& path)
 		else
 		{
 			// Not a directory, assume it's a file...make sure we're not sharing the settings file...
-			string ext = Util::getFileExtWithoutDot(lowerName);
 			const string fullPath = path + fileName;
-			int64_t size = i->getSize();
-			if (isInSkipList(lowerName))
-			{
-				// !qb, jc!, ob!, dmf, mta, dmfr, !ut, !bt, bc!, getright, antifrag, pusd, dusd, download, crdownload
-				string pathStr = Util::ellipsizePath(fullPath);
-				string sizeStr = Util::formatBytes(size);
-				LogManager::message(STRING_F(SKIPPING_FILE, pathStr % sizeStr));
+			int64_t size;
+			if (!getSharedFileSize(*i, lowerName, fullPath, size))
 				continue;
-			}
-#ifdef _WIN32
-			if (i->isLink() && size == 0) // https://github.com/pavel-pimenov/flylinkdc-r5xx/issues/14
-			{
-				try
-				{
-					File f(fullPath, File::READ, File::OPEN | File::SHARED);
-					size = f.getSize();
-				}
-				catch (FileException&)
-				{
-					continue;
-				}
-			}
-#endif
 			fileCounter++;
 			scanProgress[1]++;
 			auto itFile = dir->files.find(lowerName);
@@ -2967,6 +3311,182 @@ void ShareManager::scanDir(SharedDir* dir, const string& path)
 		dir->addTypes(filesTypesMask, dirsTypesMask);
 }
 
+void ShareManager::readDir(ScannedDir& result, const string& path, bool recursive)
+{
+	scanProgress[0]++;
+	auto ss = SettingsManager::instance.getCoreSettings();
+	ss->lockRead();
+	const string tempDownloadDir = ss->getString(Conf::TEMP_DOWNLOAD_DIRECTORY);
+	const string logDir = ss->getString(Conf::LOG_DIRECTORY);
+	ss->unlockRead();
+
+	// Changed directories are already watched, new ones are added before reading
+	// so that nothing created in the meantime is missed
+	if (recursive && optionWatchChanges)
+		dirWatcher.addDir(path);
+
+	for (FileFindIter i(path + '*'); i != FileFindIter::end; ++i)
+	{
+		if (stopScanning) break;
+		const string& fileName = i->getFileName();
+		if (isExcludedEntry(*i, fileName))
+			continue;
+		if (i->isDirectory())
+		{
+			const string fullPath = path + fileName + PATH_SEPARATOR;
+			if (isExcludedDir(fullPath, tempDownloadDir, logDir))
+				continue;
+			result.dirs.emplace_back();
+			ScannedDir& subdir = result.dirs.back();
+			subdir.name = fileName;
+			Text::toLower(fileName, subdir.lowerName);
+			if (recursive)
+				readDir(subdir, fullPath, true);
+		}
+		else
+		{
+			ScannedFile file;
+			Text::toLower(fileName, file.lowerName);
+			if (!getSharedFileSize(*i, file.lowerName, path + fileName, file.size))
+				continue;
+			file.name = fileName;
+			file.timestamp = i->getTimeStamp();
+			scanProgress[1]++;
+			result.files.push_back(std::move(file));
+		}
+	}
+}
+
+void ShareManager::applyChangedDirL(SharedDir* dir, const ScannedDir& scanned, const string& path, IncrementalScan& changes)
+{
+	int64_t deltaSize = 0;
+	uint16_t filesTypesMask = 0;
+	uint16_t dirsTypesMask = 0;
+	size_t countFiles = dir->files.size();
+	size_t countDirs = dir->dirs.size();
+	size_t foundFiles = 0;
+	size_t foundDirs = 0;
+	for (auto i = dir->dirs.begin(); i != dir->dirs.end(); ++i)
+		i->second->flags |= BaseDirItem::FLAG_NOT_FOUND;
+	for (auto i = dir->files.begin(); i != dir->files.end(); ++i)
+		i->second->flags |= BaseDirItem::FLAG_NOT_FOUND;
+
+	// Subdirectories are not rescanned, new ones are only reported
+	for (const ScannedDir& scannedDir : scanned.dirs)
+	{
+		auto itDir = dir->dirs.find(scannedDir.lowerName);
+		if (itDir != dir->dirs.end())
+		{
+			SharedDir* subdir = itDir->second;
+			subdir->flags &= ~BaseDirItem::FLAG_NOT_FOUND;
+			foundDirs++;
+			dirsTypesMask |= subdir->getTypes();
+		}
+		else
+			changes.newDirs.push_back(path + scannedDir.name + PATH_SEPARATOR);
+	}
+
+	for (const ScannedFile& scannedFile : scanned.files)
+	{
+		auto itFile = dir->files.find(scannedFile.lowerName);
+		int64_t oldSize = 0;
+		if (itFile != dir->files.end())
+		{
+			foundFiles++;
+			SharedFilePtr& file = itFile->second;
+			filesTypesMask |= file->getFileTypes();
+			oldSize = file->size;
+			if (oldSize == scannedFile.size && file->timestamp == scannedFile.timestamp &&
+			    (!optionForceUpdateMediaInfo || file->getMediaInfo() || !(mediaInfoFileTypes & file->getFileTypes())))
+			{
+				file->flags &= ~BaseDirItem::FLAG_NOT_FOUND;
+				continue;
+			}
+			removeFromIndexL(file);
+		}
+		else
+			changes.deltaFiles++;
+
+		uint16_t types = getFileTypesFromFileName(scannedFile.name);
+		SharedFilePtr newFile = std::make_shared<SharedFile>(scannedFile.name, scannedFile.lowerName, scannedFile.size, scannedFile.timestamp, types);
+		filesTypesMask |= types;
+		newFile->flags |= BaseDirItem::FLAG_HASH_FILE;
+		dir->files.insert_or_assign(scannedFile.lowerName, newFile);
+		deltaSize += newFile->getSize() - oldSize;
+		if (!(scanShareFlags & SCAN_SHARE_FLAG_REBUILD_BLOOM))
+			bloom.add(newFile->getLowerName());
+		filesToHash.emplace_back(FileToHash{newFile, path + scannedFile.name});
+		scanShareFlags |= SCAN_SHARE_FLAG_ADDED;
+	}
+
+	if (foundFiles < countFiles)
+	{
+		auto i = dir->files.begin();
+		while (i != dir->files.end())
+		{
+			SharedFilePtr& file = i->second;
+			if (file->flags & BaseDirItem::FLAG_NOT_FOUND)
+			{
+				deltaSize -= file->getSize();
+				removeFromIndexL(file);
+				changes.deltaFiles--;
+				i = dir->files.erase(i);
+				scanShareFlags |= SCAN_SHARE_FLAG_REMOVED | SCAN_SHARE_FLAG_REBUILD_BLOOM;
+			} else ++i;
+		}
+	}
+	if (foundDirs < countDirs)
+	{
+		auto i = dir->dirs.begin();
+		while (i != dir->dirs.end())
+		{
+			SharedDir* d = i->second;
+			if (d->flags & BaseDirItem::FLAG_NOT_FOUND)
+			{
+				deltaSize -= d->totalSize;
+				changes.deltaFiles -= removeDirFromIndexL(d);
+				SharedDir::deleteTree(d);
+				i = dir->dirs.erase(i);
+				scanShareFlags |= SCAN_SHARE_FLAG_REMOVED | SCAN_SHARE_FLAG_REBUILD_BLOOM;
+			} else ++i;
+		}
+	}
+	if (deltaSize)
+		dir->updateSize(deltaSize);
+	if (scanShareFlags & SCAN_SHARE_FLAG_REMOVED)
+		dir->updateTypes(filesTypesMask, dirsTypesMask);
+	else
+		dir->addTypes(filesTypesMask, dirsTypesMask);
+}
+
+void ShareManager::addNewDirL(SharedDir* parent, const ScannedDir& scanned, const string& path, IncrementalScan& changes)
+{
+	SharedDir* dir = new SharedDir(scanned.name, parent);
+	parent->dirs.insert(make_pair(scanned.lowerName, dir));
+	bloom.add(scanned.lowerName);
+
+	int64_t size = 0;
+	uint16_t filesTypesMask = 0;
+	for (const ScannedFile& scannedFile : scanned.files)
+	{
+		uint16_t types = getFileTypesFromFileName(scannedFile.name);
+		SharedFilePtr newFile = std::make_shared<SharedFile>(scannedFile.name, scannedFile.lowerName, scannedFile.size, scannedFile.timestamp, types);
+		filesTypesMask |= types;
+		newFile->flags |= BaseDirItem::FLAG_HASH_FILE;
+		dir->files.insert_or_assign(scannedFile.lowerName, newFile);
+		size += scannedFile.size;
+		bloom.add(scannedFile.lowerName);
+		filesToHash.emplace_back(FileToHash{newFile, path + scannedFile.name});
+		changes.deltaFiles++;
+	}
+	if (size)
+		dir->updateSize(size);
+	dir->addTypes(filesTypesMask, 0);
+
+	for (const ScannedDir& scannedDir : scanned.dirs)
+		addNewDirL(dir, scannedDir, path + scannedDir.name + PATH_SEPARATOR, changes);
+}
+
 void ShareManager::scanDirs()
 {
 	uint64_t startTick = GET_TICK();
@@ -3019,6 +3539,11 @@ void ShareManager::scanDirs()
 	tthIndexNew.clear();
 	filesToHash.clear();
 
+	// Watches are added again while scanning, this also drops removed shares
+	watchingShares = false;
+	if (optionWatchChanges)
+		dirWatcher.clear();
+
 	rebuildSkipList();
 	for (ShareListItem& sli : newShares)
 	{
@@ -3101,7 +3626,7 @@ void ShareManager::scanDirs()
 			hashBloom.clear();
 			csHashBloom.unlock();
 		}
-		if (scanAllFlags & SCAN_SHARE_FLAG_REBUILD_BLOOM)
+		if ((scanAllFlags & SCAN_SHARE_FLAG_REBUILD_BLOOM) || bloomNew.getSize() != getBloomSizeL())
 			updateBloomL();
 		else
 			bloom = std::move(bloomNew);
@@ -3121,18 +3646,8 @@ void ShareManager::scanDirs()
 		searchCache.clear();
 	}
 
-	if (!filesToHash.empty())
-	{
-		HashManager* hm = HashManager::getInstance();
-		for (auto i = filesToHash.begin(); i != filesToHash.end(); ++i)
-		{
-			maxSharedFileID = ++nextFileID;
-			hm->hashFile(maxSharedFileID, i->file, i->path, i->file->size);
-		}
-		filesToHash.clear();
-		filesToHash.shrink_to_fit();
+	if (hashNewFiles())
 		doingHashFiles.store(true);
-	}
 	else
 	{
 		tickLastRefresh = GET_TICK();
@@ -3142,6 +3657,8 @@ void ShareManager::scanDirs()
 			tickRefresh = std::numeric_limits<uint64_t>::max();
 		tickUpdateList.store(0);
 	}
+	if (!stopScanning)
+		watchingShares = optionWatchChanges && dirWatcher.isActive();
 
 	if (scanAllFlags & (SCAN_SHARE_FLAG_ADDED | SCAN_SHARE_FLAG_REMOVED))
 		ClientManager::infoUpdated(true);
@@ -3151,6 +3668,168 @@ void ShareManager::scanDirs()
 	LogManager::message(STRING_F(FILE_LIST_REFRESH_SCANNED, elapsed));
 }
 
+// Returns true if some files were queued for hashing
+bool ShareManager::hashNewFiles()
+{
+	// Files moved or renamed within the same volume don't need to be hashed again
+	size_t filesFound = 0;
+	if (!filesToHash.empty())
+	{
+		vector<pair<FileToHash, TTHValue>> hashedFiles;
+		TTHValue tth;
+		for (FileToHash& item : filesToHash)
+		{
+			if (stopScanning) break;
+			if (HashManager::findHashedFile(item.path, item.file->size, item.file->timestamp, tth))
+			{
+				hashedFiles.emplace_back(std::move(item), tth);
+				item.file.reset();
+			}
+		}
+		if (!hashedFiles.empty())
+		{
+			WRITE_LOCK(*csShare);
+			for (const auto& hashedFile : hashedFiles)
+				setFileHashedL(hashedFile.first.file, hashedFile.first.path, hashedFile.second);
+			filesFound = hashedFiles.size();
+		}
+		if (filesFound)
+			LogManager::message("Files found in hash database: " + Util::toString(filesFound), false);
+	}
+
+	bool result = false;
+	if (filesFound < filesToHash.size())
+	{
+		HashManager* hm = HashManager::getInstance();
+		for (auto i = filesToHash.begin(); i != filesToHash.end(); ++i)
+		{
+			if (!i->file) continue;
+			maxSharedFileID = ++nextFileID;
+			hm->hashFile(maxSharedFileID, i->file, i->path, i->file->size);
+		}
+		result = true;
+	}
+	filesToHash.clear();
+	filesToHash.shrink_to_fit();
+	return result;
+}
+
+void ShareManager::scanChangedDirs()
+{
+	uint64_t startTick = GET_TICK();
+
+	auto ss = SettingsManager::instance.getCoreSettings();
+	ss->lockRead();
+	optionShareHidden = ss->getBool(Conf::SHARE_HIDDEN);
+	optionShareSystem = ss->getBool(Conf::SHARE_SYSTEM);
+	optionShareVirtual = ss->getBool(Conf::SHARE_VIRTUAL);
+	ss->unlockRead();
+
+	{
+		READ_LOCK(*csShare);
+		newNotShared = notShared;
+	}
+	filesToHash.clear();
+	rebuildSkipList();
+
+	// Directory contents are read without holding the lock, the live tree is updated afterwards.
+	// Parents go first, so a directory created inside a new one is scanned only once
+	std::sort(changedDirs.begin(), changedDirs.end());
+	IncrementalScan changes;
+	unsigned changedFlags = 0;
+	string pathLower;
+	for (const string& path : changedDirs)
+	{
+		if (stopScanning) break;
+		ScannedDir scanned;
+		readDir(scanned, path, false);
+		if (stopScanning) break;
+		Text::toLower(path, pathLower);
+		WRITE_LOCK(*csShare);
+		ShareListItem* share = findShareL(pathLower);
+		SharedDir* dir;
+		string filename;
+		if (!share || !findByRealPathL(pathLower, dir, filename) || !filename.empty())
+			continue;
+		scanShareFlags = 0;
+		changes.deltaFiles = 0;
+		applyChangedDirL(dir, scanned, path, changes);
+		if (scanShareFlags)
+		{
+			share->totalFiles += changes.deltaFiles;
+			share->version++;
+			changedFlags |= scanShareFlags;
+		}
+	}
+
+	// New directories are read recursively and attached to the live tree
+	for (const string& path : changes.newDirs)
+	{
+		if (stopScanning) break;
+		string::size_type pos = path.rfind(PATH_SEPARATOR, path.length() - 2);
+		if (pos == string::npos) continue;
+		ScannedDir scanned;
+		scanned.name = path.substr(pos + 1, path.length() - pos - 2);
+		Text::toLower(scanned.name, scanned.lowerName);
+		readDir(scanned, path, true);
+		if (stopScanning) break;
+
+		Text::toLower(path.substr(0, pos + 1), pathLower);
+		WRITE_LOCK(*csShare);
+		ShareListItem* share = findShareL(pathLower);
+		SharedDir* parent;
+		string filename;
+		if (!share || !findByRealPathL(pathLower, parent, filename) || !filename.empty() ||
+		    parent->dirs.find(scanned.lowerName) != parent->dirs.end())
+			continue;
+		changes.deltaFiles = 0;
+		addNewDirL(parent, scanned, path, changes);
+		share->totalFiles += changes.deltaFiles;
+		share->version++;
+		changedFlags |= SCAN_SHARE_FLAG_ADDED;
+	}
+
+	if (changedFlags)
+	{
+		{
+			WRITE_LOCK(*csShare);
+			if ((changedFlags & SCAN_SHARE_FLAG_REBUILD_BLOOM) || bloom.getSize() != getBloomSizeL())
+				updateBloomL();
+			updateSharedSizeL();
+		}
+		{
+			LOCK(csSearchCache);
+			searchCache.clear();
+		}
+		csHashBloom.lock();
+		hashBloom.clear();
+		csHashBloom.unlock();
+	}
+
+	if (hashNewFiles())
+		doingHashFiles.store(true);
+	else if (changedFlags)
+		tickUpdateList.store(0);
+
+	if (changedFlags)
+		ClientManager::infoUpdated(true);
+	LogManager::message("Changed directories scanned: " + Util::toString(changedDirs.size()) +
+		", time: " + Util::toString(GET_TICK() - startTick) + " ms", false);
+	changedDirs.clear();
+	finishedScanDirs.store(true);
+}
+
+bool ShareManager::refreshChangedDirs(StringList& dirs)
+{
+	bool prevStatus = false;
+	if (!doingScanDirs.compare_exchange_strong(prevStatus, true))
+		return false;
+	finishedScanDirs = false;
+	changedDirs = std::move(dirs);
+	start(0, "ShareManager");
+	return true;
+}
+
 bool ShareManager::refreshShare()
 {
 	bool prevStatus = false;
@@ -3196,6 +3875,40 @@ void ShareManager::updateIndexDirL(const SharedDir* dir) noexcept
 		updateIndexDirL(i->second);
 }
 
+void ShareManager::removeFromIndexL(const SharedFilePtr& file) noexcept
+{
+	if (file->flags & BaseDirItem::FLAG_HASH_FILE) return;
+	auto range = tthIndex.equal_range(file->getTTH());
+	for (auto i = range.first; i != range.second; ++i)
+		if (i->second.file == file)
+		{
+			tthIndex.erase(i);
+			break;
+		}
+}
+
+int64_t ShareManager::removeDirFromIndexL(const SharedDir* dir) noexcept
+{
+	int64_t count = dir->files.size();
+	for (auto i = dir->files.cbegin(); i != dir->files.cend(); ++i)
+		removeFromIndexL(i->second);
+	for (auto i = dir->dirs.cbegin(); i != dir->dirs.cend(); ++i)
+		count += removeDirFromIndexL(i->second);
+	return count;
+}
+
+ShareManager::ShareListItem* ShareManager::findShareL(const string& pathLower) noexcept
+{
+	for (ShareListItem& sli : shares)
+	{
+		if (sli.dir->flags & BaseDirItem::FLAG_SHARE_REMOVED) continue;
+		const string& name = sli.realPath.getLowerName();
+		if (pathLower.compare(0, name.length(), name) == 0)
+			return &sli;
+	}
+	return nullptr;
+}
+
 void ShareManager::updateBloomDirL(const SharedDir* dir) noexcept
 {
 	bloom.add(dir->getLowerName());
@@ -3208,12 +3921,30 @@ void ShareManager::updateBloomDirL(const SharedDir* dir) noexcept
 void ShareManager::updateBloomL() noexcept
 {
 	LogManager::message("Bloom will be rebuilt", false);
-	bloom.clear();
+	bloom.reset(getBloomSizeL());
 	for (auto i = shares.cbegin(); i != shares.cend(); ++i)
 		if (!(i->dir->flags & BaseDirItem::FLAG_SHARE_REMOVED))
 			updateBloomDirL(i->dir);
 }
 
+// Sizes are powers of 2, so a rescan rebuilds the filter only after the share has about doubled or halved
+size_t ShareManager::getBloomSize(size_t names) noexcept
+{
+	size_t size = BLOOM_MIN_SIZE;
+	while (size < names * BLOOM_BITS_PER_NAME && size < BLOOM_MAX_SIZE)
+		size <<= 1;
+	return size;
+}
+
+size_t ShareManager::getBloomSizeL() const noexcept
+{
+	size_t names = 0;
+	for (auto i = shares.cbegin(); i != shares.cend(); ++i)
+		if (!(i->dir->flags & BaseDirItem::FLAG_SHARE_REMOVED))
+			names += (size_t) i->totalFiles;
+	return getBloomSize(names);
+}
+
 void ShareManager::updateSharedSizeL() noexcept
 {
 	int64_t totalFiles = 0;
@@ -3414,13 +4145,11 @@ void ShareManager::rebuildSkipList()
 	hasSkipList = result;
 }
 
-void ShareManager::on(FileHashed, int64_t fileID, const SharedFilePtr& file, const string& fileName, const TTHValue& root, int64_t size) noexcept
+void ShareManager::setFileHashedL(const SharedFilePtr& file, const string& fileName, const TTHValue& root) noexcept
 {
-	if (!file) return;
 	string pathLower;
 	Text::toLower(fileName, pathLower);
-	
-	WRITE_LOCK(*csShare);
+
 	file->tth = root;
 	file->flags &= ~BaseDirItem::FLAG_HASH_FILE;
 
@@ -3435,6 +4164,13 @@ void ShareManager::on(FileHashed, int64_t fileID, const SharedFilePtr& file, con
 		tthItem.dir = dir;
 		tthIndex.insert(make_pair(root, tthItem));
 	}
+}
+
+void ShareManager::on(FileHashed, int64_t fileID, const SharedFilePtr& file, const string& fileName, const TTHValue& root, int64_t size) noexcept
+{
+	if (!file) return;
+	WRITE_LOCK(*csShare);
+	setFileHashedL(file, fileName, root);
 	if (fileID > maxHashedFileID)
 		maxHashedFileID = fileID;
 }
@@ -3492,7 +4228,32 @@ void ShareManager::on(Second, uint64_t tick) noexcept
 			tickRestoreFileList.store(tick + 60000);
 	}
 	generateFileList(tick);
-	if (!doingHashFiles && tick > tickRefresh)
+	if (doingHashFiles || doingScanDirs) return;
+	if (watchingShares)
+	{
+		StringList dirs;
+		int result = dirWatcher.getChanges(dirs, tick);
+		if (result == DirWatcher::RESULT_OVERFLOW)
+		{
+			LogManager::message("Too many changes in shared directories, starting full refresh", false);
+			refreshShare();
+			return;
+		}
+		if (result == DirWatcher::RESULT_CHANGES)
+		{
+			refreshChangedDirs(dirs);
+			return;
+		}
+		// Changes are still picked up by a full refresh from time to time,
+		// in case some events were lost
+		if (dirWatcher.isActive())
+		{
+			if (tick > tickRefresh && tick > tickLastRefresh + WATCHED_SHARE_REFRESH_TIME)
+				refreshShare();
+			return;
+		}
+	}
+	if (tick > tickRefresh)
 		refreshShare();
 }
 
@@ -3501,7 +4262,20 @@ void ShareManager::on(ApplySettings) noexcept
 	auto ss = SettingsManager::instance.getCoreSettings();
 	ss->lockRead();
 	unsigned newAutoRefreshTime = ss->getInt(Conf::AUTO_REFRESH_TIME) * 60000;
+	bool watchChanges = ss->getBool(Conf::WATCH_SHARE_CHANGES);
 	ss->unlockRead();
+	if (watchChanges != optionWatchChanges && !doingScanDirs)
+	{
+		// Watches are added by the next full refresh
+		watchingShares = false;
+		if (watchChanges)
+			optionWatchChanges = dirWatcher.init();
+		else
+		{
+			optionWatchChanges = false;
+			dirWatcher.shutdown();
+		}
+	}
 	if (newAutoRefreshTime == autoRefreshTime) return;
 	autoRefreshTime = newAutoRefreshTime;
 	if (autoRefreshTime)
@@ -3521,6 +4295,8 @@ void ShareManager::shutdown()
 		doingHashFiles.store(false);
 		doingScanDirs.store(false);
 	}
+	watchingShares = false;
+	dirWatcher.shutdown();
 }
 
 bool ShareManager::isRefreshing() const noexcept
@@ -32,9 +32,11 @@
 #include "Streams.h"
 #include "BloomFilter.h"
 #include "LruCache.h"
+#include "DirWatcher.h"
 #include <regex>
 
 class OutputStream;
+class FileListWriter;
 class SimpleXML;
 class AdcCommand;
 
@@ -101,6 +103,7 @@ class ShareManager :
 	public:
 		friend class Singleton<ShareManager>;
 		friend class ShareLoader;
+		friend class FileListWriter;
 
 		enum
 		{
@@ -128,6 +131,14 @@ class ShareManager :
 			string name;
 		};
 
+		struct DirectoryEntry
+		{
+			string name;
+			int64_t size; // -1 if unknown
+			TTHValue tth;
+			bool isDirectory;
+		};
+
 		void addDirectory(const string& realPath, const string &virtualName);
 		void removeDirectory(const string& realPath);
 		void renameDirectory(const string& realPath, const string& virtualName);
@@ -172,6 +183,11 @@ class ShareManager :
 		bool getFileInfo(const TTHValue& tth, int64_t& size) const noexcept;
 		bool getFileInfo(AdcCommand& cmd, const string& filename, bool hideShare, const CID& shareGroup) const noexcept;
 		bool findByRealPath(const string& realPath, TTHValue* outTTH, string* outFilename, int64_t* outSize) const noexcept;
+		// Returns hashes of shared files larger than minSize, sorted by TTH
+		void getSharedFiles(vector<pair<TTHValue, int64_t>>& files, int64_t minSize) const noexcept;
+		// Returns one page of the directory, subdirectories first, each group ordered by name.
+		// The cursor is an opaque key of the last entry of the previous page, empty for the first page.
+		bool getDirectoryPage(const string& virtualPath, const string& cursor, size_t limit, vector<DirectoryEntry>& entries, string& nextCursor) const noexcept;
 		
 		void incHits() { ++hits; }
 		void setHits(size_t value) { hits = value; }
@@ -191,6 +207,8 @@ class ShareManager :
 		bool matchBloom(const string& s) const noexcept;
 		void getBloomInfo(size_t& size, size_t& used) const noexcept;
 #endif
+		// Size of the name bloom filter in bits for the number of shared names
+		static size_t getBloomSize(size_t names) noexcept;
 
 		bool refreshShare();
 		bool refreshShareIfChanged();
@@ -236,12 +254,40 @@ class ShareManager :
 			string path;
 		};
 
+		struct IncrementalScan
+		{
+			StringList newDirs;
+			int64_t deltaFiles = 0;
+		};
+
+		// Directory contents read from disk without holding the share lock
+		struct ScannedFile
+		{
+			string name;
+			string lowerName;
+			int64_t size;
+			uint64_t timestamp;
+		};
+
+		struct ScannedDir
+		{
+			string name;
+			string lowerName;
+			vector<ScannedFile> files;
+			vector<ScannedDir> dirs;
+		};
+
 		struct FileAttr
 		{
 			TTHValue root;
 			int64_t size;
 		};
 
+		// Compressed part of the file list, see FileListWriter
+		struct FileListFragment;
+		typedef std::shared_ptr<FileListFragment> FileListFragmentPtr;
+		typedef boost::unordered_map<TTHValue, std::weak_ptr<FileListFragment>> FileListFragmentMap;
+
 		struct ShareGroup
 		{
 			CID id;
@@ -253,6 +299,7 @@ class ShareManager :
 			int64_t totalSize;
 			int64_t totalFiles;
 			string tempXmlFile;
+			vector<FileListFragmentPtr> fragments;
 
 			ShareGroup()
 			{
@@ -292,6 +339,7 @@ class ShareManager :
 		FileAttr fileAttr[MAX_FILE_ATTR];
 
 		boost::unordered_multimap<TTHValue, TTHMapItem> tthIndex;
+		FileListFragmentMap fileListFragments;
 		Bloom bloom;
 		
 		size_t hits;
@@ -311,6 +359,10 @@ class ShareManager :
 		std::atomic<int64_t> maxHashedFileID;
 		std::atomic<int64_t> scanProgress[2];
 		vector<FileToHash> filesToHash;
+		DirWatcher dirWatcher;
+		StringList changedDirs;
+		bool optionWatchChanges;
+		bool watchingShares;
 		bool optionShareHidden, optionShareSystem, optionShareVirtual;
 		mutable bool optionIncludeUploadCount, optionIncludeTimestamp;
 		bool optionUseMediaInfo, optionForceUpdateMediaInfo;
@@ -376,7 +428,8 @@ class ShareManager :
 		static void writeShareDataDirEnd(OutputStream* os);
 		static void writeShareDataFile(OutputStream* os, const SharedFilePtr& file, uint8_t tempBuf[]);
 		void writeShareDataL(const SharedDir* dir, OutputStream* shareDataFile, uint8_t tempBuf[]) const;
-		void writeXmlL(const SharedDir* dir, OutputStream& xmlFile, string& indent, string& tmp, int mode) const;
+		// Directory boundaries are reported to writer when it's not null
+		void writeXmlL(const SharedDir* dir, OutputStream& xmlFile, FileListWriter* writer, string& indent, string& tmp, int mode) const;
 		void writeXmlFilesL(const SharedDir* dir, OutputStream& xmlFile, string& indent, string& tmp) const;
 		bool renameXmlFiles() noexcept;
 		bool getXmlFileInfo(const CID& id, bool compressed, TTHValue& tth, int64_t& size) const noexcept;
@@ -398,10 +451,24 @@ class ShareManager :
 
 		void scanDirs();
 		void scanDir(SharedDir* dir, const string& path);
+		void readDir(ScannedDir& result, const string& path, bool recursive);
+		void applyChangedDirL(SharedDir* dir, const ScannedDir& scanned, const string& path, IncrementalScan& changes);
+		void addNewDirL(SharedDir* parent, const ScannedDir& scanned, const string& path, IncrementalScan& changes);
+		bool isExcludedEntry(const FileFindIter::DirData& data, const string& fileName) const noexcept;
+		bool isExcludedDir(const string& fullPath, const string& tempDownloadDir, const string& logDir) const noexcept;
+		bool getSharedFileSize(const FileFindIter::DirData& data, const string& lowerName, const string& fullPath, int64_t& size) const;
+		void scanChangedDirs();
+		bool refreshChangedDirs(StringList& dirs);
+		bool hashNewFiles();
+		ShareListItem* findShareL(const string& pathLower) noexcept;
+		void removeFromIndexL(const SharedFilePtr& file) noexcept;
+		int64_t removeDirFromIndexL(const SharedDir* dir) noexcept;
 		bool isDirectoryExcludedL(const string& path) const noexcept;
 		void updateIndexDirL(const SharedDir* dir) noexcept; 
+		void setFileHashedL(const SharedFilePtr& file, const string& fileName, const TTHValue& root) noexcept;
 		void updateBloomDirL(const SharedDir* dir) noexcept;
 		void updateBloomL() noexcept;
+		size_t getBloomSizeL() const noexcept;
 		void updateSharedSizeL() noexcept;
 
 		void initDefaultShareGroupL() noexcept;
@@ -426,7 +493,14 @@ class ShareManager :
 		virtual void on(ApplySettings) noexcept override;
 
 		// Thread
-		virtual int run() override { scanDirs(); return 0; }
+		virtual int run() override
+		{
+			if (changedDirs.empty())
+				scanDirs();
+			else
+				scanChangedDirs();
+			return 0;
+		}
 };
 
 #endif // SHARE_MANAGER_H_
@@ -23,6 +23,15 @@
 #include "Text.h"
 #include "Streams.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define XML_READER_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 inline static bool isSpace(int c)
 {
 	return c == 0x20 || c == 0x09 || c == 0x0d || c == 0x0a;
@@ -68,8 +77,95 @@ inline static bool isNameChar(int c)
 	       ;
 }
 
+static inline unsigned firstBit(unsigned mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// Returns the first occurrence of a or b in [p, end), end if there is none
+static const char* findChar(const char* p, const char* end, char a, char b)
+{
+#ifdef XML_READER_SSE2
+	const __m128i va = _mm_set1_epi8(a);
+	const __m128i vb = _mm_set1_epi8(b);
+	while (end - p >= 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*) p);
+		unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+		if (mask) return p + firstBit(mask);
+		p += 16;
+	}
+#endif
+	while (p < end && *p != a && *p != b) ++p;
+	return p;
+}
+
+// Decodes the entity reference at p, returns its length or 0 if it's not recognized.
+// &#00000 decimal and &#x0000 hex values are skipped to avoid error, they wouldn't be parsed anyway: c is set to 0
+static size_t decodeEntity(const char* p, const char* end, char& c)
+{
+	static const struct
+	{
+		const char* name;
+		size_t len;
+		char c;
+	} entities[] =
+	{
+		{ "lt;", 3, '<' }, { "gt;", 3, '>' }, { "amp;", 4, '&' }, { "quot;", 5, '"' }, { "apos;", 5, '\'' }
+	};
+
+	const size_t avail = end - p;
+	auto at = [p, avail](size_t i) -> int { return i < avail ? (unsigned char) p[i] : 0; };
+	if (at(1) == '#')
+	{
+		const bool hex = at(2) == 'x' || at(2) == 'X';
+		const size_t first = hex ? 3 : 2;
+		const size_t maxDigits = hex ? 4 : 5;
+		size_t i = first;
+		while (i - first < maxDigits && (hex ? isxdigit(at(i)) : isdigit(at(i)))) ++i;
+		if (i == first || at(i) != ';') return 0;
+		c = 0;
+		return i + 1;
+	}
+	for (const auto& e : entities)
+		if (avail > e.len && !memcmp(p + 1, e.name, e.len))
+		{
+			c = e.c;
+			return e.len + 1;
+		}
+	return 0;
+}
+
+// Copies [start, end) to out decoding entity references, amp is the first '&' or null
+static bool unescapeValue(const char* start, const char* amp, const char* end, string& out)
+{
+	if (!amp)
+	{
+		out.assign(start, end);
+		return true;
+	}
+	out.assign(start, amp);
+	while (amp < end)
+	{
+		char c;
+		const size_t len = decodeEntity(amp, end, c);
+		if (!len) return false;
+		if (c) out += c;
+		const char* next = findChar(amp + len, end, '&', '&');
+		out.append(amp + len, next);
+		amp = next;
+	}
+	return true;
+}
+
 SimpleXMLReader::SimpleXMLReader(SimpleXMLReader::CallBack* callback) :
-	bufPos(0), pos(0), cb(callback), charset(Text::CHARSET_UTF8), state(STATE_START)
+	data(nullptr), dataSize(0), bufPos(0), pos(0), cb(callback), charset(Text::CHARSET_UTF8), state(STATE_START)
 {
 	elements.reserve(64);
 	attribs.reserve(4); // 16   void ListLoader::startTag  = 8
@@ -84,7 +180,7 @@ void SimpleXMLReader::append(std::string& str, size_t maxLen, int c)
 	str.append(1, (std::string::value_type)c);
 }
 
-void SimpleXMLReader::append(std::string& str, size_t maxLen, const std::string::const_iterator& begin, const std::string::const_iterator& end)
+void SimpleXMLReader::append(std::string& str, size_t maxLen, const char* begin, const char* end)
 {
 	if (str.size() + (end - begin) > maxLen)
 	{
@@ -93,6 +189,26 @@ void SimpleXMLReader::append(std::string& str, size_t maxLen, const std::string:
 	str.append(begin, end);
 }
 
+void SimpleXMLReader::addAttrib()
+{
+	if (attribPool.empty())
+	{
+		attribs.emplace_back();
+		return;
+	}
+	attribs.push_back(std::move(attribPool.back()));
+	attribPool.pop_back();
+	attribs.back().first.clear();
+	attribs.back().second.clear();
+}
+
+void SimpleXMLReader::clearAttribs()
+{
+	for (auto& attrib : attribs)
+		attribPool.push_back(std::move(attrib));
+	attribs.clear();
+}
+
 bool SimpleXMLReader::error(const char* e)
 {
 	throw SimpleXMLException(Util::toString(pos) + ": " + e);
@@ -171,6 +287,104 @@ bool SimpleXMLReader::element()
 	return false;
 }
 
+// Parses a start tag that is entirely in the buffer without going through the states.
+// Returns false without consuming anything when the tag is incomplete or malformed, the slow path handles it then.
+bool SimpleXMLReader::fastElement()
+{
+	if (!needChars(2) || charAt(0) != '<' || !isNameStartChar(charAt(1)) || elements.size() >= MAX_NESTING)
+	{
+		return false;
+	}
+	dcassert(attribs.empty());
+
+	const char* const start = data + bufPos;
+	const char* const end = data + dataSize;
+	const char* const name = start + 1;
+	const char* p = start + 2;
+	while (p < end && isNameChar(*p)) ++p;
+	const size_t nameLen = p - name;
+	if (p == end || nameLen > MAX_NAME_SIZE || !(isSpace(*p) || *p == '/' || *p == '>'))
+	{
+		return false;
+	}
+
+	bool simple;
+	p = fastAttribs(p, end, simple);
+	if (!p)
+	{
+		clearAttribs();
+		return false;
+	}
+
+	if (simple)
+	{
+		tagName.assign(name, nameLen);
+		cb->startTag(tagName, attribs, true);
+	}
+	else
+	{
+		elements.emplace_back(name, nameLen);
+		cb->startTag(elements.back(), attribs, false);
+	}
+	clearAttribs();
+	value.clear();
+
+	state = STATE_CONTENT;
+	advancePos(p - start);
+	return true;
+}
+
+// Adds the attributes up to the end of the tag, returns the position after '>' or null
+const char* SimpleXMLReader::fastAttribs(const char* p, const char* end, bool& simple)
+{
+	while (true)
+	{
+		while (p < end && isSpace(*p)) ++p;
+		if (p == end) return nullptr;
+		if (*p == '>')
+		{
+			simple = false;
+			return p + 1;
+		}
+		if (*p == '/')
+		{
+			if (p + 1 == end || p[1] != '>') return nullptr;
+			simple = true;
+			return p + 2;
+		}
+		if (!isNameStartChar(*p)) return nullptr;
+
+		const char* const attrName = p++;
+		while (p < end && isNameChar(*p)) ++p;
+		const size_t attrNameLen = p - attrName;
+		while (p < end && isSpace(*p)) ++p;
+		if (p == end || *p != '=' || attrNameLen > MAX_NAME_SIZE) return nullptr;
+		++p;
+		while (p < end && isSpace(*p)) ++p;
+		if (p == end || (*p != '"' && *p != '\'')) return nullptr;
+
+		const char quote = *p++;
+		const char* const valueStart = p;
+		const char* amp = nullptr;
+		while (true)
+		{
+			p = findChar(p, end, quote, '&');
+			if (p == end || *p == quote) break;
+			if (!amp) amp = p;
+			++p;
+		}
+		if (p == end || (size_t) (p - valueStart) > MAX_VALUE_SIZE) return nullptr;
+
+		addAttrib();
+		StringPair& attrib = attribs.back();
+		attrib.first.assign(attrName, attrNameLen);
+		if (!unescapeValue(valueStart, amp, p, attrib.second)) return nullptr;
+		if (charset != Text::CHARSET_UTF8)
+			attrib.second = Text::toUtf8(attrib.second, charset);
+		++p;
+	}
+}
+
 bool SimpleXMLReader::elementName()
 {
 	size_t i = 0;
@@ -180,7 +394,7 @@ bool SimpleXMLReader::elementName()
 
 		if (isSpace(c))
 		{
-			append(elements.back(), MAX_NAME_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
+			append(elements.back(), MAX_NAME_SIZE, data + bufPos, data + bufPos + i);
 
 			state = STATE_ELEMENT_ATTR;
 			advancePos(i + 1);
@@ -188,7 +402,7 @@ bool SimpleXMLReader::elementName()
 		}
 		else if (c == '/')
 		{
-			append(elements.back(), MAX_NAME_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
+			append(elements.back(), MAX_NAME_SIZE, data + bufPos, data + bufPos + i);
 
 			state = STATE_ELEMENT_END_SIMPLE;
 			advancePos(i + 1);
@@ -196,10 +410,10 @@ bool SimpleXMLReader::elementName()
 		}
 		else if (c == '>')
 		{
-			append(elements.back(), MAX_NAME_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
+			append(elements.back(), MAX_NAME_SIZE, data + bufPos, data + bufPos + i);
 
 			cb->startTag(elements.back(), attribs, false);
-			attribs.clear();
+			clearAttribs();
 
 			state = STATE_CONTENT;
 			advancePos(i + 1);
@@ -211,7 +425,7 @@ bool SimpleXMLReader::elementName()
 		}
 	}
 
-	append(elements.back(), MAX_NAME_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
+	append(elements.back(), MAX_NAME_SIZE, data + bufPos, data + bufPos + i);
 	advancePos(i);
 
 	return true;
@@ -227,7 +441,7 @@ bool SimpleXMLReader::elementAttr()
 	int c = charAt(0);
 	if (isNameStartChar(c))
 	{
-		attribs.push_back(StringPair()); // Hot point - 10%
+		addAttrib();
 		append(attribs.back().first, MAX_NAME_SIZE, c); // MAX_NAME_SIZE - 260
 
 		state = STATE_ELEMENT_ATTR_NAME;
@@ -248,7 +462,7 @@ bool SimpleXMLReader::elementAttrName()
 
 		if (isSpace(c))
 		{
-			append(attribs.back().first, MAX_NAME_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
+			append(attribs.back().first, MAX_NAME_SIZE, data + bufPos, data + bufPos + i);
 
 			state = STATE_ELEMENT_ATTR_EQ;
 			advancePos(i + 1);
@@ -256,7 +470,7 @@ bool SimpleXMLReader::elementAttrName()
 		}
 		else if (c == '=')
 		{
-			append(attribs.back().first, MAX_NAME_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
+			append(attribs.back().first, MAX_NAME_SIZE, data + bufPos, data + bufPos + i);
 
 			state = STATE_ELEMENT_ATTR_VALUE;
 			advancePos(i + 1);
@@ -268,7 +482,7 @@ bool SimpleXMLReader::elementAttrName()
 		}
 	}
 
-	append(attribs.back().first, MAX_NAME_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
+	append(attribs.back().first, MAX_NAME_SIZE, data + bufPos, data + bufPos + i);
 	advancePos(i);
 	return true;
 }
@@ -282,7 +496,7 @@ bool SimpleXMLReader::elementAttrValue()
 
 		if ((state == STATE_ELEMENT_ATTR_VALUE_APOS && c == '\'') || (state == STATE_ELEMENT_ATTR_VALUE_QUOT && c == '"'))
 		{
-			append(attribs.back().second, MAX_VALUE_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
+			append(attribs.back().second, MAX_VALUE_SIZE, data + bufPos, data + bufPos + i);
 
 			if (charset != Text::CHARSET_UTF8)
 				attribs.back().second = Text::toUtf8(attribs.back().second, charset);
@@ -293,13 +507,13 @@ bool SimpleXMLReader::elementAttrValue()
 		}
 		else if (c == '&')
 		{
-			append(attribs.back().second, MAX_VALUE_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
+			append(attribs.back().second, MAX_VALUE_SIZE, data + bufPos, data + bufPos + i);
 			advancePos(i);
 			return entref(attribs.back().second);
 		}
 	}
 
-	append(attribs.back().second, MAX_VALUE_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
+	append(attribs.back().second, MAX_VALUE_SIZE, data + bufPos, data + bufPos + i);
 	advancePos(i);
 
 	return true;
@@ -316,7 +530,7 @@ bool SimpleXMLReader::elementEndSimple()
 	{
 		cb->startTag(elements.back(), attribs, true);
 		elements.pop_back();
-		attribs.clear();
+		clearAttribs();
 
 		state = STATE_CONTENT;
 		advancePos(1);
@@ -336,7 +550,7 @@ bool SimpleXMLReader::elementEndComplex()
 	if (charAt(0) == '>')
 	{
 		cb->startTag(elements.back(), attribs, false);
-		attribs.clear();
+		clearAttribs();
 
 		state = STATE_CONTENT;
 		advancePos(1);
@@ -494,93 +708,23 @@ bool SimpleXMLReader::entref(string& d)
 		error("Buffer overflow");
 	}
 
-	if (bufSize() > 6)
+	if (bufSize() <= 6)
 	{
-		if (charAt(1) == 'l' && charAt(2) == 't' && charAt(3) == ';')
-		{
-			d.append(1, '<');
-			advancePos(4);
-			return true;
-		}
-		else if (charAt(1) == 'g' && charAt(2) == 't' && charAt(3) == ';')
-		{
-			d.append(1, '>');
-			advancePos(4);
-			return true;
-		}
-		else if (charAt(1) == 'a' && charAt(2) == 'm' && charAt(3) == 'p' && charAt(4) == ';')
-		{
-			d.append(1, '&');
-			advancePos(5);
-			return true;
-		}
-		else if (charAt(1) == 'q' && charAt(2) == 'u' && charAt(3) == 'o' && charAt(4) == 't' && charAt(5) == ';')
-		{
-			d.append(1, '"');
-			advancePos(6);
-			return true;
-		}
-		else if (charAt(1) == 'a' && charAt(2) == 'p' && charAt(3) == 'o' && charAt(4) == 's' && charAt(5) == ';')
-		{
-			d.append(1, '\'');
-			advancePos(6);
-			return true;
-
-			// Ignore &#00000 decimal and &#x0000 hex values to avoid error, they wouldn't be parsed anyway
-		}
-		else if (charAt(1) == '#' && isdigit(charAt(2)) && charAt(3) == ';')
-		{
-			advancePos(4);
-			return true;
-		}
-		else if (charAt(1) == '#' && isdigit(charAt(2)) && isdigit(charAt(3)) && charAt(4) == ';')
-		{
-			advancePos(5);
-			return true;
-		}
-		else if (charAt(1) == '#' && isdigit(charAt(2)) && isdigit(charAt(3)) && isdigit(charAt(4)) && charAt(5) == ';')
-		{
-			advancePos(6);
-			return true;
-		}
-		else if (charAt(1) == '#' && isdigit(charAt(2)) && isdigit(charAt(3)) && isdigit(charAt(4)) && isdigit(charAt(5)) && charAt(6) == ';')
-		{
-			advancePos(7);
-			return true;
-		}
-		else if (charAt(1) == '#' && isdigit(charAt(2)) && isdigit(charAt(3)) && isdigit(charAt(4)) && isdigit(charAt(5)) && isdigit(charAt(6)) && charAt(7) == ';')
-		{
-			advancePos(8);
-			return true;
+		return true;
+	}
 
-		}
-		else if (charAt(1) == '#' && (charAt(2) == 'x' ||  charAt(2) == 'X') && isxdigit(charAt(3)) && charAt(4) == ';')
-		{
-			advancePos(5);
-			return true;
-		}
-		else if (charAt(1) == '#' && (charAt(2) == 'x' ||  charAt(2) == 'X') && isxdigit(charAt(3)) && isxdigit(charAt(4)) && charAt(5) == ';')
-		{
-			advancePos(6);
-			return true;
-		}
-		else if (charAt(1) == '#' && (charAt(2) == 'x' ||  charAt(2) == 'X') && isxdigit(charAt(3)) && isxdigit(charAt(4)) && isxdigit(charAt(5)) && charAt(6) == ';')
-		{
-			advancePos(7);
-			return true;
-		}
-		else if (charAt(1) == '#' && (charAt(2) == 'x' ||  charAt(2) == 'X') && isxdigit(charAt(3)) && isxdigit(charAt(4)) && isxdigit(charAt(5)) && isxdigit(charAt(6)) && charAt(7) == ';')
-		{
-			advancePos(8);
-			return true;
-		}
+	char c;
+	const size_t len = decodeEntity(data + bufPos, data + dataSize, c);
+	if (!len)
+	{
+		return false;
 	}
-	else
+	if (c)
 	{
-		return true;
+		d.append(1, c);
 	}
-
-	return false;
+	advancePos(len);
+	return true;
 }
 
 bool SimpleXMLReader::content()
@@ -605,9 +749,10 @@ bool SimpleXMLReader::content()
 		return entref(value);
 	}
 
-	append(value, MAX_VALUE_SIZE, c);
-
-	advancePos(1);
+	const char* p = data + bufPos;
+	const char* next = findChar(p, data + dataSize, '<', '&');
+	append(value, MAX_VALUE_SIZE, p, next);
+	advancePos(next - p);
 
 	return true;
 }
@@ -625,7 +770,7 @@ bool SimpleXMLReader::elementEnd()
 		return true;
 	}
 
-	if (top.compare(0, top.size(), &buf[bufPos], top.size()) == 0)
+	if (top.compare(0, top.size(), data + bufPos, top.size()) == 0)
 	{
 		state = STATE_ELEMENT_END_END;
 		advancePos(top.size());
@@ -664,19 +809,19 @@ bool SimpleXMLReader::skipSpace(bool store)
 	{
 		return true;
 	}
-	bool skipped = false;
-	int c;
-	while (needChars(1) && isSpace(c = charAt(0)))
+	size_t i = 0;
+	for (size_t iend = bufSize(); i < iend && isSpace(charAt(i)); ++i) {}
+	if (!i)
 	{
-		if (store)
-		{
-			append(value, MAX_VALUE_SIZE, c);
-		}
-		advancePos();
-		skipped = true;
+		return false;
 	}
+	if (store)
+	{
+		append(value, MAX_VALUE_SIZE, data + bufPos, data + bufPos + i);
+	}
+	advancePos(i);
 
-	return skipped;
+	return true;
 }
 
 
@@ -707,14 +852,25 @@ void SimpleXMLReader::parse(InputStream& stream, size_t maxSize)
 			error("Unexpected end of stream");
 		}
 		buf.resize(old + len);
+		setData(buf.data(), buf.size());
 		bytesRead += len;
 	}
 	while (process());
 }
 
-bool SimpleXMLReader::parse(const char* data, size_t len, bool /*more*/)
+bool SimpleXMLReader::parse(const char* input, size_t len, bool /*more*/)
 {
-	buf.append(data, len);
+	if (buf.empty())
+	{
+		// Parse the caller's memory directly, process() keeps a copy of what is left unparsed
+		bufPos = 0;
+		setData(input, len);
+	}
+	else
+	{
+		buf.append(input, len);
+		setData(buf.data(), buf.size());
+	}
 	return process();
 }
 bool SimpleXMLReader::spaceOrError(const char* message)
@@ -739,6 +895,7 @@ bool SimpleXMLReader::process()
 				literal(LITN("\xef\xbb\xbf"), false, STATE_START)   // Byte order mark
 				|| literal(LITN("<?xml"), true, STATE_DECL_VERSION)
 				|| literal(LITN("<!--"), false, STATE_COMMENT)
+				|| fastElement()
 				|| element()
 				|| spaceOrError("Expecting XML declaration, element or comment");
 				break;
@@ -843,6 +1000,7 @@ bool SimpleXMLReader::process()
 				break;
 			case STATE_CONTENT:
 				skipSpace(true)
+				|| fastElement()
 				|| literal(LITN("<!--"), false, STATE_COMMENT)
 				|| literal(LITN("<![CDATA["), false, STATE_CDATA)
 				|| element()
@@ -852,6 +1010,8 @@ bool SimpleXMLReader::process()
 				break;
 			case STATE_END:
 				buf.clear();
+				bufPos = 0;
+				setData(nullptr, 0);
 				return false;
 			default:
 				error("Unexpected state");
@@ -861,11 +1021,17 @@ bool SimpleXMLReader::process()
 		if (oldState == state && oldPos == bufPos)
 		{
 			// Need more data...
-			if (bufPos > 0)
+			if (data != buf.data())
+			{
+				buf.assign(data + bufPos, dataSize - bufPos);
+				bufPos = 0;
+			}
+			else if (bufPos > 0)
 			{
-				buf.erase(buf.begin(), buf.begin() + bufPos);
+				buf.erase(0, bufPos);
 				bufPos = 0;
 			}
+			setData(buf.data(), buf.size());
 			return true;
 		}
 
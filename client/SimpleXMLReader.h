@@ -127,12 +127,17 @@ class SimpleXMLReader
 		};
 
 
+		// Input being parsed: buf or, when parsing a contiguous block, the caller's memory
 		std::string buf;
+		const char* data;
+		size_t dataSize;
 		std::string::size_type bufPos;
 		uint64_t pos;
 
 		StringPairList attribs;
+		StringPairList attribPool; // cleared attributes, their strings keep the capacity
 		std::string value;
+		std::string tagName;
 
 		CallBack* cb;
 		std::string encoding;
@@ -143,16 +148,18 @@ class SimpleXMLReader
 		StringList elements;
 
 		void append(std::string& str, size_t maxLen, int c);
-		void append(std::string& str, size_t maxLen, const std::string::const_iterator& begin, const std::string::const_iterator& end);
+		void append(std::string& str, size_t maxLen, const char* begin, const char* end);
+		void addAttrib();
+		void clearAttribs();
 
 		bool needChars(size_t n) const
 		{
-			return bufPos + n <= buf.size();
+			return bufPos + n <= dataSize;
 		}
 		bool skipSpace(bool store = false);
 		int charAt(size_t n) const
 		{
-			return buf[bufPos + n];
+			return data[bufPos + n];
 		}
 		void advancePos(size_t n = 1)
 		{
@@ -161,7 +168,12 @@ class SimpleXMLReader
 		}
 		string::size_type bufSize() const
 		{
-			return buf.size() - bufPos;
+			return dataSize - bufPos;
+		}
+		void setData(const char* newData, size_t newSize)
+		{
+			data = newData;
+			dataSize = newSize;
 		}
 
 		bool literal(const char* lit, size_t len, bool withSpace, ParseState newState);
@@ -171,6 +183,8 @@ class SimpleXMLReader
 		bool declEncodingValue();
 
 		bool element();
+		bool fastElement();
+		const char* fastAttribs(const char* p, const char* end, bool& simple);
 		bool elementName();
 		bool elementEnd();
 		bool elementEndEnd();
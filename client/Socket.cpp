@@ -25,6 +25,7 @@
 #include "ResourceManager.h"
 #include "SettingsManager.h"
 #include "ConfCore.h"
+#include "Metrics.h"
 
 #ifdef _WIN32
 #include "SysVersion.h"
@@ -178,6 +179,7 @@ uint16_t Socket::accept(const Socket& listeningSocket)
 #endif
 
 	type = TYPE_TCP;
+	Metrics::socketAccepted.add();
 
 	if (doLog)
 	{
@@ -327,6 +329,7 @@ void Socket::connect(const IpAddressEx& ip, uint16_t port, const string& host)
 	while (result < 0 && getLastError() == EINTR);
 #endif
 	check(result, true);
+	Metrics::socketConnected.add();
 
 	setIp(ip);
 	setPort(port);
@@ -463,6 +466,102 @@ int Socket::receivePacket(void* buffer, int bufLen, IpAddress& ip, uint16_t& por
 	return res;
 }
 
+int Socket::receivePackets(Packet* packets, int count) noexcept
+{
+	dcassert(type == TYPE_UDP);
+#ifdef __linux__
+	mmsghdr msgs[MAX_PACKET_BATCH];
+	iovec iov[MAX_PACKET_BATCH];
+	sockaddr_u addr[MAX_PACKET_BATCH];
+	if (count > MAX_PACKET_BATCH) count = MAX_PACKET_BATCH;
+	for (int i = 0; i < count; ++i)
+	{
+		iov[i].iov_base = packets[i].buffer;
+		iov[i].iov_len = packets[i].bufLen;
+		memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+		msgs[i].msg_hdr.msg_name = &addr[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int res;
+	do
+	{
+		res = recvmmsg(sock, msgs, count, MSG_DONTWAIT, nullptr);
+	}
+	while (res < 0 && getLastError() == EINTR);
+	if (res < 0)
+		return getLastError() == SE_EWOULDBLOCK ? 0 : -1;
+	for (int i = 0; i < res; ++i)
+	{
+		packets[i].len = (int) msgs[i].msg_len;
+		g_stats.udp.downloaded += msgs[i].msg_len;
+		fromSockAddr(packets[i].ip, packets[i].port, addr[i]);
+	}
+	return res;
+#else
+	int received = 0;
+	while (received < count)
+	{
+		Packet& p = packets[received];
+		p.len = receivePacket(p.buffer, p.bufLen, p.ip, p.port);
+		if (p.len < 0)
+		{
+			if (received) break;
+			return getLastError() == SE_EWOULDBLOCK ? 0 : -1;
+		}
+		++received;
+	}
+	return received;
+#endif
+}
+
+int Socket::sendPackets(const Packet* packets, int count) noexcept
+{
+	dcassert(type == TYPE_UDP);
+	dcassert(count <= MAX_PACKET_BATCH);
+#ifdef __linux__
+	mmsghdr msgs[MAX_PACKET_BATCH];
+	iovec iov[MAX_PACKET_BATCH];
+	sockaddr_u addr[MAX_PACKET_BATCH];
+	for (int i = 0; i < count; ++i)
+	{
+		socklen_t sockLen;
+		toSockAddr(addr[i], sockLen, packets[i].ip, packets[i].port);
+		iov[i].iov_base = packets[i].buffer;
+		iov[i].iov_len = packets[i].len;
+		memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+		msgs[i].msg_hdr.msg_name = &addr[i];
+		msgs[i].msg_hdr.msg_namelen = sockLen;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int sent = 0;
+	int pos = 0;
+	while (pos < count)
+	{
+		int res = sendmmsg(sock, msgs + pos, count - pos, 0);
+		if (res <= 0)
+		{
+			// sendmmsg stops at the first failed packet
+			if (res == 0 || getLastError() != EINTR) ++pos;
+			continue;
+		}
+		for (int i = pos; i < pos + res; ++i)
+			g_stats.udp.uploaded += msgs[i].msg_len;
+		pos += res;
+		sent += res;
+	}
+	return sent;
+#else
+	int sent = 0;
+	for (int i = 0; i < count; ++i)
+		if (sendPacket(packets[i].buffer, packets[i].len, packets[i].ip, packets[i].port) >= 0)
+			++sent;
+	return sent;
+#endif
+}
+
 /**
  * Blocks until timeout is reached one of the specified conditions have been fulfilled
  * @param millis Max milliseconds to block.
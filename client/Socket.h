@@ -197,6 +197,30 @@ class Socket
 		}
 		int receivePacket(void* buffer, int bufLen, IpAddress& ip, uint16_t& port) noexcept;
 
+		static const int MAX_PACKET_BATCH = 64;
+
+		struct Packet
+		{
+			void* buffer;
+			int bufLen;
+			int len; // set by receivePackets, used by sendPackets
+			IpAddress ip;
+			uint16_t port;
+		};
+
+		/**
+		 * Receives up to count packets without blocking, using one recvmmsg call where it's available.
+		 * @return Number of packets received, 0 if the call would block, -1 on other errors.
+		 */
+		int receivePackets(Packet* packets, int count) noexcept;
+
+		/**
+		 * Sends up to MAX_PACKET_BATCH packets, using sendmmsg where it's available.
+		 * A packet that fails is skipped, the rest are still sent.
+		 * @return Number of packets sent.
+		 */
+		int sendPackets(const Packet* packets, int count) noexcept;
+
 		virtual int wait(int millis, int waitFor);
 
 		void setBlocking(bool block) noexcept;
@@ -0,0 +1,66 @@
+#include "stdinc.h"
+#include "StringPool.h"
+#include "Locks.h"
+#include <boost/unordered/unordered_map.hpp>
+
+namespace
+{
+	static const size_t SHARD_COUNT = 16;
+
+	struct Shard
+	{
+		FastCriticalSection cs;
+		boost::unordered_map<string, size_t> strings; // value -> reference count
+	};
+
+	// Sharded to reduce contention between hub threads
+	static Shard shards[SHARD_COUNT];
+
+	inline Shard& getShard(const string& s)
+	{
+		return shards[boost::hash<string>()(s) % SHARD_COUNT];
+	}
+}
+
+const string* StringPool::add(const string& s) noexcept
+{
+	Shard& shard = getShard(s);
+	LOCK(shard.cs);
+	auto p = shard.strings.insert(make_pair(s, size_t(0)));
+	p.first->second++;
+	return &p.first->first;
+}
+
+void StringPool::addRef(const string* s) noexcept
+{
+	Shard& shard = getShard(*s);
+	LOCK(shard.cs);
+	auto i = shard.strings.find(*s);
+	dcassert(i != shard.strings.end() && &i->first == s);
+	i->second++;
+}
+
+void StringPool::release(const string* s) noexcept
+{
+	Shard& shard = getShard(*s);
+	LOCK(shard.cs);
+	auto i = shard.strings.find(*s);
+	dcassert(i != shard.strings.end() && &i->first == s);
+	if (i != shard.strings.end() && --i->second == 0)
+		shard.strings.erase(i);
+}
+
+void StringPool::getStats(Stats& stats) noexcept
+{
+	memset(&stats, 0, sizeof(stats));
+	for (Shard& shard : shards)
+	{
+		LOCK(shard.cs);
+		stats.strings += shard.strings.size();
+		for (const auto& i : shard.strings)
+		{
+			stats.references += i.second;
+			stats.bytes += i.first.length();
+		}
+	}
+}
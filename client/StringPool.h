@@ -0,0 +1,27 @@
+#ifndef STRING_POOL_H_
+#define STRING_POOL_H_
+
+#include "typedefs.h"
+
+/**
+ * Process-wide pool of reference counted immutable strings.
+ * Equal values stored by many objects (client tags, connection types, locales) share one copy.
+ */
+class StringPool
+{
+	public:
+		// Returns the pooled copy of the string, the caller owns one reference
+		static const string* add(const string& s) noexcept;
+		static void addRef(const string* s) noexcept;
+		static void release(const string* s) noexcept;
+
+		struct Stats
+		{
+			size_t strings;
+			size_t references;
+			size_t bytes;
+		};
+		static void getStats(Stats& stats) noexcept;
+};
+
+#endif // STRING_POOL_H_
@@ -105,6 +105,12 @@ class UploadManager : private ClientManagerListener, public Speaker<UploadManage
 			return uploads.size();
 		}
 		void clearUploads() noexcept;
+		template<typename F> void forEachUpload(F f) const
+		{
+			READ_LOCK(*csFinishedUploads);
+			for (const UploadPtr& u : uploads)
+				f(u);
+		}
 
 		static int getRunningCount() { return g_running; }
 		static int64_t getRunningAverage() { return g_runningAverage; }
@@ -20,6 +20,7 @@
 #include "Client.h"
 #include "SettingsManager.h"
 #include "DatabaseManager.h"
+#include "ClientManager.h"
 
 #ifdef BL_FEATURE_IP_DATABASE
 #include "DatabaseOptions.h"
@@ -90,20 +91,23 @@ bool User::setIP4(Ip4Address ip)
 {
 	if (!Util::isValidIp4(ip))
 		return false;
-	LOCK(cs);
-	if (lastIp4 == ip)
-		return false;
-	lastIp4 = ip;
-	flags |= LAST_IP_CHANGED;
-#ifdef BL_FEATURE_IP_DATABASE
-	userStat.setIP(Util::printIpAddress(ip));
-	static const auto MASK = UserStatItem::FLAG_INSERTED | UserStatItem::FLAG_LAST_IP_CHANGED;
-	if ((userStat.flags & MASK) == MASK)
 	{
-		dcassert(flags & USER_STAT_LOADED);
-		flags |= SAVE_USER_STAT;
-	}
+		LOCK(cs);
+		if (lastIp4 == ip)
+			return false;
+		lastIp4 = ip;
+		flags |= LAST_IP_CHANGED;
+#ifdef BL_FEATURE_IP_DATABASE
+		userStat.setIP(Util::printIpAddress(ip));
+		static const auto MASK = UserStatItem::FLAG_INSERTED | UserStatItem::FLAG_LAST_IP_CHANGED;
+		if ((userStat.flags & MASK) == MASK)
+		{
+			dcassert(flags & USER_STAT_LOADED);
+			flags |= SAVE_USER_STAT;
+		}
 #endif
+	}
+	ClientManager::updateIpIndex(this);
 	return true;
 }
 
@@ -111,20 +115,23 @@ bool User::setIP6(const Ip6Address& ip)
 {
 	if (!Util::isValidIp6(ip))
 		return false;
-	LOCK(cs);
-	if (lastIp6 == ip)
-		return false;
-	lastIp6 = ip;
-	flags |= LAST_IP_CHANGED;
-#ifdef BL_FEATURE_IP_DATABASE
-	userStat.setIP(Util::printIpAddress(ip));
-	static const auto MASK = UserStatItem::FLAG_INSERTED | UserStatItem::FLAG_LAST_IP_CHANGED;
-	if ((userStat.flags & MASK) == MASK)
 	{
-		dcassert(flags & USER_STAT_LOADED);
-		flags |= SAVE_USER_STAT;
-	}
+		LOCK(cs);
+		if (lastIp6 == ip)
+			return false;
+		lastIp6 = ip;
+		flags |= LAST_IP_CHANGED;
+#ifdef BL_FEATURE_IP_DATABASE
+		userStat.setIP(Util::printIpAddress(ip));
+		static const auto MASK = UserStatItem::FLAG_INSERTED | UserStatItem::FLAG_LAST_IP_CHANGED;
+		if ((userStat.flags & MASK) == MASK)
+		{
+			dcassert(flags & USER_STAT_LOADED);
+			flags |= SAVE_USER_STAT;
+		}
 #endif
+	}
+	ClientManager::updateIpIndex(this);
 	return true;
 }
 
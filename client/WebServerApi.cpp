@@ -0,0 +1,316 @@
+#include "stdinc.h"
+#include "WebServerManager.h"
+#include "JsonFormatter.h"
+#include "QueueManager.h"
+#include "DownloadManager.h"
+#include "UploadManager.h"
+#include "ShareManager.h"
+#include "ClientManager.h"
+#include "WebServerUtil.h"
+#include "PagedSelector.h"
+#include "TimeUtil.h"
+#include "Metrics.h"
+
+// Collections are paged by a cursor: the key of the last item of the previous page.
+// Each page is selected directly from the manager's data in one pass, the collections are never copied.
+
+static const size_t API_DEFAULT_PAGE_SIZE = 100;
+static const size_t API_MAX_PAGE_SIZE = 500;
+
+size_t WebServerManager::getApiPageLimit(const RequestInfo& state) noexcept
+{
+	int limit = WebServerUtil::getIntQueryParam(state.query, "limit");
+	if (limit <= 0) return API_DEFAULT_PAGE_SIZE;
+	return std::min((size_t) limit, API_MAX_PAGE_SIZE);
+}
+
+static void openItems(JsonFormatter& f)
+{
+	f.setDecorate(false);
+	f.open('{');
+	f.appendKey("items");
+	f.open('[');
+}
+
+static void closeItems(JsonFormatter& f, bool more, const string& nextCursor)
+{
+	f.close(']');
+	if (more)
+	{
+		f.appendKey("next");
+		f.appendStringValue(nextCursor);
+	}
+}
+
+static void appendStringField(JsonFormatter& f, const char* key, const string& value)
+{
+	f.appendKey(key);
+	f.appendStringValue(value);
+}
+
+static void appendInt64Field(JsonFormatter& f, const char* key, int64_t value)
+{
+	f.appendKey(key);
+	f.appendInt64Value(value);
+}
+
+void WebServerManager::apiQueue(HandlerResult& res, const RequestInfo& state) noexcept
+{
+	const string cursor = WebServerUtil::getStringQueryParam(state.query, "cursor");
+	const string* cursorKey = &cursor;
+	PagedSelector<const string*, QueueItemPtr, PagedSelectorPtrLess> selector(getApiPageLimit(state), cursor.empty() ? nullptr : &cursorKey);
+	JsonFormatter f;
+	openItems(f);
+	string tmp;
+	bool more;
+	size_t total;
+	string nextCursor;
+	{
+		QueueManager::LockFileQueueShared fileQueue;
+		const auto& li = fileQueue.getQueueL();
+		total = li.size();
+		for (auto j = li.cbegin(); j != li.cend(); ++j)
+			selector.add(&j->first, j->second);
+		more = selector.finish();
+		for (const auto& item : selector.getItems())
+		{
+			const QueueItemPtr& qi = item.second;
+			ClientContext::QueueItemEx inf;
+			inf.qi = qi;
+			inf.version = qi->getSourcesVersion();
+			inf.sourcesCount = (uint16_t) std::min(qi->getSourcesL().size(), (size_t) UINT16_MAX);
+			inf.onlineSourcesCount = (uint16_t) std::min(qi->getOnlineSourceCountL(), (size_t) UINT16_MAX);
+			qi->lockAttributes();
+			int priority = qi->getPriorityL();
+			qi->unlockAttributes();
+			f.open('{');
+			appendStringField(f, "target", qi->getTarget());
+			appendInt64Field(f, "size", qi->getSize());
+			appendInt64Field(f, "downloaded", qi->getDownloadedBytes());
+			appendInt64Field(f, "priority", priority);
+			appendInt64Field(f, "sources", inf.sourcesCount);
+			appendInt64Field(f, "onlineSources", inf.onlineSourcesCount);
+			if (!qi->getTTH().isZero())
+				appendStringField(f, "tth", qi->getTTH().toBase32());
+			appendStringField(f, "state", qi->isFinished() ? "finished" : qi->isWaiting() ? "waiting" : "running");
+			appendStringField(f, "status", ClientContext::getQueueItemStatus(inf, tmp));
+			f.close('}');
+		}
+		if (more) nextCursor = *selector.getItems().back().first;
+	}
+	closeItems(f, more, nextCursor);
+	appendInt64Field(f, "total", total);
+	f.close('}');
+	f.moveResult(res.data);
+	res.type = HANDLER_RESULT_JSON;
+}
+
+void WebServerManager::apiTransfers(HandlerResult& res, const RequestInfo& state) noexcept
+{
+	struct TransferItem
+	{
+		std::shared_ptr<Transfer> transfer;
+		bool download;
+	};
+	const string cursor = WebServerUtil::getStringQueryParam(state.query, "cursor");
+	PagedSelector<string, TransferItem> selector(getApiPageLimit(state), cursor.empty() ? nullptr : &cursor);
+	size_t total = 0;
+	DownloadManager::getInstance()->forEachDownload(
+		[&](const DownloadPtr& d)
+		{
+			selector.add(d->getConnectionQueueToken(), TransferItem{d, true});
+			++total;
+		});
+	UploadManager::getInstance()->forEachUpload(
+		[&](const UploadPtr& u)
+		{
+			selector.add(u->getConnectionQueueToken(), TransferItem{u, false});
+			++total;
+		});
+	bool more = selector.finish();
+
+	JsonFormatter f;
+	openItems(f);
+	for (const auto& item : selector.getItems())
+	{
+		const Transfer* t = item.second.transfer.get();
+		const HintedUser hintedUser = t->getHintedUser();
+		int64_t pos, secondsLeft;
+		if (item.second.download)
+		{
+			const Download* d = static_cast<const Download*>(t);
+			pos = d->getPos();
+			secondsLeft = d->getSecondsLeft();
+		}
+		else
+		{
+			const Upload* u = static_cast<const Upload*>(t);
+			pos = u->getAdjustedPos();
+			secondsLeft = u->getSecondsLeft();
+		}
+		f.open('{');
+		appendStringField(f, "token", item.first);
+		appendStringField(f, "direction", item.second.download ? "download" : "upload");
+		appendStringField(f, "type", Transfer::fileTypeNames[t->getType()]);
+		appendStringField(f, "path", t->getPath());
+		appendStringField(f, "user", hintedUser.user->getLastNick());
+		appendStringField(f, "hub", hintedUser.hint);
+		appendInt64Field(f, "pos", pos);
+		appendInt64Field(f, "size", t->getSize());
+		appendInt64Field(f, "speed", t->getRunningAverage());
+		appendInt64Field(f, "secondsLeft", secondsLeft);
+		f.close('}');
+	}
+	closeItems(f, more, more ? selector.getItems().back().first : Util::emptyString);
+	appendInt64Field(f, "total", total);
+	f.close('}');
+	f.moveResult(res.data);
+	res.type = HANDLER_RESULT_JSON;
+}
+
+void WebServerManager::apiSearch(HandlerResult& res, const RequestInfo& state) noexcept
+{
+	res.type = HANDLER_RESULT_ERROR;
+	JsonFormatter f;
+	LOCK(csClients);
+	auto i = clients.find(state.clientId);
+	if (i == clients.end()) return;
+	ClientContext& ctx = i->second;
+	if (state.req->getMethodId() == Http::METHOD_POST)
+	{
+		string term = WebServerUtil::getStringQueryParam(state.query, "s");
+		if (term.empty())
+		{
+			res.type = HANDLER_RESULT_BAD_REQUEST;
+			return;
+		}
+		int type = WebServerUtil::getIntQueryParam(state.query, "type");
+		bool onlyFreeSlots = WebServerUtil::getIntQueryParam(state.query, "ofs") != 0;
+		ctx.startSearch(term, type, onlyFreeSlots);
+		f.setDecorate(false);
+		f.open('{');
+		f.appendKey("success");
+		f.appendBoolValue(ctx.searchError.empty());
+		if (!ctx.searchError.empty())
+		{
+			appendStringField(f, "message", ctx.searchError);
+			ctx.searchError.clear();
+		}
+		f.close('}');
+		f.moveResult(res.data);
+		res.type = HANDLER_RESULT_JSON;
+		return;
+	}
+
+	// Results are only appended until the next search, the cursor is an index
+	const size_t total = ctx.searchResults.size();
+	const string cursor = WebServerUtil::getStringQueryParam(state.query, "cursor");
+	const size_t start = std::min((size_t) Util::toUInt32(cursor), total);
+	const size_t end = std::min(start + getApiPageLimit(state), total);
+	openItems(f);
+	for (size_t j = start; j < end; ++j)
+	{
+		const SearchResult* sr = ctx.searchResults[j].get();
+		const bool isFile = sr->getType() == SearchResult::TYPE_FILE;
+		f.open('{');
+		appendStringField(f, "path", sr->getFile());
+		appendStringField(f, "name", sr->getFileName());
+		appendStringField(f, "type", isFile ? "file" : "directory");
+		if (isFile)
+		{
+			appendInt64Field(f, "size", sr->getSize());
+			if (!sr->getTTH().isZero())
+				appendStringField(f, "tth", sr->getTTH().toBase32());
+		}
+		appendStringField(f, "user", sr->getUser()->getLastNick());
+		appendStringField(f, "hub", sr->getHubUrl());
+		appendInt64Field(f, "slots", sr->slots);
+		appendInt64Field(f, "freeSlots", sr->freeSlots);
+		f.close('}');
+	}
+	closeItems(f, end < total, Util::toString(end));
+	appendInt64Field(f, "total", total);
+	appendStringField(f, "term", ctx.searchTerm);
+	f.appendKey("running");
+	f.appendBoolValue(GET_TICK() < ctx.searchEndTime);
+	f.close('}');
+	f.moveResult(res.data);
+	res.type = HANDLER_RESULT_JSON;
+}
+
+void WebServerManager::apiShare(HandlerResult& res, const RequestInfo& state) noexcept
+{
+	string path = WebServerUtil::getStringQueryParam(state.query, "path");
+	if (path.empty()) path = "/";
+	const string cursor = WebServerUtil::getStringQueryParam(state.query, "cursor");
+	vector<ShareManager::DirectoryEntry> entries;
+	string nextCursor;
+	if (!ShareManager::getInstance()->getDirectoryPage(path, cursor, getApiPageLimit(state), entries, nextCursor))
+	{
+		res.type = HANDLER_RESULT_NOT_FOUND;
+		return;
+	}
+
+	JsonFormatter f;
+	openItems(f);
+	for (const auto& entry : entries)
+	{
+		f.open('{');
+		appendStringField(f, "name", entry.name);
+		appendStringField(f, "type", entry.isDirectory ? "directory" : "file");
+		appendInt64Field(f, "size", entry.size);
+		if (!entry.isDirectory)
+			appendStringField(f, "tth", entry.tth.toBase32());
+		f.close('}');
+	}
+	closeItems(f, !nextCursor.empty(), nextCursor);
+	appendStringField(f, "path", path);
+	f.close('}');
+	f.moveResult(res.data);
+	res.type = HANDLER_RESULT_JSON;
+}
+
+void WebServerManager::apiHubs(HandlerResult& res, const RequestInfo& state) noexcept
+{
+	const string cursor = WebServerUtil::getStringQueryParam(state.query, "cursor");
+	PagedSelector<string, ClientBasePtr> selector(getApiPageLimit(state), cursor.empty() ? nullptr : &cursor);
+	size_t total;
+	{
+		ClientManager::LockInstanceClients lock;
+		const auto& hubs = lock.getData();
+		total = hubs.size();
+		for (auto i = hubs.cbegin(); i != hubs.cend(); ++i)
+			selector.add(i->first, i->second);
+	}
+	bool more = selector.finish();
+
+	// Hub state is read without holding the list lock
+	JsonFormatter f;
+	openItems(f);
+	for (const auto& item : selector.getItems())
+	{
+		const Client* c = static_cast<const Client*>(item.second.get());
+		f.open('{');
+		appendStringField(f, "url", c->getHubUrl());
+		appendStringField(f, "name", c->getHubName());
+		appendStringField(f, "nick", c->getMyNick());
+		f.appendKey("connected");
+		f.appendBoolValue(c->isConnected());
+		f.appendKey("secure");
+		f.appendBoolValue(c->isSecure());
+		appendInt64Field(f, "users", c->getUserCount());
+		appendInt64Field(f, "shared", c->getBytesShared());
+		f.close('}');
+	}
+	closeItems(f, more, more ? selector.getItems().back().first : Util::emptyString);
+	appendInt64Field(f, "total", total);
+	f.close('}');
+	f.moveResult(res.data);
+	res.type = HANDLER_RESULT_JSON;
+}
+
+void WebServerManager::apiMetrics(HandlerResult& res, const RequestInfo& state) noexcept
+{
+	Metrics::print(res.data);
+	res.type = HANDLER_RESULT_TEXT;
+}
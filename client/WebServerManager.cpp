@@ -23,9 +23,14 @@
 #include "TimeUtil.h"
 #include "FormatUtil.h"
 #include "ConfCore.h"
+#include "ZUtils.h"
+#include "TigerHash.h"
+#include "Base32.h"
 #include <boost/algorithm/string/trim.hpp>
 
 static const unsigned SESSION_EXPIRE_TIME = 10; // minutes
+static const size_t MIN_COMPRESSED_SIZE = 1024;
+static const int DYNAMIC_COMPRESSION_LEVEL = 4;
 
 static const string htmlStart1 = "<!DOCTYPE html><html><head>\n"
 "<link rel='stylesheet' type='text/css' href='/default@";
@@ -240,6 +245,19 @@ WebServerManager::WebServerManager() noexcept : csTemplateCache(RWLock::create()
 	ui.type = HANDLER_TYPE_FILE;
 	ui.cf = &WebServerManager::downloadFinishedItem;
 	urlInfo["xfget"] = ui;
+	ui.type = HANDLER_TYPE_API;
+	ui.cf = &WebServerManager::apiQueue;
+	urlInfo["api/queue"] = ui;
+	ui.cf = &WebServerManager::apiTransfers;
+	urlInfo["api/transfers"] = ui;
+	ui.cf = &WebServerManager::apiSearch;
+	urlInfo["api/search"] = ui;
+	ui.cf = &WebServerManager::apiShare;
+	urlInfo["api/share"] = ui;
+	ui.cf = &WebServerManager::apiHubs;
+	urlInfo["api/hubs"] = ui;
+	ui.cf = &WebServerManager::apiMetrics;
+	urlInfo["metrics"] = ui;
 	themeAttr[0].timestamp = themeAttr[1].timestamp = 0;
 }
 
@@ -417,6 +435,16 @@ void WebServerManager::sendErrorResponse(HttpServerConnection* conn, int code, c
 	conn->sendResponse(resp, Util::emptyString);
 }
 
+void WebServerManager::sendAuthRequired(HttpServerConnection* conn) noexcept
+{
+	Http::Response resp;
+	resp.setResponse(401);
+	resp.addHeader(Http::HEADER_CONTENT_LENGTH, "0");
+	resp.addHeader(Http::HEADER_CONNECTION, "keep-alive");
+	resp.addHeader(Http::HEADER_WWW_AUTHENTICATE, "Basic realm=\"metrics\"");
+	conn->sendResponse(resp, Util::emptyString);
+}
+
 void WebServerManager::sendRedirect(const RequestInfo& inf, const string& location) noexcept
 {
 	Http::Response resp;
@@ -515,6 +543,46 @@ void WebServerManager::onRequest(HttpServerConnection* conn, const Http::Request
 		return;
 	}
 
+	if (uri == "/metrics")
+	{
+		// Scrapers use HTTP Basic authentication, no session is created for them
+		if (!checkAuthCookie(cookies.get("auth"), curTime, inf.clientId))
+		{
+			string user, password;
+			if (!WebServerUtil::parseBasicAuth(req.getHeaderValue(Http::HEADER_AUTHORIZATION), user, password) ||
+			    !checkUser(user, password))
+			{
+				sendAuthRequired(conn);
+				return;
+			}
+		}
+		handleRequest(inf, urlInfo.find("metrics")->second);
+		return;
+	}
+
+	if (uri.compare(0, 5, "/api/") == 0)
+	{
+		// API clients get an error code instead of the login page
+		auto i = urlInfo.find(uri.substr(1));
+		if (i == urlInfo.end() || i->second.type != HANDLER_TYPE_API)
+		{
+			sendErrorResponse(conn, 404);
+			return;
+		}
+		if (!checkAuthCookie(cookies.get("auth"), curTime, inf.clientId))
+		{
+			sendErrorResponse(conn, 401);
+			return;
+		}
+		Query query = Util::decodeQuery(method == Http::METHOD_POST ? conn->getRequestBody() : queryStr);
+		updateAuthCookie(cookies, inf.clientId, curTime);
+		inf.query = &query;
+		if (LogManager::getLogOptions() & LogManager::OPT_LOG_WEB_SERVER)
+			LogManager::log(LogManager::WEBSERVER, printClientId(inf.clientId, conn) + ": " + req.getMethod() + ' ' + req.getUri());
+		handleRequest(inf, i->second);
+		return;
+	}
+
 	string filename = uri;
 	Util::toNativePathSeparators(filename);
 	if (filename.empty() || filename.front() != PATH_SEPARATOR || filename.find(PATH_SEPARATOR, 1) != string::npos)
@@ -528,7 +596,7 @@ void WebServerManager::onRequest(HttpServerConnection* conn, const Http::Request
 	{
 		if (Text::isAsciiSuffix2(filename, string(".js")))
 		{
-			sendTemplate(inf, "templates", filename, filename, "application/javascript", ST_EXPAND_LANG_STRINGS);
+			sendTemplate(inf, "templates", filename, filename, "application/javascript", ST_EXPAND_LANG_STRINGS | ST_USE_CACHE);
 			return;
 		}
 		if (Text::isAsciiSuffix2(filename, string(".css")))
@@ -560,11 +628,7 @@ void WebServerManager::onRequest(HttpServerConnection* conn, const Http::Request
 		if (timestamp)
 		{
 			inf.cookies = nullptr;
-			uint64_t ifModified = getIfModified(req);
-			if (ifModified && File::timeStampToUnixTime(timestamp) <= ifModified)
-				sendErrorResponse(conn, 304);
-			else
-				sendFile(inf, path, false, timestamp);
+			sendFile(inf, path, false, timestamp);
 			return;
 		}
 	}
@@ -625,6 +689,7 @@ void WebServerManager::sendFile(const RequestInfo& inf, const string& path, bool
 	{
 		f = new File(path, File::READ, File::OPEN);
 		size = f->getSize();
+		if (!timestamp) timestamp = File::getTimeStamp(path);
 	}
 	catch (Exception&)
 	{
@@ -633,20 +698,96 @@ void WebServerManager::sendFile(const RequestInfo& inf, const string& path, bool
 		return;
 	}
 
+	char etag[64];
+	snprintf(etag, sizeof(etag), "\"%llx-%llx\"", (unsigned long long) timestamp, (unsigned long long) size);
+	const uint64_t modified = File::timeStampToUnixTime(timestamp);
+	if (isNotModified(*inf.req, etag, modified))
+	{
+		delete f;
+		sendNotModified(inf, etag);
+		return;
+	}
+
+	int rangeResult = WebServerUtil::RANGE_NONE;
+	int64_t start = 0, end = size - 1;
+	const string& range = inf.req->getHeaderValue(Http::HEADER_RANGE);
+	if (!range.empty())
+	{
+		// A stale If-Range validator requests the whole file
+		const string& ifRange = inf.req->getHeaderValue(Http::HEADER_IF_RANGE);
+		time_t ifRangeTime;
+		if (ifRange.empty() || ifRange == etag || (Http::parseDateTime(ifRangeTime, ifRange) && (uint64_t) ifRangeTime == modified))
+			rangeResult = WebServerUtil::parseRange(range, size, start, end);
+	}
+
 	Http::Response resp;
-	resp.setResponse(200);
-	resp.addHeader(Http::HEADER_CONTENT_LENGTH, Util::toString(size));
+	if (rangeResult == WebServerUtil::RANGE_NOT_SATISFIABLE)
+	{
+		delete f;
+		resp.setResponse(416);
+		resp.addHeader(Http::HEADER_CONTENT_RANGE, "bytes */" + Util::toString(size));
+		resp.addHeader(Http::HEADER_CONTENT_LENGTH, "0");
+		resp.addHeader(Http::HEADER_CONNECTION, "keep-alive");
+		inf.conn->sendResponse(resp, Util::emptyString);
+		return;
+	}
+
+	InputStream* stream = f;
+	if (rangeResult == WebServerUtil::RANGE_VALID)
+	{
+		try
+		{
+			f->setPos(start);
+		}
+		catch (Exception&)
+		{
+			delete f;
+			sendErrorResponse(inf.conn, 500);
+			return;
+		}
+		stream = new LimitedInputStream<true>(f, end - start + 1);
+		resp.setResponse(206);
+		resp.addHeader(Http::HEADER_CONTENT_RANGE, "bytes " + Util::toString(start) + '-' + Util::toString(end) + '/' + Util::toString(size));
+		resp.addHeader(Http::HEADER_CONTENT_LENGTH, Util::toString(end - start + 1));
+	}
+	else
+	{
+		resp.setResponse(200);
+		resp.addHeader(Http::HEADER_CONTENT_LENGTH, Util::toString(size));
+	}
 	resp.addHeader(Http::HEADER_CONTENT_TYPE, WebServerUtil::getContentTypeForFile(path));
 	resp.addHeader(Http::HEADER_CONNECTION, "keep-alive");
+	resp.addHeader(Http::HEADER_ACCEPT_RANGES, "bytes");
+	resp.addHeader(Http::HEADER_ETAG, etag);
 	if (sendContentDisposition)
 	{
 		string filename = Util::encodeUriPath(Util::getFileName(path));
 		resp.addHeader(Http::HEADER_CONTENT_DISPOSITION, "attachment; filename*=UTF-8''" + filename + "; filename=" + filename);
 	}
 	if (timestamp)
-		resp.addHeader(Http::HEADER_LAST_MODIFIED, Http::printDateTime(File::timeStampToUnixTime(timestamp)));
+		resp.addHeader(Http::HEADER_LAST_MODIFIED, Http::printDateTime(modified));
 	if (inf.cookies) inf.cookies->print(resp);
-	inf.conn->sendResponse(resp, Util::emptyString, f);
+	inf.conn->sendResponse(resp, Util::emptyString, stream);
+}
+
+void WebServerManager::sendNotModified(const RequestInfo& inf, const string& etag) noexcept
+{
+	Http::Response resp;
+	resp.setResponse(304);
+	resp.addHeader(Http::HEADER_CONTENT_LENGTH, "0");
+	resp.addHeader(Http::HEADER_CONNECTION, "keep-alive");
+	if (!etag.empty()) resp.addHeader(Http::HEADER_ETAG, etag);
+	inf.conn->sendResponse(resp, Util::emptyString);
+}
+
+bool WebServerManager::isNotModified(const Http::Request& req, const string& etag, uint64_t modified) noexcept
+{
+	// If-Modified-Since is ignored when If-None-Match is present
+	const string& ifNoneMatch = req.getHeaderValue(Http::HEADER_IF_NONE_MATCH);
+	if (!ifNoneMatch.empty())
+		return !etag.empty() && WebServerUtil::matchETag(ifNoneMatch, etag);
+	uint64_t ifModified = getIfModified(req);
+	return ifModified && modified && modified <= ifModified;
 }
 
 void WebServerManager::handleRequest(const RequestInfo& inf, const UrlInfo& ui) noexcept
@@ -659,20 +800,36 @@ void WebServerManager::handleRequest(const RequestInfo& inf, const UrlInfo& ui)
 		if (res.data.empty()) res.data = "/";
 		sendRedirect(inf, res.data);
 	}
-	else if (res.type == HANDLER_RESULT_HTML || res.type == HANDLER_RESULT_JSON)
+	else if (res.type == HANDLER_RESULT_HTML || res.type == HANDLER_RESULT_JSON || res.type == HANDLER_RESULT_TEXT)
 	{
 		Http::Response resp;
 		resp.setResponse(200);
+		if (res.data.length() >= MIN_COMPRESSED_SIZE)
+		{
+			int encoding = WebServerUtil::getAcceptedEncoding(inf.req->getHeaderValue(Http::HEADER_ACCEPT_ENCODING));
+			string compressed;
+			if (encoding != WebServerUtil::ENCODING_IDENTITY &&
+			    GZip::compress(res.data.data(), res.data.length(), compressed, encoding == WebServerUtil::ENCODING_GZIP, DYNAMIC_COMPRESSION_LEVEL))
+			{
+				res.data = std::move(compressed);
+				resp.addHeader(Http::HEADER_CONTENT_ENCODING, encoding == WebServerUtil::ENCODING_GZIP ? "gzip" : "deflate");
+			}
+			resp.addHeader("Vary", "Accept-Encoding");
+		}
 		resp.addHeader(Http::HEADER_CONTENT_LENGTH, Util::toString(res.data.length()));
 		resp.addHeader(Http::HEADER_CONTENT_TYPE,
-			res.type == HANDLER_RESULT_JSON ?
-			"application/json;charset=utf-8" : "text/html;charset=utf-8");
+			res.type == HANDLER_RESULT_JSON ? "application/json;charset=utf-8" :
+			res.type == HANDLER_RESULT_TEXT ? "text/plain;version=0.0.4;charset=utf-8" : "text/html;charset=utf-8");
 		resp.addHeader(Http::HEADER_CONNECTION, "keep-alive");
 		if (inf.cookies) inf.cookies->print(resp);
 		inf.conn->sendResponse(resp, res.data);
 	}
 	else if (res.type == HANDLER_RESULT_FILE_PATH)
 		sendFile(inf, res.data, true, 0);
+	else if (res.type == HANDLER_RESULT_BAD_REQUEST)
+		sendErrorResponse(inf.conn, 400);
+	else if (res.type == HANDLER_RESULT_NOT_FOUND)
+		sendErrorResponse(inf.conn, 404);
 	else
 		sendErrorResponse(inf.conn, 500);
 }
@@ -683,29 +840,18 @@ void WebServerManager::sendTemplate(const RequestInfo& inf, const string& dir, c
 	bool loadedFromCache = false;
 	if (flags & ST_USE_CACHE)
 	{
-		uint64_t ifModified = getIfModified(*inf.req);
-		int cache = getCacheItem(item, requestedName, ifModified);
-		if (cache == CACHE_ITEM_FOUND)
-			loadedFromCache = true;
-		else if (cache == CACHE_ITEM_NOT_MODIFIED)
+		string path = Util::getWebServerPath();
+		Util::appendPathSeparator(path);
+		path += dir;
+		path += PATH_SEPARATOR;
+		path += name;
+		uint64_t ts = File::getTimeStamp(path);
+		if (!ts)
 		{
-			string path = Util::getWebServerPath();
-			Util::appendPathSeparator(path);
-			path += dir;
-			path += PATH_SEPARATOR;
-			path += name;
-			uint64_t ts = File::getTimeStamp(path);
-			if (!ts)
-			{
-				sendErrorResponse(inf.conn, 404);
-				return;
-			}
-			if (File::timeStampToUnixTime(ts) <= ifModified)
-			{
-				sendErrorResponse(inf.conn, 304);
-				return;
-			}
+			sendErrorResponse(inf.conn, 404);
+			return;
 		}
+		loadedFromCache = getCacheItem(item, requestedName) && item.sourceTimestamp == ts;
 	}
 	if (!loadedFromCache && !loadTemplate(item, dir, name))
 	{
@@ -726,27 +872,57 @@ void WebServerManager::sendTemplate(const RequestInfo& inf, const string& dir, c
 		}
 		if (flags & ST_USE_CACHE)
 		{
+			// Expanded and compressed once, served from the cache until the template changes
+			item.sourceTimestamp = item.timestamp;
 			item.timestamp = Util::getFileTime();
-			setCacheItem(requestedName, item.data, item.timestamp);
+			TigerHash tiger;
+			tiger.update(item.data.data(), item.data.length());
+			item.etag = Util::toBase32(tiger.finalize(), 12);
+			if (!GZip::compress(item.data.data(), item.data.length(), item.gzipData, true, Z_BEST_COMPRESSION) ||
+			    item.gzipData.length() >= item.data.length())
+				item.gzipData.clear();
+			setCacheItem(requestedName, item);
 		}
 	}
 
+	// Compressed body is a different representation and needs its own tag
+	const bool useGzip = !item.gzipData.empty() &&
+		WebServerUtil::getAcceptedEncoding(inf.req->getHeaderValue(Http::HEADER_ACCEPT_ENCODING)) == WebServerUtil::ENCODING_GZIP;
+	string etag;
+	if (!item.etag.empty())
+	{
+		etag = '"' + item.etag;
+		if (useGzip) etag += "-gz";
+		etag += '"';
+	}
+	if (!(flags & ST_VOLATILE) && isNotModified(*inf.req, etag, File::timeStampToUnixTime(item.timestamp)))
+	{
+		sendNotModified(inf, etag);
+		return;
+	}
+
+	const string& body = useGzip ? item.gzipData : item.data;
 	Http::Response resp;
 	resp.setResponse(200);
-	resp.addHeader(Http::HEADER_CONTENT_LENGTH, Util::toString(item.data.length()));
+	resp.addHeader(Http::HEADER_CONTENT_LENGTH, Util::toString(body.length()));
 	if (flags & ST_VOLATILE)
 	{
 		resp.addHeader(Http::HEADER_PRAGMA, "no-cache");
 		resp.addHeader(Http::HEADER_CACHE_CONTROL, "no-cache");
 	}
 	else
+	{
 		resp.addHeader(Http::HEADER_LAST_MODIFIED, Http::printDateTime(File::timeStampToUnixTime(item.timestamp)));
+		if (!etag.empty()) resp.addHeader(Http::HEADER_ETAG, etag);
+	}
+	if (useGzip) resp.addHeader(Http::HEADER_CONTENT_ENCODING, "gzip");
+	if (!item.gzipData.empty()) resp.addHeader("Vary", "Accept-Encoding");
 	resp.addHeader(Http::HEADER_CONTENT_TYPE, mimeType + ";charset=utf-8");
 	resp.addHeader(Http::HEADER_CONNECTION, "keep-alive");
 #if 0
 	if (inf.cookies) inf.cookies->print(resp);
 #endif
-	inf.conn->sendResponse(resp, item.data);
+	inf.conn->sendResponse(resp, body);
 }
 
 bool WebServerManager::loadTemplate(CacheItem& result, const string& dir, const string& name) noexcept
@@ -792,24 +968,21 @@ bool WebServerManager::loadTemplate(CacheItem& result, const string& dir, const
 	return true;
 }
 
-int WebServerManager::getCacheItem(CacheItem& result, const string& name, uint64_t ifModified) noexcept
+bool WebServerManager::getCacheItem(CacheItem& result, const string& name) noexcept
 {
 	string key = "out:" + name;
 	READ_LOCK(*csTemplateCache);
 	auto i = templateCache.find(key);
-	if (i == templateCache.end()) return CACHE_ITEM_NOT_FOUND;
-	if (ifModified && File::timeStampToUnixTime(i->second.timestamp) <= ifModified) return CACHE_ITEM_NOT_MODIFIED;
+	if (i == templateCache.end()) return false;
 	result = i->second;
-	return CACHE_ITEM_FOUND;
+	return true;
 }
 
-void WebServerManager::setCacheItem(const string& name, const string& data, uint64_t timestamp) noexcept
+void WebServerManager::setCacheItem(const string& name, const CacheItem& item) noexcept
 {
 	string key = "out:" + name;
 	WRITE_LOCK(*csTemplateCache);
-	auto& cached = templateCache[key];
-	cached.data = data;
-	cached.timestamp = timestamp;
+	templateCache[key] = item;
 }
 
 void WebServerManager::removeCacheItem(const string& name) noexcept
@@ -169,7 +169,10 @@ private:
 		HANDLER_RESULT_REDIRECT,
 		HANDLER_RESULT_HTML,
 		HANDLER_RESULT_JSON,
-		HANDLER_RESULT_FILE_PATH
+		HANDLER_RESULT_FILE_PATH,
+		HANDLER_RESULT_BAD_REQUEST,
+		HANDLER_RESULT_NOT_FOUND,
+		HANDLER_RESULT_TEXT
 	};
 
 	using ContentFunc = void (WebServerManager::*)(HandlerResult& res, const RequestInfo& state);
@@ -178,6 +181,9 @@ private:
 	{
 		uint64_t timestamp;
 		string data;
+		uint64_t sourceTimestamp = 0;
+		string etag;
+		string gzipData; // empty if not compressed
 	};
 
 	struct UrlInfo
@@ -190,7 +196,8 @@ private:
 	{
 		HANDLER_TYPE_PAGE = 1,
 		HANDLER_TYPE_ACTION,
-		HANDLER_TYPE_FILE
+		HANDLER_TYPE_FILE,
+		HANDLER_TYPE_API
 	};
 
 	enum
@@ -201,13 +208,6 @@ private:
 		ST_VOLATILE            = 8
 	};
 
-	enum
-	{
-		CACHE_ITEM_NOT_FOUND,
-		CACHE_ITEM_FOUND,
-		CACHE_ITEM_NOT_MODIFIED
-	};
-
 	struct ThemeAttributes
 	{
 		StringMap vars;
@@ -220,8 +220,11 @@ private:
 	bool startListen(int af, bool tls);
 	void accept(const Socket& sock, bool tls, Server* server) noexcept;
 	void sendErrorResponse(HttpServerConnection* conn, int resp, const char* text = nullptr) noexcept;
+	void sendAuthRequired(HttpServerConnection* conn) noexcept;
 	void sendRedirect(const RequestInfo& inf, const string& location) noexcept;
 	void sendFile(const RequestInfo& inf, const string& path, bool sendContentDisposition, uint64_t timestamp) noexcept;
+	void sendNotModified(const RequestInfo& inf, const string& etag) noexcept;
+	static bool isNotModified(const Http::Request& req, const string& etag, uint64_t modified) noexcept;
 	void sendTemplate(const RequestInfo& inf, const string& dir, const string& name, const string& requestName, const string& mimeType, int flags) noexcept;
 	void sendLoginPage(const RequestInfo& inf) noexcept;
 	void handleRequest(const RequestInfo& inf, const UrlInfo& ui) noexcept;
@@ -232,8 +235,8 @@ private:
 	void loadColorTheme(int index) noexcept;
 
 	bool loadTemplate(CacheItem& result, const string& dir, const string& name) noexcept;
-	int getCacheItem(CacheItem& result, const string& name, uint64_t ifModified) noexcept;
-	void setCacheItem(const string& name, const string& data, uint64_t timestamp) noexcept;
+	bool getCacheItem(CacheItem& result, const string& name) noexcept;
+	void setCacheItem(const string& name, const CacheItem& item) noexcept;
 	void removeCacheItem(const string& name) noexcept;
 
 	static void printHtmlStart(string& os, const Http::ServerCookies* cookies) noexcept;
@@ -260,6 +263,15 @@ private:
 	void refreshShare(HandlerResult& res, const RequestInfo& state) noexcept;
 	void applySettings(HandlerResult& res, const RequestInfo& state) noexcept;
 
+	// JSON API, see WebServerApi.cpp
+	static size_t getApiPageLimit(const RequestInfo& state) noexcept;
+	void apiQueue(HandlerResult& res, const RequestInfo& state) noexcept;
+	void apiTransfers(HandlerResult& res, const RequestInfo& state) noexcept;
+	void apiSearch(HandlerResult& res, const RequestInfo& state) noexcept;
+	void apiShare(HandlerResult& res, const RequestInfo& state) noexcept;
+	void apiHubs(HandlerResult& res, const RequestInfo& state) noexcept;
+	void apiMetrics(HandlerResult& res, const RequestInfo& state) noexcept;
+
 	void onRequest(HttpServerConnection* conn, const Http::Request& req) noexcept override;
 	void onData(HttpServerConnection* conn, const uint8_t* data, size_t size) noexcept override {}
 	//void onDisconnected(HttpServerConnection* conn) noexcept override;
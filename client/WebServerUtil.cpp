@@ -411,3 +411,154 @@ void WebServerUtil::loadCssVariables(const string& data, StringMap& vars) noexce
 		i = j + 1;
 	}
 }
+
+static void trimSpaces(string& s)
+{
+	string::size_type i = 0;
+	while (i < s.length() && (s[i] == ' ' || s[i] == '\t')) ++i;
+	s.erase(0, i);
+	while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.pop_back();
+}
+
+static bool parseUInt64(const string& s, string::size_type start, string::size_type end, int64_t& result)
+{
+	if (start >= end || end - start > 18) return false;
+	result = 0;
+	for (string::size_type i = start; i < end; ++i)
+	{
+		if (s[i] < '0' || s[i] > '9') return false;
+		result = result * 10 + (s[i] - '0');
+	}
+	return true;
+}
+
+int WebServerUtil::getAcceptedEncoding(const string& acceptEncoding) noexcept
+{
+	bool gzip = false;
+	bool deflate = false;
+	string::size_type i = 0;
+	while (i < acceptEncoding.length())
+	{
+		string::size_type j = acceptEncoding.find(',', i);
+		if (j == string::npos) j = acceptEncoding.length();
+		string token = acceptEncoding.substr(i, j - i);
+		i = j + 1;
+		bool allowed = true;
+		string::size_type k = token.find(';');
+		if (k != string::npos)
+		{
+			// q=0 disables the encoding
+			string::size_type q = token.find("q=", k);
+			if (q != string::npos && atof(token.c_str() + q + 2) <= 0) allowed = false;
+			token.erase(k);
+		}
+		trimSpaces(token);
+		Text::asciiMakeLower(token);
+		if (token == "gzip" || token == "x-gzip")
+			gzip = allowed;
+		else if (token == "deflate")
+			deflate = allowed;
+	}
+	if (gzip) return ENCODING_GZIP;
+	if (deflate) return ENCODING_DEFLATE;
+	return ENCODING_IDENTITY;
+}
+
+bool WebServerUtil::matchETag(const string& ifNoneMatch, const string& etag) noexcept
+{
+	// If-None-Match uses the weak comparison
+	string::size_type i = 0;
+	while (i < ifNoneMatch.length())
+	{
+		string::size_type j = ifNoneMatch.find(',', i);
+		if (j == string::npos) j = ifNoneMatch.length();
+		string token = ifNoneMatch.substr(i, j - i);
+		i = j + 1;
+		trimSpaces(token);
+		if (token == "*") return true;
+		if (token.compare(0, 2, "W/") == 0) token.erase(0, 2);
+		if (token == etag) return true;
+	}
+	return false;
+}
+
+int WebServerUtil::parseRange(const string& range, int64_t size, int64_t& start, int64_t& end) noexcept
+{
+	// Only a single byte range is supported, the whole body is sent otherwise
+	static const string bytesUnit = "bytes=";
+	if (range.compare(0, bytesUnit.length(), bytesUnit) != 0 || range.find(',') != string::npos)
+		return RANGE_NONE;
+	string::size_type dash = range.find('-', bytesUnit.length());
+	if (dash == string::npos)
+		return RANGE_NONE;
+	if (dash == bytesUnit.length())
+	{
+		int64_t suffix;
+		if (!parseUInt64(range, dash + 1, range.length(), suffix))
+			return RANGE_NONE;
+		if (suffix == 0 || size == 0)
+			return RANGE_NOT_SATISFIABLE;
+		start = std::max<int64_t>(0, size - suffix);
+		end = size - 1;
+		return RANGE_VALID;
+	}
+	if (!parseUInt64(range, bytesUnit.length(), dash, start))
+		return RANGE_NONE;
+	if (dash + 1 == range.length())
+		end = size - 1;
+	else
+	{
+		if (!parseUInt64(range, dash + 1, range.length(), end) || end < start)
+			return RANGE_NONE;
+		end = std::min(end, size - 1);
+	}
+	if (start >= size)
+		return RANGE_NOT_SATISFIABLE;
+	return RANGE_VALID;
+}
+
+static int decodeBase64Char(char c)
+{
+	if (c >= 'A' && c <= 'Z') return c - 'A';
+	if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+	if (c >= '0' && c <= '9') return c - '0' + 52;
+	if (c == '+') return 62;
+	if (c == '/') return 63;
+	return -1;
+}
+
+static bool decodeBase64(const string& s, string::size_type start, string& out)
+{
+	out.clear();
+	unsigned bits = 0;
+	int bitCount = 0;
+	for (string::size_type i = start; i < s.length() && s[i] != '='; ++i)
+	{
+		int val = decodeBase64Char(s[i]);
+		if (val < 0) return false;
+		bits = bits << 6 | val;
+		bitCount += 6;
+		if (bitCount >= 8)
+		{
+			bitCount -= 8;
+			out += (char) (bits >> bitCount);
+			bits &= (1 << bitCount) - 1;
+		}
+	}
+	return true;
+}
+
+bool WebServerUtil::parseBasicAuth(const string& authorization, string& user, string& password) noexcept
+{
+	static const string basicScheme = "basic ";
+	if (authorization.length() <= basicScheme.length() || !Text::isAsciiPrefix2(authorization, basicScheme))
+		return false;
+	string credentials;
+	if (!decodeBase64(authorization, basicScheme.length(), credentials))
+		return false;
+	string::size_type pos = credentials.find(':');
+	if (pos == string::npos) return false;
+	user = credentials.substr(0, pos);
+	password = credentials.substr(pos + 1);
+	return true;
+}
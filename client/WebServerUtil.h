@@ -36,6 +36,20 @@ namespace WebServerUtil
 		int flags;
 	};
 
+	enum
+	{
+		ENCODING_IDENTITY,
+		ENCODING_GZIP,
+		ENCODING_DEFLATE
+	};
+
+	enum
+	{
+		RANGE_NONE,
+		RANGE_VALID,
+		RANGE_NOT_SATISFIABLE
+	};
+
 	enum
 	{
 		WIDTH_WRAP_CONTENT,
@@ -63,6 +77,10 @@ namespace WebServerUtil
 	void expandLangStrings(string& data) noexcept;
 	void expandCssVariables(string& data, const StringMap& vars) noexcept;
 	void loadCssVariables(const string& data, StringMap& vars) noexcept;
+	int getAcceptedEncoding(const string& acceptEncoding) noexcept;
+	bool matchETag(const string& ifNoneMatch, const string& etag) noexcept;
+	int parseRange(const string& range, int64_t size, int64_t& start, int64_t& end) noexcept;
+	bool parseBasicAuth(const string& authorization, string& user, string& password) noexcept;
 }
 
 #endif // WEB_SERVER_UTIL_H_
@@ -197,3 +197,23 @@ void GZip::decompress(const string& gzipFile, const string& outputFile)
 	}
 	gzclose(gz);
 }
+
+bool GZip::compress(const void* data, size_t size, string& out, bool gzipFormat, int level) noexcept
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, level, Z_DEFLATED, gzipFormat ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+	out.resize(deflateBound(&zs, (uLong) size));
+	zs.next_in = (Bytef*) data;
+	zs.avail_in = (uInt) size;
+	zs.next_out = (Bytef*) &out[0];
+	zs.avail_out = (uInt) out.size();
+	int result = deflate(&zs, Z_FINISH);
+	if (result == Z_STREAM_END)
+		out.resize(zs.total_out);
+	else
+		out.clear();
+	deflateEnd(&zs);
+	return result == Z_STREAM_END;
+}
@@ -68,6 +68,9 @@ class UnZFilter
 namespace GZip
 {
 	void decompress(const std::string& gzipPath, const std::string &outputPath);
+
+	// Compresses the buffer in gzip or zlib (HTTP deflate) format, returns false on error
+	bool compress(const void* data, size_t size, std::string& out, bool gzipFormat, int level = Z_DEFAULT_COMPRESSION) noexcept;
 }
 
 #endif // DCPLUSPLUS_DCPP_Z_UTILS_H
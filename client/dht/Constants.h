@@ -43,14 +43,20 @@ static const unsigned SELF_LOOKUP_TIME         = 4*60*60*1000; // how often to s
 static const unsigned SELF_LOOKUP_TIME_INIT    = 3*60*1000;
 
 static const unsigned K                        = 10;           // maximum nodes in one bucket
+static const unsigned MAX_REPLACEMENTS         = K;            // maximum nodes in replacement cache of one bucket
 
 static const int MIN_PUBLISH_FILESIZE          = 1024 * 1024;  // 1 MiB, files below this size won't be published
 
 static const unsigned REPUBLISH_TIME           = 5*60*60*1000; // when our filelist should be republished
 static const unsigned PFS_REPUBLISH_TIME       = 1*60*60*1000; // when partially downloaded files should be republished
-static const unsigned PUBLISH_TIME             = 2*1000;       // how often publishes files
 
-static const int MAX_PUBLISHES_AT_TIME         = 3;            // how many files can be published at one time
+static const int MAX_PUBLISHES_AT_TIME         = 3;            // how many node lookups for publishing can run at one time
+static const unsigned MAX_PUBLISH_GROUP_FILES  = 200;          // maximum files published with one node lookup
+static const int MIN_PUBLISH_GROUP_BITS        = 8;            // files are published one by one when our buckets cover a shorter prefix
+static const unsigned PUBLISH_BATCH_SIZE       = 20;           // files in one PUB command for nodes supporting DHTB
+static const unsigned MAX_PUBLISH_BATCH_SIZE   = 64;           // maximum files accepted in one PUB command
+static const unsigned MAX_PUBLISH_PACKETS_PER_NODE = 8;        // PUB commands sent to one IP per minute, receivers drop more than 10
+static const unsigned MAX_PENDING_PUBLISH_REQUESTS = 200;      // no new lookups are started when more requests wait to be sent
 
 static const unsigned FW_RESPONSES             = 3;            // how many UDP port checks are needed to detect we are firewalled
 static const unsigned FWCHECK_TIME             = 1*60*60*1000; // how often request firewalled UDP check
@@ -112,7 +112,7 @@ namespace dht
 				SettingsManager::getInstance()->set(SettingsManager::EXTERNAL_IP, Util::emptyString);
 #endif
 
-			bucket = new KBucket();
+			bucket = new KBucket(ClientManager::getMyCID());
 
 			BootstrapManager::newInstance();
 			SearchManager::newInstance();
@@ -540,6 +540,9 @@ namespace dht
 			su += AdcSupports::UDP4_FEATURE;
 		}
 
+		if (!su.empty()) su += ',';
+		su += AdcSupports::DHTB_FEATURE;
+
 		cmd.addParam(TAG('S', 'U'), su);
 
 		send(cmd, ip, port, targetCID, udpKey);
@@ -585,9 +588,6 @@ namespace dht
 			// load nodes; when file is older than 7 days, bootstrap from database later
 			if ((int64_t) ::File::timeStampToUnixTime(f.getTimeStamp()) > (int64_t) time(nullptr) - 7 * 24 * 60 * 60)
 				bucket->loadNodes(xml);
-
-			// load indexes
-			IndexManager::getInstance()->loadIndexes(xml);
 			xml.stepOut();
 		}
 		catch (Exception& e)
@@ -601,10 +601,9 @@ namespace dht
 	 */
 	void DHT::saveData()
 	{
-		if (!dirty)
-			return;
-
 		LOCK(cs);
+		if (!dirty && !bucket->isDirty())
+			return;
 
 		SimpleXML xml;
 		xml.addTag("DHT");
@@ -613,9 +612,6 @@ namespace dht
 		// save nodes
 		bucket->saveNodes(xml);
 
-		// save foreign published files
-		IndexManager::getInstance()->saveIndexes(xml);
-
 		xml.stepOut();
 
 		string path = Util::getPath(Util::PATH_USER_CONFIG) + DHT_FILE;
@@ -1081,7 +1077,13 @@ namespace dht
 	size_t DHT::getNodesCount() const
 	{
 		LOCK(cs);
-		return bucket ? bucket->getNodes().size() : 0;
+		return bucket ? bucket->getNodeCount() : 0;
+	}
+
+	size_t DHT::getBucketCount() const
+	{
+		LOCK(cs);
+		return bucket ? bucket->getBucketCount() : 0;
 	}
 
 	bool DHT::pingNode(const CID& cid)
@@ -1090,15 +1092,7 @@ namespace dht
 		{
 			LOCK(cs);
 			if (bucket)
-			{
-				const KBucket::NodeList& nodes = bucket->getNodes();
-				for (const Node::Ptr& n : nodes)
-					if (n->getUser()->getCID() == cid)
-					{
-						node = n;
-						break;
-					}
-			}
+				node = bucket->findNode(cid);
 		}
 		if (!node) return false;
 		node->setTimeout();
@@ -90,6 +90,9 @@ namespace dht
 		/** Returns counts of nodes available in k-buckets */
 		size_t getNodesCount() const;
 
+		/** Returns number of k-buckets, it grows with the size of the network */
+		size_t getBucketCount() const;
+
 		/** Removes dead nodes */
 		void checkExpiration(uint64_t tick);
 
@@ -146,10 +149,9 @@ namespace dht
 				}
 				LockInstanceNodes(const LockInstanceNodes&) = delete;
 				LockInstanceNodes& operator= (const LockInstanceNodes&) = delete;
-				const KBucket::NodeList* getNodes() const
+				const KBucket* getBucket() const
 				{
-					if (!instance->bucket) return nullptr;
-					return &instance->bucket->getNodes();
+					return instance->bucket;
 				}
 
 			private:
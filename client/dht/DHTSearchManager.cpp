@@ -162,19 +162,22 @@ namespace dht
 	/*
 	 * Performs node lookup to store key/value pair in the network
 	 */
-	void SearchManager::findStore(const string& tth, int64_t size, bool partial)
+	void SearchManager::findStore(const PublishGroup::Ptr& group)
 	{
+		string tth = group->files.front().tth.toBase32();
 		if (isAlreadySearchingFor(tth))
 		{
-			IndexManager::getInstance()->decPublishing();
+			// the first file is already being looked up, the rest of the group waits for another lookup
+			auto im = IndexManager::getInstance();
+			im->requeueFiles(group, 1);
+			im->decPublishing();
 			return;
 		}
 
 		DHTSearch* s = new DHTSearch;
 		s->type = DHTSearch::TYPE_STOREFILE;
-		s->term = tth;
-		s->filesize = size;
-		s->partial = partial;
+		s->term = std::move(tth);
+		s->publishGroup = group;
 		s->token = Util::rand();
 
 		search(s, GET_TICK());
@@ -499,30 +502,6 @@ namespace dht
 		return true;
 	}
 
-	/*
-	 * Sends publishing request
-	 */
-	void SearchManager::publishFile(const Node::Map& nodes, const string& tth, int64_t size, bool partial)
-	{
-		// send PUB command to K nodes
-		int n = K;
-		for (Node::Map::const_iterator i = nodes.begin(); i != nodes.end() && n > 0; i++, n--)
-		{
-			const Node::Ptr& node = i->second;
-
-			AdcCommand cmd(AdcCommand::CMD_PUB, AdcCommand::TYPE_UDP);
-			cmd.addParam(TAG('T', 'R'), tth);
-			cmd.addParam(TAG('S', 'I'), Util::toString(size));
-
-			if (partial)
-				cmd.addParam("PF1");
-
-			//i->second->setTimeout();
-			DHT::getInstance()->send(cmd, node->getIdentity().getIP4(),
-				node->getIdentity().getUdp4Port(), node->getUser()->getCID(), node->getUdpKey());
-		}
-	}
-
 	/*
 	 * Processes all running searches and removes long-time ones
 	 */
@@ -547,7 +526,7 @@ namespace dht
 
 				if (s->type == DHTSearch::TYPE_STOREFILE)
 				{
-					publishFile(s->respondedNodes, s->term, s->filesize, s->partial);
+					IndexManager::getInstance()->addPublishRequests(s->respondedNodes, s->publishGroup);
 				}
 				s->onRemove();
 				delete s;
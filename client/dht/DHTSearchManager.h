@@ -31,10 +31,12 @@
 namespace dht
 {
 
+	struct PublishGroup;
+
 	struct DHTSearch
 	{
 
-		DHTSearch() : partial(false), stopping(false) {}
+		DHTSearch() : stopping(false) {}
 
 		enum SearchType { TYPE_FILE = 1, TYPE_NODE = 3, TYPE_STOREFILE = 4 }; // standard types should match ADC protocol
 
@@ -45,10 +47,9 @@ namespace dht
 		uint32_t token;    // search token
 		string term;       // search term (TTH/CID)
 		uint64_t lifeTime; // time when this search has been started
-		int64_t filesize;  // file size
 		SearchType type;   // search type
-		bool partial;      // is this partial file search?
 		bool stopping;     // search is being stopped
+		std::shared_ptr<PublishGroup> publishGroup; // files to publish when TYPE_STOREFILE search is finished
 #ifdef DEBUG_DHT_SEARCH
 		unsigned nodeCtr = 0;
 #endif
@@ -70,8 +71,8 @@ namespace dht
 		/** Performs value lookup in the network, returns time to wait in the queue */
 		unsigned findFile(const string& tth, uint32_t token, uint64_t owner);
 
-		/** Performs node lookup to store key/value pair in the network */
-		void findStore(const string& tth, int64_t size, bool partial);
+		/** Performs node lookup to store key/value pairs in the network, the first file is used as the target */
+		void findStore(const std::shared_ptr<PublishGroup>& group);
 
 		/** Process incoming search request */
 		void processSearchRequest(const Node::Ptr& node, const AdcCommand& cmd);
@@ -103,9 +104,6 @@ namespace dht
 		/** Performs general search operation in the network */
 		void search(DHTSearch* s, uint64_t startTick);
 
-		/** Sends publishing request */
-		void publishFile(const Node::Map& nodes, const string& tth, int64_t size, bool partial);
-
 		/** Checks whether we are alreading searching for a term */
 		bool isAlreadySearchingFor(const string& term);
 	};
@@ -0,0 +1,381 @@
+#include "stdinc.h"
+#include "IndexDatabase.h"
+#include "../AppPaths.h"
+#include "../File.h"
+#include "../Path.h"
+#include "../LogManager.h"
+#include "../StrUtil.h"
+#include "../unaligned.h"
+
+namespace dht
+{
+
+	static const size_t TTH_SIZE = TigerTree::BYTES;
+
+	// Sources: TTH, CID -> expires, size, IP, UDP port, flags
+	static const size_t SOURCE_KEY_SIZE = TTH_SIZE + CID::SIZE;
+	static const size_t SOURCE_DATA_SIZE = 24;
+
+	// Expiration index: expires (big endian), TTH, CID -> empty
+	static const size_t EXPIRY_KEY_SIZE = 8 + SOURCE_KEY_SIZE;
+
+	static const uint8_t SOURCE_FLAG_PARTIAL = 1;
+
+#if defined(_WIN64) || defined(__LP64__)
+#define PLATFORM_TAG "x64"
+#else
+#define PLATFORM_TAG "x32"
+#endif
+
+	static const mdb_size_t MIN_MAP_SIZE = 64ull*1024ull*1024ull;
+
+	static inline void storeBE64(uint8_t* ptr, uint64_t val)
+	{
+		for (int i = 7; i >= 0; --i)
+		{
+			ptr[i] = static_cast<uint8_t>(val);
+			val >>= 8;
+		}
+	}
+
+	static inline uint64_t loadBE64(const uint8_t* ptr)
+	{
+		uint64_t val = 0;
+		for (int i = 0; i < 8; ++i)
+			val = val << 8 | ptr[i];
+		return val;
+	}
+
+	static inline void setVal(MDB_val& val, void* data, size_t size)
+	{
+		val.mv_data = data;
+		val.mv_size = size;
+	}
+
+	static void makeSourceKey(uint8_t* key, const TTHValue& tth, const CID& cid)
+	{
+		memcpy(key, tth.data, TTH_SIZE);
+		memcpy(key + TTH_SIZE, cid.data(), CID::SIZE);
+	}
+
+	static void makeExpiryKey(uint8_t* key, uint64_t expires, const uint8_t* sourceKey)
+	{
+		storeBE64(key, expires);
+		memcpy(key + 8, sourceKey, SOURCE_KEY_SIZE);
+	}
+
+	string IndexDatabase::getDBPath() noexcept
+	{
+		string path = Util::getConfigPath();
+		path += "dht-index." PLATFORM_TAG;
+		return path;
+	}
+
+	bool IndexDatabase::open() noexcept
+	{
+		LOCK(cs);
+		if (env) return false;
+
+		int error = mdb_env_create(&env);
+		if (!checkError(error, "mdb_env_create")) return false;
+
+		mdb_env_set_maxdbs(env, 2);
+		string path = getDBPath();
+		path += PATH_SEPARATOR;
+		File::ensureDirectory(path);
+		// Sources are republished periodically, losing the last transactions on system crash is acceptable.
+		// The environment is flushed from removeExpired.
+		error = mdb_env_open(env, path.c_str(), MDB_NOSYNC, 0664);
+		if (!checkError(error, "mdb_env_open"))
+		{
+			mdb_env_close(env);
+			env = nullptr;
+			return false;
+		}
+
+		MDB_envinfo info;
+		error = mdb_env_info(env, &info);
+		if (error || info.me_mapsize < MIN_MAP_SIZE)
+		{
+			error = mdb_env_set_mapsize(env, MIN_MAP_SIZE);
+			if (!checkError(error, "mdb_env_set_mapsize"))
+			{
+				mdb_env_close(env);
+				env = nullptr;
+				return false;
+			}
+		}
+
+		MDB_txn* txn;
+		error = mdb_txn_begin(env, nullptr, 0, &txn);
+		if (checkError(error, "mdb_txn_begin"))
+		{
+			error = mdb_dbi_open(txn, "sources", MDB_CREATE, &dbiSources);
+			if (!error) error = mdb_dbi_open(txn, "expiry", MDB_CREATE, &dbiExpiry);
+			if (!error)
+				error = mdb_txn_commit(txn);
+			else
+				mdb_txn_abort(txn);
+			if (checkError(error, "mdb_dbi_open"))
+				return true;
+		}
+		mdb_env_close(env);
+		env = nullptr;
+		return false;
+	}
+
+	void IndexDatabase::close() noexcept
+	{
+		LOCK(cs);
+		if (env)
+		{
+			mdb_env_close(env);
+			env = nullptr;
+		}
+	}
+
+	bool IndexDatabase::checkError(int error, const char* what) noexcept
+	{
+		if (!error) return true;
+		string errorText = "DHT index LMDB error: " + Util::toString(error);
+		if (what)
+		{
+			errorText += " (";
+			errorText += what;
+			errorText += ")";
+		}
+		LogManager::message(errorText, false);
+		return false;
+	}
+
+	bool IndexDatabase::resizeMap() noexcept
+	{
+		// All transactions are created under the lock, so none is active here
+		MDB_envinfo info;
+		int error = mdb_env_info(env, &info);
+		if (!checkError(error, "mdb_env_info")) return false;
+		mdb_size_t newMapSize = info.me_mapsize << 1;
+		LogManager::message("Resizing DHT index map to " + Util::toString(newMapSize), false);
+		error = mdb_env_set_mapsize(env, newMapSize);
+		return checkError(error, "mdb_env_set_mapsize");
+	}
+
+	int IndexDatabase::putSource(MDB_txn* txn, const TTHValue& tth, const Source& source, unsigned maxSources) noexcept
+	{
+		uint8_t keyData[SOURCE_KEY_SIZE];
+		uint8_t expiryKeyData[EXPIRY_KEY_SIZE];
+		uint8_t data[SOURCE_DATA_SIZE];
+		makeSourceKey(keyData, tth, source.getCID());
+
+		MDB_val key, val;
+		setVal(key, keyData, SOURCE_KEY_SIZE);
+		int error = mdb_get(txn, dbiSources, &key, &val);
+		bool found = false;
+		if (!error && val.mv_size == SOURCE_DATA_SIZE)
+		{
+			found = true;
+			uint64_t oldExpires = loadUnaligned64(val.mv_data);
+			makeExpiryKey(expiryKeyData, oldExpires, keyData);
+			MDB_val expiryKey;
+			setVal(expiryKey, expiryKeyData, EXPIRY_KEY_SIZE);
+			error = mdb_del(txn, dbiExpiry, &expiryKey, nullptr);
+			if (error && error != MDB_NOTFOUND) return error;
+		}
+		else if (error && error != MDB_NOTFOUND)
+			return error;
+
+		storeUnaligned64(data, source.getExpires());
+		storeUnaligned64(data + 8, source.getSize());
+		storeUnaligned32(data + 16, source.getIp());
+		storeUnaligned16(data + 20, source.getUdpPort());
+		data[22] = source.getPartial() ? SOURCE_FLAG_PARTIAL : 0;
+		data[23] = 0;
+		setVal(val, data, SOURCE_DATA_SIZE);
+		error = mdb_put(txn, dbiSources, &key, &val, 0);
+		if (error) return error;
+
+		makeExpiryKey(expiryKeyData, source.getExpires(), keyData);
+		MDB_val expiryKey, empty;
+		setVal(expiryKey, expiryKeyData, EXPIRY_KEY_SIZE);
+		setVal(empty, nullptr, 0);
+		error = mdb_put(txn, dbiExpiry, &expiryKey, &empty, 0);
+		if (error || found || !maxSources) return error;
+
+		// New source: if maximum sources reached, remove the oldest one
+		MDB_cursor* cursor;
+		error = mdb_cursor_open(txn, dbiSources, &cursor);
+		if (error) return error;
+		unsigned count = 0;
+		uint64_t oldestExpires = UINT64_MAX;
+		uint8_t oldestKey[SOURCE_KEY_SIZE];
+		setVal(key, keyData, TTH_SIZE);
+		error = mdb_cursor_get(cursor, &key, &val, MDB_SET_RANGE);
+		while (!error && key.mv_size == SOURCE_KEY_SIZE && !memcmp(key.mv_data, tth.data, TTH_SIZE))
+		{
+			if (val.mv_size == SOURCE_DATA_SIZE)
+			{
+				uint64_t expires = loadUnaligned64(val.mv_data);
+				if (expires < oldestExpires)
+				{
+					oldestExpires = expires;
+					memcpy(oldestKey, key.mv_data, SOURCE_KEY_SIZE);
+				}
+			}
+			++count;
+			error = mdb_cursor_get(cursor, &key, &val, MDB_NEXT);
+		}
+		mdb_cursor_close(cursor);
+		if (error && error != MDB_NOTFOUND) return error;
+		if (count <= maxSources || oldestExpires == UINT64_MAX) return 0;
+
+		setVal(key, oldestKey, SOURCE_KEY_SIZE);
+		error = mdb_del(txn, dbiSources, &key, nullptr);
+		if (error) return error;
+		makeExpiryKey(expiryKeyData, oldestExpires, oldestKey);
+		error = mdb_del(txn, dbiExpiry, &expiryKey, nullptr);
+		return error == MDB_NOTFOUND ? 0 : error;
+	}
+
+	bool IndexDatabase::addSource(const TTHValue& tth, const Source& source, unsigned maxSources) noexcept
+	{
+		LOCK(cs);
+		if (!env) return false;
+		for (int retryCount = 0; retryCount < 2; ++retryCount)
+		{
+			MDB_txn* txn;
+			int error = mdb_txn_begin(env, nullptr, 0, &txn);
+			if (!checkError(error, "mdb_txn_begin")) return false;
+			error = putSource(txn, tth, source, maxSources);
+			if (!error)
+				error = mdb_txn_commit(txn); // Must not call mdb_txn_abort after mdb_txn_commit
+			else
+				mdb_txn_abort(txn);
+			if (error == MDB_MAP_FULL)
+			{
+				if (!resizeMap()) return false;
+				continue;
+			}
+			return checkError(error, "addSource");
+		}
+		return false;
+	}
+
+	bool IndexDatabase::getSources(const TTHValue& tth, SourceList& sources, uint64_t now) noexcept
+	{
+		sources.clear();
+		LOCK(cs);
+		if (!env) return false;
+		MDB_txn* txn;
+		int error = mdb_txn_begin(env, nullptr, MDB_RDONLY, &txn);
+		if (!checkError(error, "mdb_txn_begin")) return false;
+		MDB_cursor* cursor;
+		error = mdb_cursor_open(txn, dbiSources, &cursor);
+		if (!checkError(error, "mdb_cursor_open"))
+		{
+			mdb_txn_abort(txn);
+			return false;
+		}
+		MDB_val key, val;
+		setVal(key, const_cast<uint8_t*>(tth.data), TTH_SIZE);
+		error = mdb_cursor_get(cursor, &key, &val, MDB_SET_RANGE);
+		while (!error && key.mv_size == SOURCE_KEY_SIZE && !memcmp(key.mv_data, tth.data, TTH_SIZE))
+		{
+			if (val.mv_size == SOURCE_DATA_SIZE)
+			{
+				const uint8_t* data = static_cast<const uint8_t*>(val.mv_data);
+				uint64_t expires = loadUnaligned64(data);
+				if (expires > now)
+				{
+					Source source;
+					source.setCID(CID(static_cast<const uint8_t*>(key.mv_data) + TTH_SIZE));
+					source.setExpires(expires);
+					source.setSize(loadUnaligned64(data + 8));
+					source.setIp(loadUnaligned32(data + 16));
+					source.setUdpPort(loadUnaligned16(data + 20));
+					source.setPartial((data[22] & SOURCE_FLAG_PARTIAL) != 0);
+					sources.push_back(source);
+				}
+			}
+			error = mdb_cursor_get(cursor, &key, &val, MDB_NEXT);
+		}
+		mdb_cursor_close(cursor);
+		mdb_txn_abort(txn);
+
+		// old items in front, new items in back
+		std::sort(sources.begin(), sources.end(),
+			[](const Source& a, const Source& b) { return a.getExpires() < b.getExpires(); });
+		return !sources.empty();
+	}
+
+	size_t IndexDatabase::removeExpired(uint64_t now) noexcept
+	{
+		LOCK(cs);
+		if (!env) return 0;
+		mdb_env_sync(env, 1);
+		MDB_txn* txn;
+		int error = mdb_txn_begin(env, nullptr, 0, &txn);
+		if (!checkError(error, "mdb_txn_begin")) return 0;
+		MDB_cursor* cursor;
+		error = mdb_cursor_open(txn, dbiExpiry, &cursor);
+		if (!checkError(error, "mdb_cursor_open"))
+		{
+			mdb_txn_abort(txn);
+			return 0;
+		}
+		size_t removed = 0;
+		MDB_val key, val;
+		uint8_t sourceKeyData[SOURCE_KEY_SIZE];
+		while (!(error = mdb_cursor_get(cursor, &key, &val, MDB_FIRST)))
+		{
+			if (key.mv_size == EXPIRY_KEY_SIZE)
+			{
+				const uint8_t* data = static_cast<const uint8_t*>(key.mv_data);
+				if (loadBE64(data) > now) break;
+				memcpy(sourceKeyData, data + 8, SOURCE_KEY_SIZE);
+				MDB_val sourceKey;
+				setVal(sourceKey, sourceKeyData, SOURCE_KEY_SIZE);
+				error = mdb_del(txn, dbiSources, &sourceKey, nullptr);
+				if (error && error != MDB_NOTFOUND) break;
+			}
+			error = mdb_cursor_del(cursor, 0);
+			if (error) break;
+			++removed;
+		}
+		mdb_cursor_close(cursor);
+		if (error && error != MDB_NOTFOUND)
+		{
+			mdb_txn_abort(txn);
+			// Space is reclaimed on the next attempt
+			if (error == MDB_MAP_FULL) resizeMap();
+			else checkError(error, "removeExpired");
+			return 0;
+		}
+		if (!removed)
+		{
+			mdb_txn_abort(txn);
+			return 0;
+		}
+		error = mdb_txn_commit(txn);
+		if (error == MDB_MAP_FULL)
+		{
+			resizeMap();
+			return 0;
+		}
+		return checkError(error, "mdb_txn_commit") ? removed : 0;
+	}
+
+	size_t IndexDatabase::getSourceCount() noexcept
+	{
+		LOCK(cs);
+		if (!env) return 0;
+		MDB_txn* txn;
+		if (mdb_txn_begin(env, nullptr, MDB_RDONLY, &txn)) return 0;
+		MDB_stat stat;
+		size_t result = 0;
+		if (!mdb_stat(txn, dbiSources, &stat))
+			result = stat.ms_entries;
+		mdb_txn_abort(txn);
+		return result;
+	}
+
+}
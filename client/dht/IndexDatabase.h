@@ -0,0 +1,68 @@
+#ifndef _INDEXDATABASE_H
+#define _INDEXDATABASE_H
+
+#include <lmdb.h>
+#include "../CID.h"
+#include "../MerkleTree.h"
+#include "../Locks.h"
+#include "../BaseUtil.h"
+#include "../Ip4Address.h"
+
+namespace dht
+{
+
+	struct Source
+	{
+		GETSET(CID, cid, CID);
+		GETSET(Ip4Address, ip, Ip);
+		GETSET(uint64_t, expires, Expires); // Unix time
+		GETSET(uint64_t, size, Size);
+		GETSET(uint16_t, udpPort, UdpPort);
+		GETSET(bool, partial, Partial);
+	};
+
+	/**
+	 * Sources published to us by other nodes, stored in a separate LMDB environment.
+	 * Each source is a fixed-size record keyed by TTH and CID of the publishing node,
+	 * the second table is ordered by expiration time.
+	 */
+	class IndexDatabase
+	{
+	public:
+		typedef std::deque<Source> SourceList;
+
+		IndexDatabase() {}
+		~IndexDatabase() noexcept { close(); }
+		IndexDatabase(const IndexDatabase&) = delete;
+		IndexDatabase& operator= (const IndexDatabase&) = delete;
+
+		bool open() noexcept;
+		void close() noexcept;
+		bool isOpen() const noexcept { return env != nullptr; }
+		static string getDBPath() noexcept;
+
+		/** Adds or updates source, the oldest source is removed when there are more than maxSources */
+		bool addSource(const TTHValue& tth, const Source& source, unsigned maxSources) noexcept;
+
+		/** Returns sources ordered by expiration time */
+		bool getSources(const TTHValue& tth, SourceList& sources, uint64_t now) noexcept;
+
+		/** Returns the number of removed sources */
+		size_t removeExpired(uint64_t now) noexcept;
+
+		size_t getSourceCount() noexcept;
+
+	private:
+		MDB_env* env = nullptr;
+		MDB_dbi dbiSources = 0;
+		MDB_dbi dbiExpiry = 0;
+		CriticalSection cs;
+
+		static bool checkError(int error, const char* what) noexcept;
+		bool resizeMap() noexcept;
+		int putSource(MDB_txn* txn, const TTHValue& tth, const Source& source, unsigned maxSources) noexcept;
+	};
+
+}
+
+#endif // _INDEXDATABASE_H
@@ -21,16 +21,24 @@
 #include "DHT.h"
 #include "IndexManager.h"
 #include "DHTSearchManager.h"
+#include "Utils.h"
 
 #include "../CID.h"
 #include "../ShareManager.h"
-#include "../SimpleXML.h"
+#include "../LogManager.h"
+#include "../SettingsManager.h"
+#include "../ConfCore.h"
+#include "../AdcSupports.h"
 
 namespace dht
 {
 
-	IndexManager::IndexManager() : publish(false), publishing(0), nextRepublishTime(GET_TICK())
+	IndexManager::IndexManager() : publish(false), publishing(0), nextRepublishTime(GET_TICK()),
+		nextSentToNodeReset(0)
 	{
+		memset(&stats, 0, sizeof(stats));
+		if (!db.open())
+			LogManager::message("Can't open DHT index database " + IndexDatabase::getDBPath(), false);
 	}
 
 	/*
@@ -43,150 +51,209 @@ namespace dht
 		source.setIp(node->getIdentity().getIP4());
 		source.setUdpPort(node->getIdentity().getUdp4Port());
 		source.setSize(size);
-		source.setExpires(GET_TICK() + (partial ? PFS_REPUBLISH_TIME : REPUBLISH_TIME));
+		source.setExpires(GET_TIME() + (partial ? PFS_REPUBLISH_TIME : REPUBLISH_TIME) / 1000);
 		source.setPartial(partial);
 
-		LOCK(cs);
-
-		TTHMap::iterator i = tthList.find(tth);
-		if (i != tthList.end())
-		{
-			// no user duplicites
-			SourceList& sources = i->second;
-			for (SourceList::iterator s = sources.begin(); s != sources.end(); s++)
-			{
-				if (node->getUser()->getCID() == (*s).getCID())
-				{
-					// delete old item
-					sources.erase(s);
-					break;
-				}
-			}
-
-			// old items in front, new items in back
-			sources.push_back(source);
-
-			// if maximum sources reached, remove the oldest one
-			if (sources.size() > MAX_SEARCH_RESULTS)
-				sources.pop_front();
-		}
-		else
-		{
-			// new file
-			tthList.insert(std::make_pair(tth, SourceList(1, source)));
-		}
-
-		DHT::getInstance()->setDirty();
+		// if maximum sources reached, the oldest one is removed
+		db.addSource(tth, source, MAX_SEARCH_RESULTS);
 	}
 
 	/*
 	 * Finds TTH in known indexes and returns it
 	 */
-	bool IndexManager::findResult(const TTHValue& tth, SourceList& sources) const
+	bool IndexManager::findResult(const TTHValue& tth, SourceList& sources)
 	{
 		// TODO: does file exist in my own sharelist?
-		LOCK(cs);
-		TTHMap::const_iterator i = tthList.find(tth);
-		if (i != tthList.end())
-		{
-			sources = i->second;
-			return true;
-		}
-
-		return false;
+		return db.getSources(tth, sources, GET_TIME());
 	}
 
 	/*
-	 * Try to publish next file in queue
+	 * Adds our sharelist to publish queue
 	 */
-	void IndexManager::publishNextFile()
+	void IndexManager::queueSharedFiles(uint64_t tick)
 	{
-		File f;
-		{
-			LOCK(cs);
-
-			if (publishQueue.empty() || publishing >= MAX_PUBLISHES_AT_TIME)
-				return;
+		// files sorted by TTH, so files close to each other can share the node lookup
+		vector<pair<TTHValue, int64_t>> files;
+		::ShareManager::getInstance()->getSharedFiles(files, MIN_PUBLISH_FILESIZE);
 
-			incPublishing();
+		LOCK(cs);
+		for (const auto& file : files)
+			publishQueue.push_back(File(file.first, file.second, false));
+		stats.cycleStart = tick;
+		stats.cycleFiles = 0;
+	}
 
-			f = publishQueue.front(); // get the first file in queue
-			publishQueue.pop_front(); // and remove it from queue
+	/*
+	 * Takes files whose hashes share the first groupBits bits from the queue
+	 */
+	PublishGroup::Ptr IndexManager::getNextGroupL(int groupBits)
+	{
+		PublishGroup::Ptr group = std::make_shared<PublishGroup>();
+		const File first = publishQueue.front();
+		publishQueue.pop_front();
+		group->files.push_back(first);
+		if (groupBits < MIN_PUBLISH_GROUP_BITS)
+			return group;
+		while (!publishQueue.empty() && group->files.size() < MAX_PUBLISH_GROUP_FILES)
+		{
+			const File& f = publishQueue.front();
+			if (f.partial != first.partial || Utils::getCommonPrefix(f.tth.data, first.tth.data, TTHValue::BYTES) < groupBits)
+				break;
+			group->files.push_back(f);
+			publishQueue.pop_front();
 		}
-		SearchManager::getInstance()->findStore(f.tth.toBase32(), f.size, f.partial);
+		return group;
 	}
 
 	/*
-	 * Loads existing indexes from disk
+	 * Sends queued publish requests and starts node lookups for queued files
 	 */
-	void IndexManager::loadIndexes(SimpleXML& xml)
+	void IndexManager::processPublishing(uint64_t tick)
 	{
-		xml.resetCurrentChild();
-		if (xml.findChild("Indexes"))
+		if (isTimeForPublishing())
+		{
+			bool queueEmpty;
+			{
+				LOCK(cs);
+				queueEmpty = publishQueue.empty();
+			}
+			// a large sharelist may not be published yet at low rates
+			if (queueEmpty)
+				queueSharedFiles(tick);
+			setNextPublishing();
+		}
+
+		auto ss = SettingsManager::instance.getCoreSettings();
+		ss->lockRead();
+		const unsigned rate = ss->getInt(Conf::DHT_PUBLISH_RATE);
+		ss->unlockRead();
+
+		// The closest nodes are the same for all hashes sharing the prefix covered by our k-buckets.
+		// With only a few buckets this prefix is too short and each file gets its own lookup.
+		const int groupBits = (int) DHT::getInstance()->getBucketCount() - 1;
+
+		struct Packet
+		{
+			Node::Ptr node;
+			PublishGroup::Ptr group;
+			size_t start;
+			size_t end;
+		};
+		vector<Packet> packets;
+		vector<PublishGroup::Ptr> lookups;
 		{
-			xml.stepIn();
-			while (xml.findChild("Index"))
+			LOCK(cs);
+			if (tick >= nextSentToNodeReset)
 			{
-				const TTHValue tth = TTHValue(xml.getChildAttrib("TTH"));
-				SourceList sources;
+				sentToNode.clear();
+				nextSentToNodeReset = tick + 60 * 1000;
+			}
+			unsigned tokens = rate;
+
+			auto i = pendingRequests.begin();
+			while (i != pendingRequests.end() && tokens)
+			{
+				PublishRequest& req = *i;
+				unsigned& sent = sentToNode[req.node->getIdentity().getIP4()];
+				if (sent >= MAX_PUBLISH_PACKETS_PER_NODE)
+				{
+					++i;
+					continue;
+				}
+				sent++;
+				tokens--;
+				stats.sentPackets++;
+
+				// files of the group are not modified after it's created, so the command can be built without the lock
+				const vector<File>& files = req.group->files;
+				size_t end = min(files.size(), req.offset + (req.batch ? PUBLISH_BATCH_SIZE : 1));
+				packets.push_back(Packet{req.node, req.group, req.offset, end});
+				req.offset = end;
 
-				xml.stepIn();
-				while (xml.findChild("Source"))
+				if (req.offset == files.size())
 				{
-					const string& ipStr = xml.getChildAttrib("I4");
-					Ip4Address ip;
-					if (!Util::parseIpAddress(ip, ipStr)) continue;
-
-					Source source;
-					source.setCID(CID(xml.getChildAttrib("CID")));
-					source.setIp(ip);
-					source.setUdpPort(static_cast<uint16_t>(xml.getIntChildAttrib("U4")));
-					source.setSize(xml.getInt64ChildAttrib("SI"));
-					source.setExpires(xml.getInt64ChildAttrib("EX"));
-					source.setPartial(false);
-					sources.push_back(source);
+					if (--req.group->pendingRequests == 0)
+					{
+						stats.publishedFiles += files.size();
+						stats.cycleFiles += files.size();
+					}
+					i = pendingRequests.erase(i);
 				}
+				else
+					++i;
+			}
+
+			// every lookup starts by sending SEARCH_ALPHA requests
+			const unsigned lookupCost = min(rate, SEARCH_ALPHA);
+			while (!publishQueue.empty() && publishing < MAX_PUBLISHES_AT_TIME &&
+				tokens >= lookupCost && pendingRequests.size() < MAX_PENDING_PUBLISH_REQUESTS)
+			{
+				lookups.push_back(getNextGroupL(groupBits));
+				incPublishing();
+				tokens -= lookupCost;
+				stats.lookups++;
+			}
+		}
 
-				tthList.insert(std::make_pair(tth, sources));
-				xml.stepOut();
+		for (const Packet& packet : packets)
+		{
+			const vector<File>& files = packet.group->files;
+			AdcCommand cmd(AdcCommand::CMD_PUB, AdcCommand::TYPE_UDP);
+			for (size_t i = packet.start; i < packet.end; ++i)
+			{
+				cmd.addParam(TAG('T', 'R'), files[i].tth.toBase32());
+				cmd.addParam(TAG('S', 'I'), Util::toString(files[i].size));
 			}
-			xml.stepOut();
+			if (files.front().partial)
+				cmd.addParam("PF1");
+			const Node::Ptr& node = packet.node;
+			DHT::getInstance()->send(cmd, node->getIdentity().getIP4(),
+				node->getIdentity().getUdp4Port(), node->getUser()->getCID(), node->getUdpKey());
 		}
+		for (const auto& group : lookups)
+			SearchManager::getInstance()->findStore(group);
 	}
 
 	/*
-	 * Save all indexes to disk
+	 * Returns files of a group to the front of the publish queue
 	 */
-	void IndexManager::saveIndexes(SimpleXML& xml)
+	void IndexManager::requeueFiles(const PublishGroup::Ptr& group, size_t start)
 	{
-		xml.addTag("Files");
-		xml.stepIn();
+		const vector<File>& files = group->files;
+		if (start >= files.size())
+			return;
+		LOCK(cs);
+		publishQueue.insert(publishQueue.begin(), files.begin() + start, files.end());
+	}
 
+	/*
+	 * Queues publish requests for the nodes found by lookup
+	 */
+	void IndexManager::addPublishRequests(const Node::Map& nodes, const PublishGroup::Ptr& group)
+	{
 		LOCK(cs);
-		for (TTHMap::const_iterator i = tthList.begin(); i != tthList.end(); i++)
+		// send PUB command to K nodes
+		unsigned n = K;
+		for (auto i = nodes.cbegin(); i != nodes.cend() && n > 0; ++i, --n)
 		{
-			xml.addTag("File");
-			xml.addChildAttrib("TTH", i->first.toBase32());
-
-			xml.stepIn();
-			for (SourceList::const_iterator j = i->second.begin(); j != i->second.end(); j++)
-			{
-				const Source& source = *j;
-
-				if (source.getPartial())
-					continue;	// don't store partial sources
-
-				xml.addTag("Source");
-				xml.addChildAttrib("CID", source.getCID().toBase32());
-				xml.addChildAttrib("I4", source.getIp());
-				xml.addChildAttrib("U4", source.getUdpPort());
-				xml.addChildAttrib("SI", source.getSize());
-				xml.addChildAttrib("EX", source.getExpires());
-			}
-			xml.stepOut();
+			const Node::Ptr& node = i->second;
+			PublishRequest req;
+			req.node = node;
+			req.group = group;
+			req.offset = 0;
+			req.batch = (node->getIdentity().getKnownSupports() & AdcSupports::DHTB_FEATURE_BIT) != 0;
+			pendingRequests.push_back(req);
+			group->pendingRequests++;
 		}
+	}
 
-		xml.stepOut();
+	void IndexManager::getPublishStats(PublishStats& result) const
+	{
+		LOCK(cs);
+		result = stats;
+		result.queuedFiles = publishQueue.size();
+		result.pendingRequests = pendingRequests.size();
+		result.runningLookups = publishing;
 	}
 
 	/*
@@ -194,27 +261,65 @@ namespace dht
 	 */
 	void IndexManager::processPublishSourceRequest(const Node::Ptr& node, const AdcCommand& cmd)
 	{
-		string tth;
-		if (!cmd.getParam(TAG('T', 'R'), 1, tth))
-			return;	// nothing to identify a file?
+		string partial;
+		cmd.getParam(TAG('P', 'F'), 1, partial);
 
-		string size;
-		if (!cmd.getParam(TAG('S', 'I'), 1, size))
-			return;	// no file size?
+		// Nodes supporting DHTB send several TR/SI pairs in one command
+		string tth, firstTTH;
+		unsigned count = 0;
+		const StringList& params = cmd.getParameters();
+		for (auto i = params.cbegin() + 1; i != params.cend(); ++i)
+		{
+			if (i->length() < 2)
+				continue;
 
-		int64_t intSize = Util::toInt64(size);
-		if (intSize <= 0)
-			return;
+			switch (*(const uint16_t*) i->c_str())
+			{
+				case TAG('T', 'R'):
+					tth = i->substr(2);
+					break;
 
-		string partial;
-		cmd.getParam(TAG('P', 'F'), 1, partial);
+				case TAG('S', 'I'):
+				{
+					if (tth.length() != 39)
+						break;	// nothing to identify a file?
 
-		addSource(TTHValue(tth), node, intSize, partial == "1");
+					int64_t intSize = Util::toInt64(i->c_str() + 2);
+					if (intSize <= 0)
+						break;
+
+					addSource(TTHValue(tth), node, intSize, partial == "1");
+					if (firstTTH.empty()) firstTTH = std::move(tth);
+					tth.clear();
+					count++;
+					break;
+				}
+			}
+			if (count == MAX_PUBLISH_BATCH_SIZE)
+				break;
+		}
+
+		if (firstTTH.empty())
+		{
+			if (!cmd.getParam(TAG('T', 'R'), 1, tth) || tth.length() != 39)
+				return;	// nothing to identify a file?
+
+			string size;
+			if (!cmd.getParam(TAG('S', 'I'), 1, size))
+				return;	// no file size?
+
+			int64_t intSize = Util::toInt64(size);
+			if (intSize <= 0)
+				return;
+
+			addSource(TTHValue(tth), node, intSize, partial == "1");
+			firstTTH = std::move(tth);
+		}
 
 		// send response
 		AdcCommand res(AdcCommand::SEV_SUCCESS, AdcCommand::SUCCESS, "File published", AdcCommand::TYPE_UDP);
 		res.addParam("FCPUB");
-		res.addParam(TAG('T', 'R'), tth);
+		res.addParam(TAG('T', 'R'), firstTTH);
 		DHT::getInstance()->send(res, node->getIdentity().getIP4(),
 			node->getIdentity().getUdp4Port(), node->getUser()->getCID(), node->getUdpKey());
 	}
@@ -222,36 +327,9 @@ namespace dht
 	/*
 	 * Removes old sources
 	 */
-	void IndexManager::checkExpiration(uint64_t tick)
+	void IndexManager::checkExpiration()
 	{
-		LOCK(cs);
-
-		bool dirty = false;
-
-		TTHMap::iterator i = tthList.begin();
-		while (i != tthList.end())
-		{
-			SourceList::iterator j = i->second.begin();
-			while (j != i->second.end())
-			{
-				const Source& source = *j;
-				if (source.getExpires() <= tick)
-				{
-					dirty = true;
-					j = i->second.erase(j);
-				}
-				else
-					break;	// list is sorted, so finding first non-expired can stop iteration
-			}
-
-			if (i->second.empty())
-				tthList.erase(i++);
-			else
-				++i;
-		}
-
-		if (dirty)
-			DHT::getInstance()->setDirty();
+		db.removeExpired(GET_TIME());
 	}
 
 	/** Publishes shared file */
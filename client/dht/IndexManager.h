@@ -21,6 +21,7 @@
 
 #include "Constants.h"
 #include "KBucket.h"
+#include "IndexDatabase.h"
 
 #include "../ShareManager.h"
 #include "../Singleton.h"
@@ -45,14 +46,27 @@ namespace dht
 		bool partial;
 	};
 
-	struct Source
+	/** Files with close hashes published using a single node lookup */
+	struct PublishGroup
 	{
-		GETSET(CID, cid, CID);
-		GETSET(Ip4Address, ip, Ip);
-		GETSET(uint64_t, expires, Expires);
-		GETSET(uint64_t, size, Size);
-		GETSET(uint16_t, udpPort, UdpPort);
-		GETSET(bool, partial, Partial);
+		typedef std::shared_ptr<PublishGroup> Ptr;
+
+		vector<File> files;
+
+		/** Nodes the files haven't been sent to yet */
+		unsigned pendingRequests = 0;
+	};
+
+	struct PublishStats
+	{
+		size_t queuedFiles;
+		size_t pendingRequests;
+		int runningLookups;
+		uint64_t lookups;
+		uint64_t publishedFiles;
+		uint64_t sentPackets;
+		uint64_t cycleStart;  // tick when the sharelist was queued last time
+		uint64_t cycleFiles;  // files published since cycleStart
 	};
 
 	class IndexManager : public Singleton<IndexManager>
@@ -60,19 +74,21 @@ namespace dht
 	public:
 		IndexManager();
 
-		typedef std::deque<Source> SourceList;
+		typedef IndexDatabase::SourceList SourceList;
 
 		/** Finds TTH in known indexes and returns it */
-		bool findResult(const TTHValue& tth, SourceList& sources) const;
+		bool findResult(const TTHValue& tth, SourceList& sources);
+
+		/** Sends queued publish requests and starts node lookups for queued files, called every second */
+		void processPublishing(uint64_t tick);
 
-		/** Try to publish next file in queue */
-		void publishNextFile();
+		/** Queues publish requests for the nodes found by lookup */
+		void addPublishRequests(const Node::Map& nodes, const PublishGroup::Ptr& group);
 
-		/** Loads existing indexes from disk */
-		void loadIndexes(SimpleXML& xml);
+		/** Returns files of a group starting at index start to the publish queue */
+		void requeueFiles(const PublishGroup::Ptr& group, size_t start);
 
-		/** Save all indexes to disk */
-		void saveIndexes(SimpleXML& xml);
+		void getPublishStats(PublishStats& stats) const;
 
 		/** How many files is currently being published */
 		void incPublishing() { ++publishing; }
@@ -86,7 +102,10 @@ namespace dht
 		void processPublishSourceRequest(const Node::Ptr& node, const AdcCommand& cmd);
 
 		/** Removes old sources */
-		void checkExpiration(uint64_t tick);
+		void checkExpiration();
+
+		/** Number of sources stored in the index */
+		size_t getSourceCount() { return db.getSourceCount(); }
 
 		/** Publishes shared file */
 		void publishFile(const TTHValue& tth, int64_t size);
@@ -102,13 +121,29 @@ namespace dht
 
 	private:
 		/** Contains known hashes in the network and their sources */
-		typedef std::unordered_map<TTHValue, SourceList> TTHMap;
-		TTHMap tthList;
+		IndexDatabase db;
 
 		/** Queue of files prepared for publishing */
 		typedef std::deque<File> FileQueue;
 		FileQueue publishQueue;
 
+		struct PublishRequest
+		{
+			Node::Ptr node;
+			PublishGroup::Ptr group;
+			size_t offset;
+			bool batch;
+		};
+
+		/** Requests waiting for the packet budget */
+		std::deque<PublishRequest> pendingRequests;
+
+		/** PUB commands sent to each IP in the current minute */
+		boost::unordered_map<Ip4Address, unsigned> sentToNode;
+		uint64_t nextSentToNodeReset;
+
+		PublishStats stats;
+
 		/** Is publishing allowed? */
 		bool publish;
 
@@ -118,11 +153,16 @@ namespace dht
 		/** Time when our sharelist should be republished */
 		uint64_t nextRepublishTime;
 
-		/** Synchronizes access to tthList */
+		/** Synchronizes access to publish queues */
 		mutable CriticalSection cs;
 
 		/** Add new source to tth list */
 		void addSource(const TTHValue& tth, const Node::Ptr& node, uint64_t size, bool partial);
+
+		/** Adds our sharelist to publish queue */
+		void queueSharedFiles(uint64_t tick);
+
+		PublishGroup::Ptr getNextGroupL(int groupBits);
 	};
 
 } // namespace dht
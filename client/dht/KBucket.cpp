@@ -83,17 +83,30 @@ namespace dht
 	}
 
 
+	KBucket::KBucket(const CID& myCID) : myCID(myCID), nodeCount(0), dirty(false)
+	{
+		buckets.reserve(ID_BITS);
+		buckets.emplace_back();
+	}
+
 	KBucket::~KBucket()
 	{
 		// empty table
-		for (auto it = nodes.begin(); it != nodes.end(); ++it)
+		for (Bucket& bucket : buckets)
 		{
-			Node::Ptr& node = *it;
-			if (node->isOnline())
-				ClientManager::getInstance()->putOffline(node);
+			for (const Node::Ptr& node : bucket.nodes)
+				if (node->isOnline())
+					ClientManager::getInstance()->putOffline(node);
+			for (const Node::Ptr& node : bucket.replacements)
+				if (node->isOnline())
+					ClientManager::getInstance()->putOffline(node);
 		}
+		buckets.clear();
+	}
 
-		nodes.clear();
+	size_t KBucket::getBucketIndex(const CID& cid) const
+	{
+		return std::min<size_t>(Utils::getCommonPrefix(myCID.data(), cid.data(), CID::SIZE), buckets.size() - 1);
 	}
 
 	/*
@@ -106,17 +119,21 @@ namespace dht
 			Node::Ptr node;
 
 			// no online node found, try get from routing table
-			for (auto it = nodes.begin(); it != nodes.end(); ++it)
+			const CID& cid = u->getCID();
+			Bucket& bucket = buckets[getBucketIndex(cid)];
+			for (NodeList* list : { &bucket.nodes, &bucket.replacements })
 			{
-				if (u->getCID() == (*it)->getUser()->getCID())
-				{
-					node = *it;
+				for (auto it = list->begin(); it != list->end(); ++it)
+					if (cid == (*it)->getUser()->getCID())
+					{
+						node = *it;
 
-					// put node at the end of the list
-					nodes.erase(it);
-					nodes.push_back(node);
-					break;
-				}
+						// put node at the end of the list
+						list->erase(it);
+						list->push_back(node);
+						break;
+					}
+				if (node) break;
 			}
 
 			if (!node && u->isOnline())
@@ -142,8 +159,11 @@ namespace dht
 						 // TODO: don't allow update when new IP already exists for different node
 
 						// erase old IP and remember new one
-						ipMap.erase(NodeAddress(oldIp, oldPort));
-						ipMap.insert(NodeAddress(ip, port));
+						if (node->isInList)
+						{
+							ipMap.erase(NodeAddress(oldIp, oldPort));
+							ipMap.insert(NodeAddress(ip, port));
+						}
 					}
 
 					if (!node->isIpVerified())
@@ -153,7 +173,7 @@ namespace dht
 					node->getIdentity().setIP4(ip);
 					node->getIdentity().setUdp4Port(port);
 
-					DHT::getInstance()->setDirty();
+					dirty = true;
 				}
 
 				return node;
@@ -169,6 +189,44 @@ namespace dht
 		return node;
 	}
 
+	void KBucket::addNode(Bucket& bucket, const Node::Ptr& node, const NodeAddress& na)
+	{
+		bucket.nodes.push_back(node);
+		node->isInList = true;
+		ipMap.insert(na);
+		nodeCount++;
+	}
+
+	void KBucket::addReplacement(Bucket& bucket, const Node::Ptr& node)
+	{
+		auto it = std::find(bucket.replacements.begin(), bucket.replacements.end(), node);
+		if (it != bucket.replacements.end())
+			bucket.replacements.erase(it);
+		else if (bucket.replacements.size() >= MAX_REPLACEMENTS)
+			bucket.replacements.pop_front();
+		bucket.replacements.push_back(node);
+	}
+
+	void KBucket::splitLastBucket()
+	{
+		buckets.emplace_back();
+		Bucket& newBucket = buckets.back();
+		Bucket& oldBucket = buckets[buckets.size() - 2];
+		const size_t newIndex = buckets.size() - 1;
+		for (NodeList* list : { &oldBucket.nodes, &oldBucket.replacements })
+		{
+			NodeList& newList = list == &oldBucket.nodes ? newBucket.nodes : newBucket.replacements;
+			for (auto it = list->begin(); it != list->end();)
+				if (getBucketIndex((*it)->getUser()->getCID()) == newIndex)
+				{
+					newList.push_back(*it);
+					it = list->erase(it);
+				}
+				else
+					++it;
+		}
+	}
+
 	/*
 	 * Adds node to routing table
 	 */
@@ -182,31 +240,41 @@ namespace dht
 		NodeAddress na(ip, port);
 
 		// allow only one same IP:port
-		bool isAcceptable = ipMap.find(na) == ipMap.end();
+		if (ipMap.find(na) != ipMap.end())
+			return false;
 
-		if ((nodes.size() < (K * ID_BITS)) && isAcceptable)
+		const CID& cid = node->getUser()->getCID();
+		for (;;)
 		{
-			nodes.push_back(node);
-			node->isInList = true;
-			ipMap.insert(na);
+			size_t index = getBucketIndex(cid);
+			Bucket& bucket = buckets[index];
+			if (bucket.nodes.size() < K)
+			{
+				auto it = std::find(bucket.replacements.begin(), bucket.replacements.end(), node);
+				if (it != bucket.replacements.end())
+					bucket.replacements.erase(it);
+				addNode(bucket, node, na);
+				dirty = true;
+				return true;
+			}
 
-			if (DHT::getInstance())
-				DHT::getInstance()->setDirty();
+			// only the bucket covering our own ID can be split
+			if (index == buckets.size() - 1 && buckets.size() < ID_BITS)
+			{
+				splitLastBucket();
+				continue;
+			}
 
+			// dead nodes are replaced by checkExpiration
+			addReplacement(bucket, node);
 			return true;
 		}
-
-		return isAcceptable;
 	}
 
-	/*
-	 * Finds "max" closest nodes and stores them to the list
-	 */
-	void KBucket::getClosestNodes(const CID& cid, Node::Map& closest, unsigned int max, uint8_t maxType) const
+	void KBucket::addClosestNodes(const Bucket& bucket, const CID& cid, Node::Map& closest, unsigned int max, uint8_t maxType) const
 	{
-		for (NodeList::const_iterator it = nodes.begin(); it != nodes.end(); it++)
+		for (const Node::Ptr& node : bucket.nodes)
 		{
-			const Node::Ptr& node = *it;
 			if (node->getType() <= maxType && node->isIpVerified() && !(node->getUser()->getFlags() & User::PASSIVE))
 			{
 				CID distance = Utils::getDistance(cid, node->getUser()->getCID());
@@ -229,69 +297,128 @@ namespace dht
 		}
 	}
 
+	/*
+	 * Finds "max" closest nodes and stores them to the list
+	 */
+	void KBucket::getClosestNodes(const CID& cid, Node::Map& closest, unsigned int max, uint8_t maxType) const
+	{
+		// Nodes from the target's bucket are the closest ones. All following buckets
+		// differ from the target in the same bit, so they are checked together,
+		// then the preceding buckets in descending order.
+		const size_t index = getBucketIndex(cid);
+		addClosestNodes(buckets[index], cid, closest, max, maxType);
+		if (closest.size() >= max)
+			return;
+		for (size_t i = index + 1; i < buckets.size(); i++)
+			addClosestNodes(buckets[i], cid, closest, max, maxType);
+		for (size_t i = index; i > 0; i--)
+		{
+			if (closest.size() >= max)
+				return;
+			addClosestNodes(buckets[i - 1], cid, closest, max, maxType);
+		}
+	}
+
+	Node::Ptr KBucket::findNode(const CID& cid) const
+	{
+		const Bucket& bucket = buckets[getBucketIndex(cid)];
+		for (const Node::Ptr& node : bucket.nodes)
+			if (node->getUser()->getCID() == cid)
+				return node;
+		return Node::Ptr();
+	}
+
+	void KBucket::getNodes(vector<Node::Ptr>& result) const
+	{
+		result.reserve(result.size() + nodeCount);
+		for (const Bucket& bucket : buckets)
+			result.insert(result.end(), bucket.nodes.begin(), bucket.nodes.end());
+	}
+
+	size_t KBucket::getReplacementCount() const
+	{
+		size_t count = 0;
+		for (const Bucket& bucket : buckets)
+			count += bucket.replacements.size();
+		return count;
+	}
+
 	/*
 	 * Remove dead nodes
 	 */
 	bool KBucket::checkExpiration(uint64_t currentTime, OnlineUserList& removedList)
 	{
-		bool dirty = false;
-
-		// we should ping oldest node from every bucket here
-		// but since we have only one bucket now, simulate it by pinging more nodes
-		unsigned pingCount = max(K, min(2 * K, (unsigned)(nodes.size() / (K * 10)) + 1)); // <-- pings 10 - 20 oldest nodes
+		bool changed = false;
 		unsigned pinged = 0;
 		dcdrun(unsigned removed = 0);
 
-		// first, remove dead nodes
-		auto i = nodes.begin();
-		while (i != nodes.end())
+		for (Bucket& bucket : buckets)
 		{
-			Node::Ptr& node = *i;
-			if (node->getType() == 4 && node->expires > 0 && node->expires <= currentTime)
+			// ping the oldest (expired) node from every bucket
+			bool bucketPinged = false;
+			auto i = bucket.nodes.begin();
+			while (i != bucket.nodes.end())
 			{
-				// node is dead, remove it
-				Ip4Address ip = node->getIdentity().getIP4();
-				uint16_t port = node->getIdentity().getUdp4Port();
-				ipMap.erase(NodeAddress(ip, port));
-				if (node->isOnline())
-					removedList.push_back(node);
+				Node::Ptr& node = *i;
+				if (node->getType() == 4 && node->expires > 0 && node->expires <= currentTime)
+				{
+					// node is dead, remove it
+					Ip4Address ip = node->getIdentity().getIP4();
+					uint16_t port = node->getIdentity().getUdp4Port();
+					ipMap.erase(NodeAddress(ip, port));
+					node->isInList = false;
+					if (node->isOnline())
+						removedList.push_back(node);
+
+					i = bucket.nodes.erase(i);
+					nodeCount--;
+					changed = true;
+					dcdrun(removed++);
+					continue;
+				}
 
-				i = nodes.erase(i);
-				dirty = true;
-				dcdrun(removed++);
-				continue;
-			}
+				if (node->expires == 0)
+					node->expires = currentTime;
+
+				if (!bucketPinged && node->getType() < 4 && node->expires <= currentTime)
+				{
+					node->setTimeout(currentTime);
+					DHT::getInstance()->info(node->getIdentity().getIP4(), node->getIdentity().getUdp4Port(), DHT::PING, node->getUser()->getCID(), node->getUdpKey());
+					bucketPinged = true;
+					pinged++;
+				}
 
-			if (node->expires == 0)
-				node->expires = currentTime;
+				++i;
+			}
 
-			// select the oldest expired node
-			if (pinged < pingCount && node->getType() < 4 && node->expires <= currentTime)
+			// replace dead nodes with the most recently seen ones
+			while (bucket.nodes.size() < K && !bucket.replacements.empty())
 			{
-				// ping the oldest (expired) node
-				node->setTimeout(currentTime);
-				DHT::getInstance()->info(node->getIdentity().getIP4(), node->getIdentity().getUdp4Port(), DHT::PING, node->getUser()->getCID(), node->getUdpKey());
-				pinged++;
+				Node::Ptr node = bucket.replacements.back();
+				bucket.replacements.pop_back();
+				NodeAddress na(node->getIdentity().getIP4(), node->getIdentity().getUdp4Port());
+				if (node->getType() == 4 || ipMap.find(na) != ipMap.end())
+					continue;
+				addNode(bucket, node, na);
+				changed = true;
 			}
-
-			++i;
 		}
 
 #ifndef NDEBUG
 		int verified = 0; int types[5] = { 0 };
-		for (NodeList::const_iterator j = nodes.begin(); j != nodes.end(); j++)
-		{
-			Node::Ptr n = *j;
-			if (n->isIpVerified()) verified++;
+		for (const Bucket& bucket : buckets)
+			for (const Node::Ptr& n : bucket.nodes)
+			{
+				if (n->isIpVerified()) verified++;
 
-			dcassert(n->getType() >= 0 && n->getType() <= 4);
-			types[n->getType()]++;
-		}
+				dcassert(n->getType() >= 0 && n->getType() <= 4);
+				types[n->getType()]++;
+			}
 
-		dcdebug("DHT Nodes: %d (%d verified), Types: %d/%d/%d/%d/%d, pinged %d of %d, removed %d\n", nodes.size(), verified, types[0], types[1], types[2], types[3], types[4], pinged, pingCount, removed);
+		dcdebug("DHT Nodes: %d (%d verified), Buckets: %d, Types: %d/%d/%d/%d/%d, pinged %d, removed %d\n", (int) nodeCount, verified, (int) buckets.size(), types[0], types[1], types[2], types[3], types[4], pinged, removed);
 #endif
 
-		return dirty;
+		return changed;
 	}
 
 	/*
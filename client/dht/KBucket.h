@@ -72,9 +72,15 @@ namespace dht
 		bool     isInList;
 	};
 
+	/**
+	 * Kademlia routing table.
+	 * Bucket i holds nodes sharing exactly i leading bits with our ID, the last bucket
+	 * holds all nodes closer to us and is split when it gets full.
+	 */
 	class KBucket
 	{
 	public:
+		explicit KBucket(const CID& myCID);
 		~KBucket();
 
 		typedef std::deque<Node::Ptr> NodeList;
@@ -88,8 +94,18 @@ namespace dht
 		/** Finds "max" closest nodes and stores them to the list */
 		void getClosestNodes(const CID& cid, Node::Map& closest, unsigned int max, uint8_t maxType) const;
 
-		/** Return list of all nodes in this bucket */
-		const NodeList& getNodes() const { return nodes; }
+		/** Returns node from routing table */
+		Node::Ptr findNode(const CID& cid) const;
+
+		/** Copies all nodes in routing table to the list */
+		void getNodes(vector<Node::Ptr>& result) const;
+
+		size_t getNodeCount() const { return nodeCount; }
+		size_t getBucketCount() const { return buckets.size(); }
+		size_t getReplacementCount() const;
+
+		/** Returns true when nodes were added or updated since the table was created */
+		bool isDirty() const { return dirty; }
 
 		/** Removes dead nodes */
 		bool checkExpiration(uint64_t currentTime, OnlineUserList& removedList);
@@ -101,11 +117,28 @@ namespace dht
 		void saveNodes(SimpleXML& xml);
 
 	private:
-		/** List of nodes in this bucket */
-		NodeList nodes;
+		struct Bucket
+		{
+			/** Nodes ordered by last activity, least recently seen first */
+			NodeList nodes;
 
-		/** List of known IPs in this bucket */
+			/** Recently seen nodes which didn't fit, they replace dead ones */
+			NodeList replacements;
+		};
+
+		const CID myCID;
+		vector<Bucket> buckets;
+		size_t nodeCount;
+		bool dirty;
+
+		/** List of known IPs in routing table */
 		boost::unordered_set<NodeAddress> ipMap;
+
+		size_t getBucketIndex(const CID& cid) const;
+		void splitLastBucket();
+		void addNode(Bucket& bucket, const Node::Ptr& node, const NodeAddress& na);
+		void addReplacement(Bucket& bucket, const Node::Ptr& node);
+		void addClosestNodes(const Bucket& bucket, const CID& cid, Node::Map& closest, unsigned int max, uint8_t maxType) const;
 	};
 
 }
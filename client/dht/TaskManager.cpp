@@ -36,7 +36,7 @@ namespace dht
 	TaskManager::TaskManager()
 	{
 		uint64_t tick = GET_TICK();
-		nextPublishTime = nextSearchTime = tick;
+		nextSearchTime = tick;
 		nextSelfLookup = tick + SELF_LOOKUP_TIME_INIT;
 		nextFirewallCheck = tick + FWCHECK_TIME;
 		lastBootstrap = 0;
@@ -69,11 +69,10 @@ namespace dht
 		}
 		if (d->isConnected() && d->getNodesCount() >= K)
 		{
-			if (!d->isFirewalled() && IndexManager::getInstance()->getPublish() && tick >= nextPublishTime)
+			if (!d->isFirewalled() && IndexManager::getInstance()->getPublish())
 			{
-				// publish next file
-				IndexManager::getInstance()->publishNextFile();
-				nextPublishTime = tick + PUBLISH_TIME;
+				// publish queued files
+				IndexManager::getInstance()->processPublishing(tick);
 			}
 		}
 		else
@@ -115,7 +114,7 @@ namespace dht
 
 		// remove dead nodes
 		DHT::getInstance()->checkExpiration(tick);
-		IndexManager::getInstance()->checkExpiration(tick);
+		IndexManager::getInstance()->checkExpiration();
 
 		if (tick >= nextXmlSave)
 		{
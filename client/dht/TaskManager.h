@@ -33,9 +33,6 @@ namespace dht
 
 	private:
 
-		/** Time of publishing next file in queue */
-		uint64_t nextPublishTime;
-
 		/** When running searches will be processed */
 		uint64_t nextSearchTime;
 
@@ -52,6 +52,28 @@ namespace dht
 		return CID(distance.b);
 	}
 
+	/*
+	 * Returns number of leading bits two identifiers have in common
+	 */
+	int Utils::getCommonPrefix(const uint8_t* id1, const uint8_t* id2, size_t size)
+	{
+		for (size_t i = 0; i < size; i++)
+		{
+			uint8_t x = id1[i] ^ id2[i];
+			if (x)
+			{
+				int bits = (int) i * 8;
+				while (!(x & 0x80))
+				{
+					x <<= 1;
+					bits++;
+				}
+				return bits;
+			}
+		}
+		return (int) size * 8;
+	}
+
 	/*
 	 * Detect whether it is correct to use IP:port in DHT network
 	 */
@@ -43,6 +43,9 @@ namespace dht
 			return TTHValue(const_cast<uint8_t*>(getDistance(cid, CID(tth.data)).data()));
 		}
 
+		/** Returns number of leading bits two identifiers have in common */
+		static int getCommonPrefix(const uint8_t* id1, const uint8_t* id2, size_t size);
+
 		/** Detect whether it is correct to use IP:port in DHT network */
 		static bool isGoodIPPort(uint32_t ip, uint16_t port);
 
@@ -0,0 +1,312 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+// Headless daemon: runs the client core without a GUI.
+// Settings are read from DCPlusPlus.xml in the profile directory, the daemon is controlled through the web server.
+
+#include "stdinc.h"
+#include "DCPlusPlus.h"
+#include "ClientManager.h"
+#include "ConnectivityManager.h"
+#include "FavoriteManager.h"
+#include "DatabaseManager.h"
+#include "ADLSearch.h"
+#include "CryptoManager.h"
+#include "WebServerManager.h"
+#include "ThrottleManager.h"
+#include "TimerManager.h"
+#include "LogManager.h"
+#include "SettingsManager.h"
+#include "ConfCore.h"
+#include "ProfileLocker.h"
+#include "HttpClient.h"
+#include "SocketPool.h"
+#include "AntiFlood.h"
+#include "AppPaths.h"
+#include "FormatUtil.h"
+#include "PathUtil.h"
+#include "Random.h"
+#include "Client.h"
+#include "Util.h"
+#include "SettingsUtil.h"
+#include "version.h"
+
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+extern IpBans tcpBans, udpBans;
+
+struct CommandLine
+{
+	string configPath;
+	bool daemonize = false;
+	bool verbose = false;
+	bool help = false;
+};
+
+static bool verboseOutput;
+
+static void printUsage(const char* name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -c, --config <dir>   Profile directory (default: ~/." APPNAME_LC "/)\n"
+		"  -d, --daemon         Detach from the terminal\n"
+		"  -v, --verbose        Print startup progress and log messages to stderr\n"
+		"  -h, --help           Show this message\n", name);
+}
+
+static bool parseCommandLine(CommandLine& cmd, int argc, char* argv[])
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		if (!strcmp(arg, "-c") || !strcmp(arg, "--config"))
+		{
+			if (++i == argc) return false;
+			cmd.configPath = argv[i];
+		}
+		else if (!strcmp(arg, "-d") || !strcmp(arg, "--daemon"))
+			cmd.daemonize = true;
+		else if (!strcmp(arg, "-v") || !strcmp(arg, "--verbose"))
+			cmd.verbose = true;
+		else if (!strcmp(arg, "-h") || !strcmp(arg, "--help"))
+			cmd.help = true;
+		else
+			return false;
+	}
+	return true;
+}
+
+static string getAbsolutePath(const string& path)
+{
+	if (File::isAbsolute(path)) return path;
+	char buf[PATH_MAX];
+	if (!getcwd(buf, sizeof(buf))) return path;
+	string result = buf;
+	Util::appendPathSeparator(result);
+	return result + path;
+}
+
+static void progressCallback(void*, const tstring& text)
+{
+	if (verboseOutput)
+		fprintf(stderr, "Loading: %s\n", Text::fromT(text).c_str());
+}
+
+static void dbErrorCallback(const string& message, bool forceExit)
+{
+	fprintf(stderr, "%s\n", message.c_str());
+	if (forceExit) _exit(1);
+}
+
+static bool detach()
+{
+	pid_t pid = fork();
+	if (pid < 0) return false;
+	if (pid > 0) _exit(0);
+	setsid();
+	int fd = open("/dev/null", O_RDWR);
+	if (fd >= 0)
+	{
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		if (fd > STDERR_FILENO) close(fd);
+	}
+	return true;
+}
+
+// Periodic work done by the main window in the GUI
+class Maintenance : public TimerManagerListener
+{
+	public:
+		void on(Second, uint64_t tick) noexcept override
+		{
+			if (tick >= timeUsersCleanup)
+			{
+				ClientManager::usersCleanup();
+				timeUsersCleanup = tick + Util::rand(3, 10)*60000;
+			}
+#ifdef BL_FEATURE_IP_DATABASE
+			if (tick >= timeFlushRatio)
+			{
+				ClientManager::flushRatio();
+				timeFlushRatio = tick + Util::rand(3, 10)*60000;
+			}
+#endif
+			if (tick >= timeDbCleanup)
+			{
+				DatabaseManager::getInstance()->processTimer(tick);
+				timeDbCleanup = tick + 60000;
+			}
+		}
+
+		void on(Minute, uint64_t tick) noexcept override
+		{
+			httpClient.removeUnusedConnections();
+			socketPool.removeExpired(tick);
+			tcpBans.removeExpired(tick);
+			udpBans.removeExpired(tick);
+			auto ss = SettingsManager::instance.getCoreSettings();
+			ss->lockRead();
+			bool geoIpAutoUpdate = ss->getBool(Conf::GEOIP_AUTO_UPDATE);
+			string geoIpUrl = ss->getString(Conf::URL_GEOIP);
+			ss->unlockRead();
+			if (geoIpAutoUpdate)
+				DatabaseManager::getInstance()->downloadGeoIPDatabase(tick, false, geoIpUrl);
+			ADLSearchManager::getInstance()->saveOnTimer(tick);
+			WebServerManager::getInstance()->removeExpired();
+			CryptoManager::getInstance()->checkExpiredCert();
+			LogManager::closeOldFiles(tick);
+		}
+
+	private:
+		uint64_t timeUsersCleanup = 0;
+		uint64_t timeFlushRatio = 0;
+		uint64_t timeDbCleanup = 0;
+};
+
+static void connectHubs(vector<ClientBasePtr>& clients)
+{
+	vector<string> urls;
+	{
+		FavoriteManager::LockInstanceHubs lock(FavoriteManager::getInstance(), false);
+		for (const FavoriteHubEntry* entry : lock.getFavoriteHubs())
+			if (entry->getAutoConnect())
+				urls.push_back(entry->getServer());
+	}
+	for (const string& url : urls)
+	{
+		ClientBasePtr cb = ClientManager::getInstance()->getClient(url);
+		static_cast<Client*>(cb.get())->connectIfNetworkOk();
+		clients.push_back(cb);
+	}
+	ClientManager::stopStartup();
+}
+
+int main(int argc, char* argv[])
+{
+	CommandLine cmd;
+	if (!parseCommandLine(cmd, argc, argv))
+	{
+		printUsage(argv[0]);
+		return 2;
+	}
+	if (cmd.help)
+	{
+		printUsage(argv[0]);
+		return 0;
+	}
+	verboseOutput = cmd.verbose && !cmd.daemonize;
+	LogManager::g_printMessages = verboseOutput;
+
+	// Signals are handled synchronously by the main thread, all other threads inherit the mask
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+
+	if (!cmd.configPath.empty())
+		Util::setUserConfigPath(getAbsolutePath(cmd.configPath));
+	Util::initialize();
+	Util::initFormatParams();
+
+	Conf::initCoreSettings();
+	SettingsManager::instance.loadSettings();
+
+	LogManager::init();
+	Util::loadLanguage();
+
+	Conf::updateCoreSettingsDefaults();
+	Conf::processCoreSettings();
+
+	ProfileLocker profileLocker;
+	profileLocker.setPath(Util::getConfigPath());
+	profileLocker.setLockFileName("lock.pid");
+	profileLocker.setUpdateLater(cmd.daemonize);
+	if (!profileLocker.lock())
+	{
+		fprintf(stderr, "Profile %s is used by another process\n", Util::getConfigPath().c_str());
+		SettingsManager::instance.removeListeners();
+		return 1;
+	}
+	if (cmd.daemonize)
+	{
+		if (!detach())
+		{
+			fprintf(stderr, "Can't fork: %s\n", Util::translateError().c_str());
+			return 1;
+		}
+		profileLocker.updatePidFile();
+	}
+
+	LogManager::message(getAppNameVer() + " daemon started, profile " + Util::getConfigPath(), false);
+
+	ThrottleManager::newInstance();
+	TimerManager::newInstance();
+	ClientManager::newInstance();
+	ThrottleManager::getInstance()->startup();
+
+	startup(progressCallback, nullptr, nullptr, nullptr, dbErrorCallback);
+
+	Maintenance maintenance;
+	TimerManager::getInstance()->addListener(&maintenance);
+	TimerManager::getInstance()->start(0, "TimerManager");
+
+	auto ss = SettingsManager::instance.getCoreSettings();
+	ss->lockRead();
+	const bool enableWebServer = ss->getBool(Conf::ENABLE_WEBSERVER);
+	ss->unlockRead();
+	if (enableWebServer)
+	{
+		try
+		{
+			WebServerManager::getInstance()->start();
+		}
+		catch (const Exception& e)
+		{
+			LogManager::message("Web server: " + e.getError(), false);
+		}
+	}
+	else
+		LogManager::message("Web server is disabled, the daemon can't be controlled remotely", false);
+
+	ConnectivityManager::getInstance()->setupConnections();
+
+	vector<ClientBasePtr> clients;
+	connectHubs(clients);
+	if (verboseOutput)
+		fprintf(stderr, "Started, %u hub(s) connecting\n", (unsigned) clients.size());
+
+	// SIGHUP is ignored: the daemon keeps running when the terminal is closed
+	int sig;
+	while (sigwait(&signals, &sig) || sig == SIGHUP) {}
+	LogManager::message("Received signal " + Util::toString(sig) + ", shutting down", false);
+
+	ClientManager::beforeShutdown();
+	TimerManager::getInstance()->removeListener(&maintenance);
+	preparingCoreToShutdown();
+	for (const ClientBasePtr& cb : clients)
+		ClientManager::getInstance()->putClient(cb);
+	clients.clear();
+	shutdown(nullptr, nullptr);
+	return 0;
+}
@@ -2700,11 +2700,13 @@ UserInfo* HubFrame::findUserByNick(const tstring& nick) const
 		CID cid;
 		{
 			dht::DHT::LockInstanceNodes lock(dht::DHT::getInstance());
-			const auto nodes = lock.getNodes();
-			if (nodes)
+			const dht::KBucket* bucket = lock.getBucket();
+			if (bucket)
 			{
+				vector<dht::Node::Ptr> nodes;
+				bucket->getNodes(nodes);
 				string nickUtf8 = Text::fromT(nick);
-				for (const auto& node : *nodes)
+				for (const auto& node : nodes)
 				{
 					const Identity& id = node->getIdentity();
 					if (id.getNick() == nickUtf8)
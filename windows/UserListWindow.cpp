@@ -493,10 +493,12 @@ void UserListWindow::insertDHTUsers()
 	vector<CID> cidList;
 	{
 		dht::DHT::LockInstanceNodes lock(d);
-		const auto nodes = lock.getNodes();
-		if (nodes)
+		const dht::KBucket* bucket = lock.getBucket();
+		if (bucket)
 		{
-			for (const auto& node : *nodes)
+			vector<dht::Node::Ptr> nodes;
+			bucket->getNodes(nodes);
+			for (const auto& node : nodes)
 				if (node->getType() < 4 && node->getUser()->hasNick())
 					cidList.push_back(node->getUser()->getCID());
 		}